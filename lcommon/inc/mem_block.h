@@ -0,0 +1,60 @@
+/*!
+ ************************************************************************
+ * \file mem_block.h
+ *
+ * \brief
+ *    Dense multi-dimensional arrays in one cache line aligned block,
+ *    allocated with get_mem_block1D() ... get_mem_block4D() (memalloc.h)
+ *
+ ************************************************************************
+ */
+
+#ifndef _MEM_BLOCK_H_
+#define _MEM_BLOCK_H_
+
+#include "typedefs.h"
+
+#define MEM_BLOCK_DIMS     4
+
+/*!
+ * Dense array of up to MEM_BLOCK_DIMS dimensions in one MEM_ALIGNMENT aligned
+ * block, accessed with computed strides instead of a tree of row pointers.
+ * Element (i0, i1, ...) is at data + i0 * stride[0] + i1 * stride[1] + ...
+ * Strides of a cache line or more are rounded up to whole cache lines, so
+ * such elements and rows start on a cache line.
+ */
+typedef struct mem_block
+{
+  byte   *data;
+  int     elem_size;
+  int     dims;
+  int     dim   [MEM_BLOCK_DIMS];
+  size_t  stride[MEM_BLOCK_DIMS];   //!< in bytes
+  size_t  size;                     //!< bytes allocated
+} MemBlock;
+
+//! element (i0) of a MemBlock
+static inline void* mem_block_1D(const MemBlock *block, int i0)
+{
+  return block->data + i0 * block->stride[0];
+}
+
+//! element (i0, i1) of a MemBlock
+static inline void* mem_block_2D(const MemBlock *block, int i0, int i1)
+{
+  return block->data + i0 * block->stride[0] + i1 * block->stride[1];
+}
+
+//! element (i0, i1, i2) of a MemBlock
+static inline void* mem_block_3D(const MemBlock *block, int i0, int i1, int i2)
+{
+  return block->data + i0 * block->stride[0] + i1 * block->stride[1] + i2 * block->stride[2];
+}
+
+//! element (i0, i1, i2, i3) of a MemBlock
+static inline void* mem_block_4D(const MemBlock *block, int i0, int i1, int i2, int i3)
+{
+  return block->data + i0 * block->stride[0] + i1 * block->stride[1] + i2 * block->stride[2] + i3 * block->stride[3];
+}
+
+#endif
@@ -22,6 +22,15 @@
 #include "distortion.h"
 #include "lagrangian.h"
 #include "quant_params.h"
+#include "mem_block.h"
+
+#define MEM_ALIGNMENT     64   //!< cache line size, alignment of mem_malloc_aligned() and MemBlock
+
+extern int  get_mem_block1D(MemBlock *block, int elem_size, int dim0);
+extern int  get_mem_block2D(MemBlock *block, int elem_size, int dim0, int dim1);
+extern int  get_mem_block3D(MemBlock *block, int elem_size, int dim0, int dim1, int dim2);
+extern int  get_mem_block4D(MemBlock *block, int elem_size, int dim0, int dim1, int dim2, int dim3);
+extern void free_mem_block (MemBlock *block);
 
 extern int  get_mem2Ddist(DistortionData ***array2D, int dim0, int dim1);
 
@@ -214,5 +223,48 @@ static inline void mem_free(void *a)
   free_pointer(a);
 }
 
+/*!
+ ************************************************************************
+ * \brief
+ *    allocate memory aligned at MEM_ALIGNMENT, free it with
+ *    mem_free_aligned()
+ *
+ ************************************************************************/
+static inline void* mem_malloc_aligned(size_t size)
+{
+  void *d;
+
+  if (size == 0)
+    size = MEM_ALIGNMENT;
+#if (defined(WIN32) || defined(WIN64)) && !defined(__GNUC__)
+  d = _aligned_malloc(size, MEM_ALIGNMENT);
+#else
+  if (posix_memalign(&d, MEM_ALIGNMENT, size) != 0)
+    d = NULL;
+#endif
+  if (d == NULL)
+    no_mem_exit("mem_malloc_aligned failed.\n");
+  return d;
+}
+
+static inline void* mem_calloc_aligned(size_t nitems, size_t size)
+{
+  void *d = mem_malloc_aligned(nitems * size);
+  memset(d, 0, nitems * size);
+  return d;
+}
+
+static inline void mem_free_aligned(void *a)
+{
+  if (a != NULL)
+  {
+#if (defined(WIN32) || defined(WIN64)) && !defined(__GNUC__)
+    _aligned_free(a);
+#else
+    free(a);
+#endif
+  }
+}
+
 #endif
 
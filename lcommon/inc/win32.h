@@ -55,8 +55,10 @@ typedef int   intptr_t;
 # define  OPENFLAGS_WRITE _O_WRONLY|_O_CREAT|_O_BINARY|_O_TRUNC
 # define  OPEN_PERMISSIONS _S_IREAD | _S_IWRITE
 # define  OPENFLAGS_READ  _O_RDONLY|_O_BINARY
+# define  OPENFLAGS_RDWR  _O_RDWR|_O_BINARY
 # define  inline   _inline
 # define  forceinline __forceinline
+# define  THREAD_LOCAL __declspec(thread)
 #else
 # include <unistd.h>
 # include <sys/time.h>
@@ -72,6 +74,7 @@ typedef int   intptr_t;
 # define  tell(fd) lseek(fd, 0, SEEK_CUR)
 # define  OPENFLAGS_WRITE O_WRONLY|O_CREAT|O_TRUNC
 # define  OPENFLAGS_READ  O_RDONLY
+# define  OPENFLAGS_RDWR  O_RDWR
 # define  OPEN_PERMISSIONS S_IRUSR | S_IWUSR
 
 # if __STDC_VERSION__ >= 199901L
@@ -80,6 +83,7 @@ typedef int   intptr_t;
 #  define inline /* nothing */
 # endif
 # define  forceinline inline
+# define  THREAD_LOCAL __thread
 #endif
 
 #if (defined(WIN32) || defined(WIN64)) && !defined(__GNUC__)
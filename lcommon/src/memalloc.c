@@ -169,8 +169,8 @@ int get_mem2Dmp(PicMotionParams ***array2D, int dim0, int dim1)
 
   if((*array2D    = (PicMotionParams**)mem_malloc(dim0 *      sizeof(PicMotionParams*))) == NULL)
     no_mem_exit("get_mem2Dmp: array2D");
-  if((*(*array2D) = (PicMotionParams* )mem_calloc(dim0 * dim1, sizeof(PicMotionParams ))) == NULL)
-    no_mem_exit("get_mem2Dmp: array2D");
+  // the motion parameters themselves are one cache line aligned block
+  *(*array2D) = (PicMotionParams* )mem_calloc_aligned(dim0 * dim1, sizeof(PicMotionParams ));
 
   for(i = 1 ; i < dim0; i++)
     (*array2D)[i] =  (*array2D)[i-1] + dim1;
@@ -214,7 +214,7 @@ void free_mem2Dmp(PicMotionParams **array2D)
   if (array2D)
   {
     if (*array2D)
-      mem_free (*array2D);
+      mem_free_aligned (*array2D);
     else 
       error ("free_mem2Dmp: trying to free unused memory",100);
 
@@ -2720,3 +2720,130 @@ void free_mem2Ddistblk(distblk **array2D)
     error ("free_mem2Ddistblk: trying to free unused memory",100);
   }
 }
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Allocate a dense array of dims dimensions dim[] in one block, see
+ *    MemBlock
+ *
+ * \par Output:
+ *    memory size in bytes
+ ************************************************************************
+ */
+static int get_mem_block(MemBlock *block, int elem_size, int dims, const int *dim)
+{
+  int i;
+
+  memset(block, 0, sizeof(MemBlock));
+  block->elem_size = elem_size;
+  block->dims      = dims;
+
+  for (i = dims - 1; i >= 0; i--)
+  {
+    size_t stride = (i == dims - 1) ? (size_t) elem_size : block->stride[i + 1] * dim[i + 1];
+
+    if (stride >= MEM_ALIGNMENT)
+      stride = (stride + MEM_ALIGNMENT - 1) & ~((size_t) MEM_ALIGNMENT - 1);
+    block->dim[i]    = dim[i];
+    block->stride[i] = stride;
+  }
+  block->size = block->stride[0] * dim[0];
+  block->data = (byte *) mem_calloc_aligned(block->size, 1);
+
+  return (int) block->size;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Allocate 1D contiguous memory block -> block[dim0] of elem_size bytes
+ *
+ * \par Output:
+ *    memory size in bytes
+ ************************************************************************
+ */
+int get_mem_block1D(MemBlock *block, int elem_size, int dim0)
+{
+  int dim[1];
+
+  dim[0] = dim0;
+  return get_mem_block(block, elem_size, 1, dim);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Allocate 2D contiguous memory block -> block[dim0][dim1]
+ *
+ * \par Output:
+ *    memory size in bytes
+ ************************************************************************
+ */
+int get_mem_block2D(MemBlock *block, int elem_size, int dim0, int dim1)
+{
+  int dim[2];
+
+  dim[0] = dim0;
+  dim[1] = dim1;
+  return get_mem_block(block, elem_size, 2, dim);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Allocate 3D contiguous memory block -> block[dim0][dim1][dim2]
+ *
+ * \par Output:
+ *    memory size in bytes
+ ************************************************************************
+ */
+int get_mem_block3D(MemBlock *block, int elem_size, int dim0, int dim1, int dim2)
+{
+  int dim[3];
+
+  dim[0] = dim0;
+  dim[1] = dim1;
+  dim[2] = dim2;
+  return get_mem_block(block, elem_size, 3, dim);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Allocate 4D contiguous memory block -> block[dim0][dim1][dim2][dim3]
+ *
+ * \par Output:
+ *    memory size in bytes
+ ************************************************************************
+ */
+int get_mem_block4D(MemBlock *block, int elem_size, int dim0, int dim1, int dim2, int dim3)
+{
+  int dim[4];
+
+  dim[0] = dim0;
+  dim[1] = dim1;
+  dim[2] = dim2;
+  dim[3] = dim3;
+  return get_mem_block(block, elem_size, 4, dim);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    free memory block
+ *    which was allocated with get_mem_block1D() ... get_mem_block4D()
+ ************************************************************************
+ */
+void free_mem_block(MemBlock *block)
+{
+  if (block->data)
+  {
+    mem_free_aligned(block->data);
+    block->data = NULL;
+  }
+  else
+  {
+    error ("free_mem_block: trying to free unused memory",100);
+  }
+}
@@ -0,0 +1,130 @@
+#!/bin/sh
+###
+###     Throughput benchmark of the key generation pipeline
+###
+###     usage: bench.sh <ldecod binary> <stream dir> [runs]
+###
+###     Every .264 stream in the stream dir is processed in each mode
+###     (parse: EnableKey=0, encrypt: parse + key generation + write-back,
+###     restore: KeyRestore of the protected stream with its key file)
+###     "runs" times. The median of the time measured inside the decoder
+###     ("total" of the JSON statistics report, StatsFile) and the counters
+###     of the report are summarized as MB/s, key units/s and peak RSS, and
+###     written as CSV to $BENCH_CSV (bench_results.csv). Process start-up
+###     is not timed in any mode.
+###     The encrypt and restore modes modify their input, so every run gets
+###     a fresh copy. The restore mode protects the stream once, untimed,
+###     and takes the MB count from that run. It fails unless every run
+###     gives back the original byte for byte; the exit status is 1 if any
+###     run failed.
+###
+
+BIN=$1
+DIR=$2
+RUNS=${3:-5}
+CSV=${BENCH_CSV:-bench_results.csv}
+MODES=${BENCH_MODES:-"parse encrypt restore"}
+
+if [ -z "$BIN" ] || [ -z "$DIR" ]; then
+  echo "usage: $0 <ldecod binary> <stream dir> [runs]"
+  exit 1
+fi
+
+BIN=$(cd "$(dirname "$BIN")" && pwd)/$(basename "$BIN")
+CFG=$(cd "$(dirname "$0")/../../bin" && pwd)/decoder.cfg
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/ldecod_bench.XXXXXX") || exit 1
+trap 'rm -rf "$WORK"' EXIT INT TERM
+
+# value of a numeric field in the statistics report $2, by default the one of the last run
+field()
+{
+  sed -n "s/.*\"$1\": \([0-9.]*\).*/\1/p" "${2:-$WORK/stats.json}" | head -n 1
+}
+
+# decodes $WORK/in.264 with EnableKey=$1, the key file is $WORK/in.264.key.txt
+decode()
+{
+  (cd "$WORK" && "$BIN" -f "$CFG" -p InputFile="$WORK/in.264" -p KeyFileDir="$WORK/" \
+    -p EnableKey=$1 -p StatsFile="$WORK/stats.json" > "$WORK/log.txt" 2>&1)
+}
+
+echo "stream,mode,runs,median_us,mbs,mbs_per_s,key_units,key_units_per_s,peak_rss_kb" > "$CSV"
+printf "%-36s %-8s %12s %12s %14s %12s\n" stream mode median_us MB/s key_units/s peak_rss_kb
+
+status=0
+for stream in "$DIR"/*.264; do
+  [ -f "$stream" ] || continue
+  name=$(basename "$stream")
+
+  for mode in $MODES; do
+    case $mode in
+      parse)   enable_key=0 ;;
+      encrypt) enable_key=1 ;;
+      restore) enable_key=1 ;;
+      *)       echo "unknown mode $mode"; exit 1 ;;
+    esac
+
+    times=""
+    rss=0
+    failed=""
+    run=0
+    if [ $mode = restore ]; then
+      # protected copy and key file of every run, the report of the protection counts the MBs
+      cp "$stream" "$WORK/in.264"
+      rm -f "$WORK/stats.json" "$WORK/in.264.key.txt"
+      if ! decode 1 || [ ! -f "$WORK/stats.json" ]; then
+        failed=FAILED
+      fi
+      mv "$WORK/in.264" "$WORK/protected.264"
+      mv "$WORK/in.264.key.txt" "$WORK/protected.key.txt" 2>/dev/null
+      mv "$WORK/stats.json" "$WORK/protect.json" 2>/dev/null
+    fi
+    while [ -z "$failed" ] && [ $run -lt "$RUNS" ]; do
+      rm -f "$WORK/stats.json"
+      if [ $mode = restore ]; then
+        cp "$WORK/protected.264" "$WORK/in.264"
+        if ! (cd "$WORK" && "$BIN" -f "$CFG" -p InputFile="$WORK/in.264" -p KeyRestore="$WORK/protected.key.txt" \
+          -p StatsFile="$WORK/stats.json" > "$WORK/log.txt" 2>&1) || [ ! -f "$WORK/stats.json" ]; then
+          failed=FAILED
+          break
+        fi
+        if ! cmp -s "$stream" "$WORK/in.264"; then
+          failed=MISMATCH
+          break
+        fi
+      else
+        cp "$stream" "$WORK/in.264"
+        if ! decode $enable_key || [ ! -f "$WORK/stats.json" ]; then
+          failed=FAILED
+          break
+        fi
+      fi
+      times="$times $(field total)"
+      r=$(field peak_rss_kb)
+      [ "$r" -gt "$rss" ] && rss=$r
+      run=$((run + 1))
+    done
+
+    if [ -n "$failed" ]; then
+      printf "%-36s %-8s %12s\n" "$name" "$mode" $failed
+      echo "$name,$mode,0,,,,,," >> "$CSV"
+      status=1
+      continue
+    fi
+
+    median=$(echo $times | tr ' ' '\n' | sort -n | awk '{ v[NR] = $1 } END { print v[int((NR + 1) / 2)] }')
+    if [ $mode = restore ]; then
+      mbs=$(field mbs "$WORK/protect.json")
+    else
+      mbs=$(field mbs)
+    fi
+    kus=$(field key_units)
+    mb_rate=$(awk -v n="$mbs" -v t="$median" 'BEGIN { printf "%.1f", (t > 0 ? n * 1e6 / t : 0) }')
+    ku_rate=$(awk -v n="$kus" -v t="$median" 'BEGIN { printf "%.1f", (t > 0 ? n * 1e6 / t : 0) }')
+
+    printf "%-36s %-8s %12s %12s %14s %12s\n" "$name" "$mode" "$median" "$mb_rate" "$ku_rate" "$rss"
+    echo "$name,$mode,$RUNS,$median,$mbs,$mb_rate,$kus,$ku_rate,$rss" >> "$CSV"
+  done
+done
+
+exit $status
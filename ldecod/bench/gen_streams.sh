@@ -0,0 +1,51 @@
+#!/bin/sh
+###
+###     Generates the benchmark stream matrix
+###
+###     usage: gen_streams.sh <stream dir> [frames]
+###
+###     entropy coding (CAVLC/CABAC) x GOP (P only/with B) x slices per
+###     picture (1/4) x resolution (CIF up to 2160p), encoded with ffmpeg
+###     and libx264 from a moving test pattern. Streams that already exist
+###     are kept, so the matrix is only generated once. Without ffmpeg the
+###     directory may be filled with any Annex B .264 streams instead.
+###
+
+DIR=$1
+FRAMES=${2:-30}
+
+if [ -z "$DIR" ]; then
+  echo "usage: $0 <stream dir> [frames]"
+  exit 1
+fi
+mkdir -p "$DIR" || exit 1
+
+if ! command -v ffmpeg >/dev/null 2>&1 || ! ffmpeg -hide_banner -encoders 2>/dev/null | grep -q libx264; then
+  if ls "$DIR"/*.264 >/dev/null 2>&1; then
+    echo "ffmpeg with libx264 not found, using the streams in $DIR"
+    exit 0
+  fi
+  echo "ffmpeg with libx264 not found and no .264 streams in $DIR"
+  exit 1
+fi
+
+for res in 352x288 1280x720 1920x1080 3840x2160; do
+  for entropy in cavlc cabac; do
+    for gop in p b; do
+      for slices in 1 4; do
+        name="${entropy}_${gop}_s${slices}_${res}.264"
+        [ -f "$DIR/$name" ] && continue
+
+        cabac=0; [ $entropy = cabac ] && cabac=1
+        bframes=0; [ $gop = b ] && bframes=2
+
+        echo "generating $name"
+        ffmpeg -hide_banner -loglevel error -y \
+          -f lavfi -i "testsrc2=size=$res:rate=30" -frames:v "$FRAMES" \
+          -c:v libx264 -profile:v main -preset medium -pix_fmt yuv420p \
+          -x264-params "cabac=$cabac:bframes=$bframes:slices=$slices:keyint=$FRAMES:scenecut=0" \
+          -f h264 "$DIR/$name" || exit 1
+      done
+    done
+  done
+done
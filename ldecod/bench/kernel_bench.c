@@ -0,0 +1,704 @@
+/*!
+ *************************************************************************************
+ * \file kernel_bench.c
+ *
+ * \brief
+ *    Microbenchmarks of the entropy decoding and bit manipulation kernels
+ *
+ *    Every kernel is fed with a recorded symbol stream that was produced by
+ *    a plain reference encoder. The symbols returned by the kernel are
+ *    compared with the recorded ones, and the best time of all runs is
+ *    reported per symbol.
+ *
+ *    usage: kernel_bench [symbols] [runs]
+ *
+ *************************************************************************************
+ */
+
+#include "global.h"
+#include "biaridecod.h"
+#include "vlc.h"
+#include "dec_stats.h"
+#include "key_bits.h"
+#include "key_restore.h"
+
+#define NUM_BENCH_CTX   16
+#define KEY_DATA_BYTES  32
+#define KEY_UNIT_BYTES  80          //!< key units of up to 640 bits, plain and coalesced records
+
+typedef struct
+{
+  const char *name;
+  int64 symbols;
+  int64 best_ns;
+  int   errors;
+} KernelResult;
+
+typedef struct
+{
+  byte *buf;
+  int64 pos;        //!< bit position
+} RefWriter;
+
+static unsigned int rnd_state = 0x12345678;
+
+static unsigned int rnd(void)
+{
+  rnd_state ^= rnd_state << 13;
+  rnd_state ^= rnd_state >> 17;
+  rnd_state ^= rnd_state << 5;
+  return rnd_state;
+}
+
+static void *bench_calloc(size_t n, size_t size)
+{
+  void *p = calloc(n, size);
+
+  if (p == NULL)
+  {
+    fprintf(stderr, "kernel_bench: out of memory\n");
+    exit(1);
+  }
+  return p;
+}
+
+static void ref_put_bits(RefWriter *w, unsigned int v, int n)
+{
+  while (n-- > 0)
+  {
+    if ((v >> n) & 0x01)
+      w->buf[w->pos >> 3] |= (byte) (0x80 >> (w->pos & 0x07));
+    w->pos++;
+  }
+}
+
+static void add_time(KernelResult *r, int64 ns)
+{
+  if (r->best_ns == 0 || ns < r->best_ns)
+    r->best_ns = ns;
+}
+
+static void print_result(KernelResult *r)
+{
+  printf("%-32s %10lld %10.2f   %s\n", r->name, (long long) r->symbols,
+    r->symbols ? (double) r->best_ns / (double) r->symbols : 0.0, r->errors ? "MISMATCH" : "ok");
+}
+
+/*
+ ************************************************************************
+ * Reference CABAC encoder (9.3.4.2 - 9.3.4.5), shares only the state
+ * tables with the decoder
+ ************************************************************************
+ */
+typedef struct
+{
+  RefWriter w;
+  unsigned int low;
+  unsigned int range;
+  int first_bit;
+  int outstanding;
+} RefCabac;
+
+static void ref_cabac_put_bit(RefCabac *e, int b)
+{
+  if (e->first_bit)
+    e->first_bit = 0;
+  else
+    ref_put_bits(&e->w, b, 1);
+
+  for (; e->outstanding > 0; e->outstanding--)
+    ref_put_bits(&e->w, 1 - b, 1);
+}
+
+static void ref_cabac_renorm(RefCabac *e)
+{
+  while (e->range < 256)
+  {
+    if (e->low < 256)
+      ref_cabac_put_bit(e, 0);
+    else if (e->low >= 512)
+    {
+      e->low -= 512;
+      ref_cabac_put_bit(e, 1);
+    }
+    else
+    {
+      e->low -= 256;
+      e->outstanding++;
+    }
+    e->range <<= 1;
+    e->low   <<= 1;
+  }
+}
+
+static void ref_cabac_decision(RefCabac *e, BiContextType *ctx, int bin)
+{
+  unsigned int rLPS = rLPS_table_64x4[ctx->state][(e->range >> 6) & 0x03];
+
+  e->range -= rLPS;
+  if (bin != ctx->MPS)
+  {
+    e->low  += e->range;
+    e->range = rLPS;
+    if (ctx->state == 0)
+      ctx->MPS = (unsigned char) (1 - ctx->MPS);
+    ctx->state = AC_next_state_LPS_64[ctx->state];
+  }
+  else
+    ctx->state = AC_next_state_MPS_64[ctx->state];
+
+  ref_cabac_renorm(e);
+}
+
+static void ref_cabac_bypass(RefCabac *e, int bin)
+{
+  e->low <<= 1;
+  if (bin)
+    e->low += e->range;
+
+  if (e->low >= 1024)
+  {
+    ref_cabac_put_bit(e, 1);
+    e->low -= 1024;
+  }
+  else if (e->low < 512)
+    ref_cabac_put_bit(e, 0);
+  else
+  {
+    e->low -= 512;
+    e->outstanding++;
+  }
+}
+
+static void ref_cabac_terminate(RefCabac *e)
+{
+  e->range -= 2;
+  e->low   += e->range;
+  e->range  = 2;
+  ref_cabac_renorm(e);
+  ref_cabac_put_bit(e, (e->low >> 9) & 0x01);
+  ref_put_bits(&e->w, ((e->low >> 7) & 0x03) | 0x01, 2);
+}
+
+static void ref_cabac_init(RefCabac *e, byte *buf)
+{
+  memset(e, 0, sizeof(RefCabac));
+  e->w.buf     = buf;
+  e->range     = 510;
+  e->first_bit = 1;
+}
+
+static void bench_biari_decode_symbol(KernelResult *r, int n, int runs)
+{
+  BiContextType init_ctx[NUM_BENCH_CTX], ctx[NUM_BENCH_CTX];
+  unsigned int prob[NUM_BENCH_CTX];
+  byte *ctx_idx = bench_calloc(n, 1);
+  byte *bins    = bench_calloc(n, 1);
+  byte *out     = bench_calloc(n, 1);
+  byte *buf     = bench_calloc(n / 4 + 64, 1);
+  DecodingEnvironment dep;
+  RefCabac enc;
+  int i, run, len;
+
+  for (i = 0; i < NUM_BENCH_CTX; i++)
+  {
+    init_ctx[i].state = (uint16) (rnd() % 63);
+    init_ctx[i].MPS   = (unsigned char) (rnd() & 0x01);
+    prob[i] = rnd();                       // probability of a one
+  }
+
+  memcpy(ctx, init_ctx, sizeof(ctx));
+  ref_cabac_init(&enc, buf);
+  for (i = 0; i < n; i++)
+  {
+    ctx_idx[i] = (byte) (rnd() % NUM_BENCH_CTX);
+    bins[i]    = (byte) (rnd() < prob[ctx_idx[i]]);
+    ref_cabac_decision(&enc, &ctx[ctx_idx[i]], bins[i]);
+  }
+  ref_cabac_terminate(&enc);
+
+  for (run = 0; run < runs; run++)
+  {
+    int64 start;
+
+    memcpy(ctx, init_ctx, sizeof(ctx));
+    arideco_start_decoding(&dep, buf, 0, &len);
+    start = dec_stats_now();
+    for (i = 0; i < n; i++)
+      out[i] = (byte) biari_decode_symbol(&dep, &ctx[ctx_idx[i]]);
+    add_time(r, dec_stats_now() - start);
+  }
+
+  r->symbols = n;
+  r->errors  = memcmp(out, bins, n) != 0;
+  free(ctx_idx); free(bins); free(out); free(buf);
+}
+
+static void bench_biari_decode_symbol_eq_prob(KernelResult *r, int n, int runs)
+{
+  byte *bins = bench_calloc(n, 1);
+  byte *out  = bench_calloc(n, 1);
+  byte *buf  = bench_calloc(n / 8 + 64, 1);
+  DecodingEnvironment dep;
+  RefCabac enc;
+  int i, run, len;
+
+  ref_cabac_init(&enc, buf);
+  for (i = 0; i < n; i++)
+  {
+    bins[i] = (byte) (rnd() & 0x01);
+    ref_cabac_bypass(&enc, bins[i]);
+  }
+  ref_cabac_terminate(&enc);
+
+  for (run = 0; run < runs; run++)
+  {
+    int64 start;
+
+    arideco_start_decoding(&dep, buf, 0, &len);
+    start = dec_stats_now();
+    for (i = 0; i < n; i++)
+      out[i] = (byte) biari_decode_symbol_eq_prob(&dep);
+    add_time(r, dec_stats_now() - start);
+  }
+
+  r->symbols = n;
+  r->errors  = memcmp(out, bins, n) != 0;
+  free(bins); free(out); free(buf);
+}
+
+/*
+ ************************************************************************
+ * Exp-Golomb codes (9.1), values mostly small as in slice data
+ ************************************************************************
+ */
+static void bench_GetVLCSymbol(KernelResult *r, int n, int runs)
+{
+  unsigned int *values = bench_calloc(n, sizeof(unsigned int));
+  unsigned int *out    = bench_calloc(n, sizeof(unsigned int));
+  int bytes = n * 4 + 16;
+  byte *buf = bench_calloc(bytes, 1);
+  RefWriter w = { buf, 0 };
+  int i, run;
+
+  for (i = 0; i < n; i++)
+  {
+    unsigned int v = (rnd() >> (rnd() % 32)) & 0xFFFF;
+    int m = 0;
+
+    while (((v + 1) >> (m + 1)) != 0)
+      m++;
+    values[i] = v;
+    ref_put_bits(&w, 0, m);
+    ref_put_bits(&w, v + 1, m + 1);
+  }
+
+  for (run = 0; run < runs; run++)
+  {
+    int64 start = dec_stats_now();
+    int offset = 0;
+
+    for (i = 0; i < n; i++)
+    {
+      int info;
+      int len = GetVLCSymbol(buf, offset, &info, bytes);
+
+      out[i]  = (1 << (len >> 1)) + info - 1;
+      offset += len;
+    }
+    add_time(r, dec_stats_now() - start);
+  }
+
+  r->symbols = n;
+  r->errors  = memcmp(out, values, n * sizeof(unsigned int)) != 0;
+  free(values); free(out); free(buf);
+}
+
+/*
+ ************************************************************************
+ * coeff_token (Table 9-5, 0 <= nC < 8), decoded through the 2D table
+ * search of readSyntaxElement_NumCoeffTrailingOnes
+ ************************************************************************
+ */
+static const byte coeff_token_len[3][4][17] =
+{
+  {
+    { 1, 6, 8, 9,10,11,13,13,13,14,14,15,15,16,16,16,16},
+    { 0, 2, 6, 8, 9,10,11,13,13,14,14,15,15,15,16,16,16},
+    { 0, 0, 3, 7, 8, 9,10,11,13,13,14,14,15,15,16,16,16},
+    { 0, 0, 0, 5, 6, 7, 8, 9,10,11,13,14,14,15,15,16,16},
+  },
+  {
+    { 2, 6, 6, 7, 8, 8, 9,11,11,12,12,12,13,13,13,14,14},
+    { 0, 2, 5, 6, 6, 7, 8, 9,11,11,12,12,13,13,14,14,14},
+    { 0, 0, 3, 6, 6, 7, 8, 9,11,11,12,12,13,13,13,14,14},
+    { 0, 0, 0, 4, 4, 5, 6, 6, 7, 9,11,11,12,13,13,13,14},
+  },
+  {
+    { 4, 6, 6, 6, 7, 7, 7, 7, 8, 8, 9, 9, 9,10,10,10,10},
+    { 0, 4, 5, 5, 5, 5, 6, 6, 7, 8, 8, 9, 9, 9,10,10,10},
+    { 0, 0, 4, 5, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9,10,10,10},
+    { 0, 0, 0, 4, 4, 4, 4, 4, 5, 6, 7, 8, 8, 9,10,10,10},
+  },
+};
+
+static const byte coeff_token_cod[3][4][17] =
+{
+  {
+    { 1, 5, 7, 7, 7, 7,15,11, 8,15,11,15,11,15,11, 7,4},
+    { 0, 1, 4, 6, 6, 6, 6,14,10,14,10,14,10, 1,14,10,6},
+    { 0, 0, 1, 5, 5, 5, 5, 5,13, 9,13, 9,13, 9,13, 9,5},
+    { 0, 0, 0, 3, 3, 4, 4, 4, 4, 4,12,12, 8,12, 8,12,8},
+  },
+  {
+    { 3,11, 7, 7, 7, 4, 7,15,11,15,11, 8,15,11, 7, 9,7},
+    { 0, 2, 7,10, 6, 6, 6, 6,14,10,14,10,14,10,11, 8,6},
+    { 0, 0, 3, 9, 5, 5, 5, 5,13, 9,13, 9,13, 9, 6,10,5},
+    { 0, 0, 0, 5, 4, 6, 8, 4, 4, 4,12, 8,12,12, 8, 1,4},
+  },
+  {
+    {15,15,11, 8,15,11, 9, 8,15,11,15,11, 8,13, 9, 5,1},
+    { 0,14,15,12,10, 8,14,10,14,14,10,14,10, 7,12, 8,4},
+    { 0, 0,13,14,11, 9,13, 9,13,10,13, 9,13, 9,11, 7,3},
+    { 0, 0, 0,12,11,10, 9, 8,13,12,12,12, 8,12,10, 6,2},
+  },
+};
+
+static void bench_code_from_bitstream_2d(KernelResult *r, int n, int runs)
+{
+  byte *vlcnum = bench_calloc(n, 1);
+  byte *symbol = bench_calloc(n, 1);     // TotalCoeff << 2 | TrailingOnes
+  byte *out    = bench_calloc(n, 1);
+  int bytes = n * 2 + 16;
+  byte *buf = bench_calloc(bytes, 1);
+  RefWriter w = { buf, 0 };
+  Bitstream bs;
+  SyntaxElement sym;
+  int i, run;
+
+  for (i = 0; i < n; i++)
+  {
+    int tc, t1;
+
+    vlcnum[i] = (byte) (rnd() % 3);
+    do
+    {
+      // favour the short codes of few coefficients, as in real streams
+      tc = (rnd() % 17) >> (rnd() % 3);
+      t1 = rnd() % 4;
+    } while (coeff_token_len[vlcnum[i]][t1][tc] == 0);
+    symbol[i] = (byte) ((tc << 2) | t1);
+    ref_put_bits(&w, coeff_token_cod[vlcnum[i]][t1][tc], coeff_token_len[vlcnum[i]][t1][tc]);
+  }
+
+  memset(&sym, 0, sizeof(sym));
+  for (run = 0; run < runs; run++)
+  {
+    int64 start;
+
+    memset(&bs, 0, sizeof(bs));
+    bs.streamBuffer     = buf;
+    bs.bitstream_length = bytes;
+    start = dec_stats_now();
+    for (i = 0; i < n; i++)
+    {
+      sym.value1 = vlcnum[i];
+      readSyntaxElement_NumCoeffTrailingOnes(&sym, &bs, "coeff_token");
+      out[i] = (byte) ((sym.value1 << 2) | sym.value2);
+    }
+    add_time(r, dec_stats_now() - start);
+  }
+
+  r->symbols = n;
+  r->errors  = memcmp(out, symbol, n) != 0;
+  free(vlcnum); free(symbol); free(out); free(buf);
+}
+
+/*
+ ************************************************************************
+ * Emulation prevention (7.4.1), time per RBSP byte without the copy
+ * into the work buffer
+ ************************************************************************
+ */
+static void bench_EBSPtoRBSP(KernelResult *r, int n, int runs)
+{
+  static const byte zero_heavy[8] = { 0, 0, 0, 1, 2, 3, 0x80, 0xFF };
+  byte *rbsp = bench_calloc(n, 1);
+  byte *ebsp = bench_calloc(n + n / 2 + 16, 1);
+  byte *work = bench_calloc(n + n / 2 + 16, 1);
+  int ebsp_len = 0, zeros = 0, rbsp_len = 0;
+  int i, run;
+
+  for (i = 0; i < n; i++)
+    rbsp[i] = (rnd() & 0x01) ? zero_heavy[rnd() % 8] : (byte) rnd();
+  rbsp[n - 1] = 0x80;                    // rbsp_stop_one_bit
+
+  for (i = 0; i < n; i++)
+  {
+    if (zeros == 2 && rbsp[i] <= 0x03)
+    {
+      ebsp[ebsp_len++] = 0x03;
+      zeros = 0;
+    }
+    ebsp[ebsp_len++] = rbsp[i];
+    zeros = rbsp[i] == 0 ? zeros + 1 : 0;
+  }
+
+  for (run = 0; run < runs; run++)
+  {
+    int64 start = dec_stats_now();
+    int64 copy;
+
+    memcpy(work, ebsp, ebsp_len);
+    copy  = dec_stats_now() - start;
+    start = dec_stats_now();
+    memcpy(work, ebsp, ebsp_len);
+    rbsp_len = EBSPtoRBSP(work, ebsp_len, 0);
+    add_time(r, dec_stats_now() - start - copy);
+  }
+
+  r->symbols = n;
+  r->errors  = rbsp_len != n || memcmp(work, rbsp, n) != 0;
+  free(rbsp); free(ebsp); free(work);
+}
+
+/*
+ ************************************************************************
+ * bs_write_u / bs_read_u of Encrypt.c, fields of 1 to 32 bits
+ ************************************************************************
+ */
+static void bench_bs_write_read(KernelResult *rw, KernelResult *rr, int n, int runs)
+{
+  byte *len    = bench_calloc(n, 1);
+  uint32_t *v  = bench_calloc(n, sizeof(uint32_t));
+  uint32_t *out = bench_calloc(n, sizeof(uint32_t));
+  int bytes = n * 4 + 16;
+  byte *ref = bench_calloc(bytes, 1);
+  byte *buf = bench_calloc(bytes, 1);
+  RefWriter w = { ref, 0 };
+  bs_t b;
+  int i, run;
+
+  for (i = 0; i < n; i++)
+  {
+    len[i] = (byte) (1 + rnd() % 32);
+    v[i]   = rnd() >> (32 - len[i]);
+    ref_put_bits(&w, v[i], len[i]);
+  }
+
+  for (run = 0; run < runs; run++)
+  {
+    int64 start;
+
+    memset(buf, 0xAA, bytes);            // bs_write_u1 has to clear the bits it writes
+    bs_init(&b, buf, bytes);
+    start = dec_stats_now();
+    for (i = 0; i < n; i++)
+      bs_write_u(&b, len[i], v[i]);
+    add_time(rw, dec_stats_now() - start);
+  }
+  rw->symbols = n;
+  rw->errors  = memcmp(buf, ref, (size_t) ((w.pos + 7) >> 3) - 1) != 0;
+
+  for (run = 0; run < runs; run++)
+  {
+    int64 start;
+
+    bs_init(&b, ref, bytes);
+    start = dec_stats_now();
+    for (i = 0; i < n; i++)
+      out[i] = bs_read_u(&b, len[i]);
+    add_time(rr, dec_stats_now() - start);
+  }
+  rr->symbols = n;
+  rr->errors  = memcmp(out, v, n * sizeof(uint32_t)) != 0;
+
+  free(len); free(v); free(out); free(ref); free(buf);
+}
+
+/*
+ ************************************************************************
+ * Get_Key: one serialized key unit per symbol, checked against the key
+ * file layout (6 bit offset length, offset, 3 bit bit offset, 8 bit
+ * length, key data)
+ ************************************************************************
+ */
+static int ref_key(byte *key, int byte_offset, int bit_offset, int bit_len, const byte *data)
+{
+  RefWriter w = { key, 0 };
+  int nbits = 1, i;
+
+  while ((byte_offset >> nbits) != 0)
+    nbits++;
+
+  ref_put_bits(&w, nbits, 6);
+  ref_put_bits(&w, byte_offset, nbits);
+  ref_put_bits(&w, bit_offset, 3);
+  ref_put_bits(&w, bit_len, 8);
+  for (i = 0; i < bit_len / 8; i++)
+    ref_put_bits(&w, data[i], 8);
+  if (bit_len % 8)
+    ref_put_bits(&w, data[i], bit_len % 8);
+
+  return (int) ((w.pos + 7) >> 3);
+}
+
+static void bench_Get_Key(KernelResult *r, int n, int runs)
+{
+  int *byte_offset = bench_calloc(n, sizeof(int));
+  byte *bit_offset = bench_calloc(n, 1);
+  byte *bit_len    = bench_calloc(n, 1);
+  byte *data       = bench_calloc((size_t) n * KEY_DATA_BYTES, 1);
+  int i, run;
+
+  for (i = 0; i < n; i++)
+  {
+    int j;
+
+    byte_offset[i] = (int) (rnd() >> (12 + rnd() % 20));
+    bit_offset[i]  = (byte) (rnd() % 8);
+    bit_len[i]     = (byte) (1 + rnd() % 48);
+    for (j = 0; j < KEY_DATA_BYTES; j++)
+      data[(size_t) i * KEY_DATA_BYTES + j] = (byte) rnd();
+  }
+
+  for (run = 0; run < runs; run++)
+  {
+    int64 start = dec_stats_now();
+
+    for (i = 0; i < n; i++)
+    {
+      char *key = NULL;
+
+      Get_Key(byte_offset[i], bit_offset[i], bit_len[i], &data[(size_t) i * KEY_DATA_BYTES], &key);
+      free(key);
+    }
+    add_time(r, dec_stats_now() - start);
+  }
+
+  for (i = 0; i < n && !r->errors; i++)
+  {
+    byte ref[64];
+    char *key = NULL;
+    int len;
+
+    memset(ref, 0, sizeof(ref));
+    len = Get_Key(byte_offset[i], bit_offset[i], bit_len[i], &data[(size_t) i * KEY_DATA_BYTES], &key);
+    r->errors = len != ref_key(ref, byte_offset[i], bit_offset[i], bit_len[i], &data[(size_t) i * KEY_DATA_BYTES])
+      || memcmp(key, ref, len) != 0;
+    free(key);
+  }
+
+  r->symbols = n;
+  free(byte_offset); free(bit_offset); free(bit_len); free(data);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Key records of 1 to 640 bits, read back with the KeyRestore record
+ *    reader. Key units of 256 bits and more do not fit the length field
+ *    of a plain record and need the coalesced one.
+ ************************************************************************
+ */
+static void bench_Get_Key_Record(KernelResult *r, int n, int runs)
+{
+  int *byte_offset = bench_calloc(n, sizeof(int));
+  byte *bit_offset = bench_calloc(n, 1);
+  short *bit_len   = bench_calloc(n, sizeof(short));
+  byte *data       = bench_calloc((size_t) n * KEY_UNIT_BYTES, 1);
+  int i, run;
+
+  for (i = 0; i < n; i++)
+  {
+    int j;
+
+    byte_offset[i] = (int) (rnd() >> (12 + rnd() % 20));
+    bit_offset[i]  = (byte) (rnd() % 8);
+    bit_len[i]     = (short) (1 + rnd() % (KEY_UNIT_BYTES * 8));
+    for (j = 0; j < KEY_UNIT_BYTES; j++)
+      data[(size_t) i * KEY_UNIT_BYTES + j] = (byte) rnd();
+    //bs_Write_KeyData() takes an incomplete last byte from its low end
+    if (bit_len[i] % 8)
+      data[(size_t) i * KEY_UNIT_BYTES + bit_len[i] / 8] &= (byte) ((1 << (bit_len[i] % 8)) - 1);
+  }
+
+  for (run = 0; run < runs; run++)
+  {
+    int64 start = dec_stats_now();
+
+    for (i = 0; i < n; i++)
+    {
+      char *key = NULL;
+
+      Get_Key_Record(byte_offset[i], bit_offset[i], bit_len[i], &data[(size_t) i * KEY_UNIT_BYTES], &key);
+      free(key);
+    }
+    add_time(r, dec_stats_now() - start);
+  }
+
+  for (i = 0; i < n && !r->errors; i++)
+  {
+    const byte *d = &data[(size_t) i * KEY_UNIT_BYTES];
+    char *key = NULL;
+    KeyRecord rec;
+    bs_t b;
+    int len, j;
+
+    len = Get_Key_Record(byte_offset[i], bit_offset[i], bit_len[i], (uint8_t *) d, &key);
+    bs_init(&b, (uint8_t *) key, len);
+    r->errors = key_record_read(&b, &rec) != 1 || rec.offset != byte_offset[i] || rec.bit_offset != bit_offset[i]
+      || rec.count != 1 || rec.key_bits != bit_len[i] || rec.coalesced != (bit_len[i] >= (1 << KEY_BIT_LEN_4));
+    for (j = 0; j < bit_len[i] / 8 && !r->errors; j++)
+      r->errors = bs_read_u(&b, 8) != d[j];
+    if (bit_len[i] % 8 && !r->errors)
+      r->errors = bs_read_u(&b, bit_len[i] % 8) != d[j];
+    free(key);
+  }
+
+  r->symbols = n;
+  free(byte_offset); free(bit_offset); free(bit_len); free(data);
+}
+
+int main(int argc, char **argv)
+{
+  KernelResult result[9] =
+  {
+    { "biari_decode_symbol" },
+    { "biari_decode_symbol_eq_prob" },
+    { "GetVLCSymbol" },
+    { "code_from_bitstream_2d" },
+    { "EBSPtoRBSP (per byte)" },
+    { "bs_write_u" },
+    { "bs_read_u" },
+    { "Get_Key" },
+    { "Get_Key_Record (round trip)" },
+  };
+  int n    = argc > 1 ? atoi(argv[1]) : (1 << 20);
+  int runs = argc > 2 ? atoi(argv[2]) : 5;
+  int i, errors = 0;
+
+  if (n < 16 || runs < 1)
+  {
+    fprintf(stderr, "usage: %s [symbols >= 16] [runs >= 1]\n", argv[0]);
+    return 1;
+  }
+
+  bench_biari_decode_symbol(&result[0], n, runs);
+  bench_biari_decode_symbol_eq_prob(&result[1], n, runs);
+  bench_GetVLCSymbol(&result[2], n, runs);
+  bench_code_from_bitstream_2d(&result[3], n, runs);
+  bench_EBSPtoRBSP(&result[4], n, runs);
+  bench_bs_write_read(&result[5], &result[6], n, runs);
+  bench_Get_Key(&result[7], n / 4, runs);
+  bench_Get_Key_Record(&result[8], n / 16, runs);
+
+  printf("%-32s %10s %10s   %s\n", "kernel", "symbols", "ns/symbol", "check");
+  for (i = 0; i < 9; i++)
+  {
+    print_result(&result[i]);
+    errors += result[i].errors;
+  }
+
+  return errors ? 1 : 0;
+}
@@ -16,7 +16,7 @@
 
 typedef struct annex_b_struct 
 {
-  int  BitStreamFile;                //!< the bit stream file
+  struct stream_io *io;              //!< the bit stream input
   byte *iobuffer;
   byte *iobufferread;
   int bytesinbuffer;
@@ -29,6 +29,7 @@ typedef struct annex_b_struct
 } ANNEXB_t;
 
 extern int  get_annex_b_NALU (VideoParameters *p_Vid, NALU_t *nalu, ANNEXB_t *annex_b);
+extern int  get_indexed_NALU (NALU_t *nalu, ANNEXB_t *annex_b, const NalIndexEntry *e);
 
 extern void open_annex_b     (char *fn, ANNEXB_t *annex_b);
 extern void close_annex_b    (ANNEXB_t *annex_b);
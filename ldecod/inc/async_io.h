@@ -0,0 +1,34 @@
+/*!
+ ***************************************************************************
+ *
+ * \file async_io.h
+ *
+ * \brief
+ *    Asynchronous reads and writes of a file descriptor
+ *
+ *    Requests are submitted with an explicit file offset and complete in
+ *    any order, the caller waits for each one by the tag it got. On Linux
+ *    the requests go to an io_uring. Where that is not available, or with
+ *    ASYNC_IO_THREAD, one worker thread performs them with pread() and
+ *    pwrite() in submission order. An instance is used by one thread.
+ *
+ **************************************************************************/
+
+#ifndef _ASYNC_IO_H_
+#define _ASYNC_IO_H_
+
+#include "typedefs.h"
+
+#define ASYNC_IO_OFF      0    //!< blocking I/O, no instance
+#define ASYNC_IO_URING    1    //!< io_uring, worker thread if the kernel has none
+#define ASYNC_IO_THREAD   2    //!< worker thread
+
+typedef struct async_io AsyncIO;
+
+extern AsyncIO    *async_io_open   (int fd, int depth, int mode);
+extern void        async_io_close  (AsyncIO *aio);
+extern int         async_io_submit (AsyncIO *aio, int write, byte *buf, int size, int64 offset);
+extern int         async_io_wait   (AsyncIO *aio, int tag);
+extern const char *async_io_backend(const AsyncIO *aio);
+
+#endif
@@ -0,0 +1,40 @@
+/*!
+ ***************************************************************************
+ *
+ * \file batch.h
+ *
+ * \brief
+ *    Batch mode: protects all clips of a manifest in one process
+ *
+ *    Every line of the manifest names the input bitstream, the protected
+ *    output bitstream and the key file of one clip, separated by white
+ *    space. Empty lines and lines starting with '#' are skipped. The input
+ *    files are not modified.
+ *
+ *    The clips are scheduled on a pool of worker threads with one task
+ *    deque each. A worker takes its own tasks last in first out and
+ *    steals the oldest task of another worker when it runs out of work.
+ *    A clip up to BatchSplitSize MB is parsed and protected by one task.
+ *    A larger clip is split at the IDR pictures into segments of at least
+ *    BatchSplitSize MB that are parsed in parallel, each one preceded by
+ *    the parameter sets seen before it. The key units of the segments are
+ *    then joined in stream order and protected by one more task, so the
+ *    output and the key file are the same as for a single decoder. The
+ *    split points are taken from the NAL unit index of the clip, which
+ *    with NalIndex = 1 is kept next to the input and also used to parse
+ *    clips that are not split (see nal_index.h).
+ *
+ *    All clips share one JSON report with per-clip sizes, key unit counts
+ *    and times. With DEC_STATS the stage statistics of all decoder
+ *    instances are added up into one statistics report.
+ *
+ **************************************************************************/
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include "global.h"
+
+extern int run_batch(InputParameters *p_Inp);
+
+#endif
@@ -30,11 +30,30 @@ Mapping Map[] = {
     {"InputFile",                &cfgparams.infile,                       1,   0.0,                       0,  0.0,              0.0,             FILE_NAME_SIZE, },
 		{"KeyFileDir", 							 &cfgparams.keyfile_dir, 									1,	 0.0, 											0,	0.0,							0.0,						 FILE_NAME_SIZE, },			
 		{"EnableKey",                &cfgparams.enable_key,                   0,   1.0,                       1,  0.0,              1.0,                             },			
+		{"StatsFile",                &cfgparams.stats_file,                   1,   0.0,                       0,  0.0,              0.0,             FILE_NAME_SIZE, },
 		{"MultiThread",              &cfgparams.multi_thread,                 0,   1.0,                       1,  0.0,              1.0,                             },						
+		{"StreamLag",                &cfgparams.stream_lag,                   0,   0.0,                       2,  0.0,              0.0,                             },
+		{"Pipeline",                 &cfgparams.pipeline,                     0,   0.0,                       2,  0.0,              0.0,                             },
+		{"BatchManifest",            &cfgparams.batch_manifest,               1,   0.0,                       0,  0.0,              0.0,             FILE_NAME_SIZE, },
+		{"BatchReport",              &cfgparams.batch_report,                 1,   0.0,                       0,  0.0,              0.0,             FILE_NAME_SIZE, },
+		{"BatchThreads",             &cfgparams.batch_threads,                0,   0.0,                       2,  0.0,              0.0,                             },
+		{"BatchSplitSize",           &cfgparams.batch_split_mb,               0,  16.0,                       2,  1.0,              0.0,                             },
+		{"NalIndex",                 &cfgparams.use_nal_index,                0,   0.0,                       1,  0.0,              1.0,                             },
+		{"AsyncIO",                  &cfgparams.async_io,                     0,   0.0,                       1,  0.0,              2.0,                             },
+		{"AsyncDepth",               &cfgparams.async_depth,                  0,   4.0,                       1,  1.0,             64.0,                             },
+		{"KeyCoalesce",              &cfgparams.key_coalesce,                 0,   0.0,                       1,  0.0,            255.0,                             },
+		{"KeyCompress",              &cfgparams.key_compress,                 0,   0.0,                       1,  0.0,              1.0,                             },
+		{"KeyRestore",               &cfgparams.key_restore,                  1,   0.0,                       0,  0.0,              0.0,             FILE_NAME_SIZE, },
+		{"TraceFile",                &cfgparams.trace_file,                   1,   0.0,                       0,  0.0,              0.0,             FILE_NAME_SIZE, },
+		{"TraceLast",                &cfgparams.trace_last,                   0,   0.0,                       2,  0.0,              0.0,                             },
+		{"TraceDump",                &cfgparams.trace_dump,                   1,   0.0,                       0,  0.0,              0.0,             FILE_NAME_SIZE, },
     {"FileFormat",               &cfgparams.FileFormat,                   0,   0.0,                       1,  0.0,              1.0,                             },
     {"DisplayDecParams",         &cfgparams.bDisplayDecParams,            0,   1.0,                       1,  0.0,              1.0,                             },
     {"Silent",                   &cfgparams.silent,                       0,   0.0,                       1,  0.0,              1.0,                             },
     {"FrameInterval",            &cfgparams.FrameInvl,                    0,   0.0,                       2,  0.0,              1.0,                             },
+    {"ProtectRefOnly",           &cfgparams.protect_ref_only,             0,   0.0,                       1,  0.0,              1.0,                             },
+    {"ProtectTemporalIds",       &cfgparams.protect_tids,                 1,   0.0,                       0,  0.0,              0.0,             FILE_NAME_SIZE, },
+    {"ProtectFraction",          &cfgparams.protect_fraction,             2,   0.0,                       1,  0.0,              1.0,                             },
 #if (MVC_EXTENSION_ENABLE)
     {"DecodeAllLayers",          &cfgparams.DecodeAllLayers,              0,   0.0,                       1,  0.0,              1.0,                             },
 #endif
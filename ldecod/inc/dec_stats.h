@@ -0,0 +1,182 @@
+/*!
+ ***************************************************************************
+ *
+ * \file dec_stats.h
+ *
+ * \brief
+ *    Per-stage timers and counters of the key generation pipeline
+ *
+ *    The timers use a monotonic clock and are accumulated per stage, the
+ *    counters are plain 64 bit sums. Both compile to nothing when
+ *    DEC_STATS is 0. Stages that run once per key unit are only timed
+ *    when DEC_STATS is 2, the clock reads would otherwise dominate them.
+ *
+ *    Key units are binned into log2 histograms of their byte offset and
+ *    data length as they are captured, per slice type. Bin 0 holds the
+ *    value 0, bin k the values 2^(k-1) .. 2^k - 1. Their count, bits and
+ *    largest length are also kept per picture, for the last KU_MAX_FRAMES
+ *    pictures, so that a decoder that runs indefinitely does not grow.
+ *
+ *    Every decoder instance owns its DecStats, the macros below update the
+ *    one of the instance bound to the calling thread (p_DecStats).
+ *
+ **************************************************************************/
+
+#ifndef _DEC_STATS_H_
+#define _DEC_STATS_H_
+
+#include "win32.h"
+#include "defines.h"
+
+typedef enum
+{
+  STAGE_NAL_READ = 0,    //!< start code search and NAL unit copy
+  STAGE_EBSP,            //!< emulation prevention removal
+  STAGE_SLICE_HEADER,    //!< slice header parsing
+  STAGE_MB_P,            //!< MB layer parsing of P slices
+  STAGE_MB_B,            //!< MB layer parsing of B slices
+  STAGE_MB_I,            //!< MB layer parsing of I slices
+  STAGE_MB_SP,           //!< MB layer parsing of SP slices
+  STAGE_MB_SI,           //!< MB layer parsing of SI slices
+  STAGE_KEY_CAPTURE,     //!< key unit capture (DEC_STATS 2 only)
+  STAGE_KEY_ENCODE,      //!< key extraction and encoding, without the file I/O below
+  STAGE_FILE_WRITE,      //!< write-back of the protected bitstream
+  STAGE_KEYFILE_FLUSH,   //!< key file writes
+  STAGE_NUM
+} StatStage;
+
+typedef enum
+{
+  COUNT_NALU = 0,        //!< NAL units read
+  COUNT_SLICE,           //!< slices whose MB layer was parsed
+  COUNT_MB,              //!< macroblocks parsed
+  COUNT_KEY_UNIT,        //!< key units captured
+  COUNT_KEY_BITS,        //!< bits moved from the bitstream into the key file
+  COUNT_BYTES_IN,        //!< NAL unit bytes read (without start codes)
+  COUNT_PIC_SKIPPED,     //!< pictures dropped unparsed by the selective protection
+  COUNT_NUM
+} StatCounter;
+
+typedef enum
+{
+  PHASE_PARSE = 0,       //!< decoder open until the end of the bitstream
+  PHASE_ENCRYPT,         //!< key generation and write-back
+  PHASE_RESTORE,         //!< KeyRestore of a protected bitstream
+  PHASE_NUM
+} StatPhase;
+
+#define KU_LOG2_BINS    33
+#define KU_SLICE_TYPES  5          //!< P, B, I, SP, SI
+#define KU_MAX_FRAMES   8192       //!< pictures kept in the per picture statistics, a power of 2
+
+typedef struct key_unit_hist
+{
+  int64 units;
+  int64 bits;
+  int64 byte_offset[KU_LOG2_BINS]; //!< byte distance to the previous key unit
+  int64 data_len[KU_LOG2_BINS];    //!< key data length in bits
+} KeyUnitHist;
+
+typedef struct key_unit_frame
+{
+  int   slice_types;               //!< bit mask of the slice types of the picture
+  int   max_data_len;
+  int64 units;
+  int64 bits;
+} KeyUnitFrame;
+
+typedef struct dec_stats
+{
+  int64 stage_time[STAGE_NUM];     //!< accumulated time in ns
+  int64 stage_calls[STAGE_NUM];
+  int64 counter[COUNT_NUM];
+  int64 phase_time[PHASE_NUM];     //!< wall clock time in ns
+
+  int   ku_slice_type;             //!< slice type of the MB layer being parsed
+  KeyUnitHist ku_type[KU_SLICE_TYPES];
+  KeyUnitFrame *ku_frame;          //!< the last KU_MAX_FRAMES pictures, picture n in entry n % KU_MAX_FRAMES
+  KeyUnitFrame *ku_cur;            //!< the picture being parsed, NULL before the first one
+  int64 ku_frame_num;              //!< pictures started
+  int   ku_frame_size;
+} DecStats;
+
+extern THREAD_LOCAL DecStats *p_DecStats;
+
+extern int64 dec_stats_now      (void);
+extern void  dec_stats_add_stage(StatStage stage, int64 start, int64 end);
+extern void  dec_stats_new_frame(void);
+extern void  dec_stats_report   (const DecStats *stats, const char *stream, const char *filename);
+extern void  dec_stats_free     (DecStats *stats);
+extern void  dec_stats_merge    (DecStats *dst, const DecStats *src);
+
+#ifdef _MSC_VER
+#include <intrin.h>
+static inline int dec_stats_log2_bin(unsigned int v)
+{
+  unsigned long idx;
+  return _BitScanReverse(&idx, v) ? (int) idx + 1 : 0;
+}
+#else
+static inline int dec_stats_log2_bin(unsigned int v)
+{
+  return v ? 32 - __builtin_clz(v) : 0;
+}
+#endif
+
+static inline void dec_stats_slice(int slice_type)
+{
+  p_DecStats->ku_slice_type = slice_type;
+  if (p_DecStats->ku_cur != NULL)
+    p_DecStats->ku_cur->slice_types |= 1 << slice_type;
+}
+
+static inline void dec_stats_key_unit(int64 byte_offset, int data_len)
+{
+  KeyUnitHist *h = &p_DecStats->ku_type[p_DecStats->ku_slice_type];
+
+  h->units++;
+  h->bits += data_len;
+  // distances of 4 GB and more end up in the last bin
+  h->byte_offset[dec_stats_log2_bin(byte_offset > 0xFFFFFFFF ? 0xFFFFFFFF : (unsigned int) byte_offset)]++;
+  h->data_len[dec_stats_log2_bin((unsigned int) data_len)]++;
+
+  if (p_DecStats->ku_cur != NULL)
+  {
+    KeyUnitFrame *f = p_DecStats->ku_cur;
+
+    f->units++;
+    f->bits += data_len;
+    if (data_len > f->max_data_len)
+      f->max_data_len = data_len;
+  }
+}
+
+#if (DEC_STATS)
+#define STATS_TIMER(t)          int64 t = dec_stats_now()
+#define STATS_START(t)          ((t) = dec_stats_now())
+#define STATS_STAGE(s, t)       dec_stats_add_stage((s), (t), dec_stats_now())
+#define STATS_COUNT(c, n)       (p_DecStats->counter[(c)] += (n))
+#define STATS_PHASE(p, t)       (p_DecStats->phase_time[(p)] += dec_stats_now() - (t))
+#define STATS_FRAME()           dec_stats_new_frame()
+#define STATS_SLICE(type)       dec_stats_slice(type)
+#define STATS_KEY_UNIT(off, len) dec_stats_key_unit((off), (len))
+#else
+#define STATS_TIMER(t)
+#define STATS_START(t)          ((void) 0)
+#define STATS_STAGE(s, t)       ((void) 0)
+#define STATS_COUNT(c, n)       ((void) 0)
+#define STATS_PHASE(p, t)       ((void) 0)
+#define STATS_FRAME()           ((void) 0)
+#define STATS_SLICE(type)       ((void) 0)
+#define STATS_KEY_UNIT(off, len) ((void) 0)
+#endif
+
+#if (DEC_STATS > 1)
+#define STATS_FINE_TIMER(t)     STATS_TIMER(t)
+#define STATS_FINE_STAGE(s, t)  STATS_STAGE(s, t)
+#else
+#define STATS_FINE_TIMER(t)
+#define STATS_FINE_STAGE(s, t)  ((void) 0)
+#endif
+
+#endif
@@ -30,6 +30,13 @@
 #endif
 
 #define H264_KEY_CREATE 0
+#define MVD_PARSE_ONLY  1  //!< 1: residual syntax is only parsed (no run/level buffering), only MVD key units are generated
+#ifndef DEC_STATS
+#define DEC_STATS       1  //!< 0: no instrumentation, 1: per stage timers and counters, 2: also time the per key unit stages
+#endif
+#ifndef TRACE_BIN
+#define TRACE_BIN       0  //!< 1: binary syntax element trace into TraceFile (see trace_bin.h)
+#endif
 #define MAX_THREAD_DO_KEY_UNIT_CNT 2000//1000000 //ÿ̴߳key unit
 #define MAX_THREAD_NUM  50	//̸߳
 
@@ -37,35 +37,38 @@
 #include "ifunctions.h"
 #include "parsetcommon.h"
 #include "types.h"
+#include "mem_block.h"
 #include "frame.h"
 #include "distortion.h"
+#include "dec_stats.h"
+#include "trace_bin.h"
+#include "stream_io.h"
+#include "nal_index.h"
 
 typedef struct bit_stream_dec Bitstream;
 
 //key unit format 
 typedef struct key_unit_format
 {
-	int byte_offset;	//Եֽƫ
+	int64 byte_offset;	//Եֽƫ
 	int bit_offset;
 	int key_data_len;
 }KeyUnit;
 
-KeyUnit* g_pKeyUnitBuffer;
-
 typedef struct thread_unit_par
 {
+	struct decoder_params *pDecoder;	//decoder instance owning the key unit buffer
 	int buffer_start;
 	int buffer_len;
-	int cur_absolute_offset;	//g_pKeyUnitBuffer[buffer_start-1]ľƫ
-}ThreadUnitPar;	//g_pKeyUnitBuffer
+	int64 cur_absolute_offset;	//key_unit_buffer[buffer_start-1]ľƫ
+}ThreadUnitPar;	//key_unit_buffer
 
 
 #define ET_SIZE 300      //!< size of error text buffer
-#define KEY_UNIT_BUFFER_SIZE 1024*1024*30	//3.6G
-#define KEY_UNIT_BUFFER_SIZE_APPEND	500
-#define NALU_NUM_IN_BITSTREAM 1024*1024
+#define KEY_UNIT_BUFFER_SIZE 4096	//initial number of key units, the buffer doubles when it is full
+#define KEY_UNIT_BUFFER_SIZE_MT 1024*1024*30	//MultiThread: encrypt threads read the buffer while it is filled, so it must not move
 
-extern char errortext[ET_SIZE]; //!< buffer for error message for exit with error()
+extern THREAD_LOCAL char errortext[ET_SIZE]; //!< buffer for error message for exit with error()
 
 struct pic_motion_params_old;
 struct pic_motion_params;
@@ -197,13 +200,20 @@ typedef struct
  * N e w   D a t a    t y p e s   f o r    T M L
  ***********************************************************************
  */
-//! cbp structure
-typedef struct cbp_s
+/*!
+ * Neighbour context of one macroblock.  Only the fields that are read back
+ * by the entropy decoder of a later MB in the same slice (CABAC mvd, ref_idx
+ * and coded block flags, CAVLC nnz) are kept here, in a ring of two MB rows
+ * (two MB pair rows for interlaced sequences) indexed by mbAddrX.
+ */
+typedef struct mb_context
 {
-  int64         blk     ;
-  int64         bits    ;
-  int64         bits_8x8;
-} CBPStructure;
+  short         mvd[2][BLOCK_MULTIPLE][BLOCK_MULTIPLE][2]; //!< indices correspond to [forw,backw][block_y][block_x][x,y]
+  int64         cbp_bits[3];                               //!< coded block flags per plane
+  int64         cbp_bits_8x8[3];                           //!< 8x8 coded block flags (4:4:4 only)
+  char          ref_idx[2][4];                             //!< [list][b8]
+  byte          nz_coeff[3][BLOCK_SIZE][BLOCK_SIZE];       //!< CAVLC number of non-zero coefficients
+} MbContext;
 
 //! Macroblock
 typedef struct macroblock_dec
@@ -248,10 +258,11 @@ typedef struct macroblock_dec
 
   // some storage of macroblock syntax elements for global access
   short         mb_type;	//MBModeTypes
-  short         mvd[2][BLOCK_MULTIPLE][BLOCK_MULTIPLE][2];      //!< indices correspond to [forw,backw][block_y][block_x][x,y]
   //short         ****mvd;      //!< indices correspond to [forw,backw][block_y][block_x][x,y]
   int           cbp;
-  CBPStructure  s_cbp[3];
+  MbContext    *ctx;                //!< neighbour context slot, see get_mb_ctx()
+  byte          mvd_ctx_a[2][BLOCK_MULTIPLE][2];  //!< CABAC |mvd| of the left neighbours, [list][block_y][x,y], see load_mvd_ctx()
+  byte          mvd_ctx_b[2][BLOCK_MULTIPLE][2];  //!< CABAC |mvd| of the top neighbours, [list][block_x][x,y]
 
   //int           i16mode;
   char          b8mode[4];
@@ -271,10 +282,17 @@ typedef struct macroblock_dec
   void (*read_comp_coeff_4x4_CABAC)     (struct macroblock_dec *currMB, struct syntaxelement_dec *currSE, ColorPlane pl, int cbp);
   void (*read_comp_coeff_8x8_CABAC)     (struct macroblock_dec *currMB, struct syntaxelement_dec *currSE, ColorPlane pl);
 
-  void (*read_comp_coeff_4x4_CAVLC)     (struct macroblock_dec *currMB, ColorPlane pl, int cbp, byte **nzcoeff);
-  void (*read_comp_coeff_8x8_CAVLC)     (struct macroblock_dec *currMB, ColorPlane pl, int cbp, byte **nzcoeff);
+  void (*read_comp_coeff_4x4_CAVLC)     (struct macroblock_dec *currMB, ColorPlane pl, int cbp, byte (*nzcoeff)[BLOCK_SIZE]);
+  void (*read_comp_coeff_8x8_CAVLC)     (struct macroblock_dec *currMB, ColorPlane pl, int cbp, byte (*nzcoeff)[BLOCK_SIZE]);
 } Macroblock;
 
+//! RBSP payload of a stored parameter set, used to detect identical repetitions
+typedef struct ps_payload
+{
+  byte         *buf;
+  int           len;
+} PSPayload;
+
 //! Syntaxelement
 typedef struct syntaxelement_dec
 {
@@ -359,6 +377,7 @@ typedef struct slice
   int idr_flag;
   int idr_pic_id;
   int nal_reference_idc;                       //!< nal_reference_idc from NAL unit
+  int64 nalu_pos;                              //!< stream offset of the NAL unit header, the key units of the slice are relative to it
   int Transform8x8Mode;
   Boolean chroma444_not_separate;              //!< indicates chroma 4:4:4 coding with separate_colour_plane_flag equal to zero
   
@@ -513,7 +532,8 @@ typedef struct coding_par
   char  *intra_block_JV[MAX_PLANE];
   BlockPos *PicPos;  
 
-  byte ****nz_coeff;
+  MemBlock mb_ctx;                   //!< neighbour context ring, see get_mb_ctx()
+  int mb_ctx_mask;
   //int **siblock;
   //int **siblock_JV[MAX_PLANE];
 }CodingParameters;
@@ -527,6 +547,8 @@ typedef struct video_par
   seq_parameter_set_rbsp_t *active_sps;
   seq_parameter_set_rbsp_t SeqParSet[MAXSPS];
   pic_parameter_set_rbsp_t PicParSet[MAXPPS];
+  PSPayload SeqParSetPayload[MAXSPS];    //!< RBSP the stored SPS was parsed from
+  PSPayload PicParSetPayload[MAXPPS];    //!< RBSP the stored PPS was parsed from
   CodingParameters *p_EncodePar[MAX_NUM_DPB_LAYERS];
 
 #if (MVC_EXTENSION_ENABLE)
@@ -551,7 +573,8 @@ typedef struct video_par
   char  *intra_block_JV[MAX_PLANE];
   int type;                                   //!< image type INTER/INTRA
 
-  byte ****nz_coeff;
+  MemBlock mb_ctx;                   //!< neighbour context ring, mb_ctx_mask + 1 slots, each on its own cache lines
+  int mb_ctx_mask;
   //int **siblock;
   //int **siblock_JV[MAX_PLANE];
   BlockPos *PicPos;
@@ -613,6 +636,7 @@ typedef struct video_par
   struct storable_picture *dec_picture;
   struct storable_picture *dec_picture_JV[MAX_PLANE];  //!< dec_picture to be used during 4:4:4 independent mode decoding
   struct storable_picture *no_reference_picture; //!< dummy storable picture for recovery point
+  struct storable_picture *pic_pool;             //!< released pictures kept for reuse, see alloc_storable_picture()
   struct annex_b_struct *annex_b;
   int BitStreamFile;
 
@@ -620,12 +644,18 @@ typedef struct video_par
   // FMO
   int *MbToSliceGroupMap;
   int *MapUnitToSliceGroupMap;
+  int *NextMbInSliceGroup;     //!< next MB address in the same slice group, -1 at the end of the group
+  int  NextMbInSliceGroupSize; //!< PicSizeInMbs NextMbInSliceGroup is allocated for
+  int  LastMbInSliceGroup[MAXnum_slice_groups_minus1];
   int  NumberOfSliceGroups;    // the number of slice groups -1 (0 == scan order, 7 == maximum)
 
   void (*getNeighbour)     (Macroblock *currMB, int xN, int yN, int mb_size[2], PixelPos *pix);
   void (*get_mb_block_pos) (BlockPos *PicPos, int mb_addr, short *x, short *y);
 
   struct nalu_t *nalu;
+  struct nalu_t *pending_nalu;       //!< first NAL unit of the next picture, read ahead by read_new_slice()
+  int rtp_seq_valid;
+  uint16 rtp_old_seq;                //!< last RTP sequence number, for loss detection
 	
   //int iPostProcess;
   int bFrameInit;
@@ -699,13 +729,33 @@ typedef struct inp_par
 {
   char infile[FILE_NAME_SIZE];                       //!< H.264 inputfile
   char keyfile_dir[FILE_NAME_SIZE];
+  char stats_file[FILE_NAME_SIZE];                   //!< JSON stage statistics, stdout if empty
 	int  enable_key;
 	int  multi_thread;
+	int  stream_lag;	//live mode: access units parsed before they are protected and emitted, 0: after the end of the stream
+	int  pipeline;	//key unit batches queued between the parser and the encrypt thread, 0: encrypt after parsing
+  char batch_manifest[FILE_NAME_SIZE];               //!< batch mode: one "input output key" line per clip
+  char batch_report[FILE_NAME_SIZE];                 //!< batch mode: JSON report, stdout if empty
+	int  batch_threads;	//batch mode: worker threads, 0: one per CPU
+	int  batch_split_mb;	//batch mode: clips larger than this (MB) are parsed in GOP segments
+	int  use_nal_index;	//keep a NAL unit index next to the input file and read by it (see nal_index.h)
+	int  async_io;	//0: blocking file I/O, 1: io_uring (worker thread if not available), 2: worker thread
+	int  async_depth;	//asynchronous I/O: chunks read ahead and windows written back in flight
+	int  key_coalesce;	//key units less than this many bits apart share one key record, 0: one record per key unit
+	int  key_compress;	//1: rANS compression of the key file (see key_pack.h)
+	char key_restore[FILE_NAME_SIZE];	//restores InputFile with the records of this key file instead of decoding
+	char trace_file[FILE_NAME_SIZE];	//TRACE_BIN builds: binary syntax element trace, none if empty
+	int  trace_last;	//TRACE_BIN builds: only the last this many trace records are written, 0: all
+	char trace_dump[FILE_NAME_SIZE];	//prints this binary trace file as text instead of decoding
 
   int FileFormat;                         //!< File format of the Input file, PAR_OF_ANNEXB or PAR_OF_RTP
   int silent;
 
-	int FrameInvl;		//frame interval
+	int    FrameInvl;		//selective protection: protect every Nth inter picture, 0 and 1: all
+	int    protect_ref_only;	//selective protection: protect reference pictures only
+	char   protect_tids[FILE_NAME_SIZE];	//selective protection: temporal IDs to protect, all if empty
+	int    protect_tid_mask;	//protect_tids as a bit mask, 0: all
+	double protect_fraction;	//selective protection: target fraction of the inter picture bytes, 0: all
 
   // Input/output sequence format related variables
   FrameFormat source;                   //!< source related information
@@ -737,6 +787,54 @@ typedef struct old_slice_par
   int      layer_id;
 } OldSliceParams;
 
+//state of the selective protection between two NAL units, see skip_nalu()
+typedef struct protect_policy
+{
+	int skip_pic;	//the current picture is not protected, its VCL NAL units are dropped unparsed
+	int new_au;	//an access unit delimiter was read after the last VCL NAL unit
+	int last_ref;	//nal_ref_idc != 0 of the last VCL NAL unit
+	int last_idr;
+	int prefix_tid;	//temporal_id + 1 of the prefix NAL unit in front of the next slice, 0 if none
+	int counted;	//the current picture counts for protect_fraction
+	int inter_pics;	//inter pictures that passed the reference and temporal ID filters
+	int64 bytes_total;	//VCL bytes of the pictures counted for protect_fraction
+	int64 bytes_protected;
+} ProtectPolicy;
+
+#define KEY_GROUP_MAX_UNITS 64	//KEY_BIT_LEN_COUNT bits in the key record
+#define KEY_GROUP_MAX_SPAN 4096	//bits from the first key unit of a group to the end of the last one
+
+//KeyCoalesce: key units waiting to be written as one record
+typedef struct key_group
+{
+	int64 rel;	//byte offset of the first key unit relative to the previous record
+	int bit_offset;	//of the first key unit
+	int64 last_byte;	//byte offset of the last key unit from the one of the first
+	int span;	//bits from the first key unit to the end of the last one
+	int count;
+	int start[KEY_GROUP_MAX_UNITS];	//first bit of each key unit in the span
+	int len[KEY_GROUP_MAX_UNITS];
+} KeyGroup;
+
+//state of Generate_Key() between two key units
+typedef struct key_gen_state
+{
+	struct key_bs *b_read, *b_write;
+	char *keyBuffer;
+	char *h264Buffer;
+	char *h264Spare;	//previous window, may still be written back
+	int KeyByteLen;
+	int64 RelativeByteOff_Sum;
+	int64 BufferStart;
+	int read_count;
+	int KeyByteLenSum;
+	int lastBitLen;
+	int lastBitoffset;
+	int64 LastByteOffset;
+	int64 ByteOffset;
+	KeyGroup group;
+} KeyGenState;
+
 typedef struct decoder_params
 {
   InputParameters   *p_Inp;          //!< Input Parameters
@@ -747,20 +845,45 @@ typedef struct decoder_params
   int                bitcounter;
 
 	FILE							*p_KeyFile;
-	int BitStreamFile;
-	int BitStreamFileLen;	//Χ:0~BitStreamFileLen-1
+	StreamIO io;	//bitstream input and protected output
 	
-	int pre_mvd_absolute_byte_pos;	
-	int *nalu_pos_array;	//¼ÿnaluλ,ܴ264ļ
-	int nalu_pos_array_idx;
+	int64 pre_mvd_absolute_byte_pos;	
+
+	int64 nalu_pos;
+	int64 slice_nalu_pos;	//start code of the last slice NALU read
+	int64 nalu_header_pos;	//NAL unit header of the last NALU read
+	int64 decode_nalu_pos;	//NAL unit header of the slice being decoded
+	int cur_mvd_bitpos;	//CABAC: bit position where the last syntax element read starts
+
+	const NalIndex *nal_index;	//NAL units of the input, NULL: the parser searches the start codes
+	NalIndex nal_index_own;	//index loaded from or recorded for the sidecar of the input file
+	int nal_index_next;	//next entry of nal_index to read
+	int nal_index_record;	//the NAL units read are added to nal_index_own
+	const NalIndexEntry *nal_entry;	//entry of the last NAL unit read, NULL without index
+
+	KeyUnit *key_unit_buffer;	//key units captured while parsing
+	int key_unit_idx;
+	int key_unit_buffer_size;
+	int key_unit_buffer_len;	//key units not yet handed to an encrypt thread
+	int64 thread_par_cur_pos;	//absolute offset in front of those key units
+	int64 key_units_protected;	//live and pipeline mode: key units protected and dropped from key_unit_buffer
+	int live_pending_au;	//live mode: access units parsed but not yet protected
+	ProtectPolicy policy;
+	KeyGenState key_gen;
+	struct pipeline *pipeline;	//parse/encrypt overlap, NULL if off
+	struct key_pack *key_pack;	//KeyCompress: packs the key records before they are written, NULL if off
+	struct trace_bin *trace_bin;	//TraceFile: binary syntax element trace, NULL if off
 
-	//int key_unit_buffer_;
 	pthread_attr_t thread_attr;
 	pthread_t pid[MAX_THREAD_NUM];
 	int pid_id;
+
+	DecStats stats;
 } DecoderParams;
 
-extern DecoderParams  *p_Dec;
+// decoder instance the calling thread works on, see set_current_decoder()
+extern THREAD_LOCAL DecoderParams *p_Dec;
+extern void set_current_decoder(DecoderParams *pDecoder);
 
 // prototypes
 extern void error(char *text, int code);
@@ -795,6 +918,15 @@ extern void copy_slice_info ( Slice *currSlice, OldSliceParams *p_old_slice );
 extern void OpenOutputFiles(VideoParameters *p_Vid, int view0_id, int view1_id);
 extern void set_global_coding_par(VideoParameters *p_Vid, CodingParameters *cps);
 
+/*!
+ * Neighbour context of macroblock mb_addr.  Only valid for MBs of the current
+ * slice not further back than the ring size, which covers all of A/B/C/D.
+ */
+static inline MbContext *get_mb_ctx(VideoParameters *p_Vid, int mb_addr)
+{
+  return (MbContext *) mem_block_1D(&p_Vid->mb_ctx, mb_addr & p_Vid->mb_ctx_mask);
+}
+
 static inline int is_FREXT_profile(unsigned int profile_idc) 
 {
   // we allow all FRExt tools, when no profile is active
@@ -42,10 +42,18 @@ typedef struct dec_set_t
 extern "C" {
 #endif
 
-int OpenDecoder(InputParameters *p_Inp);
-int DecodeOneFrame(/*DecodedPicList **ppDecPic*/);
-int FinitDecoder(/*DecodedPicList **ppDecPicList*/);
-int CloseDecoder();
+// Every decoder instance is a DecoderParams handle returned by
+// OpenDecoder() that owns all decoding and key generation state. A
+// handle may only be used by one thread at a time, different handles
+// can be used concurrently.
+int OpenDecoder(InputParameters *p_Inp, DecoderParams **ppDecoder);
+// Same with the bitstream taken from a memory buffer or a read callback
+// and the protected stream and key records handed to write callbacks.
+int OpenDecoderIO(InputParameters *p_Inp, const StreamInput *in, const StreamOutput *out, DecoderParams **ppDecoder);
+int DecodeOneFrame(DecoderParams *pDecoder);
+int EncryptStream(DecoderParams *pDecoder);
+int FinitDecoder(DecoderParams *pDecoder);
+int CloseDecoder(DecoderParams *pDecoder);
 int SetOptsDecoder(DecSet_t *pDecOpts);
 
 #ifdef __cplusplus
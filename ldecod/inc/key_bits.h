@@ -0,0 +1,151 @@
+/*!
+ ***************************************************************************
+ * \file key_bits.h
+ *
+ * \brief
+ *    Bit reader/writer used to cut key data out of the bitstream and to
+ *    serialize key units
+ *
+ **************************************************************************/
+
+#ifndef _KEY_BITS_H_
+#define _KEY_BITS_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*layout of a key record: KEY_BIT_LEN_1 bits width of the byte offset, the byte offset relative to the
+  previous record, KEY_BIT_LEN_3 bits bit offset, KEY_BIT_LEN_4 bits key data length and the key data,
+  padded to a byte. A zero byte ends the key file. Key units whose length does not fit the KEY_BIT_LEN_4
+  bits (0, 256 and more) are written as coalesced records with a single key unit.*/
+#define CUT_BIT_LEN 0
+#define CUT_BIT_LEN_64 0
+#define CUT_BIT_LEN_32 0
+#define CUT_BIT_LEN_16 0
+
+
+#define NOT_CUT_BIT_LEN 1
+
+#define KEY_BIT_LEN_1 6
+#define KEY_BIT_LEN_3 3
+
+#if CUT_BIT_LEN_64
+#define KEY_BIT_LEN_4 6
+#elif CUT_BIT_LEN_32
+#define KEY_BIT_LEN_4 5
+#elif CUT_BIT_LEN_16
+#define KEY_BIT_LEN_4 4
+#elif NOT_CUT_BIT_LEN
+#define KEY_BIT_LEN_4 8
+#endif
+
+/*a coalesced record (KeyCoalesce) has key data length 0, then KEY_BIT_LEN_COUNT bits number of key units - 1,
+  the skip mask as ue(v) codes of the length of the first key unit and of the gap in front of and the length
+  of every further one, and the key bits of all key units*/
+#define KEY_BIT_LEN_COUNT 6
+
+typedef struct key_bs
+{
+	uint8_t* start;
+	uint8_t* p;
+	uint8_t* end;
+	int bits_left;
+} bs_t;
+
+static inline int bs_eof(bs_t* b) { if (b->p >= b->end) { return 1; } else { return 0; } }
+
+static inline bs_t* bs_init(bs_t* b, uint8_t* buf, size_t size)
+{
+    b->start = buf;
+    b->p = buf;
+    b->end = buf + size;
+    b->bits_left = 8;
+    return b;
+}
+
+static inline bs_t* bs_new(uint8_t* buf, size_t size)
+{
+    bs_t* b = (bs_t*)malloc(sizeof(bs_t));
+    bs_init(b, buf, size);
+    return b;
+}
+
+
+static inline void bs_skip_u1(bs_t* b)
+{    
+    b->bits_left--;
+    if (b->bits_left == 0) { b->p ++; b->bits_left = 8; }
+}
+
+static inline void bs_skip_u(bs_t* b, int n)
+{
+    int i;
+    for ( i = 0; i < n; i++ ) 
+    {
+        bs_skip_u1( b );
+    }
+}
+
+static inline void bs_free(bs_t* b)
+{
+    free(b);
+}
+
+static inline uint32_t bs_read_u1(bs_t* b)
+{
+    uint32_t r = 0;
+    
+    b->bits_left--;
+
+    if (! bs_eof(b))
+    {
+        r = ((*(b->p)) >> b->bits_left) & 0x01;
+    }
+
+    if (b->bits_left == 0) { b->p ++; b->bits_left = 8; }
+
+    return r;
+}
+/*bufferǰnλʮu32 return*/
+static inline uint32_t bs_read_u(bs_t* b, int n)
+{
+    uint32_t r = 0;
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        r |= ( bs_read_u1(b) << ( n - i - 1 ) );
+    }
+    return r;
+}
+
+/*ָbָֽbufferдv*/
+static inline void bs_write_u1(bs_t* b, uint32_t v)
+{
+    b->bits_left--;
+
+    if (! bs_eof(b))
+    {
+        /* FIXME this is slow, but we must clear bit first
+         is it better to memset(0) the whole buffer during bs_init() instead? 
+         if we don't do either, we introduce pretty nasty bugs*/
+        (*(b->p)) &= ~(0x01 << b->bits_left);
+        (*(b->p)) |= ((v & 0x01) << b->bits_left);
+    }
+
+    if (b->bits_left == 0) { b->p ++; b->bits_left = 8; }
+}
+
+/*ָbָֽbufferǰnbitλдv*/
+static inline void bs_write_u(bs_t* b, int n, uint32_t v)
+{
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        bs_write_u1(b, (v >> ( n - i - 1 ))&0x01 );
+    }
+}
+
+extern int Get_Key(int64 ByteOffset,int BitOffset,int BitLength,uint8_t *s_Keydata,char **key);
+extern int Get_Key_Record(int64 ByteOffset,int BitOffset,int BitLength,uint8_t *s_Keydata,char **key);
+
+#endif
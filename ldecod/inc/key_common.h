@@ -1,12 +1,9 @@
 #ifndef _KEY_COMMON_H_
 #define _KEY_COMMON_H_
 
-extern int g_KeyUnitIdx;
-extern int g_KeyUnitBufferSize;
-
-void print_KeyUnit();
-
 void init_GenKeyPar();
 void deinit_GenKeyPar();
+void add_KeyUnit(int64 byte_offset, int bit_offset, int key_data_len);
+void write_key_bytes(void *opaque, const byte *buf, int len);
 
 #endif
\ No newline at end of file
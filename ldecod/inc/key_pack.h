@@ -0,0 +1,44 @@
+/*!
+ ***************************************************************************
+ *
+ * \file key_pack.h
+ *
+ * \brief
+ *    Compression of the key file (KeyCompress)
+ *
+ *    The key records are split into four streams: the relative byte
+ *    offsets, the bit offsets and record types, the key data lengths and
+ *    skip masks, and the key bits. Offsets, lengths and masks are written
+ *    as variable length integers. Every stream of a block is coded with
+ *    an order-0 rANS coder (12 bit probabilities, four interleaved states,
+ *    table driven decoding), or stored if that does not make it smaller.
+ *
+ *    A packed key file starts with KEY_PACK_MAGIC, followed by blocks of
+ *    a 32 bit record count and the four streams, each a 32 bit raw size,
+ *    a 32 bit coded size, a method byte and the coded bytes. A block with
+ *    no records ends the file. Unpacking gives back the key records byte
+ *    for byte, so KeyRestore takes packed and plain key files.
+ *
+ **************************************************************************/
+
+#ifndef _KEY_PACK_H_
+#define _KEY_PACK_H_
+
+#include "typedefs.h"
+
+#define KEY_PACK_MAGIC    "KEYPACK1"
+
+typedef void (*KeyPackWrite)(void *opaque, const byte *buf, int len);
+typedef struct key_pack KeyPack;
+
+extern KeyPack *key_pack_open     (KeyPackWrite write, void *opaque);
+extern void     key_pack_add      (KeyPack *kp, const byte *buf, int len);
+extern void     key_pack_flush    (KeyPack *kp);
+extern void     key_pack_close    (KeyPack *kp);
+extern int      key_pack_is_packed(const byte *data, int64 size);
+extern byte    *key_pack_unpack   (const byte *data, int64 size, int64 *out_size);
+
+extern int      rans_encode       (const byte *in, int n, byte *out, int out_size);
+extern int      rans_decode       (const byte *in, int in_size, byte *out, int n);
+
+#endif
@@ -0,0 +1,43 @@
+/*!
+ ***************************************************************************
+ *
+ * \file key_restore.h
+ *
+ * \brief
+ *    Restores a protected bitstream with its key file
+ *
+ *    The key records are read in order and their key bits are written
+ *    back into the bitstream in place. Plain records carry one key unit,
+ *    coalesced records (KeyCoalesce) several key units of one span with
+ *    the skip mask of the bits between them (see key_bits.h). The
+ *    bitstream is read and written in windows, a record is restored with
+ *    at most one window move. A key file with data behind its end record
+ *    or a record that is not inside the payload of one NAL unit of the
+ *    restored bitstream fails the restore.
+ *
+ **************************************************************************/
+
+#ifndef _KEY_RESTORE_H_
+#define _KEY_RESTORE_H_
+
+#include "global.h"
+
+//! header and skip mask of a key record
+typedef struct key_record
+{
+  int64 offset;                        //!< byte offset relative to the previous record
+  int   bit_offset;
+  int   coalesced;                     //!< coalesced record, also with a single key unit
+  int   count;                         //!< key units
+  int   gap[KEY_GROUP_MAX_UNITS];      //!< bits in front of each key unit, gap[0] is 0
+  int   len[KEY_GROUP_MAX_UNITS];
+  int   span;                          //!< bits from the first key unit to the end of the last one
+  int   key_bits;
+} KeyRecord;
+
+struct key_bs;
+
+extern int key_record_read(struct key_bs *b, KeyRecord *r);
+extern int restore_stream (const char *fn, const char *key_fn);
+
+#endif
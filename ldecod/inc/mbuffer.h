@@ -24,6 +24,7 @@
 #include "global.h"
 
 #define MAX_LIST_SIZE 33
+#define MAX_PIC_POOL_SIZE 4   //!< number of released pictures kept for reuse
 //! definition of pic motion parameters
 typedef struct pic_motion_params_old
 {
@@ -131,6 +132,8 @@ typedef struct storable_picture
   //char listXsize[MAX_NUM_SLICES][2];
   //struct storable_picture **listX[MAX_NUM_SLICES][2];
   int         layer_id;
+
+  struct storable_picture *pool_next;     //!< next entry in p_Vid->pic_pool
 } StorablePicture;
 
 typedef StorablePicture *StorablePicturePtr;
@@ -172,6 +175,8 @@ extern FrameStore*       alloc_frame_store(void);
 extern void              free_frame_store (FrameStore* f);
 extern StorablePicture*  alloc_storable_picture(VideoParameters *p_Vid, PictureStructure type, int size_x, int size_y, int size_x_cr, int size_y_cr);
 extern void              free_storable_picture (StorablePicture* p);
+extern void              release_storable_picture(VideoParameters *p_Vid, StorablePicture* p);
+extern void              free_picture_pool     (VideoParameters *p_Vid);
 
 #if (MVC_EXTENSION_ENABLE)
 extern int              GetMaxDecFrameBuffering(VideoParameters *p_Vid);
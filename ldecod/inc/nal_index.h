@@ -0,0 +1,68 @@
+/*!
+ ***************************************************************************
+ *
+ * \file nal_index.h
+ *
+ * \brief
+ *    NAL unit index of an Annex B bitstream
+ *
+ *    The index holds the offset, size and header byte of every NAL unit,
+ *    the positions of its emulation prevention bytes and the access unit
+ *    boundaries. A decoder that has an index reads the NAL units at their
+ *    offsets instead of searching for start codes, and only removes the
+ *    emulation prevention bytes that are listed.
+ *
+ *    With NalIndex = 1 the index of a bitstream file is kept in a sidecar
+ *    file next to it (<file>.nalidx), keyed by the size and modification
+ *    time of the bitstream. A decoder that finds no valid sidecar records
+ *    the index while it scans and writes the sidecar at the end of the
+ *    stream. A bitstream that is protected in place gets a new time, so
+ *    its sidecar is only reused for inputs that are left untouched, as in
+ *    batch mode or with a write_stream callback.
+ *
+ **************************************************************************/
+
+#ifndef _NAL_INDEX_H_
+#define _NAL_INDEX_H_
+
+#include "typedefs.h"
+
+#define NAL_INDEX_AU_START  0x01    //!< first NAL unit of an access unit
+#define NAL_INDEX_IDR_AU    0x02    //!< first NAL unit of an access unit with an IDR picture
+
+typedef struct nal_index_entry
+{
+  int64  pos;          //!< stream offset of the NAL unit header
+  int    len;          //!< NAL unit bytes without start code and trailing zeros
+  int    epb;          //!< first of its emulation prevention bytes in NalIndex.epb
+  int    epb_count;
+  byte   header;       //!< first byte of the NAL unit
+  byte   sc_len;       //!< start code length, 3 or 4
+  byte   flags;        //!< NAL_INDEX_AU_START, NAL_INDEX_IDR_AU
+} NalIndexEntry;
+
+typedef struct nal_index
+{
+  NalIndexEntry *nal;
+  int            count;
+  int            size;
+  int           *epb;        //!< offsets of emulation prevention bytes from the NAL unit header
+  int            epb_count;
+  int            epb_size;
+  int64          file_size;  //!< key of the sidecar
+  int64          mtime;
+  int            prev_vcl;   //!< while recording: the last NAL unit was a VCL NAL unit
+  int            au_start;   //!< while recording: entry that started the current access unit
+} NalIndex;
+
+extern void nal_index_init  (NalIndex *idx);
+extern void nal_index_free  (NalIndex *idx);
+extern void nal_index_add   (NalIndex *idx, int64 pos, int sc_len, const byte *buf, int len);
+extern void nal_index_copy  (NalIndex *dst, const NalIndex *src, int first, int last, int64 delta);
+extern void nal_index_scan  (NalIndex *idx, const byte *data, int64 size);
+extern int  nal_index_key   (NalIndex *idx, const char *fn);
+extern int  nal_index_load  (NalIndex *idx, const char *fn);
+extern int  nal_index_save  (const NalIndex *idx, const char *fn);
+extern int  nal_index_rbsp  (const NalIndex *idx, const NalIndexEntry *e, byte *buf);
+
+#endif
@@ -23,5 +23,6 @@ extern void CheckZeroByteNonVCL(VideoParameters *p_Vid, NALU_t *nalu);
 extern void CheckZeroByteVCL   (VideoParameters *p_Vid, NALU_t *nalu);
 
 extern int read_next_nalu(VideoParameters *p_Vid, NALU_t *nalu);
+extern int peek_slice_header(const byte *nal, int nal_len, int header_len, int *first_mb, int *slice_type);
 
 #endif
@@ -0,0 +1,45 @@
+/*!
+ ***************************************************************************
+ *
+ * \file pipeline.h
+ *
+ * \brief
+ *    Overlaps parsing with key generation
+ *
+ *    The parser hands the key units of every access unit as one batch to
+ *    an encrypt thread through a bounded single producer single consumer
+ *    queue. The encrypt thread protects the stream and passes the key
+ *    records on to a key writer thread through a second queue. Batches
+ *    end at NAL unit boundaries and are processed in order, so the key
+ *    file and the protected stream are the same as without the pipeline.
+ *
+ **************************************************************************/
+
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include "typedefs.h"
+
+//! lock-free ring of pointers with one producer and one consumer thread
+typedef struct spsc_queue
+{
+  void                  **slot;
+  unsigned int            mask;   //!< number of slots - 1, the number of slots is a power of two
+  volatile unsigned int   head;   //!< items popped so far, written by the consumer only
+  volatile unsigned int   tail;   //!< items pushed so far, written by the producer only
+} SpscQueue;
+
+struct decoder_params;
+typedef struct pipeline Pipeline;
+
+extern int  spsc_init (SpscQueue *q, int size);
+extern void spsc_free (SpscQueue *q);
+extern void spsc_push (SpscQueue *q, void *item);
+extern void *spsc_pop (SpscQueue *q);
+
+extern int  pipeline_start     (struct decoder_params *pDecoder, int queue_size);
+extern void pipeline_push_units(struct decoder_params *pDecoder);
+extern void pipeline_push_keys (Pipeline *pl, const char *buf, int len);
+extern void pipeline_finish    (struct decoder_params *pDecoder);
+
+#endif
@@ -0,0 +1,84 @@
+/*!
+ ***************************************************************************
+ *
+ * \file stream_io.h
+ *
+ * \brief
+ *    Bitstream input and protected output of a decoder instance
+ *
+ *    The bitstream is read from a file (default), from a caller owned
+ *    memory buffer or from a read callback that delivers it chunk by
+ *    chunk. The key generation pass reads and rewrites parts of it
+ *    afterwards: a file is rewritten in place, a memory buffer is
+ *    protected in place and callback input is kept in a memory image
+ *    owned by the decoder. The protected stream and the key records may
+ *    be handed to write callbacks instead of the input and the key file.
+ *
+ *    In live mode (StreamLag > 0) the protected stream is emitted piece
+ *    by piece while parsing goes on, and the part of an owned memory
+ *    image that has been emitted is dropped again.
+ *
+ *    With AsyncIO a file is read ahead of the parser by AsyncDepth
+ *    chunks in flight, and the windows patched by the key generation
+ *    pass are written back while it goes on. A read or write of the
+ *    bitstream waits for the pending writes it overlaps.
+ *
+ **************************************************************************/
+
+#ifndef _STREAM_IO_H_
+#define _STREAM_IO_H_
+
+#include "typedefs.h"
+
+//! fills buf with up to size bytes, returns the number of bytes read, 0 at the end of the stream
+typedef int (*StreamReadFunc) (void *opaque, byte *buf, int size);
+//! consumes size bytes, returns the number of bytes written
+typedef int (*StreamWriteFunc)(void *opaque, const byte *buf, int size);
+
+typedef struct stream_input
+{
+  byte           *data;          //!< complete bitstream in memory, protected in place
+  int64           size;
+  StreamReadFunc  read;          //!< used if data is NULL
+  void           *opaque;
+  const struct nal_index *index; //!< NAL units of data, NULL: the parser searches the start codes
+} StreamInput;
+
+typedef struct stream_output
+{
+  StreamWriteFunc write_stream;  //!< receives the protected bitstream once it is complete
+  StreamWriteFunc write_key;     //!< receives the key records, NULL: key file in KeyFileDir
+  void           *opaque;
+} StreamOutput;
+
+typedef struct stream_io
+{
+  int            fd;             //!< input file read by the parser, -1 for memory and callback input
+  int            fd_rw;          //!< same file for the key generation pass, which may run in another thread
+  byte          *mem;            //!< memory image of the bitstream
+  int64          mem_base;       //!< stream offset of mem[0]
+  int64          mem_size;
+  int64          mem_alloc;      //!< allocated size if the image is owned by the decoder
+  int64          read_pos;       //!< next byte of a memory buffer handed to the parser
+  int64          out_pos;        //!< stream offset up to which write_stream got the protected stream
+  StreamReadFunc read;
+  void          *read_opaque;
+  StreamOutput   out;
+  struct stream_async *async;    //!< read-ahead and write-back of a file (AsyncIO), NULL: blocking I/O
+} StreamIO;
+
+extern void stream_io_init     (StreamIO *io, const StreamInput *in, const StreamOutput *out);
+extern int  stream_io_open     (StreamIO *io, const char *fn);
+extern void stream_io_async    (StreamIO *io, int mode, int depth, int write_back);
+extern void stream_io_drain    (StreamIO *io);
+extern void stream_io_close    (StreamIO *io);
+extern int  stream_next_chunk  (StreamIO *io, byte *buf, int size, byte **data);
+extern int  stream_read_at     (StreamIO *io, byte *buf, int size, int64 offset);
+extern int  stream_pread       (StreamIO *io, byte *buf, int size, int64 offset);
+extern int  stream_pwrite      (StreamIO *io, const byte *buf, int size, int64 offset);
+extern int  stream_pwrite_async(StreamIO *io, const byte *buf, int size, int64 offset);
+extern void stream_wait_buffer (StreamIO *io, const byte *buf);
+extern int  stream_emit_output (StreamIO *io, int64 end);
+extern int  stream_flush_output(StreamIO *io);
+
+#endif
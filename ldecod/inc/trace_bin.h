@@ -0,0 +1,140 @@
+/*!
+ ***************************************************************************
+ *
+ * \file trace_bin.h
+ *
+ * \brief
+ *    Binary syntax element trace (TRACE_BIN)
+ *
+ *    Every syntax element read, NAL unit, macroblock start and key unit
+ *    is stored as one fixed size record in a ring buffer, without any
+ *    formatting or flushing. The ring of a decoder instance is only
+ *    written by the thread that parses for it, so it needs no locks.
+ *    A full ring is written to the trace file with one fwrite, or, with
+ *    TraceLast, its oldest records are dropped and the ring is written
+ *    when the decoder is closed or a key unit is rejected.
+ *
+ *    A trace file starts with TRACE_BIN_MAGIC, a byte order mark, the
+ *    record size and the name of the traced stream, followed by the
+ *    records in host byte order. TraceDump prints a trace file as text
+ *    instead of decoding, in any build.
+ *
+ *    With TRACE_BIN 0 the hooks compile to nothing, with TRACE_BIN 1 and
+ *    no TraceFile they cost one test of p_TraceBin.
+ *
+ **************************************************************************/
+
+#ifndef _TRACE_BIN_H_
+#define _TRACE_BIN_H_
+
+#include "win32.h"
+#include "defines.h"
+#include "typedefs.h"
+
+#define TRACE_BIN_MAGIC   "TRACEBN1"
+#define TRACE_BIN_BOM     0x01020304
+#define TRACE_BIN_RING    (1 << 16)     //!< records of the ring without TraceLast
+
+typedef enum
+{
+  TRACE_BIN_NAL = 0,     //!< NAL unit read: bit_pos is the byte position of its header, len its type, value its size
+  TRACE_BIN_MB,          //!< macroblock start: value is the slice type
+  TRACE_BIN_KEY,         //!< key unit: bit_pos is its bit position in the file, value its bit offset in the RBSP
+  TRACE_BIN_VLC,         //!< exp-Golomb code, bit_pos is the bit position in the RBSP for this and the kinds below
+  TRACE_BIN_FLC,         //!< fixed length code
+  TRACE_BIN_IPRED,       //!< intra prediction mode
+  TRACE_BIN_COEFF_TOKEN, //!< CAVLC coeff_token, value is TotalCoeff
+  TRACE_BIN_LEVEL,       //!< CAVLC level
+  TRACE_BIN_TOTAL_ZEROS, //!< CAVLC total_zeros
+  TRACE_BIN_RUN,         //!< CAVLC run_before
+  TRACE_BIN_CABAC,       //!< CABAC syntax element, bit_pos counts the bits read by the arithmetic decoder
+  TRACE_BIN_KINDS
+} TraceBinKind;
+
+//! one trace record, 24 bytes without padding
+typedef struct trace_bin_record
+{
+  int64 bit_pos;
+  int   nal_idx;         //!< index of the NAL unit of the record in the stream
+  int   mb_addr;         //!< -1 outside of the MB layer
+  int   value;
+  short len;             //!< bits
+  byte  kind;            //!< TraceBinKind
+  byte  se_type;         //!< SE_* of syntax elements
+} TraceBinRecord;
+
+typedef struct trace_bin
+{
+  TraceBinRecord *rec;
+  unsigned int    mask;  //!< records - 1, the number of records is a power of two
+  unsigned int    head;  //!< records stored so far
+  unsigned int    tail;  //!< first record not yet written
+  int             last;  //!< TraceLast: full rings drop their oldest record
+  int             nal_idx;
+  int             mb_addr;
+  int64           dropped;
+  FILE           *f;
+} TraceBin;
+
+extern THREAD_LOCAL TraceBin *p_TraceBin;
+
+extern TraceBin *trace_bin_open (const char *fn, const char *stream, int last);
+extern void      trace_bin_full (TraceBin *tb);
+extern void      trace_bin_flush(TraceBin *tb);
+extern void      trace_bin_close(TraceBin *tb);
+extern int       trace_bin_dump (const char *fn, FILE *out);
+
+static inline void trace_bin_put(int kind, int se_type, int64 bit_pos, int len, int value)
+{
+  TraceBin *tb = p_TraceBin;
+
+  if (tb != NULL)
+  {
+    TraceBinRecord *r = &tb->rec[tb->head & tb->mask];
+
+    r->bit_pos = bit_pos;
+    r->nal_idx = tb->nal_idx;
+    r->mb_addr = tb->mb_addr;
+    r->value   = value;
+    r->len     = (short) len;
+    r->kind    = (byte) kind;
+    r->se_type = (byte) se_type;
+    if (++tb->head - tb->tail > tb->mask)
+      trace_bin_full(tb);
+  }
+}
+
+static inline void trace_bin_nal(int64 pos, int size, int nal_unit_type)
+{
+  if (p_TraceBin != NULL)
+  {
+    p_TraceBin->nal_idx++;
+    p_TraceBin->mb_addr = -1;
+    trace_bin_put(TRACE_BIN_NAL, 0, pos, nal_unit_type, size);
+  }
+}
+
+static inline void trace_bin_mb(int mb_addr, int slice_type)
+{
+  if (p_TraceBin != NULL)
+  {
+    p_TraceBin->mb_addr = mb_addr;
+    trace_bin_put(TRACE_BIN_MB, 0, 0, 0, slice_type);
+  }
+}
+
+#if (TRACE_BIN)
+#define TRACE_BIN_SE(kind, type, pos, len, value)  trace_bin_put((kind), (type), (pos), (len), (value))
+#define TRACE_BIN_NAL(pos, size, type)             trace_bin_nal((pos), (size), (type))
+#define TRACE_BIN_MB(addr, slice_type)             trace_bin_mb((addr), (slice_type))
+#define TRACE_BIN_KEY(pos, len, rbsp_bit)          trace_bin_put(TRACE_BIN_KEY, 0, (pos), (len), (rbsp_bit))
+#define TRACE_BIN_FLUSH()                          trace_bin_flush(p_TraceBin)
+#else
+#define TRACE_BIN_SE(kind, type, pos, len, value)  ((void) 0)
+#define TRACE_BIN_NAL(pos, size, type)             ((void) 0)
+#define TRACE_BIN_MB(addr, slice_type)             ((void) 0)
+#define TRACE_BIN_KEY(pos, len, rbsp_bit)          ((void) 0)
+#define TRACE_BIN_FLUSH()                          ((void) 0)
+#endif
+
+#endif
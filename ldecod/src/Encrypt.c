@@ -7,133 +7,20 @@
 #include <math.h>
 
 #include "global.h"
+#include "dec_stats.h"
+#include "key_bits.h"
+#include "pipeline.h"
+#include "key_pack.h"
 
 #define MAX_BUFFER_LEN 1024*1024
-#define CUT_BIT_LEN 0
-#define CUT_BIT_LEN_64 0
-#define CUT_BIT_LEN_32 0
-#define CUT_BIT_LEN_16 0
-
-
-#define NOT_CUT_BIT_LEN 1
-
-#define KEY_BIT_LEN_1 6
-#define KEY_BIT_LEN_3 3
-
-#if CUT_BIT_LEN_64
-#define KEY_BIT_LEN_4 6
-#elif CUT_BIT_LEN_32
-#define KEY_BIT_LEN_4 5
-#elif CUT_BIT_LEN_16
-#define KEY_BIT_LEN_4 4
-#elif NOT_CUT_BIT_LEN
-#define KEY_BIT_LEN_4 8
-#endif
 
 #define KEY_MAX_BYTE_LEN 32
-typedef struct
-{
-	uint8_t* start;
-	uint8_t* p;
-	uint8_t* end;
-	int bits_left;
-} bs_t;
 
-static inline int bs_eof(bs_t* b) { if (b->p >= b->end) { return 1; } else { return 0; } }
-
-static inline bs_t* bs_init(bs_t* b, uint8_t* buf, size_t size)
-{
-    b->start = buf;
-    b->p = buf;
-    b->end = buf + size;
-    b->bits_left = 8;
-    return b;
-}
-
-static inline bs_t* bs_new(uint8_t* buf, size_t size)
-{
-    bs_t* b = (bs_t*)malloc(sizeof(bs_t));
-    bs_init(b, buf, size);
-    return b;
-}
-
-
-static inline void bs_skip_u1(bs_t* b)
-{    
-    b->bits_left--;
-    if (b->bits_left == 0) { b->p ++; b->bits_left = 8; }
-}
-
-static inline void bs_skip_u(bs_t* b, int n)
-{
-    int i;
-    for ( i = 0; i < n; i++ ) 
-    {
-        bs_skip_u1( b );
-    }
-}
-
-static inline void bs_free(bs_t* b)
-{
-    free(b);
-}
-
-static inline uint32_t bs_read_u1(bs_t* b)
-{
-    uint32_t r = 0;
-    
-    b->bits_left--;
-
-    if (! bs_eof(b))
-    {
-        r = ((*(b->p)) >> b->bits_left) & 0x01;
-    }
-
-    if (b->bits_left == 0) { b->p ++; b->bits_left = 8; }
-
-    return r;
-}
-/*bufferǰnλʮu32 return*/
-static inline uint32_t bs_read_u(bs_t* b, int n)
-{
-    uint32_t r = 0;
-    int i;
-    for (i = 0; i < n; i++)
-    {
-        r |= ( bs_read_u1(b) << ( n - i - 1 ) );
-    }
-    return r;
-}
-
-/*ָbָֽbufferдv*/
-static inline void bs_write_u1(bs_t* b, uint32_t v)
-{
-    b->bits_left--;
-
-    if (! bs_eof(b))
-    {
-        /* FIXME this is slow, but we must clear bit first
-         is it better to memset(0) the whole buffer during bs_init() instead? 
-         if we don't do either, we introduce pretty nasty bugs*/
-        (*(b->p)) &= ~(0x01 << b->bits_left);
-        (*(b->p)) |= ((v & 0x01) << b->bits_left);
-    }
-
-    if (b->bits_left == 0) { b->p ++; b->bits_left = 8; }
-}
-
-/*ָbָֽbufferǰnbitλдv*/
-static inline void bs_write_u(bs_t* b, int n, uint32_t v)
-{
-    int i;
-    for (i = 0; i < n; i++)
-    {
-        bs_write_u1(b, (v >> ( n - i - 1 ))&0x01 );
-    }
-}
+int Generate_Key(int64 RelativeByteOff, int64 cur_absolute_offset, int BitOffset,int BitLength, int canfree);
+static int write_key_group(KeyGenState *ks);
 
 /*NumberҪٸbitλ*/
-int GetNeedBitCount(unsigned int Number,int *BitCount )
+int GetNeedBitCount(uint64_t Number,int *BitCount )
 {
 	int i32Count=0;
 	
@@ -155,7 +42,7 @@ int GetNeedBitCount(unsigned int Number,int *BitCount )
 	return 0;
 }
 
-int GetKeyByteLen(int ByteOffset,int ByteOffsetBitNum,int BitOffset,int BitLength,int *KeyByteLen)
+int GetKeyByteLen(int64 ByteOffset,int ByteOffsetBitNum,int BitOffset,int BitLength,int *KeyByteLen)
 {
 	int KeyBitLength;
 	int KeyByteLength;
@@ -229,7 +116,22 @@ int bs_Read_KeyData(bs_t *b, int BitLength,uint8_t *s_Keydata)
 	return 0;
 }
 
-int Get_Key(int ByteOffset,int BitOffset,int BitLength,uint8_t *s_Keydata,char **key)
+static void bs_Write_KeyHeader(bs_t *b,int64 ByteOffset,int ByteOffsetBitNum,int BitOffset,int BitLength)
+{
+	bs_write_u(b,KEY_BIT_LEN_1,ByteOffsetBitNum);
+	if(ByteOffsetBitNum>32)
+	{
+		//offsets of 4 GB and more, bs_write_u() takes up to 32 bits
+		bs_write_u(b,ByteOffsetBitNum-32,(uint32_t)(ByteOffset>>32));
+		bs_write_u(b,32,(uint32_t)ByteOffset);
+	}
+	else
+		bs_write_u(b,ByteOffsetBitNum,(uint32_t)ByteOffset);
+	bs_write_u(b,KEY_BIT_LEN_3,BitOffset);
+	bs_write_u(b,KEY_BIT_LEN_4,BitLength);
+}
+
+int Get_Key(int64 ByteOffset,int BitOffset,int BitLength,uint8_t *s_Keydata,char **key)
 {
 	uint8_t *u8Buffer;
 	int ByteOffsetBitNum=0;
@@ -247,10 +149,7 @@ int Get_Key(int ByteOffset,int BitOffset,int BitLength,uint8_t *s_Keydata,char *
 	memset(u8Buffer,0x00,KeyByteLength);
 	b=bs_new(u8Buffer,KeyByteLength);
 
-	bs_write_u(b,KEY_BIT_LEN_1,ByteOffsetBitNum);
-	bs_write_u(b,ByteOffsetBitNum,ByteOffset);
-	bs_write_u(b,KEY_BIT_LEN_3,BitOffset);
-	bs_write_u(b,KEY_BIT_LEN_4,BitLength);
+	bs_Write_KeyHeader(b,ByteOffset,ByteOffsetBitNum,BitOffset,BitLength);
 	bs_Write_KeyData(b,BitLength,s_Keydata);	
 	*key=u8Buffer;
 	bs_free(b);
@@ -258,6 +157,82 @@ int Get_Key(int ByteOffset,int BitOffset,int BitLength,uint8_t *s_Keydata,char *
 		
 }
 
+/*bits of the ue(v) code of Number*/
+static int ue_bits(int Number)
+{
+	int BitCount=0;
+
+	GetNeedBitCount(Number+1,&BitCount);
+	return 2*BitCount-1;
+}
+
+static void bs_write_ue(bs_t *b,int Number)
+{
+	int BitCount=0;
+
+	GetNeedBitCount(Number+1,&BitCount);
+	bs_write_u(b,BitCount-1,0);
+	bs_write_u(b,BitCount,Number+1);
+}
+
+/*one record for the key units of g: header with key data length 0, number of key units, skip mask and the KeyBits bits of s_Keydata*/
+static int Get_Key_Group(int64 ByteOffset,int BitOffset,const KeyGroup *g,int KeyBits,uint8_t *s_Keydata,char **key)
+{
+	uint8_t *u8Buffer;
+	int ByteOffsetBitNum=0;
+	int KeyByteLength=0;
+	int MaskBits=0;
+	int i;
+	bs_t *b;
+
+	if(-1 == GetNeedBitCount(ByteOffset,&ByteOffsetBitNum))
+	{
+		return -1;
+	}
+
+	for(i=0;i<g->count;i++)
+	{
+		if(i>0)
+			MaskBits+=ue_bits(g->start[i]-g->start[i-1]-g->len[i-1]);
+		MaskBits+=ue_bits(g->len[i]);
+	}
+	GetKeyByteLen(ByteOffset,ByteOffsetBitNum,BitOffset,KEY_BIT_LEN_COUNT+MaskBits+KeyBits,&KeyByteLength);
+
+	u8Buffer=(uint8_t*)malloc(KeyByteLength*sizeof(uint8_t));
+	memset(u8Buffer,0x00,KeyByteLength);
+	b=bs_new(u8Buffer,KeyByteLength);
+
+	bs_Write_KeyHeader(b,ByteOffset,ByteOffsetBitNum,BitOffset,0);
+	bs_write_u(b,KEY_BIT_LEN_COUNT,g->count-1);
+	for(i=0;i<g->count;i++)
+	{
+		if(i>0)
+			bs_write_ue(b,g->start[i]-g->start[i-1]-g->len[i-1]);
+		bs_write_ue(b,g->len[i]);
+	}
+	bs_Write_KeyData(b,KeyBits,s_Keydata);
+	*key=u8Buffer;
+	bs_free(b);
+	return KeyByteLength;
+}
+
+/*one record for a key unit. The KEY_BIT_LEN_4 bits length of a plain record cannot hold 0 or 256 bits and more,
+  such key units get a coalesced record with a single key unit*/
+int Get_Key_Record(int64 ByteOffset,int BitOffset,int BitLength,uint8_t *s_Keydata,char **key)
+{
+	KeyGroup g;
+
+	if(BitLength>0&&BitLength<(1<<KEY_BIT_LEN_4))
+	{
+		return Get_Key(ByteOffset,BitOffset,BitLength,s_Keydata,key);
+	}
+	g.count=1;
+	g.start[0]=0;
+	g.len[0]=BitLength;
+	g.span=BitLength;
+	return Get_Key_Group(ByteOffset,BitOffset,&g,BitLength,s_Keydata,key);
+}
+
 int Generate_Key_Get_Changed_ByteNum(int BitLength,int BitOffset,int *ChangedByteNum)
 {
 	int ByteCount=0;
@@ -276,26 +251,32 @@ int Generate_Key_Get_Changed_ByteNum(int BitLength,int BitOffset,int *ChangedByt
 void Encrypt(ThreadUnitPar *thread_unit_par)
 {
 	int i=0;
+	KeyUnit *key_unit_buffer;
+
+	set_current_decoder(thread_unit_par->pDecoder);
+	key_unit_buffer = p_Dec->key_unit_buffer;
+	STATS_TIMER(t_encode);
 
 	//if(p_Dec->p_Inp->multi_thread == 1)
 	{	
 
 		for(i=thread_unit_par->buffer_start;i<thread_unit_par->buffer_len;i++)
 		{
-			Generate_Key(g_pKeyUnitBuffer[i].byte_offset,thread_unit_par->cur_absolute_offset,
-											g_pKeyUnitBuffer[i].bit_offset,g_pKeyUnitBuffer[i].key_data_len,0);			
+			Generate_Key(key_unit_buffer[i].byte_offset,thread_unit_par->cur_absolute_offset,
+											key_unit_buffer[i].bit_offset,key_unit_buffer[i].key_data_len,0);			
 		}
 
 		if(i == thread_unit_par->buffer_len)
 			Generate_Key(0,0,0,0,1);
 	}
+	STATS_STAGE(STAGE_KEY_ENCODE, t_encode);
 }
 
-int Is_Para_Valid(int RelativeByteOff,int BitOffset,int BitLength)
+int Is_Para_Valid(int64 RelativeByteOff,int BitOffset,int BitLength)
 {
 	if(RelativeByteOff<0)
 	{
-		printf("Param error:RelativeByteOff=(%d)!\n",RelativeByteOff);
+		printf("Param error:RelativeByteOff=(%lld)!\n",(long long)RelativeByteOff);
 		return -1;
 	}
 
@@ -310,18 +291,176 @@ int Is_Para_Valid(int RelativeByteOff,int BitOffset,int BitLength)
 		printf("Param error:BitLength=(%d)!\n",BitLength);
 		return -3;
 	}
-	 
+	return 0;
+}
+
+/*key file bytes go to the write_key callback of the decoder, otherwise to the key file*/
+void write_key_bytes(void *opaque, const byte *buf, int len)
+{
+	DecoderParams *pDecoder = (DecoderParams *)opaque;
+
+	if(pDecoder->io.out.write_key)
+		pDecoder->io.out.write_key(pDecoder->io.out.opaque, buf, len);
+	else
+		fwrite(buf,sizeof(char),len,pDecoder->p_KeyFile);
+}
 
+/*with KeyCompress the key records are packed first*/
+void write_key_records(DecoderParams *pDecoder, const char *buf, int len)
+{
+	if(pDecoder->key_pack)
+		key_pack_add(pDecoder->key_pack,(const byte *)buf,len);
+	else
+		write_key_bytes(pDecoder,(const byte *)buf,len);
 }
 
-int Generate_Key(int RelativeByteOff, int cur_absolute_offset, int BitOffset,int BitLength, int canfree)
+/*with the pipeline the key writer thread writes them*/
+static void write_key_data(const char *buf, int len)
 {
+	if(p_Dec->pipeline)
+		pipeline_push_keys(p_Dec->pipeline,buf,len);
+	else
+		write_key_records(p_Dec,buf,len);
+}
 
-	if(Is_Para_Valid(RelativeByteOff,BitOffset,BitLength)<0)
+/*writes the buffered stream bytes and key records through, the next key unit reloads the stream buffer*/
+void Generate_Key_Sync(void)
+{
+	KeyGenState *ks = &p_Dec->key_gen;
+#if (DEC_STATS)
+	int64 t_io;
+#endif
+
+	if(ks->group.count>0)
 	{
-		return -1;
+		write_key_group(ks);
 	}
-	
+	if(ks->h264Buffer==NULL)
+	{
+		return;
+	}
+
+	STATS_START(t_io);
+	stream_pwrite(&p_Dec->io,(byte *)ks->h264Buffer,ks->read_count,ks->BufferStart);
+	STATS_STAGE(STAGE_FILE_WRITE, t_io);
+
+	STATS_START(t_io);
+	write_key_data(ks->keyBuffer,ks->KeyByteLenSum);
+	if(p_Dec->key_pack && !p_Dec->pipeline)
+		key_pack_flush(p_Dec->key_pack);
+	if(p_Dec->p_KeyFile)
+		fflush(p_Dec->p_KeyFile);
+	STATS_STAGE(STAGE_KEYFILE_FLUSH, t_io);
+
+	ks->KeyByteLenSum=0;
+	ks->read_count=0;
+	ks->RelativeByteOff_Sum=MAX_BUFFER_LEN;
+}
+
+/*moves the stream window to ByteOffset: the old window is written back, with AsyncIO while the key generation goes on,
+  and the part of the new window that is still in the old one is taken from there*/
+static int next_window(KeyGenState *ks)
+{
+	char *old=ks->h264Buffer;
+	int64 overlap=ks->BufferStart+ks->read_count-ks->ByteOffset;
+
+	if(ks->read_count>0)
+		stream_pwrite_async(&p_Dec->io,(byte *)old,ks->read_count,ks->BufferStart);
+
+	if(ks->h264Spare==NULL)
+	{
+		ks->h264Spare=(char *)malloc(MAX_BUFFER_LEN*sizeof(char));
+		memset(ks->h264Spare,0x00,MAX_BUFFER_LEN);
+	}
+	stream_wait_buffer(&p_Dec->io,(byte *)ks->h264Spare);
+	ks->h264Buffer=ks->h264Spare;
+	ks->h264Spare=old;
+
+	if(overlap<0)
+		overlap=0;
+	if(overlap>0)
+		memcpy(ks->h264Buffer,old+(ks->ByteOffset-ks->BufferStart),(size_t)overlap);
+	ks->BufferStart=ks->ByteOffset;
+	ks->read_count=(int)overlap+stream_pread(&p_Dec->io,(byte *)ks->h264Buffer+overlap,MAX_BUFFER_LEN-(int)overlap,ks->ByteOffset+overlap);
+	return ks->read_count;
+}
+
+/*cuts the BitLength key bits at the reader position out of the stream window into a record*/
+static int cut_key_unit(KeyGenState *ks,int64 RelativeByteOff,int BitOffset,int BitLength,char **key)
+{
+	uint8_t s_Keybuf[32]={0x00};
+	uint8_t *s_Keydata=s_Keybuf;
+	int Keydata_Byte_Len=BitLength/8;
+	int Keydata_RemainBit_Len=BitLength%8;
+	int KeyByteLen;
+	int i=0;
+	if(Keydata_RemainBit_Len!=0)
+	{
+		Keydata_Byte_Len++;
+	}
+	if(Keydata_Byte_Len>(int)sizeof(s_Keybuf))
+	{
+		s_Keydata=(uint8_t*)calloc(Keydata_Byte_Len,sizeof(uint8_t));
+	}
+
+	for(i=0;i<Keydata_Byte_Len;i++)
+	{
+		if(i==Keydata_Byte_Len-1&&Keydata_RemainBit_Len!=0)
+		{
+			s_Keydata[i]=bs_read_u(ks->b_read,Keydata_RemainBit_Len);
+			bs_write_u(ks->b_write,Keydata_RemainBit_Len,0);	
+		}
+		else
+		{
+			s_Keydata[i]=bs_read_u(ks->b_read,8);
+			bs_write_u(ks->b_write,8,0);
+		}
+		
+	}
+
+	KeyByteLen=Get_Key_Record(RelativeByteOff,BitOffset,BitLength,s_Keydata,key);
+	if(s_Keydata!=s_Keybuf)
+	{
+		free(s_Keydata);
+	}
+	return KeyByteLen;
+}
+
+/*cuts the key units of g out of the span at the reader position, the bits between them are skipped*/
+static int cut_key_group(KeyGenState *ks,int64 RelativeByteOff,int BitOffset,const KeyGroup *g,char **key)
+{
+	uint8_t *s_Keydata=(uint8_t*)calloc(g->span/8+1,sizeof(uint8_t));
+	bs_t d;
+	int i,n,v,end=0,KeyBits=0,KeyByteLen;
+
+	bs_init(&d,s_Keydata,g->span/8+1);
+	for(i=0;i<g->count;i++)
+	{
+		bs_skip_u(ks->b_read,g->start[i]-end);
+		bs_skip_u(ks->b_write,g->start[i]-end);
+		for(n=g->len[i];n>0;n-=8)
+		{
+			int k=n>8?8:n;
+			v=bs_read_u(ks->b_read,k);
+			bs_write_u(ks->b_write,k,0);
+			bs_write_u(&d,k,v);
+		}
+		end=g->start[i]+g->len[i];
+		KeyBits+=g->len[i];
+	}
+	/*bs_Write_KeyData() takes the bits of an incomplete last byte from its low end*/
+	if(KeyBits%8!=0)
+		s_Keydata[KeyBits/8]>>=8-KeyBits%8;
+
+	KeyByteLen=Get_Key_Group(RelativeByteOff,BitOffset,g,KeyBits,s_Keydata,key);
+	free(s_Keydata);
+	return KeyByteLen;
+}
+
+/*protects one record: BitLength key bits at BitOffset of the byte RelativeByteOff behind the previous record,
+  or with g the key units of g in a span of BitLength bits*/
+static int protect_bits(int64 RelativeByteOff,int BitOffset,int BitLength,int canfree,const KeyGroup *g)
+{
 #if CUT_BIT_LEN
 	if(BitLength>=pow(2,KEY_BIT_LEN_4))
 	{
@@ -331,162 +470,253 @@ int Generate_Key(int RelativeByteOff, int cur_absolute_offset, int BitOffset,int
 
 	int keydata;
 	int ChangedByteNum=0;
-	static bs_t *b_read,*b_write;
+	KeyGenState *ks = &p_Dec->key_gen;	//kept between the calls of one decoder
 	char *key=NULL;
-	static int KeyByteLen;
-	static int RelativeByteOff_Sum=0;
-	static int BufferStart=0;
-	static int read_count=0;
-	static int KeyByteLenSum=0;
-	
-	static char *keyBuffer=NULL;
-	static char *h264Buffer=NULL;
-	static int lastBitLen=0;
-	static int lastBitoffset=0;
-	static int LastByteOffset=0;
-	static int ByteOffset=0;
-	int tmpRelativeByteOff=0;
-	LastByteOffset=ByteOffset;
-	ByteOffset+=RelativeByteOff;
+	int64 tmpRelativeByteOff=0;
+#if (DEC_STATS)
+	int64 t_io;
+#endif
+	ks->LastByteOffset=ks->ByteOffset;
+	ks->ByteOffset+=RelativeByteOff;
 	tmpRelativeByteOff=RelativeByteOff;
 	Generate_Key_Get_Changed_ByteNum(BitLength,BitOffset,&ChangedByteNum);
 	
 	
-	if(LastByteOffset==0)
+	if(ks->LastByteOffset==0)
 	{
 		//if(p_Dec->p_Inp->multi_thread == 1)
-			//ByteOffset=cur_absolute_offset;
+			//ks->ByteOffset=cur_absolute_offset;
 		
-		lseek(p_Dec->BitStreamFile,ByteOffset,SEEK_SET);
-		BufferStart=ByteOffset;
+		STATS_START(t_io);
+		ks->BufferStart=ks->ByteOffset;
 
-		h264Buffer=(char *)malloc(MAX_BUFFER_LEN*sizeof(char));
-		memset(h264Buffer,0x00,MAX_BUFFER_LEN);
+		ks->h264Buffer=(char *)malloc(MAX_BUFFER_LEN*sizeof(char));
+		memset(ks->h264Buffer,0x00,MAX_BUFFER_LEN);
 	
-		read_count=read(p_Dec->BitStreamFile,h264Buffer,MAX_BUFFER_LEN);
+		ks->read_count=stream_pread(&p_Dec->io,(byte *)ks->h264Buffer,MAX_BUFFER_LEN,ks->ByteOffset);
+		STATS_STAGE(STAGE_FILE_WRITE, t_io);
 
-		if(0==read_count)
+		if(0==ks->read_count)
 		{
 			return -1;
 		}
 
-		b_read=bs_new(h264Buffer,MAX_BUFFER_LEN);
-		b_write=bs_new(h264Buffer,MAX_BUFFER_LEN);
+		ks->b_read=bs_new(ks->h264Buffer,MAX_BUFFER_LEN);
+		ks->b_write=bs_new(ks->h264Buffer,MAX_BUFFER_LEN);
 
-		keyBuffer=(char *)malloc(MAX_BUFFER_LEN*sizeof(char));
-		memset(keyBuffer,0x00,MAX_BUFFER_LEN);
+		ks->keyBuffer=(char *)malloc(MAX_BUFFER_LEN*sizeof(char));
+		memset(ks->keyBuffer,0x00,MAX_BUFFER_LEN);
 	}
-	else if(LastByteOffset>0)
+	else if(ks->LastByteOffset>0)
 	{	
-		RelativeByteOff_Sum+=RelativeByteOff;
+		ks->RelativeByteOff_Sum+=RelativeByteOff;
 
-		if(RelativeByteOff_Sum+ChangedByteNum<MAX_BUFFER_LEN)
+		if(ks->RelativeByteOff_Sum+ChangedByteNum<MAX_BUFFER_LEN)
 		{	
-			if(RelativeByteOff*8-lastBitoffset-lastBitLen>=0)
+			if(RelativeByteOff*8-ks->lastBitoffset-ks->lastBitLen>=0)
 			{	
-				bs_skip_u(b_read,RelativeByteOff*8-lastBitoffset-lastBitLen);
-				bs_skip_u(b_write,RelativeByteOff*8-lastBitoffset-lastBitLen);	
+				bs_skip_u(ks->b_read,(int)(RelativeByteOff*8-ks->lastBitoffset-ks->lastBitLen));
+				bs_skip_u(ks->b_write,(int)(RelativeByteOff*8-ks->lastBitoffset-ks->lastBitLen));	
 			}	
 		}		
 		else
 		{
-			lseek(p_Dec->BitStreamFile,BufferStart,SEEK_SET);
-			write(p_Dec->BitStreamFile,h264Buffer,MAX_BUFFER_LEN);
+			STATS_START(t_io);
+			next_window(ks);
+			STATS_STAGE(STAGE_FILE_WRITE, t_io);
 
-			lseek(p_Dec->BitStreamFile,ByteOffset,SEEK_SET);
-			BufferStart=ByteOffset;
-			read_count=read(p_Dec->BitStreamFile,h264Buffer,MAX_BUFFER_LEN);
-
-			if(0==read_count)
+			if(0==ks->read_count)
 			{
 				return -1;
 			}
 			
-			b_read=bs_new(h264Buffer,MAX_BUFFER_LEN);
-			b_write=bs_new(h264Buffer,MAX_BUFFER_LEN);
-			RelativeByteOff_Sum=0;
+			bs_init(ks->b_read,(uint8_t *)ks->h264Buffer,MAX_BUFFER_LEN);
+			bs_init(ks->b_write,(uint8_t *)ks->h264Buffer,MAX_BUFFER_LEN);
+			ks->RelativeByteOff_Sum=0;
 			tmpRelativeByteOff=0;
-			lastBitoffset=0;
-			lastBitLen=0;
+			ks->lastBitoffset=0;
+			ks->lastBitLen=0;
 		}
 	}
 
 	
 	if(canfree)
 	{
-		lseek(p_Dec->BitStreamFile,BufferStart,SEEK_SET);
-		write(p_Dec->BitStreamFile,h264Buffer,read_count);
-		fwrite(keyBuffer,sizeof(char),KeyByteLenSum,p_Dec->p_KeyFile);
-		//int keyfd = fileno(p_Dec->p_KeyFile);
-		//write(keyfd, keyBuffer, KeyByteLenSum);
+		STATS_START(t_io);
+		stream_pwrite(&p_Dec->io,(byte *)ks->h264Buffer,ks->read_count,ks->BufferStart);
+		STATS_STAGE(STAGE_FILE_WRITE, t_io);
+
+		STATS_START(t_io);
+		write_key_data(ks->keyBuffer,ks->KeyByteLenSum);
 		/*write 0x00 to keyfile as end of file*/
-		fputc(0x00,p_Dec->p_KeyFile);		
+		write_key_data("",1);
 
-		fflush(p_Dec->p_KeyFile);
+		if(p_Dec->p_KeyFile && !p_Dec->pipeline)
+			fflush(p_Dec->p_KeyFile);
+		STATS_STAGE(STAGE_KEYFILE_FLUSH, t_io);
 		
 		free(key);
-		free(keyBuffer);
-		free(h264Buffer);
-		free(b_read);
-		free(b_write);
+		free(ks->keyBuffer);
+		free(ks->h264Buffer);
+		stream_wait_buffer(&p_Dec->io,(byte *)ks->h264Spare);
+		free(ks->h264Spare);
+		ks->h264Spare=NULL;
+		free(ks->b_read);
+		free(ks->b_write);
 		return 0;
 	}
 	
 
-	if(tmpRelativeByteOff*8-lastBitoffset-lastBitLen>=0)
+	if(tmpRelativeByteOff*8-ks->lastBitoffset-ks->lastBitLen>=0)
 	{
-		bs_skip_u(b_read,BitOffset);
-		bs_skip_u(b_write,BitOffset);		
+		bs_skip_u(ks->b_read,BitOffset);
+		bs_skip_u(ks->b_write,BitOffset);		
 	}
 	else
 	{
-	    bs_skip_u(b_read,BitOffset-(lastBitoffset+lastBitLen)%8);
-		bs_skip_u(b_write,BitOffset-(lastBitoffset+lastBitLen)%8);	
+	    bs_skip_u(ks->b_read,BitOffset-(ks->lastBitoffset+ks->lastBitLen)%8);
+		bs_skip_u(ks->b_write,BitOffset-(ks->lastBitoffset+ks->lastBitLen)%8);	
 	}
 
-	uint8_t s_Keydata[32]={0x00};
-	int Keydata_Byte_Len=BitLength/8;
-	int Keydata_RemainBit_Len=BitLength%8;
-	int i=0;
-	if(Keydata_RemainBit_Len!=0)
+	if(g)
+		ks->KeyByteLen=cut_key_group(ks,RelativeByteOff,BitOffset,g,&key);
+	else
+		ks->KeyByteLen=cut_key_unit(ks,RelativeByteOff,BitOffset,BitLength,&key);
+
+	ks->lastBitLen=BitLength;
+	ks->lastBitoffset=BitOffset;
+	
+	ks->KeyByteLenSum+=ks->KeyByteLen;
+
+	if(ks->KeyByteLenSum<=MAX_BUFFER_LEN)
 	{
-		Keydata_Byte_Len++;
+		memcpy(ks->keyBuffer+ks->KeyByteLenSum-ks->KeyByteLen,key,ks->KeyByteLen);
 	}
+	else
+	{
+		STATS_START(t_io);
+		write_key_data(ks->keyBuffer,ks->KeyByteLenSum-ks->KeyByteLen);
+		STATS_STAGE(STAGE_KEYFILE_FLUSH, t_io);
+		memset(ks->keyBuffer,0x00,MAX_BUFFER_LEN);
 
-	for(i=0;i<Keydata_Byte_Len;i++)
+		memcpy(ks->keyBuffer,key,ks->KeyByteLen);
+		ks->KeyByteLenSum=ks->KeyByteLen;
+	}
+	free(key);
+	
+	return 0;		
+}
+
+/*adds a key unit to g if it starts less than max_gap bits behind the last one, the span stays within
+  KEY_GROUP_MAX_SPAN and its skip mask entry costs less than a record of its own, which is padded by
+  4 bits on average. RelativeByteOff is relative to the last key unit*/
+static int join_key_group(KeyGroup *g,int64 RelativeByteOff,int BitOffset,int BitLength,int max_gap)
+{
+	int64 byte,start;
+	int ByteOffsetBitNum=0;
+	int MaskBits;
+
+	if(g->count==0||g->count==KEY_GROUP_MAX_UNITS)
 	{
-		if(i==Keydata_Byte_Len-1&&Keydata_RemainBit_Len!=0)
-		{
-			s_Keydata[i]=bs_read_u(b_read,Keydata_RemainBit_Len);
-			bs_write_u(b_write,Keydata_RemainBit_Len,0);	
-		}
-		else
-		{
-			s_Keydata[i]=bs_read_u(b_read,8);
-			bs_write_u(b_write,8,0);
-		}
-		
+		return 0;
 	}
 
-	lastBitLen=BitLength;
-	lastBitoffset=BitOffset;
-	
-	KeyByteLen=Get_Key(RelativeByteOff,BitOffset,BitLength,s_Keydata,&key);
-	KeyByteLenSum+=KeyByteLen;
+	byte=g->last_byte+RelativeByteOff;
+	start=byte*8+BitOffset-g->bit_offset;
+	if(start<g->span||start-g->span>=max_gap||start+BitLength>KEY_GROUP_MAX_SPAN)
+	{
+		return 0;
+	}
 
-	if(KeyByteLenSum<=MAX_BUFFER_LEN)
+	GetNeedBitCount(RelativeByteOff,&ByteOffsetBitNum);
+	MaskBits=ue_bits((int)start-g->span)+ue_bits(BitLength);
+	if(g->count==1)
+		MaskBits+=KEY_BIT_LEN_COUNT+ue_bits(g->len[0]);
+	if(MaskBits>=KEY_BIT_LEN_1+ByteOffsetBitNum+KEY_BIT_LEN_3+KEY_BIT_LEN_4+4)
 	{
-		memcpy(keyBuffer+KeyByteLenSum-KeyByteLen,key,KeyByteLen);
+		return 0;
 	}
+
+	g->last_byte=byte;
+	g->start[g->count]=(int)start;
+	g->len[g->count]=BitLength;
+	g->count++;
+	g->span=(int)start+BitLength;
+	return 1;
+}
+
+/*protects the key units of the group, a single one gets a plain record if its length fits. last_byte stays for the
+  offset of the next group, which is relative to the first key unit of this one*/
+static int write_key_group(KeyGenState *ks)
+{
+	KeyGroup *g=&ks->group;
+	int ret;
+
+	if(g->count==1&&g->len[0]>0&&g->len[0]<(1<<KEY_BIT_LEN_4))
+		ret=protect_bits(g->rel,g->bit_offset,g->len[0],0,NULL);
 	else
+		ret=protect_bits(g->rel,g->bit_offset,g->span,0,g);
+	g->count=0;
+	return ret;
+}
+
+/*protects a key unit. With KeyCoalesce the key units are collected in a group first and
+  protected when the next one is too far away, by Generate_Key_Sync() or at the end.
+  KeyCompress takes the same path, key units of 256 bits or more need the coalesced record*/
+int Generate_Key(int64 RelativeByteOff, int64 cur_absolute_offset, int BitOffset,int BitLength, int canfree)
+{
+	KeyGenState *ks = &p_Dec->key_gen;
+	KeyGroup *g = &ks->group;
+	int ret=0;
+
+	if(Is_Para_Valid(RelativeByteOff,BitOffset,BitLength)<0)
 	{
-		fwrite(keyBuffer,sizeof(char),KeyByteLenSum-KeyByteLen,p_Dec->p_KeyFile);
-		memset(keyBuffer,0x00,MAX_BUFFER_LEN);
+		return -1;
+	}
 
-		memcpy(keyBuffer,key,KeyByteLen);
-		KeyByteLenSum=KeyByteLen;
+	if(p_Dec->p_Inp->key_coalesce==0&&!p_Dec->p_Inp->key_compress)
+	{
+		return protect_bits(RelativeByteOff,BitOffset,BitLength,canfree,NULL);
 	}
-	
-	return 0;		
+
+	if(!canfree&&join_key_group(g,RelativeByteOff,BitOffset,BitLength,p_Dec->p_Inp->key_coalesce))
+	{
+		return 0;
+	}
+	if(g->count>0)
+	{
+		ret=write_key_group(ks);
+	}
+	if(canfree)
+	{
+		return protect_bits(0,0,0,1,NULL);
+	}
+
+	g->rel=g->last_byte+RelativeByteOff;
+	g->bit_offset=BitOffset;
+	g->last_byte=0;
+	g->span=BitLength;
+	g->start[0]=0;
+	g->len[0]=BitLength;
+	g->count=1;
+	return ret;
 }
 
+/*live mode: protects the key units of thread_unit_par and writes the protected bytes and key records through, the key file stays open*/
+void Encrypt_Sync(ThreadUnitPar *thread_unit_par)
+{
+	int i=0;
+	KeyUnit *key_unit_buffer;
+
+	set_current_decoder(thread_unit_par->pDecoder);
+	key_unit_buffer = p_Dec->key_unit_buffer;
+	STATS_TIMER(t_encode);
+
+	for(i=thread_unit_par->buffer_start;i<thread_unit_par->buffer_len;i++)
+	{
+		Generate_Key(key_unit_buffer[i].byte_offset,thread_unit_par->cur_absolute_offset,
+										key_unit_buffer[i].bit_offset,key_unit_buffer[i].key_data_len,0);			
+	}
+	Generate_Key_Sync();
+	STATS_STAGE(STAGE_KEY_ENCODE, t_encode);
+}
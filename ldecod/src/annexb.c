@@ -35,7 +35,7 @@ void malloc_annex_b(VideoParameters *p_Vid, ANNEXB_t **p_annex_b)
 
 void init_annex_b(ANNEXB_t *annex_b)
 {
-  annex_b->BitStreamFile = -1;
+  annex_b->io = NULL;
   annex_b->iobuffer = NULL;
   annex_b->iobufferread = NULL;
   annex_b->bytesinbuffer = 0;
@@ -60,7 +60,7 @@ void free_annex_b(ANNEXB_t **p_annex_b)
 */
 static inline int getChunk(ANNEXB_t *annex_b)
 {
-  unsigned int readbytes = read (annex_b->BitStreamFile, annex_b->iobuffer, annex_b->iIOBufferSize); 
+  int readbytes = stream_next_chunk(annex_b->io, annex_b->iobuffer, annex_b->iIOBufferSize, &annex_b->iobufferread);
   if (0==readbytes)
   {
     annex_b->is_eof = TRUE;
@@ -68,7 +68,6 @@ static inline int getChunk(ANNEXB_t *annex_b)
   }
 
   annex_b->bytesinbuffer = readbytes;
-  annex_b->iobufferread = annex_b->iobuffer;
   return readbytes;
 }
 
@@ -296,6 +295,46 @@ int get_annex_b_NALU (VideoParameters *p_Vid, NALU_t *nalu, ANNEXB_t *annex_b)
 
 }
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Reads the NAL unit of the index entry e at its stream offset instead
+ *    of searching for its start code. nalu->buf and nalu->len are filled
+ *    as by get_annex_b_NALU().
+ *
+ * \return
+ *    size of the start code and the NAL unit, -1 in case of any error
+ ************************************************************************
+ */
+int get_indexed_NALU (NALU_t *nalu, ANNEXB_t *annex_b, const NalIndexEntry *e)
+{
+  if (e->len > (int) nalu->max_size)
+  {
+    printf ("get_indexed_NALU: NAL unit of %d bytes exceeds the buffer, return -1\n", e->len);
+    return -1;
+  }
+  if (stream_read_at(annex_b->io, nalu->buf, e->len, e->pos) != e->len)
+  {
+    printf ("get_indexed_NALU: cannot read the NAL unit at offset %lld, return -1\n", (long long) e->pos);
+    return -1;
+  }
+
+  nalu->startcodeprefix_len = e->sc_len;
+  nalu->len               = e->len;
+  nalu->forbidden_bit     = (*(nalu->buf) >> 7) & 1;
+  nalu->nal_reference_idc = (NalRefIdc) ((*(nalu->buf) >> 5) & 3);
+  nalu->nal_unit_type     = (NaluType) ((*(nalu->buf)) & 0x1f);
+  nalu->lost_packets = 0;
+
+#if TRACE
+  fprintf (p_Dec->p_trace, "\n\nIndexed NALU w/ %s startcode, len %d, forbidden_bit %d, nal_reference_idc %d, nal_unit_type %d\n\n",
+    nalu->startcodeprefix_len == 4?"long":"short", nalu->len, nalu->forbidden_bit, nalu->nal_reference_idc, nalu->nal_unit_type);
+  fflush (p_Dec->p_trace);
+#endif
+
+  return e->sc_len + e->len;
+}
+
 
 
 /*!
@@ -313,7 +352,8 @@ void open_annex_b (char *fn, ANNEXB_t *annex_b)
   {
     error ("open_annex_b: tried to open Annex B file twice",500);
   }
-  if ((annex_b->BitStreamFile = open(fn, O_RDWR)) == -1)
+  annex_b->io = &p_Dec->io;
+  if (stream_io_open(annex_b->io, fn) == -1)
   {
     snprintf (errortext, ET_SIZE, "Cannot open Annex B ByteStream file '%s'", fn);
     error(errortext,500);
@@ -327,10 +367,6 @@ void open_annex_b (char *fn, ANNEXB_t *annex_b)
     error ("open_annex_b: cannot allocate IO buffer",500);
   }
 
-	p_Dec->BitStreamFile = annex_b->BitStreamFile;
-	p_Dec->BitStreamFileLen = lseek(annex_b->BitStreamFile, 0, 2);
-	lseek(annex_b->BitStreamFile,0,0);
-	
   annex_b->is_eof = FALSE;
   getChunk(annex_b);
 }
@@ -344,10 +380,10 @@ void open_annex_b (char *fn, ANNEXB_t *annex_b)
  */
 void close_annex_b(ANNEXB_t *annex_b)
 {
-  if (annex_b->BitStreamFile != -1)
+  if (annex_b->io != NULL)
   {
-    close(annex_b->BitStreamFile);
-    annex_b->BitStreamFile = - 1;
+    stream_io_close(annex_b->io);
+    annex_b->io = NULL;
   }
   free (annex_b->iobuffer);
   annex_b->iobuffer = NULL;
@@ -0,0 +1,455 @@
+/*!
+ *************************************************************************************
+ * \file async_io.c
+ *
+ * \brief
+ *    Asynchronous file reads and writes on an io_uring or a worker thread
+ *
+ *************************************************************************************
+ */
+
+#include <pthread.h>
+#include <errno.h>
+
+#include "global.h"
+#include "async_io.h"
+#include "memalloc.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define USE_IO_URING 1
+#endif
+#endif
+
+#ifdef USE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+typedef struct async_req
+{
+  int           in_use;      //!< submitted and not yet waited for, only touched by the owner
+  int           done;        //!< transfer finished, the worker sets it under aio->lock
+  int           write;
+  byte         *buf;
+  int           size;
+  int64         offset;
+  int           result;      //!< bytes transferred, -errno if the request failed
+#ifdef USE_IO_URING
+  struct iovec  iov;
+#endif
+} AsyncReq;
+
+#ifdef USE_IO_URING
+typedef struct async_ring
+{
+  int                  fd;
+  void                *sq_ptr;
+  size_t               sq_size;
+  void                *cq_ptr;
+  size_t               cq_size;
+  struct io_uring_sqe *sqes;
+  size_t               sqes_size;
+  unsigned            *sq_tail;
+  unsigned            *sq_mask;
+  unsigned            *sq_array;
+  unsigned            *cq_head;
+  unsigned            *cq_tail;
+  unsigned            *cq_mask;
+  struct io_uring_cqe *cqes;
+} AsyncRing;
+#endif
+
+struct async_io
+{
+  int             fd;
+  int             depth;
+  int             backend;   //!< ASYNC_IO_URING or ASYNC_IO_THREAD
+  AsyncReq       *req;
+#ifdef USE_IO_URING
+  AsyncRing       ring;
+#endif
+  // worker thread
+  pthread_t       thread;
+  pthread_mutex_t lock;
+  pthread_cond_t  work;
+  pthread_cond_t  done;
+  int            *queue;     //!< tags in submission order
+  int             q_head;
+  int             q_count;
+  int             stop;
+};
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Blocking transfer of size bytes, continued after short transfers
+ * \return
+ *    bytes transferred, less than size at the end of the file or on error
+ ************************************************************************
+ */
+static int transfer(int fd, int write, byte *buf, int size, int64 offset)
+{
+  int done = 0;
+
+#ifdef _WIN32
+  // no positioned I/O, async_io_open() never starts a worker
+  return 0;
+#else
+  while (done < size)
+  {
+    ssize_t n = write ? pwrite(fd, buf + done, size - done, (off_t) (offset + done))
+                      : pread (fd, buf + done, size - done, (off_t) (offset + done));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    done += (int) n;
+  }
+  return done;
+#endif
+}
+
+static void *async_worker(void *arg)
+{
+  AsyncIO *aio = (AsyncIO *) arg;
+
+  pthread_mutex_lock(&aio->lock);
+  for (;;)
+  {
+    AsyncReq *r;
+    int tag;
+
+    while (aio->q_count == 0 && !aio->stop)
+      pthread_cond_wait(&aio->work, &aio->lock);
+    if (aio->q_count == 0)
+      break;
+    tag = aio->queue[aio->q_head];
+    aio->q_head = (aio->q_head + 1) % aio->depth;
+    aio->q_count--;
+    r = &aio->req[tag];
+    pthread_mutex_unlock(&aio->lock);
+
+    r->result = transfer(aio->fd, r->write, r->buf, r->size, r->offset);
+
+    pthread_mutex_lock(&aio->lock);
+    r->done = 1;
+    pthread_cond_broadcast(&aio->done);
+  }
+  pthread_mutex_unlock(&aio->lock);
+  return NULL;
+}
+
+static int start_worker(AsyncIO *aio)
+{
+  if ((aio->queue = calloc(aio->depth, sizeof(int))) == NULL)
+    return -1;
+  pthread_mutex_init(&aio->lock, NULL);
+  pthread_cond_init(&aio->work, NULL);
+  pthread_cond_init(&aio->done, NULL);
+  if (pthread_create(&aio->thread, NULL, async_worker, aio) != 0)
+  {
+    pthread_mutex_destroy(&aio->lock);
+    pthread_cond_destroy(&aio->work);
+    pthread_cond_destroy(&aio->done);
+    return -1;
+  }
+  aio->backend = ASYNC_IO_THREAD;
+  return 0;
+}
+
+#ifdef USE_IO_URING
+static void ring_unmap(AsyncRing *ring)
+{
+  if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+    munmap(ring->sqes, ring->sqes_size);
+  if (ring->cq_ptr != NULL && ring->cq_ptr != MAP_FAILED)
+    munmap(ring->cq_ptr, ring->cq_size);
+  if (ring->sq_ptr != NULL && ring->sq_ptr != MAP_FAILED)
+    munmap(ring->sq_ptr, ring->sq_size);
+  if (ring->fd >= 0)
+    close(ring->fd);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Sets up an io_uring with room for depth requests
+ * \return
+ *    0 on success, -1 if the kernel does not provide one
+ ************************************************************************
+ */
+static int ring_setup(AsyncRing *ring, int depth)
+{
+  struct io_uring_params p;
+
+  memset(ring, 0, sizeof(AsyncRing));
+  memset(&p, 0, sizeof(p));
+  if ((ring->fd = (int) syscall(__NR_io_uring_setup, depth, &p)) < 0)
+    return -1;
+
+  ring->sq_size   = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  ring->cq_size   = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+  ring->sqes   = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sq_ptr == MAP_FAILED || ring->cq_ptr == MAP_FAILED || ring->sqes == MAP_FAILED)
+  {
+    ring_unmap(ring);
+    return -1;
+  }
+
+  ring->sq_tail  = (unsigned *) ((char *) ring->sq_ptr + p.sq_off.tail);
+  ring->sq_mask  = (unsigned *) ((char *) ring->sq_ptr + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned *) ((char *) ring->sq_ptr + p.sq_off.array);
+  ring->cq_head  = (unsigned *) ((char *) ring->cq_ptr + p.cq_off.head);
+  ring->cq_tail  = (unsigned *) ((char *) ring->cq_ptr + p.cq_off.tail);
+  ring->cq_mask  = (unsigned *) ((char *) ring->cq_ptr + p.cq_off.ring_mask);
+  ring->cqes     = (struct io_uring_cqe *) ((char *) ring->cq_ptr + p.cq_off.cqes);
+  return 0;
+}
+
+static int ring_enter(AsyncRing *ring, unsigned submit, unsigned wait)
+{
+  int ret;
+
+  do
+  {
+    ret = (int) syscall(__NR_io_uring_enter, ring->fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+  } while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+  return ret;
+}
+
+static int ring_submit(AsyncIO *aio, int tag)
+{
+  AsyncRing *ring = &aio->ring;
+  AsyncReq *r = &aio->req[tag];
+  unsigned tail = *ring->sq_tail;
+  unsigned idx = tail & *ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[idx];
+
+  r->iov.iov_base = r->buf;
+  r->iov.iov_len  = r->size;
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  sqe->opcode    = r->write ? IORING_OP_WRITEV : IORING_OP_READV;
+  sqe->fd        = aio->fd;
+  sqe->addr      = (unsigned long) &r->iov;
+  sqe->len       = 1;
+  sqe->off       = (unsigned long long) r->offset;
+  sqe->user_data = (unsigned long long) tag;
+  ring->sq_array[idx] = idx;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  if (ring_enter(ring, 1, 0) == 1)
+    return 0;
+  // not consumed, the kernel only looks at the queue in io_uring_enter()
+  __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+  return -1;
+}
+
+static void ring_reap(AsyncIO *aio)
+{
+  AsyncRing *ring = &aio->ring;
+  unsigned head = *ring->cq_head;
+  unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+  for (; head != tail; head++)
+  {
+    struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+    AsyncReq *r = &aio->req[cqe->user_data];
+
+    r->result = cqe->res;
+    r->done   = 1;
+  }
+  __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+#endif
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Opens an instance for up to depth requests in flight on fd
+ * \return
+ *    the instance, NULL if mode is ASYNC_IO_OFF or neither backend works
+ ************************************************************************
+ */
+AsyncIO *async_io_open(int fd, int depth, int mode)
+{
+  AsyncIO *aio;
+
+#ifdef _WIN32
+  return NULL;
+#endif
+  if (mode == ASYNC_IO_OFF || fd < 0)
+    return NULL;
+  if ((aio = calloc(1, sizeof(AsyncIO))) == NULL)
+    no_mem_exit("async_io_open: aio");
+  aio->fd    = fd;
+  aio->depth = imax(depth, 1);
+  if ((aio->req = calloc(aio->depth, sizeof(AsyncReq))) == NULL)
+    no_mem_exit("async_io_open: req");
+
+#ifdef USE_IO_URING
+  aio->ring.fd = -1;
+  if (mode == ASYNC_IO_URING && ring_setup(&aio->ring, aio->depth) == 0)
+  {
+    aio->backend = ASYNC_IO_URING;
+    return aio;
+  }
+#endif
+  if (start_worker(aio) != 0)
+  {
+    free(aio->queue);
+    free(aio->req);
+    free(aio);
+    return NULL;
+  }
+  return aio;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Waits for all requests and frees the instance
+ ************************************************************************
+ */
+void async_io_close(AsyncIO *aio)
+{
+  int i;
+
+  if (aio == NULL)
+    return;
+  for (i = 0; i < aio->depth; i++)
+  {
+    if (aio->req[i].in_use)
+      async_io_wait(aio, i);
+  }
+
+  if (aio->backend == ASYNC_IO_THREAD)
+  {
+    pthread_mutex_lock(&aio->lock);
+    aio->stop = 1;
+    pthread_cond_signal(&aio->work);
+    pthread_mutex_unlock(&aio->lock);
+    pthread_join(aio->thread, NULL);
+    pthread_mutex_destroy(&aio->lock);
+    pthread_cond_destroy(&aio->work);
+    pthread_cond_destroy(&aio->done);
+  }
+#ifdef USE_IO_URING
+  else
+    ring_unmap(&aio->ring);
+#endif
+  free(aio->queue);
+  free(aio->req);
+  free(aio);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Starts reading (write = 0) or writing size bytes of buf at offset.
+ *    buf must not be touched until the request has been waited for.
+ * \return
+ *    tag of the request, -1 if depth requests are in flight already
+ ************************************************************************
+ */
+int async_io_submit(AsyncIO *aio, int write, byte *buf, int size, int64 offset)
+{
+  AsyncReq *r;
+  int tag;
+
+  for (tag = 0; tag < aio->depth && aio->req[tag].in_use; tag++)
+    ;
+  if (tag == aio->depth)
+    return -1;
+
+  r = &aio->req[tag];
+  r->write  = write;
+  r->buf    = buf;
+  r->size   = size;
+  r->offset = offset;
+  r->result = 0;
+  r->done   = 0;
+  r->in_use = 1;
+
+#ifdef USE_IO_URING
+  if (aio->backend == ASYNC_IO_URING)
+  {
+    if (ring_submit(aio, tag) != 0)
+    {
+      // the ring refused it, done right away
+      r->result = transfer(aio->fd, write, buf, size, offset);
+      r->done   = 1;
+    }
+    return tag;
+  }
+#endif
+
+  pthread_mutex_lock(&aio->lock);
+  aio->queue[(aio->q_head + aio->q_count) % aio->depth] = tag;
+  aio->q_count++;
+  pthread_cond_signal(&aio->work);
+  pthread_mutex_unlock(&aio->lock);
+  return tag;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Waits for the request tag and releases it. A short transfer before
+ *    the end of the file is completed with blocking I/O.
+ * \return
+ *    bytes transferred
+ ************************************************************************
+ */
+int async_io_wait(AsyncIO *aio, int tag)
+{
+  AsyncReq *r = &aio->req[tag];
+  int n;
+
+  if (!r->in_use)
+    return 0;
+
+#ifdef USE_IO_URING
+  if (aio->backend == ASYNC_IO_URING)
+  {
+    ring_reap(aio);
+    while (!r->done)
+    {
+      if (ring_enter(&aio->ring, 0, 1) < 0)
+      {
+        // nothing more can complete, the request is repeated below
+        r->result = -EIO;
+        break;
+      }
+      ring_reap(aio);
+    }
+  }
+  else
+#endif
+  {
+    pthread_mutex_lock(&aio->lock);
+    while (!r->done)
+      pthread_cond_wait(&aio->done, &aio->lock);
+    pthread_mutex_unlock(&aio->lock);
+  }
+
+  n = r->result;
+  if (n < 0)
+    n = transfer(aio->fd, r->write, r->buf, r->size, r->offset);
+  else if (n > 0 && n < r->size)
+    n += transfer(aio->fd, r->write, r->buf + n, r->size - n, r->offset + n);
+  r->in_use = 0;
+  return n;
+}
+
+const char *async_io_backend(const AsyncIO *aio)
+{
+  if (aio == NULL)
+    return "blocking";
+  return aio->backend == ASYNC_IO_URING ? "io_uring" : "thread";
+}
@@ -0,0 +1,994 @@
+/*!
+ *************************************************************************************
+ * \file batch.c
+ *
+ * \brief
+ *    Batch mode: work stealing scheduler for the clips of a manifest, GOP
+ *    splitting of large clips and the joint report
+ *
+ *************************************************************************************
+ */
+
+#include <pthread.h>
+
+#include "global.h"
+#include "h264decoder.h"
+#include "nalucommon.h"
+#include "key_common.h"
+#include "dec_stats.h"
+#include "memalloc.h"
+#include "batch.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define BATCH_LINE_SIZE   (3 * FILE_NAME_SIZE + 16)
+
+typedef enum
+{
+  TASK_CLIP = 0,      //!< load a clip, parse it whole or split it into segments
+  TASK_SEGMENT,       //!< parse one segment of a split clip
+  TASK_PROTECT        //!< protect a split clip with the key units of all segments
+} BatchTaskType;
+
+typedef struct batch_clip BatchClip;
+
+typedef struct batch_task
+{
+  BatchTaskType  type;
+  BatchClip     *clip;
+  int            seg;
+} BatchTask;
+
+//! one GOP aligned piece of a split clip
+typedef struct batch_segment
+{
+  int64      start;          //!< file offset of the first byte
+  int64      end;
+  int        first_nal;      //!< first entry of the clip index in the segment
+  int        last_nal;       //!< first entry after the segment
+  int        prefix_len;     //!< parameter sets put in front of the segment
+  byte      *prefix;
+  KeyUnit   *unit;           //!< key units, the first byte_offset is relative to the start of prefix
+  int        count;
+  int64      first_pos;      //!< file offset of the first key unit
+  int64      last_pos;       //!< file offset of the last key unit
+} BatchSegment;
+
+struct batch_clip
+{
+  char           input[FILE_NAME_SIZE];
+  char           output[FILE_NAME_SIZE];
+  char           key[FILE_NAME_SIZE];
+  byte          *data;
+  int64          size;
+  NalIndex       index;      //!< NAL units of data, empty if the clip is not indexed
+  BatchSegment  *seg;
+  int            segments;
+  int            segments_left;
+  int            failed;
+  int64          key_units;
+  int64          parse_us;
+  int64          protect_us;
+  pthread_mutex_t lock;
+#if (DEC_STATS)
+  DecStats       stats;
+#endif
+};
+
+//! tasks of one worker, the owner works at the tail, thieves at the head
+typedef struct batch_deque
+{
+  pthread_mutex_t lock;
+  BatchTask      *task;
+  int             head;
+  int             tail;
+  int             size;
+} BatchDeque;
+
+typedef struct batch_pool
+{
+  InputParameters *p_Inp;
+  BatchDeque      *deque;
+  int              workers;
+  int64            split_size;
+  pthread_mutex_t  lock;
+  pthread_cond_t   wake;
+  int              pending;  //!< tasks queued or running
+  unsigned int     pushed;   //!< tasks pushed so far, a sleeping worker waits for a change
+} BatchPool;
+
+typedef struct batch_worker
+{
+  BatchPool *pool;
+  int        id;
+} BatchWorker;
+
+//! destination of the protected stream and the key records of a clip
+typedef struct batch_sink
+{
+  FILE *stream;
+  FILE *key;
+} BatchSink;
+
+static int write_stream_file(void *opaque, const byte *buf, int size)
+{
+  return (int) fwrite(buf, 1, size, ((BatchSink *) opaque)->stream);
+}
+
+static int write_key_file(void *opaque, const byte *buf, int size)
+{
+  return (int) fwrite(buf, 1, size, ((BatchSink *) opaque)->key);
+}
+
+//! the key records of a segment are not written, segments are protected together
+static int write_key_none(void *opaque, const byte *buf, int size)
+{
+  return size;
+}
+
+static int cpu_count(void)
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+
+  GetSystemInfo(&info);
+  return (int) info.dwNumberOfProcessors;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+  return n > 0 ? (int) n : 1;
+#endif
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Queues a task on the deque of worker id
+ ************************************************************************
+ */
+static void push_task(BatchPool *pool, int id, BatchTaskType type, BatchClip *clip, int seg)
+{
+  BatchDeque *d = &pool->deque[id];
+
+  pthread_mutex_lock(&pool->lock);
+  pool->pending++;
+  pthread_mutex_unlock(&pool->lock);
+
+  pthread_mutex_lock(&d->lock);
+  if (d->tail == d->size)
+  {
+    if (d->head > 0)
+    {
+      memmove(d->task, d->task + d->head, (d->tail - d->head) * sizeof(BatchTask));
+      d->tail -= d->head;
+      d->head  = 0;
+    }
+    else
+    {
+      int size = d->size ? 2 * d->size : 64;
+      BatchTask *task = realloc(d->task, size * sizeof(BatchTask));
+
+      if (task == NULL)
+        no_mem_exit("push_task: task");
+      d->task = task;
+      d->size = size;
+    }
+  }
+  d->task[d->tail].type = type;
+  d->task[d->tail].clip = clip;
+  d->task[d->tail].seg  = seg;
+  d->tail++;
+  pthread_mutex_unlock(&d->lock);
+
+  pthread_mutex_lock(&pool->lock);
+  pool->pushed++;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Takes the newest task of the own deque or, if it is empty, the
+ *    oldest task of another deque
+ * \return
+ *    1 if a task was found, 0 otherwise
+ ************************************************************************
+ */
+static int take_task(BatchPool *pool, int id, BatchTask *task)
+{
+  BatchDeque *d = &pool->deque[id];
+  int i, found = 0;
+
+  pthread_mutex_lock(&d->lock);
+  if (d->tail > d->head)
+  {
+    *task = d->task[--d->tail];
+    found = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+
+  for (i = 1; !found && i < pool->workers; i++)
+  {
+    d = &pool->deque[(id + i) % pool->workers];
+    pthread_mutex_lock(&d->lock);
+    if (d->tail > d->head)
+    {
+      *task = d->task[d->head++];
+      found = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+  }
+
+  return found;
+}
+
+static int load_file(const char *fn, byte **data, int64 *size)
+{
+  FILE *f = fopen(fn, "rb");
+  int64 len;
+
+  *data = NULL;
+  *size = 0;
+  if (f == NULL)
+    return -1;
+  fseek(f, 0, SEEK_END);
+  len = (int64) ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (len < 0 || (*data = malloc((size_t) (len > 0 ? len : 1))) == NULL)
+  {
+    fclose(f);
+    return -1;
+  }
+  if ((int64) fread(*data, 1, (size_t) len, f) != len)
+  {
+    fclose(f);
+    free(*data);
+    *data = NULL;
+    return -1;
+  }
+  fclose(f);
+  *size = len;
+  return 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Input parameters of the decoder instances of a clip: all clips use
+ *    the configuration, the key generation runs in the worker thread
+ ************************************************************************
+ */
+static void clip_params(BatchPool *pool, BatchClip *clip, InputParameters *inp)
+{
+  memcpy(inp, pool->p_Inp, sizeof(InputParameters));
+  strncpy(inp->infile, clip->input, FILE_NAME_SIZE - 1);
+  inp->infile[FILE_NAME_SIZE - 1] = '\0';
+  inp->multi_thread   = 0;
+  inp->stream_lag     = 0;
+  inp->pipeline       = 0;
+  inp->silent         = 1;
+  inp->batch_manifest[0] = '\0';
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Parses image with a new decoder instance
+ * \return
+ *    the instance, NULL if it cannot be opened or the bitstream is broken
+ ************************************************************************
+ */
+static DecoderParams *parse_image(BatchPool *pool, BatchClip *clip, byte *image, int64 size, const NalIndex *index, StreamOutput *out)
+{
+  InputParameters inp;
+  StreamInput in;
+  DecoderParams *pDecoder;
+  int iRet;
+#if (DEC_STATS)
+  int64 t_parse = dec_stats_now();
+#endif
+
+  clip_params(pool, clip, &inp);
+  memset(&in, 0, sizeof(StreamInput));
+  in.data  = image;
+  in.size  = size;
+  in.index = (index != NULL && index->count > 0) ? index : NULL;
+
+  if (OpenDecoderIO(&inp, &in, out, &pDecoder) != DEC_OPEN_NOERR)
+    return NULL;
+  do
+  {
+    iRet = DecodeOneFrame(pDecoder);
+  } while (iRet == DEC_SUCCEED);
+
+  if (iRet != DEC_EOS)
+  {
+    fprintf(stderr, "%s: error in decoding process: 0x%x\n", clip->input, iRet);
+    CloseDecoder(pDecoder);
+    return NULL;
+  }
+#if (DEC_STATS)
+  pDecoder->stats.phase_time[PHASE_PARSE] += dec_stats_now() - t_parse;
+#endif
+  return pDecoder;
+}
+
+static void release_clip(BatchClip *clip)
+{
+  free(clip->data);
+  clip->data = NULL;
+  nal_index_free(&clip->index);
+}
+
+static void close_instance(BatchClip *clip, DecoderParams *pDecoder)
+{
+#if (DEC_STATS)
+  pthread_mutex_lock(&clip->lock);
+  dec_stats_merge(&clip->stats, &pDecoder->stats);
+  pthread_mutex_unlock(&clip->lock);
+#endif
+  FinitDecoder(pDecoder);
+  CloseDecoder(pDecoder);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Opens the output and key file of a clip
+ ************************************************************************
+ */
+static int open_sink(BatchClip *clip, BatchSink *sink, StreamOutput *out)
+{
+  sink->stream = fopen(clip->output, "wb");
+  sink->key    = fopen(clip->key, "w");
+  if (sink->stream == NULL || sink->key == NULL)
+  {
+    fprintf(stderr, "%s: cannot open %s\n", clip->input, sink->stream == NULL ? clip->output : clip->key);
+    if (sink->stream)
+      fclose(sink->stream);
+    if (sink->key)
+      fclose(sink->key);
+    return -1;
+  }
+  out->write_stream = write_stream_file;
+  out->write_key    = write_key_file;
+  out->opaque       = sink;
+  return 0;
+}
+
+static int close_sink(BatchSink *sink)
+{
+  int ret = 0;
+
+  if (fclose(sink->stream) != 0)
+    ret = -1;
+  if (fclose(sink->key) != 0)
+    ret = -1;
+  return ret;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Protects the key units of pDecoder and writes the clip
+ ************************************************************************
+ */
+static void protect_clip(BatchClip *clip, DecoderParams *pDecoder, BatchSink *sink)
+{
+  TIME_T start, end;
+
+  gettime(&start);
+  clip->key_units = pDecoder->key_unit_idx;
+  if (EncryptStream(pDecoder) != DEC_GEN_NOERR)
+    clip->failed = 1;
+#if (DEC_STATS)
+  gettime(&end);
+  pDecoder->stats.phase_time[PHASE_ENCRYPT] += timediff(&start, &end) * 1000;
+#endif
+  close_instance(clip, pDecoder);
+  if (close_sink(sink) != 0)
+    clip->failed = 1;
+  gettime(&end);
+  clip->protect_us += timediff(&start, &end);
+
+  release_clip(clip);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Indexes the NAL units of a loaded clip. With NalIndex the sidecar of
+ *    the input is used if it is valid and written otherwise, the input
+ *    is never modified in batch mode.
+ ************************************************************************
+ */
+static void index_clip(BatchPool *pool, BatchClip *clip)
+{
+  int ret = pool->p_Inp->use_nal_index ? nal_index_load(&clip->index, clip->input) : -1;
+
+  if (ret == 0 && clip->index.file_size == clip->size)
+    return;
+
+  nal_index_free(&clip->index);
+  nal_index_scan(&clip->index, clip->data, clip->size);
+  if (ret >= 0 && nal_index_key(&clip->index, clip->input) == 0 && clip->index.file_size == clip->size)
+  {
+    if (nal_index_save(&clip->index, clip->input) != 0)
+      fprintf(stderr, "%s: cannot write the NAL unit index\n", clip->input);
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Splits an indexed clip into segments of at least split_size bytes.
+ *    A segment starts with the access unit of an IDR picture that follows
+ *    another picture, and gets the SPS and PPS seen before it as prefix.
+ *    The last copy of equal parameter sets is kept.
+ * \return
+ *    number of segments, 1 if the clip is not split
+ ************************************************************************
+ */
+static int split_clip(BatchClip *clip, int64 split_size)
+{
+  const NalIndex *idx = &clip->index;
+  int *param = NULL;                     // entries of the parameter sets
+  int params = 0, param_size = 0;
+  int prev_vcl = 0;                      // a picture was seen
+  int seg_size = 0;
+  int64 seg_start = 0;
+  int i, j, k;
+
+  clip->seg = NULL;
+  clip->segments = 0;
+
+  for (k = 0; k < idx->count; k++)
+  {
+    const NalIndexEntry *e = &idx->nal[k];
+    int64 cut = e->pos - e->sc_len;
+    int type = e->header & 0x1f;
+
+    if ((e->flags & NAL_INDEX_IDR_AU) && prev_vcl && cut - seg_start >= split_size)
+    {
+      BatchSegment *s;
+
+      if (clip->segments + 1 >= seg_size)
+      {
+        int size = seg_size ? 2 * seg_size : 16;
+
+        if ((clip->seg = realloc(clip->seg, size * sizeof(BatchSegment))) == NULL)
+          no_mem_exit("split_clip: seg");
+        memset(clip->seg + seg_size, 0, (size - seg_size) * sizeof(BatchSegment));
+        seg_size = size;
+      }
+      s = &clip->seg[clip->segments];
+      s->end      = cut;
+      s->last_nal = k;
+      clip->segments++;
+
+      // parameter sets of the next segment, those of its first access
+      // unit are part of the segment
+      s++;
+      s->start     = cut;
+      s->first_nal = k;
+      for (i = 0; i < params; i++)
+        s->prefix_len += 4 + idx->nal[param[i]].len;
+      if (s->prefix_len > 0 && (s->prefix = malloc(s->prefix_len)) == NULL)
+        no_mem_exit("split_clip: prefix");
+      for (i = 0, j = 0; i < params; i++)
+      {
+        const NalIndexEntry *ps = &idx->nal[param[i]];
+
+        s->prefix[j++] = 0;
+        s->prefix[j++] = 0;
+        s->prefix[j++] = 0;
+        s->prefix[j++] = 1;
+        memcpy(s->prefix + j, clip->data + ps->pos, ps->len);
+        j += ps->len;
+      }
+      seg_start = cut;
+    }
+
+    if (type >= NALU_TYPE_SLICE && type <= NALU_TYPE_IDR)
+    {
+      prev_vcl = 1;
+    }
+    else if (type == NALU_TYPE_SPS || type == NALU_TYPE_PPS)
+    {
+      for (i = 0; i < params; i++)
+      {
+        const NalIndexEntry *ps = &idx->nal[param[i]];
+
+        if (ps->len == e->len && !memcmp(clip->data + ps->pos, clip->data + e->pos, e->len))
+        {
+          memmove(param + i, param + i + 1, (params - i - 1) * sizeof(int));
+          params--;
+          break;
+        }
+      }
+      if (params == param_size)
+      {
+        param_size = param_size ? 2 * param_size : 16;
+        if ((param = realloc(param, param_size * sizeof(int))) == NULL)
+          no_mem_exit("split_clip: param");
+      }
+      param[params++] = k;
+    }
+  }
+  free(param);
+
+  if (clip->segments == 0)
+  {
+    free(clip->seg);
+    clip->seg = NULL;
+    return 1;
+  }
+  clip->seg[clip->segments].end      = clip->size;
+  clip->seg[clip->segments].last_nal = idx->count;
+  clip->segments++;
+  return clip->segments;
+}
+
+static void free_segments(BatchClip *clip)
+{
+  int i;
+
+  for (i = 0; i < clip->segments; i++)
+  {
+    free(clip->seg[i].prefix);
+    free(clip->seg[i].unit);
+  }
+  free(clip->seg);
+  clip->seg = NULL;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Loads a clip and protects it whole, or queues its segments
+ ************************************************************************
+ */
+static void run_clip(BatchPool *pool, int id, BatchClip *clip)
+{
+  DecoderParams *pDecoder;
+  StreamOutput out;
+  BatchSink sink;
+  TIME_T start, end;
+  int i;
+
+  if (load_file(clip->input, &clip->data, &clip->size) != 0)
+  {
+    fprintf(stderr, "%s: cannot read the bitstream\n", clip->input);
+    clip->failed = 1;
+    return;
+  }
+
+  if (pool->p_Inp->use_nal_index || clip->size > pool->split_size)
+    index_clip(pool, clip);
+
+  if (clip->size > pool->split_size && split_clip(clip, pool->split_size) > 1)
+  {
+    clip->segments_left = clip->segments;
+    for (i = clip->segments - 1; i >= 0; i--)
+      push_task(pool, id, TASK_SEGMENT, clip, i);
+    return;
+  }
+
+  memset(&out, 0, sizeof(StreamOutput));
+  if (open_sink(clip, &sink, &out) != 0)
+  {
+    clip->failed = 1;
+    release_clip(clip);
+    return;
+  }
+
+  gettime(&start);
+  pDecoder = parse_image(pool, clip, clip->data, clip->size, &clip->index, &out);
+  gettime(&end);
+  clip->parse_us += timediff(&start, &end);
+  if (pDecoder == NULL)
+  {
+    clip->failed = 1;
+    close_sink(&sink);
+    release_clip(clip);
+    return;
+  }
+  protect_clip(clip, pDecoder, &sink);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Parses one segment of a split clip and keeps its key units. The
+ *    last segment to finish queues the protection of the clip.
+ ************************************************************************
+ */
+static void run_segment(BatchPool *pool, int id, BatchClip *clip, int seg)
+{
+  BatchSegment *s = &clip->seg[seg];
+  DecoderParams *pDecoder;
+  StreamOutput out;
+  NalIndex index;
+  TIME_T start, end;
+  int64 len = s->end - s->start;
+  byte *image;
+  int last, i;
+
+  gettime(&start);
+  if ((image = malloc((size_t) (s->prefix_len + len))) == NULL)
+    no_mem_exit("run_segment: image");
+  if (s->prefix_len > 0)
+    memcpy(image, s->prefix, s->prefix_len);
+  memcpy(image + s->prefix_len, clip->data + s->start, (size_t) len);
+
+  // index of the image: the prefix, then the entries of the segment
+  nal_index_init(&index);
+  nal_index_scan(&index, image, s->prefix_len);
+  nal_index_copy(&index, &clip->index, s->first_nal, s->last_nal, s->prefix_len - s->start);
+
+  memset(&out, 0, sizeof(StreamOutput));
+  out.write_key = write_key_none;
+  pDecoder = parse_image(pool, clip, image, s->prefix_len + len, &index, &out);
+  if (pDecoder != NULL)
+  {
+    s->count = pDecoder->key_unit_idx;
+    if (s->count > 0)
+    {
+      if ((s->unit = malloc(s->count * sizeof(KeyUnit))) == NULL)
+        no_mem_exit("run_segment: unit");
+      memcpy(s->unit, pDecoder->key_unit_buffer, s->count * sizeof(KeyUnit));
+
+      // key unit positions in the image -> positions in the clip
+      s->first_pos = s->unit[0].byte_offset;
+      s->last_pos  = s->first_pos;
+      for (i = 1; i < s->count; i++)
+        s->last_pos += s->unit[i].byte_offset;
+      s->first_pos += s->start - s->prefix_len;
+      s->last_pos  += s->start - s->prefix_len;
+    }
+    close_instance(clip, pDecoder);
+  }
+  nal_index_free(&index);
+  free(image);
+  gettime(&end);
+
+  pthread_mutex_lock(&clip->lock);
+  if (pDecoder == NULL)
+    clip->failed = 1;
+  clip->parse_us += timediff(&start, &end);
+  last = (--clip->segments_left == 0);
+  pthread_mutex_unlock(&clip->lock);
+
+  if (last)
+    push_task(pool, id, TASK_PROTECT, clip, 0);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Protects a split clip with the key units of all its segments
+ ************************************************************************
+ */
+static void run_protect(BatchPool *pool, BatchClip *clip)
+{
+  InputParameters inp;
+  DecoderParams *pDecoder;
+  StreamInput in;
+  StreamOutput out;
+  BatchSink sink;
+  int64 prev = 0;
+  int i, j;
+
+  if (!clip->failed)
+  {
+    memset(&out, 0, sizeof(StreamOutput));
+    if (open_sink(clip, &sink, &out) != 0)
+      clip->failed = 1;
+  }
+  if (clip->failed)
+  {
+    free_segments(clip);
+    release_clip(clip);
+    return;
+  }
+
+  clip_params(pool, clip, &inp);
+  memset(&in, 0, sizeof(StreamInput));
+  in.data = clip->data;
+  in.size = clip->size;
+  if (OpenDecoderIO(&inp, &in, &out, &pDecoder) != DEC_OPEN_NOERR)
+  {
+    clip->failed = 1;
+    close_sink(&sink);
+    free_segments(clip);
+    release_clip(clip);
+    return;
+  }
+
+  if (inp.enable_key)
+  {
+    for (i = 0; i < clip->segments; i++)
+    {
+      BatchSegment *s = &clip->seg[i];
+
+      if (s->count == 0)
+        continue;
+      add_KeyUnit(s->first_pos - prev, s->unit[0].bit_offset, s->unit[0].key_data_len);
+      for (j = 1; j < s->count; j++)
+        add_KeyUnit(s->unit[j].byte_offset, s->unit[j].bit_offset, s->unit[j].key_data_len);
+      prev = s->last_pos;
+    }
+  }
+  free_segments(clip);
+  protect_clip(clip, pDecoder, &sink);
+}
+
+static void *batch_worker(void *arg)
+{
+  BatchWorker *w = (BatchWorker *) arg;
+  BatchPool *pool = w->pool;
+  BatchTask task;
+  unsigned int pushed;
+
+  for (;;)
+  {
+    pthread_mutex_lock(&pool->lock);
+    pushed = pool->pushed;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (take_task(pool, w->id, &task))
+    {
+      switch (task.type)
+      {
+      case TASK_CLIP:
+        run_clip(pool, w->id, task.clip);
+        break;
+      case TASK_SEGMENT:
+        run_segment(pool, w->id, task.clip, task.seg);
+        break;
+      case TASK_PROTECT:
+        run_protect(pool, task.clip);
+        break;
+      }
+      pthread_mutex_lock(&pool->lock);
+      if (--pool->pending == 0)
+        pthread_cond_broadcast(&pool->wake);
+      pthread_mutex_unlock(&pool->lock);
+      continue;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0 && pool->pushed == pushed)
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    if (pool->pending == 0)
+    {
+      pthread_mutex_unlock(&pool->lock);
+      break;
+    }
+    pthread_mutex_unlock(&pool->lock);
+  }
+  return NULL;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Reads the manifest
+ * \return
+ *    number of clips, -1 if the manifest cannot be read
+ ************************************************************************
+ */
+static int read_manifest(const char *fn, BatchClip **clips)
+{
+  FILE *f = fopen(fn, "r");
+  char line[BATCH_LINE_SIZE];
+  int num = 0, size = 0;
+
+  *clips = NULL;
+  if (f == NULL)
+    return -1;
+
+  while (fgets(line, sizeof(line), f) != NULL)
+  {
+    char *p = line;
+    BatchClip *clip;
+
+    while (*p == ' ' || *p == '\t')
+      p++;
+    if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0')
+      continue;
+
+    if (num == size)
+    {
+      size = size ? 2 * size : 16;
+      if ((*clips = realloc(*clips, size * sizeof(BatchClip))) == NULL)
+        no_mem_exit("read_manifest: clips");
+    }
+    clip = &(*clips)[num];
+    memset(clip, 0, sizeof(BatchClip));
+    if (sscanf(p, "%255s %255s %255s", clip->input, clip->output, clip->key) != 3)
+    {
+      fprintf(stderr, "%s: expected \"input output key\": %s", fn, line);
+      continue;
+    }
+    pthread_mutex_init(&clip->lock, NULL);
+    num++;
+  }
+  fclose(f);
+  return num;
+}
+
+static void write_json_string(FILE *f, const char *str)
+{
+  fputc('"', f);
+  for (; *str; str++)
+  {
+    if (*str == '"' || *str == '\\')
+      fputc('\\', f);
+    fputc(*str, f);
+  }
+  fputc('"', f);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Writes the per-clip results and their sums as JSON to filename, or
+ *    to stdout if filename is empty
+ ************************************************************************
+ */
+static void write_report(BatchPool *pool, BatchClip *clips, int num, int64 wall_us, const char *filename)
+{
+  FILE *f = stdout;
+  int64 bytes = 0, key_units = 0, parse_us = 0, protect_us = 0;
+  int failed = 0;
+  int i;
+
+  if (filename != NULL && *filename != '\0')
+  {
+    if ((f = fopen(filename, "w")) == NULL)
+    {
+      fprintf(stderr, "run_batch: cannot open %s\n", filename);
+      return;
+    }
+  }
+
+  fprintf(f, "{\n  \"manifest\": ");
+  write_json_string(f, pool->p_Inp->batch_manifest);
+  fprintf(f, ",\n  \"threads\": %d,\n  \"wall_us\": %lld,\n  \"files\": [", pool->workers, (long long) wall_us);
+  for (i = 0; i < num; i++)
+  {
+    BatchClip *c = &clips[i];
+
+    fprintf(f, "%s\n    { \"input\": ", i ? "," : "");
+    write_json_string(f, c->input);
+    fprintf(f, ", \"output\": ");
+    write_json_string(f, c->output);
+    fprintf(f, ", \"key\": ");
+    write_json_string(f, c->key);
+    fprintf(f, ",\n      \"status\": \"%s\", \"bytes\": %lld, \"segments\": %d, \"key_units\": %lld, \"parse_us\": %lld, \"protect_us\": %lld }",
+      c->failed ? "failed" : "ok", (long long) c->size, imax(c->segments, 1), (long long) c->key_units,
+      (long long) c->parse_us, (long long) c->protect_us);
+
+    failed     += c->failed;
+    bytes      += c->size;
+    key_units  += c->key_units;
+    parse_us   += c->parse_us;
+    protect_us += c->protect_us;
+  }
+  fprintf(f, "%s  ],\n", num ? "\n" : "");
+  fprintf(f, "  \"totals\": { \"clips\": %d, \"failed\": %d, \"bytes\": %lld, \"key_units\": %lld, \"parse_us\": %lld, \"protect_us\": %lld }\n}\n",
+    num, failed, (long long) bytes, (long long) key_units, (long long) parse_us, (long long) protect_us);
+
+  if (f != stdout)
+    fclose(f);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Protects all clips of the manifest p_Inp->batch_manifest
+ * \return
+ *    0 if all clips were protected, -1 otherwise
+ ************************************************************************
+ */
+int run_batch(InputParameters *p_Inp)
+{
+  BatchPool pool;
+  BatchClip *clips;
+  BatchWorker *worker;
+  pthread_t *thread;
+  TIME_T start, end;
+  int num, failed = 0;
+  int i;
+
+  num = read_manifest(p_Inp->batch_manifest, &clips);
+  if (num < 0)
+  {
+    fprintf(stderr, "run_batch: cannot read the manifest %s\n", p_Inp->batch_manifest);
+    return -1;
+  }
+
+#ifdef __GLIBC__
+  // every decoder instance callocs frame sized buffers of several MB. Once
+  // such a buffer is freed glibc raises its mmap threshold and serves the
+  // next ones from the heap, where calloc has to clear them.
+  mallopt(M_MMAP_THRESHOLD, 1024 * 1024);
+#endif
+
+  memset(&pool, 0, sizeof(BatchPool));
+  pool.p_Inp      = p_Inp;
+  pool.workers    = p_Inp->batch_threads > 0 ? p_Inp->batch_threads : cpu_count();
+  pool.split_size = (int64) imax(p_Inp->batch_split_mb, 1) * 1024 * 1024;
+  // FrameInterval and ProtectFraction count pictures from the start of the
+  // clip, a segment decoder would restart the count
+  if (p_Inp->FrameInvl > 1 || p_Inp->protect_fraction > 0.0)
+    pool.split_size = INT64_MAX;
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init(&pool.wake, NULL);
+
+  pool.deque = calloc(pool.workers, sizeof(BatchDeque));
+  worker     = calloc(pool.workers, sizeof(BatchWorker));
+  thread     = calloc(pool.workers, sizeof(pthread_t));
+  if (pool.deque == NULL || worker == NULL || thread == NULL)
+    no_mem_exit("run_batch: pool");
+  for (i = 0; i < pool.workers; i++)
+  {
+    pthread_mutex_init(&pool.deque[i].lock, NULL);
+    worker[i].pool = &pool;
+    worker[i].id   = i;
+  }
+  for (i = 0; i < num; i++)
+    push_task(&pool, i % pool.workers, TASK_CLIP, &clips[i], 0);
+
+  gettime(&start);
+  for (i = 0; i < pool.workers; i++)
+  {
+    if (pthread_create(&thread[i], NULL, batch_worker, &worker[i]) != 0)
+    {
+      fprintf(stderr, "run_batch: cannot create worker %d\n", i);
+      exit(1);
+    }
+  }
+  for (i = 0; i < pool.workers; i++)
+    pthread_join(thread[i], NULL);
+  gettime(&end);
+
+  write_report(&pool, clips, num, timediff(&start, &end), p_Inp->batch_report);
+
+#if (DEC_STATS)
+  {
+    DecStats total;
+
+    memset(&total, 0, sizeof(DecStats));
+    for (i = 0; i < num; i++)
+      dec_stats_merge(&total, &clips[i].stats);
+    dec_stats_report(&total, p_Inp->batch_manifest, p_Inp->stats_file);
+  }
+#endif
+
+  for (i = 0; i < num; i++)
+  {
+    failed += clips[i].failed;
+    pthread_mutex_destroy(&clips[i].lock);
+  }
+  for (i = 0; i < pool.workers; i++)
+  {
+    free(pool.deque[i].task);
+    pthread_mutex_destroy(&pool.deque[i].lock);
+  }
+  pthread_mutex_destroy(&pool.lock);
+  pthread_cond_destroy(&pool.wake);
+  free(pool.deque);
+  free(worker);
+  free(thread);
+  free(clips);
+
+  return failed ? -1 : 0;
+}
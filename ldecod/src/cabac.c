@@ -20,12 +20,12 @@
 #include "mb_access.h"
 #include "vlc.h"
 
+#define MVD_CTX_MAX   33   //!< |mvd| above 32 selects the last mvd context on its own
+
 #if TRACE
 int symbolCount = 0;	//¼﷨Ԫصĸ
 #endif
 
-int s_cur_mvd_bitpos;
-
 static const short maxpos       [] = {15, 14, 63, 31, 31, 15,  3, 14,  7, 15, 15, 14, 63, 31, 31, 15, 15, 14, 63, 31, 31, 15};
 static const short c1isdc       [] = { 1,  0,  1,  1,  1,  1,  1,  0,  1,  1,  1,  0,  1,  1,  1,  1,  1,  0,  1,  1,  1,  1};
 static const short type2ctx_bcbp[] = { 0,  1,  2,  3,  3,  4,  5,  6,  5,  5, 10, 11, 12, 13, 13, 14, 16, 17, 18, 19, 19, 20};
@@ -159,23 +159,26 @@ void readFieldModeInfo_CABAC(Macroblock *currMB,
 }
 
 
-int check_next_mb_and_get_field_mode_CABAC_p_slice( Slice *currSlice,
-                                           SyntaxElement *se,                                           
-                                           DataPartition  *act_dp)
+//! engine and context state the skip/field lookahead of the bottom MB of an MBAFF pair changes
+typedef struct mbaff_lookahead
 {
-  VideoParameters *p_Vid = currSlice->p_Vid;
-  BiContextTypePtr          mb_type_ctx_copy[3];
-  BiContextTypePtr          mb_aff_ctx_copy;
-  DecodingEnvironmentPtr    dep_dp_copy;
-  MotionInfoContexts *mot_ctx  = currSlice->mot_ctx;  
-
-  int length;
-  DecodingEnvironmentPtr    dep_dp = &(act_dp->de_cabac);
-
-  int skip   = 0;
-  int field  = 0;
-  int i;
+  DecodingEnvironment dep;
+  int                 code_len;
+  BiContextType       skip_ctx[3];                  //!< mb_skip_flag contexts of the slice type
+  BiContextType       field_ctx[NUM_MB_AFF_CTX];
+} MbaffLookahead;
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Sets up the bottom MB of the current pair for the lookahead and
+ *    saves the state that reading its skip and field flags changes.
+ *    skip_ctx are the mb_skip_flag contexts of the slice type.
+ ************************************************************************
+ */
+static Macroblock *start_mbaff_lookahead(Slice *currSlice, DecodingEnvironmentPtr dep_dp, BiContextType *skip_ctx, MbaffLookahead *la)
+{
+  VideoParameters *p_Vid = currSlice->p_Vid;
   Macroblock *currMB;
 
   //get next MB
@@ -192,24 +195,53 @@ int check_next_mb_and_get_field_mode_CABAC_p_slice( Slice *currSlice,
   CheckAvailabilityOfNeighborsMBAFF(currMB);
   CheckAvailabilityOfNeighborsCABAC(currMB);
 
-  //create
-  dep_dp_copy = (DecodingEnvironmentPtr) calloc(1, sizeof(DecodingEnvironment) );
-  for (i=0;i<3;++i)
-    mb_type_ctx_copy[i] = (BiContextTypePtr) calloc(NUM_MB_TYPE_CTX, sizeof(BiContextType) );
-  mb_aff_ctx_copy = (BiContextTypePtr) calloc(NUM_MB_AFF_CTX, sizeof(BiContextType) );
-
   //copy
-  memcpy(dep_dp_copy,dep_dp,sizeof(DecodingEnvironment));
-  length = *(dep_dp_copy->Dcodestrm_len) = *(dep_dp->Dcodestrm_len);
-  for (i=0;i<3;++i)
-    memcpy(mb_type_ctx_copy[i], mot_ctx->mb_type_contexts[i],NUM_MB_TYPE_CTX*sizeof(BiContextType) );
-  memcpy(mb_aff_ctx_copy, mot_ctx->mb_aff_contexts,NUM_MB_AFF_CTX*sizeof(BiContextType) );
+  la->dep      = *dep_dp;
+  la->code_len = *(dep_dp->Dcodestrm_len);
+  memcpy(la->skip_ctx, skip_ctx, sizeof(la->skip_ctx));
+  memcpy(la->field_ctx, currSlice->mot_ctx->mb_aff_contexts, sizeof(la->field_ctx));
+
+  currSlice->last_dquant = 0;
+  return currMB;
+}
+
+static void end_mbaff_lookahead(Slice *currSlice, Macroblock *currMB, DecodingEnvironmentPtr dep_dp, BiContextType *skip_ctx, MbaffLookahead *la)
+{
+  //reset
+  currSlice->current_mb_nr--;
+
+  *dep_dp = la->dep;
+  *(dep_dp->Dcodestrm_len) = la->code_len;
+  memcpy(skip_ctx, la->skip_ctx, sizeof(la->skip_ctx));
+  memcpy(currSlice->mot_ctx->mb_aff_contexts, la->field_ctx, sizeof(la->field_ctx));
+
+  CheckAvailabilityOfNeighborsCABAC(currMB);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Reads the skip flag and, if not skipped, the field flag of the
+ *    bottom MB of the current pair ahead of time. The field flag is
+ *    taken over by the top MB, everything else is undone.
+ * \return
+ *    1 if the bottom MB is skipped
+ ************************************************************************
+ */
+int check_next_mb_and_get_field_mode_CABAC_p_slice( Slice *currSlice,
+                                           SyntaxElement *se,                                           
+                                           DataPartition  *act_dp)
+{
+  DecodingEnvironmentPtr dep_dp = &(act_dp->de_cabac);
+  BiContextType *skip_ctx = &currSlice->mot_ctx->mb_type_contexts[1][0];
+  MbaffLookahead la;
+  Macroblock *currMB = start_mbaff_lookahead(currSlice, dep_dp, skip_ctx, &la);
+  int skip;
 
   //check_next_mb
 #if TRACE
   strncpy(se->tracestring, "mb_skip_flag (of following bottom MB)", TRACESTRING_SIZE);
 #endif
-  currSlice->last_dquant = 0;
   read_skip_flag_CABAC_p_slice(currMB, se, dep_dp);
 
   skip = (se->value1==0);
@@ -220,27 +252,10 @@ int check_next_mb_and_get_field_mode_CABAC_p_slice( Slice *currSlice,
     strncpy(se->tracestring, "mb_field_decoding_flag (of following bottom MB)", TRACESTRING_SIZE);
 #endif
     readFieldModeInfo_CABAC( currMB, se,dep_dp);
-    field = se->value1;
-    currSlice->mb_data[currSlice->current_mb_nr-1].mb_field = field;
+    currSlice->mb_data[currSlice->current_mb_nr-1].mb_field = se->value1;
   }
 
-  //reset
-  currSlice->current_mb_nr--;
-
-  memcpy(dep_dp,dep_dp_copy,sizeof(DecodingEnvironment));
-  *(dep_dp->Dcodestrm_len) = length;
-  for (i=0;i<3;++i)
-    memcpy(mot_ctx->mb_type_contexts[i],mb_type_ctx_copy[i], NUM_MB_TYPE_CTX*sizeof(BiContextType) );
-  memcpy( mot_ctx->mb_aff_contexts,mb_aff_ctx_copy,NUM_MB_AFF_CTX*sizeof(BiContextType) );
-
-  CheckAvailabilityOfNeighborsCABAC(currMB);
-
-  //delete
-  free(dep_dp_copy);
-  for (i=0;i<3;++i)
-    free(mb_type_ctx_copy[i]);
-  free(mb_aff_ctx_copy);
-
+  end_mbaff_lookahead(currSlice, currMB, dep_dp, skip_ctx, &la);
   return skip;
 }
 
@@ -248,55 +263,16 @@ int check_next_mb_and_get_field_mode_CABAC_b_slice( Slice *currSlice,
                                            SyntaxElement *se,                                           
                                            DataPartition  *act_dp)
 {
-  VideoParameters *p_Vid = currSlice->p_Vid;
-  BiContextTypePtr          mb_type_ctx_copy[3];
-  BiContextTypePtr          mb_aff_ctx_copy;
-  DecodingEnvironmentPtr    dep_dp_copy;
-
-  int length;
-  DecodingEnvironmentPtr    dep_dp = &(act_dp->de_cabac);
-  MotionInfoContexts  *mot_ctx = currSlice->mot_ctx;
-
-  int skip   = 0;
-  int field  = 0;
-  int i;
-
-  Macroblock *currMB;
-
-  //get next MB
-  ++currSlice->current_mb_nr; // ++p_Vid->current_mb_nr;
-  
-  currMB = &currSlice->mb_data[currSlice->current_mb_nr];
-  currMB->p_Vid    = p_Vid;
-  currMB->p_Slice  = currSlice; 
-  currMB->slice_nr = currSlice->current_slice_nr;
-  currMB->mb_field = currSlice->mb_data[currSlice->current_mb_nr-1].mb_field;
-  currMB->mbAddrX  = currSlice->current_mb_nr;
-  currMB->list_offset = ((currSlice->mb_aff_frame_flag)&&(currMB->mb_field))? (currMB->mbAddrX & 0x01) ? 4 : 2 : 0;
-
-  CheckAvailabilityOfNeighborsMBAFF(currMB);
-  CheckAvailabilityOfNeighborsCABAC(currMB);
-
-  //create
-  dep_dp_copy = (DecodingEnvironmentPtr) calloc(1, sizeof(DecodingEnvironment) );
-  for (i=0;i<3;++i)
-    mb_type_ctx_copy[i] = (BiContextTypePtr) calloc(NUM_MB_TYPE_CTX, sizeof(BiContextType) );
-  mb_aff_ctx_copy = (BiContextTypePtr) calloc(NUM_MB_AFF_CTX, sizeof(BiContextType) );
-
-  //copy
-  memcpy(dep_dp_copy,dep_dp,sizeof(DecodingEnvironment));
-  length = *(dep_dp_copy->Dcodestrm_len) = *(dep_dp->Dcodestrm_len);
-
-  for (i=0;i<3;++i)
-    memcpy(mb_type_ctx_copy[i], mot_ctx->mb_type_contexts[i],NUM_MB_TYPE_CTX*sizeof(BiContextType) );
-
-  memcpy(mb_aff_ctx_copy, mot_ctx->mb_aff_contexts,NUM_MB_AFF_CTX*sizeof(BiContextType) );
+  DecodingEnvironmentPtr dep_dp = &(act_dp->de_cabac);
+  BiContextType *skip_ctx = &currSlice->mot_ctx->mb_type_contexts[2][7];
+  MbaffLookahead la;
+  Macroblock *currMB = start_mbaff_lookahead(currSlice, dep_dp, skip_ctx, &la);
+  int skip;
 
   //check_next_mb
 #if TRACE
   strncpy(se->tracestring, "mb_skip_flag (of following bottom MB)", TRACESTRING_SIZE);
 #endif
-  currSlice->last_dquant = 0;
   read_skip_flag_CABAC_b_slice(currMB, se, dep_dp);
 
   skip = (se->value1==0 && se->value2==0);
@@ -306,30 +282,141 @@ int check_next_mb_and_get_field_mode_CABAC_b_slice( Slice *currSlice,
     strncpy(se->tracestring, "mb_field_decoding_flag (of following bottom MB)", TRACESTRING_SIZE);
 #endif
     readFieldModeInfo_CABAC( currMB, se,dep_dp);
-    field = se->value1;
-    currSlice->mb_data[currSlice->current_mb_nr-1].mb_field = field;
+    currSlice->mb_data[currSlice->current_mb_nr-1].mb_field = se->value1;
   }
 
-  //reset
-  currSlice->current_mb_nr--;
+  end_mbaff_lookahead(currSlice, currMB, dep_dp, skip_ctx, &la);
+  return skip;
+}
 
-  memcpy(dep_dp,dep_dp_copy,sizeof(DecodingEnvironment));
-  *(dep_dp->Dcodestrm_len) = length;
-  
-  for (i=0;i<3;++i)
-    memcpy(mot_ctx->mb_type_contexts[i],mb_type_ctx_copy[i], NUM_MB_TYPE_CTX * sizeof(BiContextType) );
+//! |mvd| kept for the context selection, larger values select the same context
+static inline byte mvd_ctx_clip(int mvd)
+{
+  return (byte) imin(iabs(mvd), MVD_CTX_MAX);
+}
 
-  memcpy( mot_ctx->mb_aff_contexts, mb_aff_ctx_copy, NUM_MB_AFF_CTX * sizeof(BiContextType) );
+/*!
+ ************************************************************************
+ * \brief
+ *    Loads the absolute mvds of the left and top neighbour 4x4 blocks
+ *    of the current MB, the mvd context selection reads them instead of
+ *    deriving the neighbours per mvd component
+ ************************************************************************
+ */
+void load_mvd_ctx(Macroblock *currMB)
+{
+  VideoParameters *p_Vid = currMB->p_Vid;
+  int list, y, x, k;
 
-  CheckAvailabilityOfNeighborsCABAC(currMB);
+  if (currMB->mbAvailA)
+  {
+    MbContext *left = get_mb_ctx(p_Vid, currMB->mbAddrA);
 
-  //delete
-  free(dep_dp_copy);
-  for (i=0;i<3;++i)
-    free(mb_type_ctx_copy[i]);
-  free(mb_aff_ctx_copy);
+    for (list = 0; list < 2; ++list)
+      for (y = 0; y < BLOCK_MULTIPLE; ++y)
+        for (k = 0; k < 2; ++k)
+          currMB->mvd_ctx_a[list][y][k] = mvd_ctx_clip(left->mvd[list][y][BLOCK_MULTIPLE - 1][k]);
+  }
+  else
+    memset(currMB->mvd_ctx_a, 0, sizeof(currMB->mvd_ctx_a));
 
-  return skip;
+  if (currMB->mbAvailB)
+  {
+    MbContext *up = get_mb_ctx(p_Vid, currMB->mbAddrB);
+
+    for (list = 0; list < 2; ++list)
+      for (x = 0; x < BLOCK_MULTIPLE; ++x)
+        for (k = 0; k < 2; ++k)
+          currMB->mvd_ctx_b[list][x][k] = mvd_ctx_clip(up->mvd[list][BLOCK_MULTIPLE - 1][x][k]);
+  }
+  else
+    memset(currMB->mvd_ctx_b, 0, sizeof(currMB->mvd_ctx_b));
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    load_mvd_ctx() for MBAFF frames: every row of the left neighbour
+ *    is derived on its own, vertical mvds of a neighbour in the other
+ *    field/frame mode are scaled
+ ************************************************************************
+ */
+void load_mvd_ctx_mbaff(Macroblock *currMB)
+{
+  VideoParameters *p_Vid = currMB->p_Vid;
+  Slice *currSlice = currMB->p_Slice;
+  PixelPos block;
+  int list, y, x, k;
+
+  for (y = 0; y < BLOCK_MULTIPLE; ++y)
+  {
+    get4x4NeighbourBase(currMB, -1, y << 2, p_Vid->mb_size[IS_LUMA], &block);
+    for (list = 0; list < 2; ++list)
+    {
+      for (k = 0; k < 2; ++k)
+      {
+        int a = 0;
+
+        if (block.available)
+        {
+          a = iabs(get_mb_ctx(p_Vid, block.mb_addr)->mvd[list][block.y][block.x][k]);
+          if (k == 1)
+          {
+            if ((currMB->mb_field == 0) && (currSlice->mb_data[block.mb_addr].mb_field == 1))
+              a *= 2;
+            else if ((currMB->mb_field == 1) && (currSlice->mb_data[block.mb_addr].mb_field == 0))
+              a /= 2;
+          }
+        }
+        currMB->mvd_ctx_a[list][y][k] = mvd_ctx_clip(a);
+      }
+    }
+  }
+
+  // all columns have the same top neighbour MB and row
+  get4x4NeighbourBase(currMB, 0, -1, p_Vid->mb_size[IS_LUMA], &block);
+  for (list = 0; list < 2; ++list)
+  {
+    for (x = 0; x < BLOCK_MULTIPLE; ++x)
+    {
+      for (k = 0; k < 2; ++k)
+      {
+        int b = 0;
+
+        if (block.available)
+        {
+          b = iabs(get_mb_ctx(p_Vid, block.mb_addr)->mvd[list][block.y][x][k]);
+          if (k == 1)
+          {
+            if ((currMB->mb_field == 0) && (currSlice->mb_data[block.mb_addr].mb_field == 1))
+              b *= 2;
+            else if ((currMB->mb_field == 1) && (currSlice->mb_data[block.mb_addr].mb_field == 0))
+              b /= 2;
+          }
+        }
+        currMB->mvd_ctx_b[list][x][k] = mvd_ctx_clip(b);
+      }
+    }
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Sum of the absolute mvds of the left and top neighbour 4x4 blocks,
+ *    taken from the current MB inside of it and from the cache of
+ *    load_mvd_ctx() at its edges
+ ************************************************************************
+ */
+static inline int mvd_ctx_sum(Macroblock *currMB, int list_idx, int k)
+{
+  int i = currMB->subblock_x >> 2;
+  int j = currMB->subblock_y >> 2;
+  short (*mvd)[BLOCK_MULTIPLE][2] = currMB->ctx->mvd[list_idx];
+  int a = (i > 0) ? iabs(mvd[j][i - 1][k]) : currMB->mvd_ctx_a[list_idx][j][k];
+  int b = (j > 0) ? iabs(mvd[j - 1][i][k]) : currMB->mvd_ctx_b[list_idx][i][k];
+
+  return a + b;
 }
 
 /*!
@@ -343,31 +430,13 @@ void read_MVD_CABAC( Macroblock *currMB,
                     SyntaxElement *se,
                     DecodingEnvironmentPtr dep_dp)
 {  
-  int *mb_size = currMB->p_Vid->mb_size[IS_LUMA];
   Slice *currSlice = currMB->p_Slice;
   MotionInfoContexts *ctx = currSlice->mot_ctx;
-  int i = currMB->subblock_x;
-  int j = currMB->subblock_y;
-  int a = 0;
   //int act_ctx;
   int act_sym;  
   int list_idx = se->value2 & 0x01;
   int k = (se->value2 >> 1); // MVD component
-
-  PixelPos block_a, block_b;
-
-  get4x4NeighbourBase(currMB, i - 1, j    , mb_size, &block_a);
-  get4x4NeighbourBase(currMB, i    , j - 1, mb_size, &block_b);
-  if (block_a.available)
-  {
-    a = iabs(currSlice->mb_data[block_a.mb_addr].mvd[list_idx][block_a.y][block_a.x][k]);
-  }
-  if (block_b.available)
-  {
-    a += iabs(currSlice->mb_data[block_b.mb_addr].mvd[list_idx][block_b.y][block_b.x][k]);
-  }
-
-  //a += b;
+  int a = mvd_ctx_sum(currMB, list_idx, k);
 
   if (a < 3)
     a = 5 * k;
@@ -408,45 +477,14 @@ void read_mvd_CABAC_mbaff( Macroblock *currMB,
                     SyntaxElement *se,
                     DecodingEnvironmentPtr dep_dp)
 {
-  VideoParameters *p_Vid = currMB->p_Vid;
   Slice *currSlice = currMB->p_Slice;
   MotionInfoContexts *ctx = currSlice->mot_ctx;
-  int i = currMB->subblock_x;
-  int j = currMB->subblock_y;
-  int a = 0, b = 0;
   int act_ctx;
   int act_sym;  
   int list_idx = se->value2 & 0x01;
   int k = (se->value2 >> 1); // MVD component
-
-  PixelPos block_a, block_b;
-
-  get4x4NeighbourBase(currMB, i - 1, j    , p_Vid->mb_size[IS_LUMA], &block_a);
-  if (block_a.available)
-  {
-    a = iabs(currSlice->mb_data[block_a.mb_addr].mvd[list_idx][block_a.y][block_a.x][k]);
-    if (currSlice->mb_aff_frame_flag && (k==1))
-    {
-      if ((currMB->mb_field==0) && (currSlice->mb_data[block_a.mb_addr].mb_field==1))
-        a *= 2;
-      else if ((currMB->mb_field==1) && (currSlice->mb_data[block_a.mb_addr].mb_field==0))
-        a /= 2;
-    }
-  }
-
-  get4x4NeighbourBase(currMB, i    , j - 1, p_Vid->mb_size[IS_LUMA], &block_b);
-  if (block_b.available)
-  {
-    b = iabs(currSlice->mb_data[block_b.mb_addr].mvd[list_idx][block_b.y][block_b.x][k]);
-    if (currSlice->mb_aff_frame_flag && (k==1))
-    {
-      if ((currMB->mb_field==0) && (currSlice->mb_data[block_b.mb_addr].mb_field==1))
-        b *= 2;
-      else if ((currMB->mb_field==1) && (currSlice->mb_data[block_b.mb_addr].mb_field==0))
-        b /= 2;
-    }
-  }
-  a += b;
+  // the neighbours in the other field/frame mode are scaled by load_mvd_ctx_mbaff()
+  int a = mvd_ctx_sum(currMB, list_idx, k);
 
   if (a < 3)
     act_ctx = 5 * k;
@@ -1076,7 +1114,6 @@ void readRefFrame_CABAC(Macroblock *currMB,
 {
   Slice *currSlice = currMB->p_Slice;
   VideoParameters *p_Vid = currMB->p_Vid;
-  StorablePicture *dec_picture = currSlice->dec_picture;
   MotionInfoContexts *ctx = currSlice->mot_ctx;
   Macroblock *neighborMB = NULL;
 
@@ -1098,9 +1135,9 @@ void readRefFrame_CABAC(Macroblock *currMB,
     if (!( (neighborMB->mb_type==IPCM) || IS_DIRECT(neighborMB) || (neighborMB->b8mode[b8b]==0 && neighborMB->b8pdir[b8b]==2)))
     {
       if (currSlice->mb_aff_frame_flag && (currMB->mb_field == FALSE) && (neighborMB->mb_field == TRUE))
-        b = (dec_picture->mv_info[block_b.pos_y][block_b.pos_x].ref_idx[list] > 1 ? 2 : 0);
+        b = (get_mb_ctx(p_Vid, block_b.mb_addr)->ref_idx[list][b8b] > 1 ? 2 : 0);
       else
-        b = (dec_picture->mv_info[block_b.pos_y][block_b.pos_x].ref_idx[list] > 0 ? 2 : 0);
+        b = (get_mb_ctx(p_Vid, block_b.mb_addr)->ref_idx[list][b8b] > 0 ? 2 : 0);
     }
   }
 
@@ -1111,9 +1148,9 @@ void readRefFrame_CABAC(Macroblock *currMB,
     if (!((neighborMB->mb_type==IPCM) || IS_DIRECT(neighborMB) || (neighborMB->b8mode[b8a]==0 && neighborMB->b8pdir[b8a]==2)))
     {
       if (currSlice->mb_aff_frame_flag && (currMB->mb_field == FALSE) && (neighborMB->mb_field == 1))
-        a = (dec_picture->mv_info[block_a.pos_y][block_a.pos_x].ref_idx[list] > 1 ? 1 : 0);
+        a = (get_mb_ctx(p_Vid, block_a.mb_addr)->ref_idx[list][b8a] > 1 ? 1 : 0);
       else
-        a = (dec_picture->mv_info[block_a.pos_y][block_a.pos_x].ref_idx[list] > 0 ? 1 : 0);
+        a = (get_mb_ctx(p_Vid, block_a.mb_addr)->ref_idx[list][b8a] > 0 ? 1 : 0);
     }
   }
 
@@ -1418,7 +1455,7 @@ static int read_and_store_CBP_block_bit_444 (Macroblock              *currMB,
         if(mb_data[block_b.mb_addr].mb_type==IPCM)
           upper_bit=1;
         else
-          upper_bit = get_bit(mb_data[block_b.mb_addr].s_cbp[0].bits, bit + bit_pos_b);
+          upper_bit = get_bit(get_mb_ctx(p_Vid, block_b.mb_addr)->cbp_bits[0], bit + bit_pos_b);
       }
             
       if (block_a.available)
@@ -1426,7 +1463,7 @@ static int read_and_store_CBP_block_bit_444 (Macroblock              *currMB,
         if(mb_data[block_a.mb_addr].mb_type==IPCM)
           left_bit=1;
         else
-          left_bit = get_bit(mb_data[block_a.mb_addr].s_cbp[0].bits, bit + bit_pos_a);
+          left_bit = get_bit(get_mb_ctx(p_Vid, block_a.mb_addr)->cbp_bits[0], bit + bit_pos_a);
       }
       
       
@@ -1445,7 +1482,7 @@ static int read_and_store_CBP_block_bit_444 (Macroblock              *currMB,
         if(mb_data[block_b.mb_addr].mb_type==IPCM)
           upper_bit = 1;
         else
-          upper_bit = get_bit(mb_data[block_b.mb_addr].s_cbp[0].bits,bit+bit_pos_b);
+          upper_bit = get_bit(get_mb_ctx(p_Vid, block_b.mb_addr)->cbp_bits[0],bit+bit_pos_b);
       }
       
       
@@ -1454,7 +1491,7 @@ static int read_and_store_CBP_block_bit_444 (Macroblock              *currMB,
         if(mb_data[block_a.mb_addr].mb_type==IPCM)
           left_bit = 1;
         else
-          left_bit = get_bit(mb_data[block_a.mb_addr].s_cbp[0].bits,bit+bit_pos_a);
+          left_bit = get_bit(get_mb_ctx(p_Vid, block_a.mb_addr)->cbp_bits[0],bit+bit_pos_a);
       }
       
       
@@ -1479,17 +1516,17 @@ static int read_and_store_CBP_block_bit_444 (Macroblock              *currMB,
       else
       {
         if(type==LUMA_8x8)
-          upper_bit = get_bit(mb_data[block_b.mb_addr].s_cbp[0].bits_8x8, bit + bit_pos_b);
+          upper_bit = get_bit(get_mb_ctx(p_Vid, block_b.mb_addr)->cbp_bits_8x8[0], bit + bit_pos_b);
         else if (type==CB_8x8)
-          upper_bit = get_bit(mb_data[block_b.mb_addr].s_cbp[1].bits_8x8, bit + bit_pos_b);
+          upper_bit = get_bit(get_mb_ctx(p_Vid, block_b.mb_addr)->cbp_bits_8x8[1], bit + bit_pos_b);
         else if (type==CR_8x8)
-          upper_bit = get_bit(mb_data[block_b.mb_addr].s_cbp[2].bits_8x8, bit + bit_pos_b);
+          upper_bit = get_bit(get_mb_ctx(p_Vid, block_b.mb_addr)->cbp_bits_8x8[2], bit + bit_pos_b);
         else if ((type==CB_4x4)||(type==CB_4x8)||(type==CB_8x4)||(type==CB_16AC)||(type==CB_16DC))
-          upper_bit = get_bit(mb_data[block_b.mb_addr].s_cbp[1].bits,bit+bit_pos_b);
+          upper_bit = get_bit(get_mb_ctx(p_Vid, block_b.mb_addr)->cbp_bits[1],bit+bit_pos_b);
         else if ((type==CR_4x4)||(type==CR_4x8)||(type==CR_8x4)||(type==CR_16AC)||(type==CR_16DC))
-          upper_bit = get_bit(mb_data[block_b.mb_addr].s_cbp[2].bits,bit+bit_pos_b);
+          upper_bit = get_bit(get_mb_ctx(p_Vid, block_b.mb_addr)->cbp_bits[2],bit+bit_pos_b);
         else
-          upper_bit = get_bit(mb_data[block_b.mb_addr].s_cbp[0].bits,bit+bit_pos_b);
+          upper_bit = get_bit(get_mb_ctx(p_Vid, block_b.mb_addr)->cbp_bits[0],bit+bit_pos_b);
       }
     }
     
@@ -1508,17 +1545,17 @@ static int read_and_store_CBP_block_bit_444 (Macroblock              *currMB,
       else
       {
         if(type==LUMA_8x8)
-          left_bit = get_bit(mb_data[block_a.mb_addr].s_cbp[0].bits_8x8,bit+bit_pos_a);
+          left_bit = get_bit(get_mb_ctx(p_Vid, block_a.mb_addr)->cbp_bits_8x8[0],bit+bit_pos_a);
         else if (type==CB_8x8)
-          left_bit = get_bit(mb_data[block_a.mb_addr].s_cbp[1].bits_8x8,bit+bit_pos_a);
+          left_bit = get_bit(get_mb_ctx(p_Vid, block_a.mb_addr)->cbp_bits_8x8[1],bit+bit_pos_a);
         else if (type==CR_8x8)
-          left_bit = get_bit(mb_data[block_a.mb_addr].s_cbp[2].bits_8x8,bit+bit_pos_a);
+          left_bit = get_bit(get_mb_ctx(p_Vid, block_a.mb_addr)->cbp_bits_8x8[2],bit+bit_pos_a);
         else if ((type==CB_4x4)||(type==CB_4x8)||(type==CB_8x4)||(type==CB_16AC)||(type==CB_16DC))
-          left_bit = get_bit(mb_data[block_a.mb_addr].s_cbp[1].bits,bit+bit_pos_a);
+          left_bit = get_bit(get_mb_ctx(p_Vid, block_a.mb_addr)->cbp_bits[1],bit+bit_pos_a);
         else if ((type==CR_4x4)||(type==CR_4x8)||(type==CR_8x4)||(type==CR_16AC)||(type==CR_16DC))
-          left_bit = get_bit(mb_data[block_a.mb_addr].s_cbp[2].bits,bit+bit_pos_a);
+          left_bit = get_bit(get_mb_ctx(p_Vid, block_a.mb_addr)->cbp_bits[2],bit+bit_pos_a);
         else
-          left_bit = get_bit(mb_data[block_a.mb_addr].s_cbp[0].bits,bit+bit_pos_a);
+          left_bit = get_bit(get_mb_ctx(p_Vid, block_a.mb_addr)->cbp_bits[0],bit+bit_pos_a);
       }
     }
     
@@ -1532,61 +1569,61 @@ static int read_and_store_CBP_block_bit_444 (Macroblock              *currMB,
 
   if (cbp_bit)
   {  
-    CBPStructure  *s_cbp = currMB->s_cbp;
+    MbContext  *mb_ctx = currMB->ctx;
     if (type==LUMA_8x8) 
     {      
-      s_cbp[0].bits |= ((int64) 0x33 << bit   );
+      mb_ctx->cbp_bits[0] |= ((int64) 0x33 << bit   );
       
       if (dec_picture->chroma_format_idc==YUV444)
       {
-        s_cbp[0].bits_8x8   |= ((int64) 0x33 << bit   );
+        mb_ctx->cbp_bits_8x8[0]   |= ((int64) 0x33 << bit   );
       }
     }
     else if (type==CB_8x8)
     {
-      s_cbp[1].bits_8x8   |= ((int64) 0x33 << bit   );      
-      s_cbp[1].bits   |= ((int64) 0x33 << bit   );
+      mb_ctx->cbp_bits_8x8[1]   |= ((int64) 0x33 << bit   );      
+      mb_ctx->cbp_bits[1]   |= ((int64) 0x33 << bit   );
     }
     else if (type==CR_8x8)
     {
-      s_cbp[2].bits_8x8   |= ((int64) 0x33 << bit   );      
-      s_cbp[2].bits   |= ((int64) 0x33 << bit   );
+      mb_ctx->cbp_bits_8x8[2]   |= ((int64) 0x33 << bit   );      
+      mb_ctx->cbp_bits[2]   |= ((int64) 0x33 << bit   );
     }
     else if (type==LUMA_8x4)
     {
-      s_cbp[0].bits   |= ((int64) 0x03 << bit   );
+      mb_ctx->cbp_bits[0]   |= ((int64) 0x03 << bit   );
     }
     else if (type==CB_8x4)
     {
-      s_cbp[1].bits   |= ((int64) 0x03 << bit   );
+      mb_ctx->cbp_bits[1]   |= ((int64) 0x03 << bit   );
     }
     else if (type==CR_8x4)
     {
-      s_cbp[2].bits   |= ((int64) 0x03 << bit   );
+      mb_ctx->cbp_bits[2]   |= ((int64) 0x03 << bit   );
     }
     else if (type==LUMA_4x8)
     {
-      s_cbp[0].bits   |= ((int64) 0x11<< bit   );
+      mb_ctx->cbp_bits[0]   |= ((int64) 0x11<< bit   );
     }
     else if (type==CB_4x8)
     {
-      s_cbp[1].bits   |= ((int64)0x11<< bit   );
+      mb_ctx->cbp_bits[1]   |= ((int64)0x11<< bit   );
     }
     else if (type==CR_4x8)
     {
-      s_cbp[2].bits   |= ((int64)0x11<< bit   );
+      mb_ctx->cbp_bits[2]   |= ((int64)0x11<< bit   );
     }
     else if ((type==CB_4x4)||(type==CB_16AC)||(type==CB_16DC))
     {
-      s_cbp[1].bits   |= i64_power2(bit);
+      mb_ctx->cbp_bits[1]   |= i64_power2(bit);
     }
     else if ((type==CR_4x4)||(type==CR_16AC)||(type==CR_16DC))
     {
-      s_cbp[2].bits   |= i64_power2(bit);
+      mb_ctx->cbp_bits[2]   |= i64_power2(bit);
     }
     else
     {
-      s_cbp[0].bits   |= i64_power2(bit);
+      mb_ctx->cbp_bits[0]   |= i64_power2(bit);
     }
   }
   return cbp_bit;
@@ -1598,7 +1635,7 @@ static inline int set_cbp_bit(Macroblock *neighbor_mb)
   if(neighbor_mb->mb_type == IPCM)
     return 1;
   else
-    return (int) (neighbor_mb->s_cbp[0].bits & 0x01);
+    return (int) (neighbor_mb->ctx->cbp_bits[0] & 0x01);
 }
 
 static inline int set_cbp_bit_ac(Macroblock *neighbor_mb, PixelPos *block)
@@ -1608,7 +1645,7 @@ static inline int set_cbp_bit_ac(Macroblock *neighbor_mb, PixelPos *block)
   else
   {
     int bit_pos = 1 + (block->y << 2) + block->x;
-    return get_bit(neighbor_mb->s_cbp[0].bits, bit_pos);
+    return get_bit(neighbor_mb->ctx->cbp_bits[0], bit_pos);
   }
 }
 
@@ -1658,7 +1695,7 @@ static int read_and_store_CBP_block_bit_normal (Macroblock              *currMB,
 
     if (cbp_bit)
     {  
-      currMB->s_cbp[0].bits |= 1;
+      currMB->ctx->cbp_bits[0] |= 1;
     }
   }
   else if (type==LUMA_16AC)
@@ -1695,7 +1732,7 @@ static int read_and_store_CBP_block_bit_normal (Macroblock              *currMB,
     {
       //--- set bits for current block ---
       bit = 1 + j + (i >> 2); 
-      currMB->s_cbp[0].bits   |= i64_power2(bit);
+      currMB->ctx->cbp_bits[0]   |= i64_power2(bit);
     }
   }
   else if (type==LUMA_8x4)
@@ -1732,7 +1769,7 @@ static int read_and_store_CBP_block_bit_normal (Macroblock              *currMB,
     {  
       //--- set bits for current block ---
       bit = 1 + j + (i >> 2); 
-      currMB->s_cbp[0].bits   |= ((int64) 0x03 << bit   );
+      currMB->ctx->cbp_bits[0]   |= ((int64) 0x03 << bit   );
     }
   }
   else if (type==LUMA_4x8)
@@ -1770,7 +1807,7 @@ static int read_and_store_CBP_block_bit_normal (Macroblock              *currMB,
       //--- set bits for current block ---
       bit = 1 + j + (i >> 2); 
 
-      currMB->s_cbp[0].bits   |= ((int64) 0x11 << bit   );
+      currMB->ctx->cbp_bits[0]   |= ((int64) 0x11 << bit   );
     }
   }
   else if (type==LUMA_4x4)
@@ -1808,7 +1845,7 @@ static int read_and_store_CBP_block_bit_normal (Macroblock              *currMB,
       //--- set bits for current block ---
       bit = 1 + j + (i >> 2); 
 
-      currMB->s_cbp[0].bits   |= i64_power2(bit);
+      currMB->ctx->cbp_bits[0]   |= i64_power2(bit);
     }
   }
   else if (type == LUMA_8x8)
@@ -1818,7 +1855,7 @@ static int read_and_store_CBP_block_bit_normal (Macroblock              *currMB,
     //--- set bits for current block ---
     int bit         = 1 + j + (i >> 2);
 
-    currMB->s_cbp[0].bits |= ((int64) 0x33 << bit   );      
+    currMB->ctx->cbp_bits[0] |= ((int64) 0x33 << bit   );      
   }
   else if (type==CHROMA_DC || type==CHROMA_DC_2x4 || type==CHROMA_DC_4x4)
   {
@@ -1842,7 +1879,7 @@ static int read_and_store_CBP_block_bit_normal (Macroblock              *currMB,
       if(mb_data[block_b.mb_addr].mb_type==IPCM)
         upper_bit = 1;
       else
-        upper_bit = get_bit(mb_data[block_b.mb_addr].s_cbp[0].bits, bit);
+        upper_bit = get_bit(get_mb_ctx(p_Vid, block_b.mb_addr)->cbp_bits[0], bit);
     }
 
     if (block_a.available)
@@ -1850,7 +1887,7 @@ static int read_and_store_CBP_block_bit_normal (Macroblock              *currMB,
       if(mb_data[block_a.mb_addr].mb_type==IPCM)
         left_bit = 1;
       else
-        left_bit = get_bit(mb_data[block_a.mb_addr].s_cbp[0].bits, bit);
+        left_bit = get_bit(get_mb_ctx(p_Vid, block_a.mb_addr)->cbp_bits[0], bit);
     }
 
     ctx = 2 * upper_bit + left_bit;     
@@ -1861,7 +1898,7 @@ static int read_and_store_CBP_block_bit_normal (Macroblock              *currMB,
     {
       //--- set bits for current block ---
       bit = (u_dc ? 17 : 18); 
-      currMB->s_cbp[0].bits   |= i64_power2(bit);
+      currMB->ctx->cbp_bits[0]   |= i64_power2(bit);
     }
   }
   else
@@ -1888,7 +1925,7 @@ static int read_and_store_CBP_block_bit_normal (Macroblock              *currMB,
       else
       {
         int bit_pos_b = 4*block_b.y + block_b.x;
-        upper_bit = get_bit(mb_data[block_b.mb_addr].s_cbp[0].bits, bit + bit_pos_b);
+        upper_bit = get_bit(get_mb_ctx(p_Vid, block_b.mb_addr)->cbp_bits[0], bit + bit_pos_b);
       }
     }
 
@@ -1899,7 +1936,7 @@ static int read_and_store_CBP_block_bit_normal (Macroblock              *currMB,
       else
       {
         int bit_pos_a = 4*block_a.y + block_a.x;
-        left_bit = get_bit(mb_data[block_a.mb_addr].s_cbp[0].bits,bit + bit_pos_a);
+        left_bit = get_bit(get_mb_ctx(p_Vid, block_a.mb_addr)->cbp_bits[0],bit + bit_pos_a);
       }
     }
 
@@ -1911,7 +1948,7 @@ static int read_and_store_CBP_block_bit_normal (Macroblock              *currMB,
     {
       //--- set bits for current block ---
       bit = (u_ac ? 19 + j + (i >> 2) : 35 + j + (i >> 2)); 
-      currMB->s_cbp[0].bits   |= i64_power2(bit);
+      currMB->ctx->cbp_bits[0]   |= i64_power2(bit);
     }
   }
   return cbp_bit;
@@ -2144,6 +2181,122 @@ void readRunLevel_CABAC (Macroblock *currMB,
 #endif
 }
 
+#if (MVD_PARSE_ONLY)
+/*!
+ ************************************************************************
+ * \brief
+ *    Skip Significance MAP, only the number of significant
+ *    coefficients is returned
+ ************************************************************************
+ */
+static int skip_significance_map (Macroblock              *currMB,
+                                  DecodingEnvironmentPtr  dep_dp,
+                                  int                     type)
+{
+  Slice *currSlice = currMB->p_Slice;
+  int               fld    = ( currSlice->structure!=FRAME || currMB->mb_field );
+  const byte *pos2ctx_Map = (fld) ? pos2ctx_map_int[type] : pos2ctx_map[type];
+  const byte *pos2ctx_Last = pos2ctx_last[type];
+
+  BiContextTypePtr  map_ctx  = currSlice->tex_ctx->map_contexts [fld][type2ctx_map [type]];
+  BiContextTypePtr  last_ctx = currSlice->tex_ctx->last_contexts[fld][type2ctx_last[type]];
+
+  int   i;
+  int   coeff_ctr = 0;
+  int   i0        = 0;
+  int   i1        = maxpos[type];
+
+  if (!c1isdc[type])
+  {
+    ++i0; 
+    ++i1; 
+  }
+
+  for (i=i0; i < i1; ++i) // if last coeff is reached, it has to be significant
+  {
+    //--- read significance symbol ---
+    if (biari_decode_symbol   (dep_dp, map_ctx + pos2ctx_Map[i]))
+    {
+      ++coeff_ctr;
+      //--- read last coefficient symbol ---
+      if (biari_decode_symbol (dep_dp, last_ctx + pos2ctx_Last[i]))
+        return coeff_ctr;
+    }
+  }
+  //--- last coefficient must be significant if no last symbol was received ---
+  return coeff_ctr + 1;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Skip Levels, the context selection only depends on the
+ *    order of the significant coefficients, not on their position
+ ************************************************************************
+ */
+static void skip_significant_coefficients (DecodingEnvironmentPtr  dep_dp,
+                                           TextureInfoContexts    *tex_ctx,
+                                           int                     type,
+                                           int                     coeff_ctr)
+{
+  BiContextType *one_contexts = tex_ctx->one_contexts[type2ctx_one[type]];
+  BiContextType *abs_contexts = tex_ctx->abs_contexts[type2ctx_abs[type]];
+  const short max_type = max_c2[type];
+  int   c1 = 1;
+  int   c2 = 0;
+
+  for (; coeff_ctr > 0; --coeff_ctr)
+  {
+    if (biari_decode_symbol (dep_dp, one_contexts + c1))
+    {
+      unary_exp_golomb_level_decode (dep_dp, abs_contexts + c2);
+      c2 = imin (c2 + 1, max_type);
+      c1 = 0;
+    }
+    else if (c1)
+    {
+      c1 = imin (c1 + 1, 4);
+    }
+
+    // sign
+    biari_decode_symbol_eq_prob(dep_dp);
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Parse Block-Transform Coefficients without reconstructing them.
+ *    The whole block is consumed at once and EOB is returned, so the
+ *    run/level loops of the callers terminate after the first call.
+ ************************************************************************
+ */
+void skipRunLevel_CABAC (Macroblock *currMB, 
+                         SyntaxElement  *se,
+                         DecodingEnvironmentPtr dep_dp)
+{
+  int coeff_ctr;
+
+  //===== decode CBP-BIT =====
+  if ((coeff_ctr = currMB->read_and_store_CBP_block_bit (currMB, dep_dp, se->context) ) != 0)
+  {
+    //===== decode significance map =====
+    coeff_ctr = skip_significance_map (currMB, dep_dp, se->context);
+
+    //===== decode significant coefficients =====
+    skip_significant_coefficients (dep_dp, currMB->p_Slice->tex_ctx, se->context, coeff_ctr);
+  }
+
+  //--- set run and level (EOB) ---
+  se->value1 = se->value2 = 0;
+
+#if TRACE
+  fprintf(p_Dec->p_trace, "@%-6d %-53s %3d  %3d (%d coeffs)\n",symbolCount++, se->tracestring, se->value1,se->value2, coeff_ctr);
+  fflush(p_Dec->p_trace);
+#endif
+}
+#endif
+
 /*!
  ************************************************************************
  * \brief
@@ -2154,12 +2307,13 @@ int readSyntaxElement_CABAC(Macroblock *currMB, SyntaxElement *se, DataPartition
 {
   DecodingEnvironmentPtr dep_dp = &(this_dataPart->de_cabac);
   int curr_len = arideco_bits_read(dep_dp);		//ǰѽĳ
-	s_cur_mvd_bitpos = curr_len;
+	p_Dec->cur_mvd_bitpos = curr_len;
 
   // perform the actual decoding by calling the appropriate method
   se->reading(currMB, se, dep_dp);
   //read again and minus curr_len = arideco_bits_read(dep_dp); from above
   se->len = (arideco_bits_read(dep_dp) - curr_len);
+  TRACE_BIN_SE(TRACE_BIN_CABAC, se->type, curr_len, se->len, se->value1);
 
 #if (TRACE==2)
   fprintf(p_Dec->p_trace, "curr_len: %d\n",curr_len);		//ǰ﷨ڵλ
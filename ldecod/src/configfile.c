@@ -302,7 +302,43 @@ static void PatchInp (InputParameters *p_Inp)
 {
   //int i;
   //int storedBplus1;
+  char *tid, *end;
+  long value;
+
   TestParams(Map, NULL);
+
+  // "0,1" or "0 1": temporal IDs whose pictures are protected
+  p_Inp->protect_tid_mask = 0;
+  for (tid = p_Inp->protect_tids; *tid; tid = end)
+  {
+    while (*tid == ',' || *tid == ' ' || *tid == '\t')
+      tid++;
+    if (*tid == '\0')
+      break;
+    value = strtol(tid, &end, 10);
+    if (end == tid || value < 0 || value > 7)
+    {
+      snprintf(errortext, ET_SIZE, "Error in ProtectTemporalIds '%.64s', temporal IDs are 0 to 7", p_Inp->protect_tids);
+      error (errortext, 400);
+    }
+    p_Inp->protect_tid_mask |= 1 << value;
+  }
+
+  if (p_Inp->stream_lag > 0 && p_Inp->multi_thread)
+  {
+    fprintf(stderr, "Warning: MultiThread is not supported with StreamLag > 0, key units are protected in the decoding thread\n");
+    p_Inp->multi_thread = 0;
+  }
+  if (p_Inp->pipeline > 0 && p_Inp->stream_lag > 0)
+  {
+    fprintf(stderr, "Warning: Pipeline is not supported with StreamLag > 0, the pipeline is switched off\n");
+    p_Inp->pipeline = 0;
+  }
+  if (p_Inp->pipeline > 0 && p_Inp->multi_thread)
+  {
+    fprintf(stderr, "Warning: MultiThread is not supported with Pipeline > 0, key units are protected in the pipeline\n");
+    p_Inp->multi_thread = 0;
+  }
   //if(p_Inp->export_views == 1)
     //p_Inp->dpb_plus[1] = imax(1, p_Inp->dpb_plus[1]);
 }
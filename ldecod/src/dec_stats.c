@@ -0,0 +1,318 @@
+/*!
+ *************************************************************************************
+ * \file dec_stats.c
+ *
+ * \brief
+ *    Per-stage timers and counters of the key generation pipeline and
+ *    their JSON report
+ *
+ *************************************************************************************
+ */
+
+#include "global.h"
+#include "dec_stats.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+THREAD_LOCAL DecStats *p_DecStats;
+
+static const char *stage_name[STAGE_NUM] =
+{
+  "nal_read", "ebsp_to_rbsp", "slice_header",
+  "mb_parse_p", "mb_parse_b", "mb_parse_i", "mb_parse_sp", "mb_parse_si",
+  "key_capture", "key_encode", "file_write", "keyfile_flush"
+};
+
+static const char *counter_name[COUNT_NUM] =
+{
+  "nalus", "slices", "mbs", "key_units", "bits_protected", "bytes_in",
+  "pictures_skipped"
+};
+
+static const char *phase_name[PHASE_NUM] =
+{
+  "parse", "encrypt", "restore"
+};
+
+static const char *slice_type_name[KU_SLICE_TYPES] =
+{
+  "P", "B", "I", "SP", "SI"
+};
+
+#ifdef _WIN32
+
+int64 dec_stats_now(void)
+{
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER t;
+
+  if (freq.QuadPart == 0)
+    QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&t);
+  return (int64) ((double) t.QuadPart * 1e9 / (double) freq.QuadPart);
+}
+
+#define ATOMIC_ADD64(p, v)  InterlockedExchangeAdd64((p), (v))
+
+static int64 peak_rss_kb(void)
+{
+  return 0;
+}
+
+#else
+
+int64 dec_stats_now(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (int64) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+#define ATOMIC_ADD64(p, v)  __sync_fetch_and_add((p), (v))
+
+static int64 peak_rss_kb(void)
+{
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+  return (int64) usage.ru_maxrss;
+}
+
+#endif
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Accumulates the time spent in one stage. The encrypt stages may run
+ *    in several threads, so the sums are updated atomically.
+ ************************************************************************
+ */
+void dec_stats_add_stage(StatStage stage, int64 start, int64 end)
+{
+  ATOMIC_ADD64(&p_DecStats->stage_time[stage], end - start);
+  ATOMIC_ADD64(&p_DecStats->stage_calls[stage], 1);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Starts the key unit statistics of a new picture. Once KU_MAX_FRAMES
+ *    pictures are kept, it takes the entry of the oldest one.
+ ************************************************************************
+ */
+void dec_stats_new_frame(void)
+{
+  DecStats *s = p_DecStats;
+
+  if (s->ku_frame_num == s->ku_frame_size && s->ku_frame_size < KU_MAX_FRAMES)
+  {
+    int size = s->ku_frame_size ? imin(2 * s->ku_frame_size, KU_MAX_FRAMES) : 256;
+    KeyUnitFrame *frame = realloc(s->ku_frame, size * sizeof(KeyUnitFrame));
+
+    if (frame == NULL)
+      return;                      // keep counting into the last picture
+    s->ku_frame      = frame;
+    s->ku_frame_size = size;
+  }
+  s->ku_cur = &s->ku_frame[s->ku_frame_num++ & (KU_MAX_FRAMES - 1)];
+  memset(s->ku_cur, 0, sizeof(KeyUnitFrame));
+}
+
+void dec_stats_free(DecStats *stats)
+{
+  free(stats->ku_frame);
+  stats->ku_frame      = NULL;
+  stats->ku_cur        = NULL;
+  stats->ku_frame_num  = 0;
+  stats->ku_frame_size = 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Adds the timers, counters and key unit histograms of src to dst.
+ *    The per picture statistics are not merged.
+ ************************************************************************
+ */
+void dec_stats_merge(DecStats *dst, const DecStats *src)
+{
+  int i, j;
+
+  for (i = 0; i < STAGE_NUM; i++)
+  {
+    dst->stage_time[i]  += src->stage_time[i];
+    dst->stage_calls[i] += src->stage_calls[i];
+  }
+  for (i = 0; i < COUNT_NUM; i++)
+    dst->counter[i] += src->counter[i];
+  for (i = 0; i < PHASE_NUM; i++)
+    dst->phase_time[i] += src->phase_time[i];
+  for (i = 0; i < KU_SLICE_TYPES; i++)
+  {
+    dst->ku_type[i].units += src->ku_type[i].units;
+    dst->ku_type[i].bits  += src->ku_type[i].bits;
+    for (j = 0; j < KU_LOG2_BINS; j++)
+    {
+      dst->ku_type[i].byte_offset[j] += src->ku_type[i].byte_offset[j];
+      dst->ku_type[i].data_len[j]    += src->ku_type[i].data_len[j];
+    }
+  }
+}
+
+static double per_second(int64 count, int64 ns)
+{
+  return ns > 0 ? (double) count * 1e9 / (double) ns : 0.0;
+}
+
+static void write_json_hist(FILE *f, const char *name, const int64 *bin)
+{
+  int last = KU_LOG2_BINS - 1;
+  int i;
+
+  while (last > 0 && bin[last] == 0)
+    last--;
+  fprintf(f, "\"%s\": [", name);
+  for (i = 0; i <= last; i++)
+    fprintf(f, "%s%lld", i ? ", " : "", (long long) bin[i]);
+  fprintf(f, "]");
+}
+
+static void write_json_key_units(FILE *f, const char *name, const KeyUnitHist *h, const char *indent)
+{
+  fprintf(f, "%s\"%s\": { \"units\": %lld, \"bits\": %lld,\n%s  ", indent, name,
+    (long long) h->units, (long long) h->bits, indent);
+  write_json_hist(f, "byte_offset_log2", h->byte_offset);
+  fprintf(f, ",\n%s  ", indent);
+  write_json_hist(f, "data_len_log2", h->data_len);
+  fprintf(f, " }");
+}
+
+static void write_json_string(FILE *f, const char *str)
+{
+  fputc('"', f);
+  for (; *str; str++)
+  {
+    if (*str == '"' || *str == '\\')
+      fputc('\\', f);
+    fputc(*str, f);
+  }
+  fputc('"', f);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Writes the stage times and counters as JSON to filename, or to
+ *    stdout if filename is empty
+ ************************************************************************
+ */
+void dec_stats_report(const DecStats *stats, const char *stream, const char *filename)
+{
+  DecStats copy = *stats;
+  DecStats *s = &copy;
+  FILE *f = stdout;
+  int64 total = 0;
+  int64 mb_time = 0;
+  int64 first = i64max(s->ku_frame_num - KU_MAX_FRAMES, 0), n;
+  KeyUnitHist all;
+  int i, j;
+
+  if (filename != NULL && *filename != '\0')
+  {
+    if ((f = fopen(filename, "w")) == NULL)
+    {
+      fprintf(stderr, "dec_stats_report: cannot open %s\n", filename);
+      return;
+    }
+  }
+
+  // key_encode is measured around the whole key generation loop, the
+  // write-back and key file I/O inside of it are reported separately
+  s->stage_time[STAGE_KEY_ENCODE] -= s->stage_time[STAGE_FILE_WRITE] + s->stage_time[STAGE_KEYFILE_FLUSH];
+  if (s->stage_time[STAGE_KEY_ENCODE] < 0)
+    s->stage_time[STAGE_KEY_ENCODE] = 0;
+
+  for (i = STAGE_MB_P; i <= STAGE_MB_SI; i++)
+    mb_time += s->stage_time[i];
+  for (i = 0; i < PHASE_NUM; i++)
+    total += s->phase_time[i];
+
+  memset(&all, 0, sizeof(all));
+  for (i = 0; i < KU_SLICE_TYPES; i++)
+  {
+    all.units += s->ku_type[i].units;
+    all.bits  += s->ku_type[i].bits;
+    for (j = 0; j < KU_LOG2_BINS; j++)
+    {
+      all.byte_offset[j] += s->ku_type[i].byte_offset[j];
+      all.data_len[j]    += s->ku_type[i].data_len[j];
+    }
+  }
+
+  fprintf(f, "{\n");
+  fprintf(f, "  \"stream\": ");
+  write_json_string(f, stream);
+  fprintf(f, ",\n");
+  fprintf(f, "  \"stats_level\": %d,\n", DEC_STATS);
+  fprintf(f, "  \"peak_rss_kb\": %lld,\n", (long long) peak_rss_kb());
+  fprintf(f, "  \"phases_us\": {");
+  for (i = 0; i < PHASE_NUM; i++)
+    fprintf(f, "%s\"%s\": %lld", i ? ", " : " ", phase_name[i], (long long) (s->phase_time[i] / 1000));
+  fprintf(f, ", \"total\": %lld },\n", (long long) (total / 1000));
+
+  fprintf(f, "  \"stages\": {\n");
+  for (i = 0; i < STAGE_NUM; i++)
+  {
+    fprintf(f, "    \"%s\": { \"us\": %lld, \"calls\": %lld }%s\n", stage_name[i],
+      (long long) (s->stage_time[i] / 1000), (long long) s->stage_calls[i], i < STAGE_NUM - 1 ? "," : "");
+  }
+  fprintf(f, "  },\n");
+
+  fprintf(f, "  \"counters\": {");
+  for (i = 0; i < COUNT_NUM; i++)
+    fprintf(f, "%s\"%s\": %lld", i ? ", " : " ", counter_name[i], (long long) s->counter[i]);
+  fprintf(f, " },\n");
+
+  fprintf(f, "  \"key_units\": {\n");
+  write_json_key_units(f, "all", &all, "    ");
+  fprintf(f, ",\n    \"by_slice_type\": {\n");
+  for (i = 0, j = 0; i < KU_SLICE_TYPES; i++)
+  {
+    if (s->ku_type[i].units == 0)
+      continue;
+    fprintf(f, "%s", j++ ? ",\n" : "");
+    write_json_key_units(f, slice_type_name[i], &s->ku_type[i], "      ");
+  }
+  fprintf(f, "%s    },\n", j ? "\n" : "");
+  fprintf(f, "    \"frames_dropped\": %lld,\n", (long long) first);
+  fprintf(f, "    \"frames\": [");
+  for (n = first; n < s->ku_frame_num; n++)
+  {
+    KeyUnitFrame *fr = &s->ku_frame[n & (KU_MAX_FRAMES - 1)];
+    int sep = 0;
+
+    fprintf(f, "%s\n      { \"slice_types\": \"", n > first ? "," : "");
+    for (j = 0; j < KU_SLICE_TYPES; j++)
+    {
+      if (fr->slice_types & (1 << j))
+        fprintf(f, "%s%s", sep++ ? "," : "", slice_type_name[j]);
+    }
+    fprintf(f, "\", \"units\": %lld, \"bits\": %lld, \"max_data_len\": %d }",
+      (long long) fr->units, (long long) fr->bits, fr->max_data_len);
+  }
+  fprintf(f, "%s]\n  },\n", s->ku_frame_num ? "\n    " : "");
+
+  fprintf(f, "  \"rates\": { \"mbs_per_s\": %.1f, \"mb_parse_mbs_per_s\": %.1f, \"key_units_per_s\": %.1f, \"mbytes_in_per_s\": %.3f }\n",
+    per_second(s->counter[COUNT_MB], total), per_second(s->counter[COUNT_MB], mb_time),
+    per_second(s->counter[COUNT_KEY_UNIT], total), per_second(s->counter[COUNT_BYTES_IN], total) / 1e6);
+  fprintf(f, "}\n");
+
+  if (f != stdout)
+    fclose(f);
+  else
+    fflush(f);
+}
@@ -19,14 +19,12 @@
 #include "win32.h"
 #include "h264decoder.h"
 #include "configfile.h"
-#include "key_common.h"
+#include "dec_stats.h"
+#include "batch.h"
+#include "key_restore.h"
+#include "trace_bin.h"
 
 
-extern int g_ThreadParCurPos;
-extern int g_KeyUnitBufferLen;
-extern void Encrypt(ThreadUnitPar *thread_unit_par); 
-extern void encryt_thread(ThreadUnitPar* thread_unit_par);
-
 static void Configure(InputParameters *p_Inp, int ac, char *av[])
 {
   memset(p_Inp, 0, sizeof(InputParameters));
@@ -52,30 +50,54 @@ static void Configure(InputParameters *p_Inp, int ac, char *av[])
 
 int main(int argc, char **argv)
 {
-	struct timeval start, end1, end2;
-	long int time_us1,time_us2;
-	gettimeofday( &start, NULL );
-	
+  STATS_TIMER(t_phase);
   int iRet;
   InputParameters InputParams;
+  DecoderParams *pDecoder = NULL;
   init_time();
 
   //get input parameters;
   Configure(&InputParams, argc, argv);
+  if(InputParams.key_restore[0])
+  {
+#if (DEC_STATS)
+    DecStats stats;
+
+    memset(&stats, 0, sizeof(DecStats));
+    p_DecStats = &stats;
+#endif
+    //undo the protection of InputFile, see key_restore.h
+    iRet = restore_stream(InputParams.infile, InputParams.key_restore);
+    STATS_PHASE(PHASE_RESTORE, t_phase);
+#if (DEC_STATS)
+    //only on request, the restore prints no report otherwise
+    if(iRet == 0 && InputParams.stats_file[0])
+      dec_stats_report(&stats, InputParams.infile, InputParams.stats_file);
+#endif
+    return iRet == 0 ? 0 : -1;
+  }
+  if(InputParams.trace_dump[0])
+  {
+    //text of a binary trace, see trace_bin.h
+    return trace_bin_dump(InputParams.trace_dump, stdout) == 0 ? 0 : -1;
+  }
+  if(InputParams.batch_manifest[0])
+  {
+    //several clips in one process, see batch.h
+    return run_batch(&InputParams) == 0 ? 0 : -1;
+  }
   //open decoder;
-  iRet = OpenDecoder(&InputParams);
+  iRet = OpenDecoder(&InputParams, &pDecoder);
   if(iRet != DEC_OPEN_NOERR)
   {
     fprintf(stderr, "Open encoder failed: 0x%x!\n", iRet);
     return -1; //failed;
   }
 
-	init_GenKeyPar();
-	
   //decoding;
   do
   {
-    iRet = DecodeOneFrame();
+    iRet = DecodeOneFrame(pDecoder);
     if(iRet==DEC_EOS || iRet==DEC_SUCCEED)
     {
 
@@ -87,76 +109,22 @@ int main(int argc, char **argv)
     }
   }while((iRet == DEC_SUCCEED) /*&& ((p_Dec->p_Inp->iDecFrmNum==0) || (iFramesDecoded<p_Dec->p_Inp->iDecFrmNum))*/);
 
-	gettimeofday( &end1, NULL );
-	time_us1 = 1000000 * ( end1.tv_sec - start.tv_sec ) + end1.tv_usec - start.tv_usec;
-	printf("\nrun time0: %ld us\n",time_us1);
-
-	//encrypt the H.264 file
-	printf("key unit count: %d\n",g_KeyUnitIdx);
-
-	int ret;
-	void* status;
-	pthread_attr_t attr;
-
-	/*********use multi thread********/
-	if(p_Dec->p_Inp->multi_thread == 1)
-	{
-		pthread_attr_t attr;
-						
-		ret = pthread_attr_destroy(&p_Dec->thread_attr);
-		if (ret != 0)
-		{
-			printf("pthread_attr_destroy error: %s\n",strerror(ret));
-		}
-	}
-
-	ThreadUnitPar* par = NULL;
-	par = (ThreadUnitPar*)malloc(sizeof(ThreadUnitPar));
-	if(!par)
-	{
-		printf("malloc failed!\n");
-		exit(1);
-	}
-	memset(par,0,sizeof(ThreadUnitPar));
-	
-	if(p_Dec->p_Inp->multi_thread)  
-	{
-		//deal with the rest KU buffer data
-		if(g_KeyUnitBufferLen <= MAX_THREAD_DO_KEY_UNIT_CNT)
-		{
-			par->buffer_start = g_KeyUnitIdx - g_KeyUnitBufferLen;
-			par->buffer_len = g_KeyUnitBufferLen;
-			par->cur_absolute_offset = g_ThreadParCurPos;
-			Encrypt(par);
-		}
-
-		int i;
-		for(i = 0; i < p_Dec->pid_id; ++i)
-		{
-			pthread_join(p_Dec->pid[i], &status);
-		}
-	}
-	else
-	{		
-		par->buffer_start = 0;
-		par->buffer_len = g_KeyUnitIdx;
-		par->cur_absolute_offset = g_pKeyUnitBuffer[0].byte_offset;
-		Encrypt(par);
-		//encryt_thread(par);
-	}
-
-	gettimeofday( &end2, NULL );
-	time_us2 = 1000000 * ( end2.tv_sec - end1.tv_sec ) + end2.tv_usec - end1.tv_usec;
-	printf("run time1: %ld us\n",time_us2);
-
-	//print_KeyUnit();
-
-	deinit_GenKeyPar();
-  iRet = FinitDecoder();
-  iRet = CloseDecoder();	
+  STATS_PHASE(PHASE_PARSE, t_phase);
+  STATS_START(t_phase);
+
+  //encrypt the H.264 file
+  EncryptStream(pDecoder);
+
+  STATS_PHASE(PHASE_ENCRYPT, t_phase);
+
+#if (DEC_STATS)
+  dec_stats_report(&pDecoder->stats, InputParams.infile, InputParams.stats_file);
+#endif
+
+  iRet = FinitDecoder(pDecoder);
+  iRet = CloseDecoder(pDecoder);
 
 	fflush(NULL);
-	printf("run time(all): %ld us\n", time_us1+time_us2);
   return 0;
 }
 
@@ -117,7 +117,7 @@ static void encryt_one_unit(char* buf_key, int buf_key_len, char* buf_264, int b
 {
 	int i;
 
-	int byteoffset 	= KUBuf[KUBuf_idx].byte_offset;
+	int byteoffset 	= (int) KUBuf[KUBuf_idx].byte_offset;	//within the window of the thread
 	int bitoffset 	= KUBuf[KUBuf_idx].bit_offset;
 	int datalen			= KUBuf[KUBuf_idx].key_data_len;
 	int bit_sum 		= bitoffset + datalen;
@@ -183,6 +183,8 @@ void encryt_thread(ThreadUnitPar* thread_unit_par)
 	int i = 0, j = 0;		
 	int rd_cnt;
 	
+	set_current_decoder(thread_unit_par->pDecoder);
+
 	char* buf_264;
 	buf_264 = (char*)malloc(sizeof(char)*MAX_BUF_SIZE);
 	if(!buf_264)
@@ -199,19 +201,16 @@ void encryt_thread(ThreadUnitPar* thread_unit_par)
 		exit(1);
 	}
 	
-	int fd = p_Dec->BitStreamFile;//open("bus_cavlc_Copy.264",O_RDWR);
-
 	j = 0;
-	for(i = thread_unit_par->buffer_start; i < thread_unit_par->buffer_len; i++)	// should locked g_pKeyUnitBuffer
+	for(i = thread_unit_par->buffer_start; i < thread_unit_par->buffer_len; i++)	// should locked key_unit_buffer
 	{
-		KU_copy(&KUBuf[j],&g_pKeyUnitBuffer[i]);
+		KU_copy(&KUBuf[j],&p_Dec->key_unit_buffer[i]);
 		j ++;
 	}
 	
-	lseek(fd, thread_unit_par->cur_absolute_offset, SEEK_SET);	// should locked fd
-	rd_cnt = read(fd, buf_264, MAX_BUF_SIZE);	// should locked fd
+	rd_cnt = stream_pread(&p_Dec->io, (byte *)buf_264, MAX_BUF_SIZE, thread_unit_par->cur_absolute_offset);	// should locked io
 
-	int start = 0;
+	int64 start = 0;
 	KUBuf[0].byte_offset = 0;
 	/*** encryt every key unit***/
 	for(i = thread_unit_par->buffer_start; i < thread_unit_par->buffer_len; i++)
@@ -225,8 +224,7 @@ void encryt_thread(ThreadUnitPar* thread_unit_par)
 	}
 
 	int wr_cnt;
-	lseek(fd, thread_unit_par->cur_absolute_offset, SEEK_SET);
-	wr_cnt = write(fd, buf_264, rd_cnt);	// should locked fd
+	wr_cnt = stream_pwrite(&p_Dec->io, (byte *)buf_264, rd_cnt, thread_unit_par->cur_absolute_offset);	// should locked io
 	if(wr_cnt == -1)
 	{
 		printf("write to 264 bs error!\n");
@@ -161,6 +161,58 @@ static int FmoGenerateMbToSliceGroupMap (VideoParameters *p_Vid, Slice *pSlice)
 }
 
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Generates p_Vid->NextMbInSliceGroup and p_Vid->LastMbInSliceGroup
+ *    from p_Vid->MbToSliceGroupMap, so that the MB scan of a slice
+ *    group does not have to search the map
+ *
+ * \param p_Vid
+ *      video encoding parameters for current picture
+ *
+ ************************************************************************
+ */
+static int FmoGenerateNextMbMap (VideoParameters *p_Vid)
+{
+  int i;
+  int *MbToSliceGroupMap = p_Vid->MbToSliceGroupMap;
+  int *NextMbInSliceGroup;
+  int next[MAXnum_slice_groups_minus1];
+
+  // the map is kept across slices and pictures, it only changes size with the picture
+  if (p_Vid->NextMbInSliceGroup == NULL || p_Vid->NextMbInSliceGroupSize != (int) p_Vid->PicSizeInMbs)
+  {
+    if (p_Vid->NextMbInSliceGroup)
+      free (p_Vid->NextMbInSliceGroup);
+
+    if ((p_Vid->NextMbInSliceGroup = malloc ((p_Vid->PicSizeInMbs) * sizeof (int))) == NULL)
+    {
+      printf ("cannot allocate %d bytes for p_Vid->NextMbInSliceGroup, exit\n", (int) ((p_Vid->PicSizeInMbs) * sizeof (int)));
+      exit (-1);
+    }
+    p_Vid->NextMbInSliceGroupSize = p_Vid->PicSizeInMbs;
+  }
+  NextMbInSliceGroup = p_Vid->NextMbInSliceGroup;
+
+  for (i = 0; i < MAXnum_slice_groups_minus1; i++)
+  {
+    next[i] = -1;
+    p_Vid->LastMbInSliceGroup[i] = -1;
+  }
+
+  for (i = p_Vid->PicSizeInMbs - 1; i >= 0; i--)
+  {
+    int SliceGroup = MbToSliceGroupMap[i];
+    NextMbInSliceGroup[i] = next[SliceGroup];
+    if (next[SliceGroup] < 0)
+      p_Vid->LastMbInSliceGroup[SliceGroup] = i;
+    next[SliceGroup] = i;
+  }
+  return 0;
+}
+
+
 /*!
  ************************************************************************
  * \brief
@@ -180,6 +232,7 @@ int fmo_init(VideoParameters *p_Vid, Slice *pSlice)
 
   FmoGenerateMapUnitToSliceGroupMap(p_Vid, pSlice);
   FmoGenerateMbToSliceGroupMap(p_Vid, pSlice);
+  FmoGenerateNextMbMap(p_Vid);
 
   p_Vid->NumberOfSliceGroups = pps->num_slice_groups_minus1 + 1;
 
@@ -232,6 +285,12 @@ int FmoFinit(VideoParameters *p_Vid)
     free (p_Vid->MapUnitToSliceGroupMap);
     p_Vid->MapUnitToSliceGroupMap = NULL;
   }
+  if (p_Vid->NextMbInSliceGroup)
+  {
+    free (p_Vid->NextMbInSliceGroup);
+    p_Vid->NextMbInSliceGroup = NULL;
+  }
+  p_Vid->NextMbInSliceGroupSize = 0;
   return 0;
 }
 
@@ -281,13 +340,8 @@ int FmoGetLastMBOfPicture(VideoParameters *p_Vid)
 
 int FmoGetLastMBInSliceGroup (VideoParameters *p_Vid, int SliceGroup)
 {
-  int i;
-
-  for (i=p_Vid->PicSizeInMbs-1; i>=0; i--)
-    if (FmoGetSliceGroupId (p_Vid, i) == SliceGroup)
-      return i;
-  return -1;
-
+  assert (SliceGroup < MAXnum_slice_groups_minus1);
+  return p_Vid->LastMbInSliceGroup[SliceGroup];
 }
 
 
@@ -324,15 +378,10 @@ int FmoGetSliceGroupId (VideoParameters *p_Vid, int mb)
  */
 int FmoGetNextMBNr (VideoParameters *p_Vid, int CurrentMbNr)
 {
-  int SliceGroup = FmoGetSliceGroupId (p_Vid, CurrentMbNr);
-
-  while (++CurrentMbNr<(int)p_Vid->PicSizeInMbs && p_Vid->MbToSliceGroupMap [CurrentMbNr] != SliceGroup)
-    ;
-
-  if (CurrentMbNr >= (int)p_Vid->PicSizeInMbs)
-    return -1;    // No further MB in this slice (could be end of picture)
-  else
-    return CurrentMbNr;
+  assert (CurrentMbNr < (int) p_Vid->PicSizeInMbs);
+  assert (p_Vid->NextMbInSliceGroup != NULL);
+  // -1: no further MB in this slice (could be end of picture)
+  return p_Vid->NextMbInSliceGroup[CurrentMbNr];
 }
 
 
@@ -49,6 +49,7 @@
 #include "cabac.h"
 #include "vlc.h"
 #include "fast_memory.h"
+#include "dec_stats.h"
 
 extern int testEndian(void);
 void reorder_lists(Slice *currSlice);
@@ -84,7 +85,8 @@ static void setup_buffers(VideoParameters *p_Vid, int layer_id)
       //p_Vid->siblock = cps->siblock;
     }
     p_Vid->PicPos = cps->PicPos;
-    p_Vid->nz_coeff = cps->nz_coeff;
+    p_Vid->mb_ctx = cps->mb_ctx;
+    p_Vid->mb_ctx_mask = cps->mb_ctx_mask;
     //p_Vid->qp_per_matrix = cps->qp_per_matrix;
     //p_Vid->qp_rem_matrix = cps->qp_rem_matrix;
     p_Vid->oldFrameSizeInMbs = cps->oldFrameSizeInMbs;
@@ -113,10 +115,17 @@ static void init_picture(VideoParameters *p_Vid, Slice *currSlice, InputParamete
   p_Vid->FrameSizeInMbs = p_Vid->PicWidthInMbs * p_Vid->FrameHeightInMbs;
 
   p_Vid->bFrameInit = 1;
+  STATS_FRAME();
   if (p_Vid->dec_picture) // && p_Vid->num_dec_mb == p_Vid->PicSizeInMbs)
   {
     // this may only happen on slice loss
     exit_picture(p_Vid, &p_Vid->dec_picture);
+    if (p_Vid->dec_picture)
+    {
+      // incomplete picture, drop it
+      release_storable_picture(p_Vid, p_Vid->dec_picture);
+      p_Vid->dec_picture = NULL;
+    }
   }
   p_Vid->dpb_layer_id = currSlice->layer_id;
   //set buffers;
@@ -155,12 +164,6 @@ static void init_picture(VideoParameters *p_Vid, Slice *currSlice, InputParamete
     p_Vid->type = P_SLICE;  // concealed element
   }
 
-  // CAVLC init
-  if (p_Vid->active_pps->entropy_coding_mode_flag == (Boolean) CAVLC)
-  {
-    memset(p_Vid->nz_coeff[0][0][0], -1, p_Vid->PicSizeInMbs * 48 *sizeof(byte)); // 3 * 4 * 4
-  }
-
   // Set the slice_nr member of each MB to -1, to ensure correct when packet loss occurs
   // TO set Macroblock Map (mark all MBs as 'have to be concealed')
   if( (p_Vid->separate_colour_plane_flag != 0) )
@@ -504,7 +507,6 @@ int decode_one_frame(DecoderParams *pDecoder)
          p_Vid->iNumOfSlicesAllocated += MAX_NUM_DECSLICES;
        }
 
-			 p_Dec->nalu_pos_array_idx--;
        current_header = SOS;       
     }
     else
@@ -521,29 +523,12 @@ int decode_one_frame(DecoderParams *pDecoder)
        //keep it in currentslice;
        ppSliceList[p_Vid->iSliceNumOfCurrPic] = p_Vid->pNextSlice;
        p_Vid->pNextSlice = currSlice;
-
-			 p_Dec->nalu_pos_array_idx++;
     }
 
     copy_slice_info(currSlice, p_Vid->old_slice);
   }
   iRet = current_header;
 
-#if 0
-  static int interval;
-	static int is_decode_one_pbframe = 0;
-
-	if(is_decode_one_pbframe && interval)
-	{
-		interval --;
-		return iRet;
-	}
-	if(is_decode_one_pbframe && !interval)
-	{
-		is_decode_one_pbframe = 0;
-		//interval = p_Dec->p_Inp->FrameInvl;
-	}
-#endif
   init_picture_decoding(p_Vid);
 	
   for(iSliceNo=0; iSliceNo<p_Vid->iSliceNumOfCurrPic; iSliceNo++)
@@ -565,12 +550,6 @@ int decode_one_frame(DecoderParams *pDecoder)
 
     p_Vid->iNumOfSlicesDecoded++;
     p_Vid->num_dec_mb += currSlice->num_dec_mb;
-
-		if(iSliceNo == p_Vid->iSliceNumOfCurrPic - 1)
-		{
-			//interval = p_Dec->p_Inp->FrameInvl;
-			//is_decode_one_pbframe = 1;
-		}
   }
 
   exit_picture(p_Vid, &p_Vid->dec_picture);
@@ -618,24 +597,25 @@ int read_new_slice(Slice *currSlice)
   int BitsUsedByHeader;
   Bitstream *currStream = NULL;
 
-  static NALU_t *pending_nalu = NULL;
-
   int slice_id_a, slice_id_b, slice_id_c;
+#if (DEC_STATS)
+  int64 t_header;
+#endif
 
   for (;;)
   {
 #if (MVC_EXTENSION_ENABLE)
     currSlice->svc_extension_flag = -1;
 #endif
-    if (!pending_nalu)
+    if (!p_Vid->pending_nalu)
     {
       if (0 == read_next_nalu(p_Vid, nalu))
         return EOS;
     }
     else
     {
-      nalu = pending_nalu;
-      pending_nalu = NULL;
+      nalu = p_Vid->pending_nalu;
+      p_Vid->pending_nalu = NULL;
     }
 
 #if (MVC_EXTENSION_ENABLE)
@@ -701,6 +681,7 @@ process_nalu:
 
       currSlice->idr_flag = (nalu->nal_unit_type == NALU_TYPE_IDR);
       currSlice->nal_reference_idc = nalu->nal_reference_idc;
+      currSlice->nalu_pos = p_Dec->nalu_header_pos;
       currSlice->dp_mode = PAR_DP_1;
       currSlice->max_part_nr = 1;
 #if (MVC_EXTENSION_ENABLE)
@@ -772,6 +753,7 @@ process_nalu:
       // the parameter set ID of the SLice header.  Hence, read the pic_parameter_set_id
       // of the slice header first, then setup the active parameter sets, and then read
       // the rest of the slice header
+      STATS_START(t_header);
       BitsUsedByHeader = FirstPartOfSliceHeader(currSlice);
       UseParameterSet (currSlice);
       currSlice->active_sps = p_Vid->active_sps;
@@ -780,6 +762,7 @@ process_nalu:
       currSlice->chroma444_not_separate = (p_Vid->active_sps->chroma_format_idc==YUV444)&&((p_Vid->separate_colour_plane_flag == 0));
 
       BitsUsedByHeader += RestOfSliceHeader (currSlice);
+      STATS_STAGE(STAGE_SLICE_HEADER, t_header);
 #if (MVC_EXTENSION_ENABLE)
       //if(currSlice->view_id >=0)
       {
@@ -839,6 +822,7 @@ process_nalu:
 
       currSlice->idr_flag          = FALSE;
       currSlice->nal_reference_idc = nalu->nal_reference_idc;
+      currSlice->nalu_pos          = p_Dec->nalu_header_pos;
       currSlice->dp_mode     = PAR_DP_3;
       currSlice->max_part_nr = 3;
       currSlice->ei_flag     = 0;
@@ -857,6 +841,7 @@ process_nalu:
       currSlice->anchor_pic_flag = currSlice->idr_flag;
 #endif
 
+      STATS_START(t_header);
       BitsUsedByHeader = FirstPartOfSliceHeader(currSlice);
       UseParameterSet (currSlice);
       currSlice->active_sps = p_Vid->active_sps;
@@ -865,6 +850,7 @@ process_nalu:
       currSlice->chroma444_not_separate = (p_Vid->active_sps->chroma_format_idc==YUV444)&&((p_Vid->separate_colour_plane_flag == 0));
 
       BitsUsedByHeader += RestOfSliceHeader (currSlice);
+      STATS_STAGE(STAGE_SLICE_HEADER, t_header);
 #if MVC_EXTENSION_ENABLE
       //currSlice->p_Dpb = p_Vid->p_Dpb_layer[currSlice->view_id];
 #endif
@@ -965,7 +951,7 @@ process_nalu:
       else
       {
         currSlice->dpC_NotPresent =1;
-        pending_nalu = nalu;
+        p_Vid->pending_nalu = nalu;
       }
 
       // check if we read anything else than the expected partitions
@@ -993,17 +979,14 @@ process_nalu:
       }
       break;
     case NALU_TYPE_SEI:
-			p_Dec->nalu_pos_array_idx++;
       //printf ("read_new_slice: Found NALU_TYPE_SEI, len %d\n", nalu->len);
       InterpretSEIMessage(nalu->buf,nalu->len,p_Vid, currSlice);
       break;
     case NALU_TYPE_PPS:
-			p_Dec->nalu_pos_array_idx++;
       //printf ("Found NALU_TYPE_PPS\n");
       ProcessPPS(p_Vid, nalu);
       break;
     case NALU_TYPE_SPS:
-			p_Dec->nalu_pos_array_idx++;
       //printf ("Found NALU_TYPE_SPS\n");
       ProcessSPS(p_Vid, nalu);
       break;
@@ -1038,7 +1021,6 @@ process_nalu:
       //printf ("Found NALU_TYPE_SUB_SPS\n");
       if (p_Inp->DecodeAllLayers== 1)
       {
-				p_Dec->nalu_pos_array_idx++;
         ProcessSubsetSPS(p_Vid, nalu);
       }
       else
@@ -1100,6 +1082,8 @@ void exit_picture(VideoParameters *p_Vid, StorablePicture **dec_picture)
 
   chroma_format_idc = (*dec_picture)->chroma_format_idc;
 
+  // nothing is kept for reference or output, the buffers go back to the pool
+  release_storable_picture(p_Vid, *dec_picture);
   *dec_picture=NULL;
 
   if (p_Vid->last_has_mmco_5)
@@ -1394,7 +1378,10 @@ void decode_one_slice(Slice *currSlice)
   VideoParameters *p_Vid = currSlice->p_Vid;
   Boolean end_of_slice = FALSE;
   Macroblock *currMB = NULL;
+  STATS_TIMER(t_slice);
+  STATS_SLICE(currSlice->slice_type);
   currSlice->cod_counter=-1;
+  p_Dec->decode_nalu_pos = currSlice->nalu_pos;
 
   if( (p_Vid->separate_colour_plane_flag != 0) )
   {
@@ -1428,6 +1415,7 @@ void decode_one_slice(Slice *currSlice)
 
     // Initializes the current macroblock
     start_macroblock(currSlice, &currMB);
+    TRACE_BIN_MB(currSlice->current_mb_nr, currSlice->slice_type);
     // Get the syntax elements from the NAL
     //read_one_macroblock_i_slice_cabac read_one_macroblock_i_slice_cavlc
     currSlice->read_one_macroblock(currMB);
@@ -1440,8 +1428,11 @@ void decode_one_slice(Slice *currSlice)
     }
 
     end_of_slice = exit_macroblock(currSlice, (!currSlice->mb_aff_frame_flag|| currSlice->current_mb_nr%2));
+    STATS_COUNT(COUNT_MB, 1);
   }
   //reset_ec_flags(p_Vid);
+  STATS_STAGE((StatStage) (STAGE_MB_P + currSlice->slice_type), t_slice);
+  STATS_COUNT(COUNT_SLICE, 1);
 }
 
 #if (MVC_EXTENSION_ENABLE)
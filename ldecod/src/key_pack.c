@@ -0,0 +1,657 @@
+/*!
+ *************************************************************************************
+ * \file key_pack.c
+ *
+ * \brief
+ *    Compression of the key file: stream separation of the key records and
+ *    an order-0 rANS coder
+ *
+ *************************************************************************************
+ */
+
+#include "global.h"
+#include "key_bits.h"
+#include "key_restore.h"
+#include "key_pack.h"
+#include "memalloc.h"
+
+#define KEY_PACK_BLOCK    (1024 * 1024)   //!< stream bytes that are coded as one block
+#define KEY_PACK_STREAMS  4
+
+#define RANS_PROB_BITS    12
+#define RANS_PROB_SCALE   (1 << RANS_PROB_BITS)
+#define RANS_L            (1u << 23)      //!< lower bound of the coder state
+#define RANS_TABLE_SIZE   (32 + 2 * 256)  //!< symbol bitmap and frequencies
+
+#define PACK_RAW          0
+#define PACK_RANS         1
+
+//! streams of a block
+enum
+{
+  S_OFFSET = 0,   //!< relative byte offsets
+  S_TYPE,         //!< bit offset, record type
+  S_LENGTH,       //!< key data lengths and skip masks
+  S_DATA          //!< key bits
+};
+
+typedef struct pack_stream
+{
+  byte *buf;
+  int   size;
+  int   alloc;
+} PackStream;
+
+struct key_pack
+{
+  KeyPackWrite write;
+  void        *opaque;
+  PackStream   s[KEY_PACK_STREAMS];
+  PackStream   out;          //!< block being written
+  int          records;
+  int          free_bits;    //!< unused bits in the last byte of the key bit stream
+  int          started;      //!< KEY_PACK_MAGIC written
+  int          done;         //!< end of the key records seen
+};
+
+static void reserve(PackStream *s, int n)
+{
+  if (s->size + n > s->alloc)
+  {
+    int alloc = imax(2 * s->alloc, s->size + n);
+    byte *buf = realloc(s->buf, alloc);
+
+    if (buf == NULL)
+      no_mem_exit("key_pack: stream");
+    s->buf   = buf;
+    s->alloc = alloc;
+  }
+}
+
+static void put_byte(PackStream *s, byte v)
+{
+  reserve(s, 1);
+  s->buf[s->size++] = v;
+}
+
+static void put_varint(PackStream *s, uint64_t v)
+{
+  reserve(s, 10);
+  while (v >= 0x80)
+  {
+    s->buf[s->size++] = (byte) (v | 0x80);
+    v >>= 7;
+  }
+  s->buf[s->size++] = (byte) v;
+}
+
+static void put_u32(PackStream *s, unsigned int v)
+{
+  reserve(s, 4);
+  s->buf[s->size++] = (byte) v;
+  s->buf[s->size++] = (byte) (v >> 8);
+  s->buf[s->size++] = (byte) (v >> 16);
+  s->buf[s->size++] = (byte) (v >> 24);
+}
+
+static unsigned int get_u32(const byte *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+static int get_varint(const PackStream *s, int *pos, uint64_t *v)
+{
+  int shift = 0;
+
+  *v = 0;
+  while (*pos < s->size && shift < 64)
+  {
+    byte b = s->buf[(*pos)++];
+
+    *v |= (uint64_t) (b & 0x7f) << shift;
+    if (b < 0x80)
+      return 0;
+    shift += 7;
+  }
+  return -1;
+}
+
+//! appends the n <= 8 low bits of v to the key bit stream
+static void put_bits(KeyPack *kp, unsigned int v, int n)
+{
+  PackStream *s = &kp->s[S_DATA];
+
+  while (n > 0)
+  {
+    int k;
+
+    if (kp->free_bits == 0)
+    {
+      put_byte(s, 0);
+      kp->free_bits = 8;
+    }
+    k = imin(n, kp->free_bits);
+    s->buf[s->size - 1] |= (byte) (((v >> (n - k)) & ((1 << k) - 1)) << (kp->free_bits - k));
+    kp->free_bits -= k;
+    n -= k;
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Scales the symbol counts of n symbols to frequencies that add up to
+ *    RANS_PROB_SCALE, every symbol that occurs keeps at least 1
+ ************************************************************************
+ */
+static void normalize_freq(const int *count, int n, unsigned int *freq)
+{
+  int s, sum = 0;
+
+  for (s = 0; s < 256; s++)
+  {
+    freq[s] = 0;
+    if (count[s])
+    {
+      freq[s] = (unsigned int) ((int64) count[s] * RANS_PROB_SCALE / n);
+      if (freq[s] == 0)
+        freq[s] = 1;
+      sum += freq[s];
+    }
+  }
+  while (sum != RANS_PROB_SCALE)
+  {
+    int best = 0;
+
+    for (s = 1; s < 256; s++)
+    {
+      if (freq[s] > freq[best])
+        best = s;
+    }
+    if (sum > RANS_PROB_SCALE)
+    {
+      freq[best]--;
+      sum--;
+    }
+    else
+    {
+      freq[best]++;
+      sum++;
+    }
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Codes the n > 0 bytes of in with four interleaved rANS states. The
+ *    frequency table comes first, the coded bytes are produced from the
+ *    end of out backwards and moved behind it.
+ * \return
+ *    size of the coded bytes, -1 if they do not fit into out_size bytes
+ ************************************************************************
+ */
+int rans_encode(const byte *in, int n, byte *out, int out_size)
+{
+  int count[256] = {0};
+  unsigned int freq[256], start[256], x[4];
+  byte *ptr = out + out_size;
+  int s, i, len = 32;
+
+  if (out_size < RANS_TABLE_SIZE + 16)
+    return -1;
+  for (i = 0; i < n; i++)
+    count[in[i]]++;
+  normalize_freq(count, n, freq);
+
+  memset(out, 0, 32);
+  for (s = 0, i = 0; s < 256; s++)
+  {
+    start[s] = i;
+    i += freq[s];
+    if (freq[s])
+    {
+      unsigned int f = freq[s] - 1;
+
+      out[s >> 3] |= (byte) (1 << (s & 7));
+      // frequencies up to RANS_PROB_SCALE take two varint bytes at most
+      if (f >= 0x80)
+        out[len++] = (byte) (f | 0x80), f >>= 7;
+      out[len++] = (byte) f;
+    }
+  }
+
+  x[0] = x[1] = x[2] = x[3] = RANS_L;
+  for (i = n - 1; i >= 0; i--)
+  {
+    unsigned int f = freq[in[i]];
+    unsigned int x_max = ((RANS_L >> RANS_PROB_BITS) << 8) * f;
+    unsigned int st = x[i & 3];
+
+    while (st >= x_max)
+    {
+      if (ptr - out <= len + 16)
+        return -1;
+      *--ptr = (byte) st;
+      st >>= 8;
+    }
+    x[i & 3] = ((st / f) << RANS_PROB_BITS) + (st % f) + start[in[i]];
+  }
+  for (i = 3; i >= 0; i--)
+  {
+    ptr -= 4;
+    ptr[0] = (byte) x[i];
+    ptr[1] = (byte) (x[i] >> 8);
+    ptr[2] = (byte) (x[i] >> 16);
+    ptr[3] = (byte) (x[i] >> 24);
+  }
+
+  memmove(out + len, ptr, out + out_size - ptr);
+  return len + (int) (out + out_size - ptr);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Decodes n bytes coded by rans_encode(). Every slot of the
+ *    probability range maps to its symbol, frequency and start in one
+ *    table lookup.
+ * \return
+ *    0 on success, -1 if the in_size coded bytes are damaged
+ ************************************************************************
+ */
+int rans_decode(const byte *in, int in_size, byte *out, int n)
+{
+  unsigned int slot_entry[RANS_PROB_SCALE];   // frequency << 16 | slot - start
+  byte slot_sym[RANS_PROB_SCALE];
+  const byte *ptr, *end = in + in_size;
+  unsigned int x[4];
+  int s, i, pos = 32, slot = 0;
+
+  if (in_size < 32)
+    return -1;
+  for (s = 0; s < 256; s++)
+  {
+    unsigned int f;
+
+    if (!(in[s >> 3] & (1 << (s & 7))))
+      continue;
+    if (pos >= in_size)
+      return -1;
+    f = in[pos] & 0x7f;
+    if (in[pos++] & 0x80)
+    {
+      if (pos >= in_size)
+        return -1;
+      f |= in[pos++] << 7;
+    }
+    f++;
+    if (slot + (int) f > RANS_PROB_SCALE)
+      return -1;
+    for (i = 0; i < (int) f; i++)
+    {
+      slot_entry[slot + i] = (f << 16) | i;
+      slot_sym[slot + i]   = (byte) s;
+    }
+    slot += f;
+  }
+  if (slot != RANS_PROB_SCALE || end - (in + pos) < 16)
+    return -1;
+
+  ptr = in + pos;
+  for (i = 0; i < 4; i++, ptr += 4)
+    x[i] = ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((unsigned int) ptr[3] << 24);
+
+  for (i = 0; i < n; i++)
+  {
+    unsigned int st = x[i & 3];
+    unsigned int e  = slot_entry[st & (RANS_PROB_SCALE - 1)];
+
+    out[i] = slot_sym[st & (RANS_PROB_SCALE - 1)];
+    st = (e >> 16) * (st >> RANS_PROB_BITS) + (e & 0xffff);
+    while (st < RANS_L)
+    {
+      if (ptr >= end)
+        return -1;
+      st = (st << 8) | *ptr++;
+    }
+    x[i & 3] = st;
+  }
+  return 0;
+}
+
+KeyPack *key_pack_open(KeyPackWrite write, void *opaque)
+{
+  KeyPack *kp = calloc(1, sizeof(KeyPack));
+
+  if (kp == NULL)
+    no_mem_exit("key_pack_open: kp");
+  kp->write  = write;
+  kp->opaque = opaque;
+  return kp;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Codes the streams of the records collected so far as one block
+ ************************************************************************
+ */
+static void write_block(KeyPack *kp)
+{
+  PackStream *o = &kp->out;
+  int i;
+
+  if (kp->records == 0)
+    return;
+
+  o->size = 0;
+  if (!kp->started)
+  {
+    reserve(o, 8);
+    memcpy(o->buf, KEY_PACK_MAGIC, 8);
+    o->size = 8;
+    kp->started = 1;
+  }
+  put_u32(o, kp->records);
+  for (i = 0; i < KEY_PACK_STREAMS; i++)
+  {
+    PackStream *s = &kp->s[i];
+    int cap = 2 * s->size + RANS_TABLE_SIZE + 16;
+    int head = o->size;
+    int size = -1;
+
+    reserve(o, 9 + cap);
+    if (s->size > 0)
+      size = rans_encode(s->buf, s->size, o->buf + head + 9, cap);
+    o->buf[head + 8] = PACK_RANS;
+    if (size < 0 || size >= s->size)
+    {
+      memcpy(o->buf + head + 9, s->buf, s->size);
+      size = s->size;
+      o->buf[head + 8] = PACK_RAW;
+    }
+    o->size = head;
+    put_u32(o, s->size);
+    put_u32(o, size);
+    o->size += 1 + size;
+    s->size = 0;
+  }
+  kp->records   = 0;
+  kp->free_bits = 0;
+  kp->write(kp->opaque, o->buf, o->size);
+}
+
+static void write_end(KeyPack *kp)
+{
+  PackStream *o = &kp->out;
+
+  o->size = 0;
+  if (!kp->started)
+  {
+    reserve(o, 8);
+    memcpy(o->buf, KEY_PACK_MAGIC, 8);
+    o->size = 8;
+    kp->started = 1;
+  }
+  put_u32(o, 0);
+  kp->write(kp->opaque, o->buf, o->size);
+  kp->done = 1;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Splits the whole key records in buf into the streams. The zero byte
+ *    that ends the key records ends the packed file.
+ ************************************************************************
+ */
+void key_pack_add(KeyPack *kp, const byte *buf, int len)
+{
+  KeyRecord r;
+  bs_t b;
+  int n, i, k;
+
+  if (kp->done)
+    return;
+
+  bs_init(&b, (uint8_t *) buf, len);
+  while ((n = key_record_read(&b, &r)) > 0)
+  {
+    put_varint(&kp->s[S_OFFSET], (uint64_t) r.offset);
+    put_byte(&kp->s[S_TYPE], (byte) (r.bit_offset | (r.coalesced << KEY_BIT_LEN_3)));
+    if (r.coalesced)
+    {
+      put_varint(&kp->s[S_LENGTH], r.count - 1);
+      for (i = 0; i < r.count; i++)
+      {
+        if (i > 0)
+          put_varint(&kp->s[S_LENGTH], r.gap[i]);
+        put_varint(&kp->s[S_LENGTH], r.len[i]);
+      }
+    }
+    else
+      put_byte(&kp->s[S_LENGTH], (byte) r.len[0]);
+
+    for (k = r.key_bits; k > 0; k -= 8)
+      put_bits(kp, bs_read_u(&b, imin(k, 8)), imin(k, 8));
+    if (b.bits_left != 8)
+    {
+      b.p++;
+      b.bits_left = 8;
+    }
+    kp->records++;
+  }
+
+  if (n < 0)
+    fprintf(stderr, "key_pack_add: key record cut off\n");
+  else if (!bs_eof(&b))
+  {
+    write_block(kp);
+    write_end(kp);
+    return;
+  }
+  if (kp->s[S_OFFSET].size + kp->s[S_TYPE].size + kp->s[S_LENGTH].size + kp->s[S_DATA].size >= KEY_PACK_BLOCK)
+    write_block(kp);
+}
+
+//! writes the records collected so far, live mode makes its key records available this way
+void key_pack_flush(KeyPack *kp)
+{
+  write_block(kp);
+}
+
+void key_pack_close(KeyPack *kp)
+{
+  int i;
+
+  if (kp == NULL)
+    return;
+  write_block(kp);
+  for (i = 0; i < KEY_PACK_STREAMS; i++)
+    free(kp->s[i].buf);
+  free(kp->out.buf);
+  free(kp);
+}
+
+int key_pack_is_packed(const byte *data, int64 size)
+{
+  return size >= 8 && memcmp(data, KEY_PACK_MAGIC, 8) == 0;
+}
+
+static void write_ue(bs_t *b, unsigned int v)
+{
+  int len = 0;
+
+  while ((v + 1) >> len)
+    len++;
+  bs_write_u(b, len - 1, 0);
+  bs_write_u(b, len, v + 1);
+}
+
+static int copy_bits(bs_t *dst, bs_t *src, int n)
+{
+  if ((src->end - src->p) * 8 - (8 - src->bits_left) < n)
+    return -1;
+  for (; n > 0; n -= 8)
+    bs_write_u(dst, imin(n, 8), bs_read_u(src, imin(n, 8)));
+  return 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Writes the records of one block back in the layout of Get_Key()
+ * \return
+ *    0 on success, -1 if the streams do not match
+ ************************************************************************
+ */
+static int unpack_records(PackStream *o, PackStream *d, int records)
+{
+  int pos[KEY_PACK_STREAMS] = {0};
+  int room, r, i;
+  bs_t w, data;
+
+  // one type byte per record
+  if (records < 0 || records > d[S_TYPE].size)
+    return -1;
+  room = records * 13 + 2 * d[S_LENGTH].size + d[S_DATA].size + 16;
+  reserve(o, room);
+  memset(o->buf + o->size, 0, room);
+  bs_init(&w, o->buf + o->size, room);
+  bs_init(&data, d[S_DATA].buf, d[S_DATA].size);
+
+  for (r = 0; r < records; r++)
+  {
+    uint64_t offset, v;
+    int type, width = 1;
+
+    if (get_varint(&d[S_OFFSET], &pos[S_OFFSET], &offset) != 0 || pos[S_TYPE] >= d[S_TYPE].size)
+      return -1;
+    type = d[S_TYPE].buf[pos[S_TYPE]++];
+    while (width < 64 && (offset >> width))
+      width++;
+
+    bs_write_u(&w, KEY_BIT_LEN_1, width);
+    if (width > 32)
+    {
+      bs_write_u(&w, width - 32, (uint32_t) (offset >> 32));
+      bs_write_u(&w, 32, (uint32_t) offset);
+    }
+    else
+      bs_write_u(&w, width, (uint32_t) offset);
+    bs_write_u(&w, KEY_BIT_LEN_3, type & ((1 << KEY_BIT_LEN_3) - 1));
+
+    if (type >> KEY_BIT_LEN_3)
+    {
+      int count, len[KEY_GROUP_MAX_UNITS], key_bits = 0;
+
+      if (get_varint(&d[S_LENGTH], &pos[S_LENGTH], &v) != 0 || v >= KEY_GROUP_MAX_UNITS)
+        return -1;
+      count = (int) v + 1;
+      bs_write_u(&w, KEY_BIT_LEN_4, 0);
+      bs_write_u(&w, KEY_BIT_LEN_COUNT, count - 1);
+      for (i = 0; i < count; i++)
+      {
+        if (i > 0)
+        {
+          if (get_varint(&d[S_LENGTH], &pos[S_LENGTH], &v) != 0 || v > KEY_GROUP_MAX_SPAN)
+            return -1;
+          write_ue(&w, (unsigned int) v);
+        }
+        if (get_varint(&d[S_LENGTH], &pos[S_LENGTH], &v) != 0 || v > KEY_GROUP_MAX_SPAN)
+          return -1;
+        write_ue(&w, (unsigned int) v);
+        len[i] = (int) v;
+        key_bits += len[i];
+      }
+      if (copy_bits(&w, &data, key_bits) != 0)
+        return -1;
+    }
+    else
+    {
+      int len;
+
+      if (pos[S_LENGTH] >= d[S_LENGTH].size)
+        return -1;
+      len = d[S_LENGTH].buf[pos[S_LENGTH]++];
+      bs_write_u(&w, KEY_BIT_LEN_4, len);
+      if (copy_bits(&w, &data, len) != 0)
+        return -1;
+    }
+    if (w.bits_left != 8)
+    {
+      w.p++;
+      w.bits_left = 8;
+    }
+    if (bs_eof(&w))
+      return -1;
+  }
+  o->size += (int) (w.p - w.start);
+  return 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Unpacks a packed key file into the key records and the zero byte
+ *    that ends them
+ * \return
+ *    the key records, NULL if the packed file is damaged
+ ************************************************************************
+ */
+byte *key_pack_unpack(const byte *data, int64 size, int64 *out_size)
+{
+  PackStream o = {0}, d[KEY_PACK_STREAMS];
+  int64 pos = 8;
+  int i, ok = 1;
+
+  memset(d, 0, sizeof(d));
+  while (ok && pos + 4 <= size)
+  {
+    int records = (int) get_u32(data + pos);
+
+    pos += 4;
+    if (records == 0)
+      break;
+    for (i = 0; ok && i < KEY_PACK_STREAMS; i++)
+    {
+      int raw, coded, method;
+
+      if (pos + 9 > size)
+      {
+        ok = 0;
+        break;
+      }
+      raw    = (int) get_u32(data + pos);
+      coded  = (int) get_u32(data + pos + 4);
+      method = data[pos + 8];
+      pos   += 9;
+      if (raw < 0 || coded < 0 || pos + coded > size)
+      {
+        ok = 0;
+        break;
+      }
+      d[i].size = 0;
+      reserve(&d[i], raw);
+      if (method == PACK_RAW && coded == raw)
+        memcpy(d[i].buf, data + pos, raw);
+      else if (method != PACK_RANS || rans_decode(data + pos, coded, d[i].buf, raw) != 0)
+        ok = 0;
+      d[i].size = raw;
+      pos += coded;
+    }
+    if (ok && unpack_records(&o, d, records) != 0)
+      ok = 0;
+  }
+  for (i = 0; i < KEY_PACK_STREAMS; i++)
+    free(d[i].buf);
+  if (!ok)
+  {
+    free(o.buf);
+    return NULL;
+  }
+  put_byte(&o, 0);
+  *out_size = o.size;
+  return o.buf;
+}
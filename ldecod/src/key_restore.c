@@ -0,0 +1,339 @@
+/*!
+ *************************************************************************************
+ * \file key_restore.c
+ *
+ * \brief
+ *    Restores a protected bitstream with the records of its key file
+ *
+ *************************************************************************************
+ */
+
+#include "global.h"
+#include "key_bits.h"
+#include "key_restore.h"
+#include "key_pack.h"
+#include "memalloc.h"
+
+#define RESTORE_WINDOW    (1024 * 1024)
+
+//! part of the bitstream that is being restored
+typedef struct restore_window
+{
+  StreamIO io;
+  byte    *buf;
+  int64    start;      //!< stream offset of buf[0]
+  int      count;      //!< bytes in buf
+  int      dirty;
+  int      moves;      //!< window loads, the random accesses of the restore
+} RestoreWindow;
+
+//! bytes of the bitstream that hold the key units of a record
+typedef struct key_span
+{
+  int64 first;
+  int64 last;
+} KeySpan;
+
+static int flush_window(RestoreWindow *w)
+{
+  if (w->dirty && stream_pwrite(&w->io, w->buf, w->count, w->start) != w->count)
+    return -1;
+  w->dirty = 0;
+  return 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Makes the bytes first to last - 1 of the bitstream available in the
+ *    window
+ * \return
+ *    0 on success, -1 if they are not in the file
+ ************************************************************************
+ */
+static int load_window(RestoreWindow *w, int64 first, int64 last)
+{
+  if (first >= w->start && last <= w->start + w->count)
+    return 0;
+  if (flush_window(w) != 0)
+    return -1;
+  w->start = first;
+  w->count = stream_pread(&w->io, w->buf, RESTORE_WINDOW, first);
+  w->moves++;
+  return (last <= w->start + w->count) ? 0 : -1;
+}
+
+static void put_bit(byte *buf, int64 bit, int v)
+{
+  byte mask = (byte) (0x80 >> (bit & 7));
+
+  if (v)
+    buf[bit >> 3] |= mask;
+  else
+    buf[bit >> 3] &= (byte) ~mask;
+}
+
+static int read_ue(bs_t *b)
+{
+  int zeros = 0;
+
+  while (!bs_eof(b) && bs_read_u1(b) == 0 && zeros < 31)
+    zeros++;
+  return (int) ((1u << zeros) - 1 + bs_read_u(b, zeros));
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Reads the header and skip mask of the next key record, b is left at
+ *    its key bits
+ * \return
+ *    1 if a record was read, 0 at the end of the key file, -1 if the
+ *    record is cut off
+ ************************************************************************
+ */
+int key_record_read(bs_t *b, KeyRecord *r)
+{
+  int width, len, i;
+
+  if (bs_eof(b) || (width = bs_read_u(b, KEY_BIT_LEN_1)) == 0)
+    return 0;
+  if (width > 32)
+  {
+    r->offset  = (int64) bs_read_u(b, width - 32) << 32;
+    r->offset |= bs_read_u(b, 32);
+  }
+  else
+    r->offset = bs_read_u(b, width);
+  r->bit_offset = bs_read_u(b, KEY_BIT_LEN_3);
+  len           = bs_read_u(b, KEY_BIT_LEN_4);
+
+  if (len > 0)
+  {
+    r->coalesced = 0;
+    r->count     = 1;
+    r->gap[0]    = 0;
+    r->len[0]    = len;
+    r->span      = len;
+    r->key_bits  = len;
+  }
+  else
+  {
+    r->coalesced = 1;
+    r->count     = bs_read_u(b, KEY_BIT_LEN_COUNT) + 1;
+    r->span      = 0;
+    r->key_bits  = 0;
+    for (i = 0; i < r->count; i++)
+    {
+      r->gap[i]    = (i > 0) ? read_ue(b) : 0;
+      r->len[i]    = read_ue(b);
+      r->span     += r->gap[i] + r->len[i];
+      r->key_bits += r->len[i];
+    }
+  }
+  return bs_eof(b) ? -1 : 1;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Checks that the rest of the key file behind the end record is zero
+ ************************************************************************
+ */
+static int key_file_ended(bs_t *b)
+{
+  if (bs_eof(b) || bs_read_u(b, b->bits_left) != 0)
+    return 0;
+  while (!bs_eof(b))
+  {
+    if (*b->p++ != 0)
+      return 0;
+  }
+  return 1;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Checks that every record lies in the payload of one NAL unit of the
+ *    restored bitstream: behind the NAL unit header, with no start code
+ *    or other forbidden three byte sequence (00 00 00, 00 00 01,
+ *    00 00 02) overlapping it. The protected bitstream cannot be checked,
+ *    its zeroed key bits may form such sequences.
+ * \return
+ *    -1 if all records fit, otherwise the number of the first one that
+ *    does not
+ ************************************************************************
+ */
+static int check_nal_bounds(RestoreWindow *w, const KeySpan *span, int count)
+{
+  int64 pos = 0, header = -1;
+  int next = 0, open = 0, zeros = 0, i, n;
+
+  while (open < count && (n = stream_pread(&w->io, w->buf, RESTORE_WINDOW, pos)) > 0)
+  {
+    for (i = 0; i < n && open < count; i++, pos++)
+    {
+      int v = w->buf[i];
+
+      for (; next < count && span[next].first <= pos; next++)
+      {
+        if (header < 0 || header >= span[next].first)
+          return next;
+      }
+      if (zeros >= 2 && v <= 2)
+      {
+        //records from open on end at pos - 2 or later
+        if (open < next)
+          return open;
+        if (v == 1)
+          header = pos + 1;
+      }
+      zeros = (v == 0) ? zeros + 1 : 0;
+      while (open < next && span[open].last < pos - 1)
+        open++;
+    }
+  }
+  //no start code follows the end of the bitstream
+  return (next < count) ? next : -1;
+}
+
+static byte *read_key_file(const char *key_fn, int64 *size)
+{
+  FILE *f = fopen(key_fn, "rb");
+  byte *data = NULL;
+  int64 alloc = 0, n = 0;
+  size_t got;
+
+  if (f == NULL)
+    return NULL;
+  do
+  {
+    if (n == alloc)
+    {
+      alloc = alloc ? 2 * alloc : RESTORE_WINDOW;
+      if ((data = realloc(data, (size_t) alloc)) == NULL)
+        no_mem_exit("read_key_file: data");
+    }
+    got = fread(data + n, 1, (size_t) (alloc - n), f);
+    n += got;
+  } while (got > 0);
+  fclose(f);
+  *size = n;
+  return data;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Writes the key bits of the key file key_fn back into the protected
+ *    bitstream file fn. The restored key units and bits are counted in
+ *    p_DecStats, which must be bound with DEC_STATS.
+ * \return
+ *    0 on success, -1 if a file cannot be opened or the key file does
+ *    not fit the bitstream
+ ************************************************************************
+ */
+int restore_stream(const char *fn, const char *key_fn)
+{
+  RestoreWindow w;
+  byte *keys;
+  KeySpan *span = NULL;
+  int64 key_size = 0, pos = 0, key_bits = 0;
+  int records = 0, units = 0, span_size = 0, ret, n;
+  KeyRecord r;
+  bs_t b;
+
+  if ((keys = read_key_file(key_fn, &key_size)) == NULL)
+  {
+    fprintf(stderr, "restore_stream: cannot read key file %s\n", key_fn);
+    return -1;
+  }
+  if (key_pack_is_packed(keys, key_size))
+  {
+    byte *records = key_pack_unpack(keys, key_size, &key_size);
+
+    free(keys);
+    if ((keys = records) == NULL)
+    {
+      fprintf(stderr, "restore_stream: damaged packed key file %s\n", key_fn);
+      return -1;
+    }
+  }
+  memset(&w, 0, sizeof(RestoreWindow));
+  stream_io_init(&w.io, NULL, NULL);
+  if (stream_io_open(&w.io, fn) != 0)
+  {
+    fprintf(stderr, "restore_stream: cannot open %s\n", fn);
+    stream_io_close(&w.io);
+    free(keys);
+    return -1;
+  }
+  if ((w.buf = malloc(RESTORE_WINDOW)) == NULL)
+    no_mem_exit("restore_stream: window");
+
+  bs_init(&b, keys, (size_t) key_size);
+  while ((n = key_record_read(&b, &r)) > 0)
+  {
+    int64 bit;
+    int i, k;
+
+    pos += r.offset;
+    if (load_window(&w, pos, pos + (r.bit_offset + r.span + 7) / 8) != 0)
+    {
+      n = -1;
+      break;
+    }
+    if (records == span_size)
+    {
+      span_size = span_size ? 2 * span_size : 1024;
+      if ((span = realloc(span, span_size * sizeof(KeySpan))) == NULL)
+        no_mem_exit("restore_stream: span");
+    }
+    span[records].first = pos + r.bit_offset / 8;
+    span[records].last  = pos + (r.bit_offset + imax(r.span, 1) - 1) / 8;
+    bit = (pos - w.start) * 8 + r.bit_offset;
+    for (i = 0; i < r.count; i++)
+    {
+      bit += r.gap[i];
+      for (k = 0; k < r.len[i]; k++)
+        put_bit(w.buf, bit++, bs_read_u1(&b));
+    }
+    w.dirty   = 1;
+    units    += r.count;
+    key_bits += r.key_bits;
+    records++;
+    if (b.bits_left != 8)
+    {
+      b.p++;
+      b.bits_left = 8;
+    }
+  }
+
+  //a record header that was read wrong ends the key file too early
+  if (n == 0 && !key_file_ended(&b))
+    n = -1;
+  ret = (n < 0) ? -1 : 0;
+  if (flush_window(&w) != 0)
+    ret = -1;
+  if (ret != 0)
+    fprintf(stderr, "restore_stream: key record %d does not fit %s\n", records, fn);
+  else if ((n = check_nal_bounds(&w, span, records)) >= 0)
+  {
+    fprintf(stderr, "restore_stream: key record %d is not inside a NAL unit payload of %s\n", n, fn);
+    ret = -1;
+  }
+  else
+  {
+    STATS_COUNT(COUNT_KEY_UNIT, units);
+    STATS_COUNT(COUNT_KEY_BITS, key_bits);
+    printf("restored %s: %d key records, %d key units, %lld key bits, %d window loads\n",
+      fn, records, units, (long long) key_bits, w.moves);
+  }
+
+  free(span);
+  free(w.buf);
+  stream_io_close(&w.io);
+  free(keys);
+  return ret;
+}
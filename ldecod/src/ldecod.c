@@ -45,6 +45,7 @@
 #include "contributors.h"
 
 //#include <sys/stat.h>
+#include <pthread.h>
 
 #include "global.h"
 #include "annexb.h"
@@ -58,15 +59,21 @@
 #include "nalu.h"
 #include "rtp.h"
 #include "h264decoder.h"
+#include "key_common.h"
+#include "pipeline.h"
 
 #define LOGFILE     "log.dec"
 #define DATADECFILE "dataDec.txt"
 #define TRACEFILE   "vfile/trace_dec.txt"
 
-// Decoder definition. This should be the only global variable in the entire
-// software. Global variables should be avoided.
-DecoderParams  *p_Dec;
-char errortext[ET_SIZE];
+// Decoder bound to the calling thread. All decoder state lives in the
+// DecoderParams instances, every interface function binds its instance
+// here so that several decoders can run in one process.
+THREAD_LOCAL DecoderParams  *p_Dec;
+THREAD_LOCAL char errortext[ET_SIZE];
+
+extern void Encrypt(ThreadUnitPar *thread_unit_par);
+extern void Encrypt_Sync(ThreadUnitPar *thread_unit_par);
 
 // Prototypes of static functions
 static void init        (VideoParameters *p_Vid);
@@ -95,8 +102,24 @@ void error(char *text, int code)
 void error_KeyGen(char *text, int code)
 {
   fprintf(stderr, "%s\n", text);
+  //with TraceLast the ring holds the syntax elements in front of the rejected key unit
+  TRACE_BIN_FLUSH();
   exit(code);
 }
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Binds a decoder instance to the calling thread. Needs to be called
+ *    by every thread before it works on the instance.
+ ************************************************************************
+ */
+void set_current_decoder(DecoderParams *pDecoder)
+{
+  p_Dec = pDecoder;
+  p_DecStats = pDecoder ? &pDecoder->stats : NULL;
+  p_TraceBin = pDecoder ? pDecoder->trace_bin : NULL;
+}
 /*!
  ***********************************************************************
  * \brief
@@ -273,6 +296,8 @@ static void init(VideoParameters *p_Vid)  //!< video parameters
   p_Vid->dec_picture = NULL;
   p_Vid->MbToSliceGroupMap = NULL;
   p_Vid->MapUnitToSliceGroupMap = NULL;
+  p_Vid->NextMbInSliceGroup = NULL;
+  p_Vid->NextMbInSliceGroupSize = 0;
 
   p_Vid->LastAccessUnitExists  = 0;
   p_Vid->NALUCount = 0;
@@ -526,33 +551,28 @@ int init_global_buffers(VideoParameters *p_Vid, int layer_id)
   {
     for( i=0; i<MAX_PLANE; ++i )
     {
-      if(((cps->mb_data_JV[i]) = (Macroblock *) calloc(cps->FrameSizeInMbs, sizeof(Macroblock))) == NULL)
-        no_mem_exit("init_global_buffers: cps->mb_data_JV");
+      cps->mb_data_JV[i] = (Macroblock *) mem_calloc_aligned(cps->FrameSizeInMbs, sizeof(Macroblock));
     }
     cps->mb_data = NULL;
   }
   else
   {
-    if(((cps->mb_data) = (Macroblock *) calloc(cps->FrameSizeInMbs, sizeof(Macroblock))) == NULL)
-      no_mem_exit("init_global_buffers: cps->mb_data");
+    cps->mb_data = (Macroblock *) mem_calloc_aligned(cps->FrameSizeInMbs, sizeof(Macroblock));
   }
   if( (cps->separate_colour_plane_flag != 0) )
   {
     for( i=0; i<MAX_PLANE; ++i )
     {
-      if(((cps->intra_block_JV[i]) = (char*) calloc(cps->FrameSizeInMbs, sizeof(char))) == NULL)
-        no_mem_exit("init_global_buffers: cps->intra_block_JV");
+      cps->intra_block_JV[i] = (char*) mem_calloc_aligned(cps->FrameSizeInMbs, sizeof(char));
     }
     cps->intra_block = NULL;
   }
   else
   {
-    if(((cps->intra_block) = (char*) calloc(cps->FrameSizeInMbs, sizeof(char))) == NULL)
-      no_mem_exit("init_global_buffers: cps->intra_block");
+    cps->intra_block = (char*) mem_calloc_aligned(cps->FrameSizeInMbs, sizeof(char));
   }
 
-  if(((cps->PicPos) = (BlockPos*) calloc(cps->FrameSizeInMbs + 1, sizeof(BlockPos))) == NULL)
-    no_mem_exit("init_global_buffers: PicPos");
+  cps->PicPos = (BlockPos*) mem_calloc_aligned(cps->FrameSizeInMbs + 1, sizeof(BlockPos));
 
   PicPos = cps->PicPos;
   for (i = 0; i < (int) cps->FrameSizeInMbs + 1;++i)
@@ -561,8 +581,13 @@ int init_global_buffers(VideoParameters *p_Vid, int layer_id)
     PicPos[i].y = (short) (i / cps->PicWidthInMbs);
   }
 
-  // CAVLC mem
-  memory_size += get_mem4D(&(cps->nz_coeff), cps->FrameSizeInMbs, 3, BLOCK_SIZE, BLOCK_SIZE);
+  // neighbour context ring: two MB rows, or two MB pair rows for interlaced sequences,
+  // every slot starts on a cache line
+  i = cps->PicWidthInMbs * (cps->FrameHeightInMbs == cps->PicHeightInMapUnits ? 2 : 4);
+  for (cps->mb_ctx_mask = 1; cps->mb_ctx_mask < i; cps->mb_ctx_mask <<= 1)
+    ;
+  memory_size += get_mem_block1D(&cps->mb_ctx, sizeof(MbContext), cps->mb_ctx_mask);
+  cps->mb_ctx_mask -= 1;
   //if( (cps->separate_colour_plane_flag != 0) )
   {
     //for( i=0; i<MAX_PLANE; ++i )
@@ -607,12 +632,8 @@ void free_layer_buffers(VideoParameters *p_Vid, int layer_id)
   if(!p_Vid->global_init_done[layer_id])
     return;
 
-  // CAVLC free mem
-  if (cps->nz_coeff)
-  {
-    free_mem4D(cps->nz_coeff);
-    cps->nz_coeff = NULL;
-  }
+  if (cps->mb_ctx.data)
+    free_mem_block(&cps->mb_ctx);
 
   // free mem, allocated for structure p_Vid
   if( (cps->separate_colour_plane_flag != 0) )
@@ -620,11 +641,11 @@ void free_layer_buffers(VideoParameters *p_Vid, int layer_id)
     int i;
     for(i=0; i<MAX_PLANE; i++)
     {
-      free(cps->mb_data_JV[i]);
+      mem_free_aligned(cps->mb_data_JV[i]);
       cps->mb_data_JV[i] = NULL;
       //free_mem2Dint(cps->siblock_JV[i]);
       //cps->siblock_JV[i] = NULL;
-      free (cps->intra_block_JV[i]);
+      mem_free_aligned(cps->intra_block_JV[i]);
       cps->intra_block_JV[i] = NULL;
     }   
   }
@@ -632,7 +653,7 @@ void free_layer_buffers(VideoParameters *p_Vid, int layer_id)
   {
     if (cps->mb_data != NULL)
     {
-      free(cps->mb_data);
+      mem_free_aligned(cps->mb_data);
       cps->mb_data = NULL;
     }
     //if(cps->siblock)
@@ -642,13 +663,13 @@ void free_layer_buffers(VideoParameters *p_Vid, int layer_id)
     }
     if(cps->intra_block)
     {
-      free (cps->intra_block);
+      mem_free_aligned(cps->intra_block);
       cps->intra_block = NULL;
     }
   }
   if(cps->PicPos)
   {
-    free(cps->PicPos);
+    mem_free_aligned(cps->PicPos);
     cps->PicPos = NULL;
   }
 
@@ -662,6 +683,7 @@ void free_global_buffers(VideoParameters *p_Vid)
     free_storable_picture(p_Vid->dec_picture);
     p_Vid->dec_picture = NULL;
   }
+  free_picture_pool(p_Vid);
 }
 
 void ClearDecPicList(VideoParameters *p_Vid)
@@ -689,25 +711,36 @@ void ClearDecPicList(VideoParameters *p_Vid)
 #endif
 }
 /************************************
-Interface: OpenDecoder
+Interface: OpenDecoderIO
+  Like OpenDecoder() but the bitstream
+  comes from in and the protected stream
+  and the key records go to out, either
+  may be NULL (see stream_io.h)
 Return: 
        0: NOERROR;
        <0: ERROR;
 ************************************/
-int OpenDecoder(InputParameters *p_Inp)
+int OpenDecoderIO(InputParameters *p_Inp, const StreamInput *in, const StreamOutput *out, DecoderParams **ppDecoder)
 {
   int iRet;
   DecoderParams *pDecoder;
   
-  iRet = alloc_decoder(&p_Dec);
+  *ppDecoder = NULL;
+  if (in != NULL && p_Inp->FileFormat == PAR_OF_RTP)
+  {
+    //RTP packets are only read from files
+    return (DEC_INVALID_PARAM|DEC_ERRMASK);
+  }
+  iRet = alloc_decoder(&pDecoder);
   if(iRet)
   {
     return (iRet|DEC_ERRMASK);
   }
+  set_current_decoder(pDecoder);
   init_time();
 
-  pDecoder = p_Dec;
   memcpy(pDecoder->p_Inp, p_Inp, sizeof(InputParameters));
+  stream_io_init(&pDecoder->io, in, out);
 #if TRACE
   if ((pDecoder->p_trace = fopen(TRACEFILE,"w"))==0) 
   {
@@ -716,6 +749,15 @@ int OpenDecoder(InputParameters *p_Inp)
     return -1;
   }
 #endif
+  if (pDecoder->p_Inp->trace_file[0])
+  {
+#if (TRACE_BIN)
+    pDecoder->trace_bin = trace_bin_open(pDecoder->p_Inp->trace_file, pDecoder->p_Inp->infile, pDecoder->p_Inp->trace_last);
+    p_TraceBin = pDecoder->trace_bin;
+#else
+    fprintf(stderr, "TraceFile %s ignored, the binary trace needs a build with TRACE_BIN 1\n", pDecoder->p_Inp->trace_file);
+#endif
+  }
 
   switch( pDecoder->p_Inp->FileFormat )
   {
@@ -723,6 +765,20 @@ int OpenDecoder(InputParameters *p_Inp)
   case PAR_OF_ANNEXB:
     malloc_annex_b(pDecoder->p_Vid, &pDecoder->p_Vid->annex_b);
     open_annex_b(pDecoder->p_Inp->infile, pDecoder->p_Vid->annex_b);	//ݵ
+    //MultiThread key generation threads share the file without write-back
+    stream_io_async(&pDecoder->io, pDecoder->p_Inp->async_io, pDecoder->p_Inp->async_depth, !pDecoder->p_Inp->multi_thread);
+    if (in != NULL && in->index != NULL)
+    {
+      pDecoder->nal_index = in->index;
+    }
+    else if (pDecoder->p_Inp->use_nal_index && pDecoder->io.fd != -1)
+    {
+      //read by the sidecar index if it is valid, otherwise record one
+      if (nal_index_load(&pDecoder->nal_index_own, pDecoder->p_Inp->infile) == 0)
+        pDecoder->nal_index = &pDecoder->nal_index_own;
+      else
+        pDecoder->nal_index_record = 1;
+    }
     break;
   case PAR_OF_RTP:
     OpenRTPFile(pDecoder->p_Inp->infile, &pDecoder->p_Vid->BitStreamFile);
@@ -739,9 +795,64 @@ int OpenDecoder(InputParameters *p_Inp)
   init_subset_sps_list(pDecoder->p_Vid->SubsetSeqParSet, MAXSPS);
 #endif
 
+  init_GenKeyPar();
+
+  if(pDecoder->p_Inp->pipeline > 0 && pDecoder->p_Inp->enable_key)
+  {
+    if(pDecoder->io.read != NULL)
+    {
+      //the memory image of callback input is reallocated while parsing
+      fprintf(stderr, "Warning: Pipeline is not supported with callback input, key units are protected after parsing\n");
+    }
+    else if(pipeline_start(pDecoder, pDecoder->p_Inp->pipeline) != 0)
+    {
+      fprintf(stderr, "Warning: cannot start the pipeline, key units are protected after parsing\n");
+    }
+  }
+
+  *ppDecoder = pDecoder;
   return DEC_OPEN_NOERR;
 }
 
+/************************************
+Interface: OpenDecoder
+Return: 
+       0: NOERROR;
+       <0: ERROR;
+************************************/
+int OpenDecoder(InputParameters *p_Inp, DecoderParams **ppDecoder)
+{
+  return OpenDecoderIO(p_Inp, NULL, NULL, ppDecoder);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Live mode: protects the key units of the access units parsed so far
+ *    and emits the protected stream up to the next slice, which has been
+ *    read but not parsed yet
+ ************************************************************************
+ */
+static int protect_parsed_units(DecoderParams *pDecoder)
+{
+  ThreadUnitPar par;
+
+  if(pDecoder->p_Inp->enable_key)
+  {
+    memset(&par, 0, sizeof(ThreadUnitPar));
+    par.pDecoder = pDecoder;
+    par.buffer_start = 0;
+    par.buffer_len = pDecoder->key_unit_idx;
+    Encrypt_Sync(&par);
+
+    pDecoder->key_units_protected += pDecoder->key_unit_idx;
+    pDecoder->key_unit_idx = 0;
+  }
+  pDecoder->live_pending_au = 0;
+
+  return stream_emit_output(&pDecoder->io, pDecoder->slice_nalu_pos);
+}
+
 /************************************
 Interface: DecodeOneFrame
 Return: 
@@ -749,15 +860,23 @@ Return:
        1: Finished decoding;
        others: Error Code;
 ************************************/
-int DecodeOneFrame(/*DecodedPicList **ppDecPicList*/)
+int DecodeOneFrame(DecoderParams *pDecoder)
 {
   int iRet;
-  DecoderParams *pDecoder = p_Dec;
+
+  set_current_decoder(pDecoder);
   //ClearDecPicList(pDecoder->p_Vid);
   iRet = decode_one_frame(pDecoder);
   if(iRet == SOP)
   {
     iRet = DEC_SUCCEED;
+    if(pDecoder->p_Inp->stream_lag > 0 && ++pDecoder->live_pending_au >= pDecoder->p_Inp->stream_lag)
+    {
+      if(protect_parsed_units(pDecoder) != 0)
+        iRet = DEC_ERRMASK;
+    }
+    if(pDecoder->pipeline)
+      pipeline_push_units(pDecoder);
   }
   else if(iRet == EOS)
   {
@@ -772,11 +891,84 @@ int DecodeOneFrame(/*DecodedPicList **ppDecPicList*/)
   return iRet;
 }
 
-int FinitDecoder(/*DecodedPicList **ppDecPicList*/)
+/************************************
+Interface: EncryptStream
+  Cuts the key units captured by
+  DecodeOneFrame() out of the bitstream
+  and writes them to the key file, the
+  protected stream is then handed to the
+  write_stream callback if there is one
+Return: 
+       0: NOERROR;
+       <0: ERROR;
+************************************/
+int EncryptStream(DecoderParams *pDecoder)
+{
+  ThreadUnitPar par;
+  void *status;
+  int i, ret;
+
+  set_current_decoder(pDecoder);
+  printf("key unit count: %lld\n", (long long) (pDecoder->key_units_protected + pDecoder->key_unit_idx));
+
+  if(pDecoder->p_Inp->multi_thread == 1)
+  {
+    ret = pthread_attr_destroy(&pDecoder->thread_attr);
+    if (ret != 0)
+    {
+      printf("pthread_attr_destroy error: %s\n",strerror(ret));
+    }
+  }
+
+  memset(&par, 0, sizeof(ThreadUnitPar));
+  par.pDecoder = pDecoder;
+
+  if(!pDecoder->p_Inp->enable_key)
+  {
+    //parse only, no key units were captured
+  }
+  else if(pDecoder->pipeline)
+  {
+    //the encrypt thread gets the key units of the last access unit
+    pipeline_finish(pDecoder);
+  }
+  else if(pDecoder->p_Inp->multi_thread)
+  {
+    //deal with the rest KU buffer data
+    if(pDecoder->key_unit_buffer_len <= MAX_THREAD_DO_KEY_UNIT_CNT)
+    {
+      par.buffer_start = pDecoder->key_unit_idx - pDecoder->key_unit_buffer_len;
+      par.buffer_len = pDecoder->key_unit_buffer_len;
+      par.cur_absolute_offset = pDecoder->thread_par_cur_pos;
+      Encrypt(&par);
+    }
+
+    for(i = 0; i < pDecoder->pid_id; ++i)
+    {
+      pthread_join(pDecoder->pid[i], &status);
+    }
+  }
+  else
+  {
+    par.buffer_start = 0;
+    par.buffer_len = pDecoder->key_unit_idx;
+    par.cur_absolute_offset = pDecoder->key_unit_buffer[0].byte_offset;
+    Encrypt(&par);
+  }
+
+  if (stream_flush_output(&pDecoder->io) != 0)
+  {
+    fprintf(stderr, "EncryptStream: output callback did not take the protected stream\n");
+    return -1;
+  }
+  return DEC_GEN_NOERR;
+}
+
+int FinitDecoder(DecoderParams *pDecoder)
 {
-  DecoderParams *pDecoder = p_Dec;
   if(!pDecoder)
     return DEC_GEN_NOERR;
+  set_current_decoder(pDecoder);
   ClearDecPicList(pDecoder->p_Vid);
 
   if (pDecoder->p_Inp->FileFormat == PAR_OF_ANNEXB)
@@ -789,14 +981,16 @@ int FinitDecoder(/*DecodedPicList **ppDecPicList*/)
   return DEC_GEN_NOERR;
 }
 
-int CloseDecoder()
+int CloseDecoder(DecoderParams *pDecoder)
 {
   int i;
 
-  DecoderParams *pDecoder = p_Dec;
   if(!pDecoder)
     return DEC_CLOSE_NOERR;
-  
+  set_current_decoder(pDecoder);
+
+  pipeline_finish(pDecoder);
+  deinit_GenKeyPar();
   //Report  (pDecoder->p_Vid);
   FmoFinit(pDecoder->p_Vid);
   free_layer_buffers(pDecoder->p_Vid, 0);
@@ -816,8 +1010,12 @@ int CloseDecoder()
 #if TRACE
   fclose(pDecoder->p_trace);
 #endif
+  trace_bin_close(pDecoder->trace_bin);
+  pDecoder->trace_bin = NULL;
 
+  nal_index_free(&pDecoder->nal_index_own);
   CleanUpPPS(pDecoder->p_Vid);
+  CleanUpSPS(pDecoder->p_Vid);
 #if (MVC_EXTENSION_ENABLE)
   for(i=0; i<MAXSPS; i++)
   {
@@ -827,9 +1025,10 @@ int CloseDecoder()
 
   free_img (pDecoder->p_Vid);
   free (pDecoder->p_Inp);
+  dec_stats_free(&pDecoder->stats);
   free(pDecoder);
 
-  p_Dec = NULL;
+  set_current_decoder(NULL);
   return DEC_CLOSE_NOERR;
 }
 
@@ -37,7 +37,9 @@
 #include "mb_access.h"
 #include "biaridecod.h"
 #include "fast_memory.h"
+#include "dec_stats.h"
 #include "filehandle.h"
+#include "key_common.h"
 
 
 #if TRACE
@@ -55,13 +57,13 @@
 //! look up tables for FRExt_chroma support
 void dectracebitcnt(int count);
 
-extern int s_cur_mvd_bitpos;
 
 extern void setup_read_macroblock              (Slice *currSlice);
 extern void set_read_CBP_and_coeffs_cabac      (Slice *currSlice);
 extern void set_read_CBP_and_coeffs_cavlc      (Slice *currSlice);
 extern void read_coeff_4x4_CAVLC               (Macroblock *currMB, int block_type, int i, int j, int levarr[16], int runarr[16], int *number_coefficients);
 extern void read_coeff_4x4_CAVLC_444           (Macroblock *currMB, int block_type, int i, int j, int levarr[16], int runarr[16], int *number_coefficients);
+extern void skip_coeff_4x4_CAVLC               (Macroblock *currMB, int block_type, int i, int j, int levarr[16], int runarr[16], int *number_coefficients);
 
 static void read_motion_info_from_NAL_p_slice  (Macroblock *currMB);
 static void read_motion_info_from_NAL_b_slice  (Macroblock *currMB);
@@ -221,6 +223,7 @@ static void readMBRefPictureIdx (SyntaxElement *currSE, DataPartition *dP, Macro
       currMB->subblock_x = 0;
       currMB->subblock_y = 0;
       refframe = currMB->readRefPictureIdx(currMB, currSE, dP, 1, list);	//readRefPictureIdx_FLC readRefPictureIdx_VLC
+      memset(currMB->ctx->ref_idx[list], refframe, 4 * sizeof(char));
 			#if	0      
       for (j = 0; j <  step_v0; ++j)
       {
@@ -250,6 +253,7 @@ static void readMBRefPictureIdx (SyntaxElement *currSE, DataPartition *dP, Macro
         currMB->subblock_y = j0 << 2;
         currMB->subblock_x = 0;
         refframe = currMB->readRefPictureIdx(currMB, currSE, dP, currMB->b8mode[k], list);
+        currMB->ctx->ref_idx[list][k] = currMB->ctx->ref_idx[list][k + 1] = refframe;
 				#if 0
         for (j = j0; j < j0 + step_v0; ++j)
         {
@@ -280,6 +284,7 @@ static void readMBRefPictureIdx (SyntaxElement *currSE, DataPartition *dP, Macro
       {
         currMB->subblock_x = i0 << 2;
         refframe = currMB->readRefPictureIdx(currMB, currSE, dP, currMB->b8mode[k], list);
+        currMB->ctx->ref_idx[list][k] = currMB->ctx->ref_idx[list][k + 2] = refframe;
 				#if 0
         for (j = 0; j < step_v0; ++j)
         {
@@ -312,6 +317,7 @@ static void readMBRefPictureIdx (SyntaxElement *currSE, DataPartition *dP, Macro
         {
           currMB->subblock_x = i0 << 2;
           refframe = currMB->readRefPictureIdx(currMB, currSE, dP, currMB->b8mode[k], list);
+          currMB->ctx->ref_idx[list][k] = refframe;
 					#if 0
           for (j = j0; j < j0 + step_v0; ++j)
           {
@@ -364,68 +370,61 @@ void create_thread(pthread_t *thread, const pthread_attr_t *attr,
 		}
 }
 	
-extern int g_KeyUnitIdx;
-extern int g_KeyUnitBufferSize;
-int g_KeyUnitBufferLen;
-int g_ThreadParCurPos;	//ڴһ
-
-extern int Encrypt(int UnitNum); 
+extern void Encrypt(ThreadUnitPar *thread_unit_par);
 
 //RBSP_offset:RBSP(NALU=header+RBSP)ʼλƫ
 void write_mvd2keyfile(int bit_offset_from_rbsp, int KeyDataLen, int mvd, int mvd_num)
 {
 	if(p_Dec->p_Inp->enable_key)
 	{
+		STATS_FINE_TIMER(t_capture);
 		FILE* p_KeyFile = p_Dec->p_KeyFile;
 		int ByteOffset = 0; 	
 		int BitOffset = bit_offset_from_rbsp;
-		int cur_rbsp_absolute_pos = p_Dec->nalu_pos_array[p_Dec->nalu_pos_array_idx] + 1;
+		int64 cur_rbsp_absolute_pos = p_Dec->decode_nalu_pos + 1;
 
 		analysis_bitoffset(&ByteOffset,&BitOffset);
-		int mvd_absolute_byte_pos = cur_rbsp_absolute_pos + ByteOffset;	//ǰRBSPλ+ֽƫ,λMVDֽڴ(ƫ)
+		int64 mvd_absolute_byte_pos = cur_rbsp_absolute_pos + ByteOffset;	//ǰRBSPλ+ֽƫ,λMVDֽڴ(ƫ)
 
-		int diff = mvd_absolute_byte_pos - p_Dec->pre_mvd_absolute_byte_pos;
+		int64 diff = mvd_absolute_byte_pos - p_Dec->pre_mvd_absolute_byte_pos;
 		p_Dec->pre_mvd_absolute_byte_pos = mvd_absolute_byte_pos; 
+		TRACE_BIN_KEY(mvd_absolute_byte_pos * 8 + BitOffset, KeyDataLen, bit_offset_from_rbsp);
 		
 		if(diff < 0 || BitOffset < 0)
 		{
-			printf("diff: %d, BitOffset: %d\n",diff,BitOffset);
+			printf("diff: %lld, BitOffset: %d\n",(long long) diff,BitOffset);
 			error_KeyGen("[Byte offset diff] or [BitOffset] less-than 0, they should not less-than 0!",1);
 		}	
 
 		/*****create a thread to deal with the Key Unit Buffer*****/
 		if(p_Dec->p_Inp->multi_thread)
 		{
-			if(g_KeyUnitBufferLen >= MAX_THREAD_DO_KEY_UNIT_CNT && 
+			if(p_Dec->key_unit_buffer_len >= MAX_THREAD_DO_KEY_UNIT_CNT && 
 				 p_Dec->pid_id < MAX_THREAD_NUM)
 			{
 				ThreadUnitPar* par;
 				par = (ThreadUnitPar*)malloc(sizeof(ThreadUnitPar));
 				
-				par->buffer_start = g_KeyUnitIdx - g_KeyUnitBufferLen;
-				par->buffer_len = g_KeyUnitBufferLen;
-				par->cur_absolute_offset = g_ThreadParCurPos;
-				g_KeyUnitBufferLen = 0;
+				par->pDecoder = p_Dec;
+				par->buffer_start = p_Dec->key_unit_idx - p_Dec->key_unit_buffer_len;
+				par->buffer_len = p_Dec->key_unit_buffer_len;
+				par->cur_absolute_offset = p_Dec->thread_par_cur_pos;
+				p_Dec->key_unit_buffer_len = 0;
 
 				create_thread(&p_Dec->pid[p_Dec->pid_id++], NULL, (void *)Encrypt, (void *)par);
 			}
-			if(g_KeyUnitBufferLen == 0 || p_Dec->pid_id == MAX_THREAD_NUM)
-				g_ThreadParCurPos = mvd_absolute_byte_pos;
+			if(p_Dec->key_unit_buffer_len == 0 || p_Dec->pid_id == MAX_THREAD_NUM)
+				p_Dec->thread_par_cur_pos = mvd_absolute_byte_pos;
 
-			g_KeyUnitBufferLen ++;
+			p_Dec->key_unit_buffer_len ++;
 		}
 		
 		//put the key datas into the key unit buffer		
-		if(g_KeyUnitIdx >= g_KeyUnitBufferSize - 1)
-		{
-			//printf("\033[1;31m tmp_test===============idx: %d======= \033[0m \n",g_KeyUnitIdx);
-			g_KeyUnitBufferSize += KEY_UNIT_BUFFER_SIZE_APPEND;
-			g_pKeyUnitBuffer = (KeyUnit*)realloc(g_pKeyUnitBuffer, g_KeyUnitBufferSize);			
-		}
-		g_pKeyUnitBuffer[g_KeyUnitIdx].byte_offset 		= diff;
-		g_pKeyUnitBuffer[g_KeyUnitIdx].bit_offset 		= BitOffset;
-		g_pKeyUnitBuffer[g_KeyUnitIdx].key_data_len 	= KeyDataLen;		
-		g_KeyUnitIdx ++;
+		add_KeyUnit(diff, BitOffset, KeyDataLen);
+		STATS_COUNT(COUNT_KEY_UNIT, 1);
+		STATS_COUNT(COUNT_KEY_BITS, KeyDataLen);
+		STATS_KEY_UNIT(diff, KeyDataLen);
+		STATS_FINE_STAGE(STAGE_KEY_CAPTURE, t_capture);
 		
 #if 0
 #if H264_KEY_CREATE		
@@ -433,8 +432,8 @@ void write_mvd2keyfile(int bit_offset_from_rbsp, int KeyDataLen, int mvd, int mv
 #else
 		char s[400];
 		//cur_rbsp_pos + ByteOffset = ȡMVDĵһֽ
-		snprintf(s,400,"RBSP_start: %4d, bit_offset_from_rbsp: %4d, ByteOffset: %4d, mvd_absolute_byte_pos: %4d, BitOffset: %3d, KeyDataLen: %3d, mvd_num: %2d, mvd_sum: %3d\n",
-						cur_rbsp_absolute_pos,bit_offset_from_rbsp,ByteOffset,mvd_absolute_byte_pos,BitOffset,KeyDataLen,mvd_num,mvd); 	
+		snprintf(s,400,"RBSP_start: %4lld, bit_offset_from_rbsp: %4d, ByteOffset: %4d, mvd_absolute_byte_pos: %4lld, BitOffset: %3d, KeyDataLen: %3d, mvd_num: %2d, mvd_sum: %3d\n",
+						(long long) cur_rbsp_absolute_pos,bit_offset_from_rbsp,ByteOffset,(long long) mvd_absolute_byte_pos,BitOffset,KeyDataLen,mvd_num,mvd); 	
 		fwrite(s,strlen(s),1,p_KeyFile);	
 #endif
 #endif
@@ -462,7 +461,7 @@ static void readMBMotionVectors (SyntaxElement *currSE, DataPartition *dP, Macro
       currMB->subblock_y = 0; // position used for context determination
       i4  = currMB->block_x;
       j4  = currMB->block_y;
-      mvd = &currMB->mvd [list][0];
+      mvd = &currMB->ctx->mvd[list][0];
 
       //get_neighbors(currMB, block, 0, 0, step_h0 << 2);
 
@@ -473,16 +472,19 @@ static void readMBMotionVectors (SyntaxElement *currSE, DataPartition *dP, Macro
 #if TRACE
       trace_info(currSE, "mvd0_l", list);
 #endif
-			bit_offset_from_rbsp = s_cur_mvd_bitpos;	//CABAC mvd bit offset
-
       currSE->value2 = list; // identifies the component; only used for context determination
       dP->readSyntaxElement(currMB, currSE, dP);
       curr_mvd[0] = (short) currSE->value1; 
 									
+			/*the start of this mvd, cur_mvd_bitpos is set by readSyntaxElement_CABAC*/
 			if(currMB->p_Slice->p_Vid->active_pps->entropy_coding_mode_flag == (Boolean) CAVLC)
 			{
 				bit_offset_from_rbsp = dP->bitstream->frame_bitoffset - currSE->len;
 			}
+			else
+			{
+				bit_offset_from_rbsp = p_Dec->cur_mvd_bitpos;	//CABAC mvd bit offset
+			}
 			key_data_len += currSE->len;
 			//first_sy_len = currSE->len;
 			
@@ -517,6 +519,7 @@ static void readMBMotionVectors (SyntaxElement *currSE, DataPartition *dP, Macro
           (mvinfo++)->mv[list] = curr_mv;
         }            
       }
+#endif
 
       // Init first line (mvd)
       for(ii = 0; ii < step_h0; ++ii)
@@ -531,7 +534,6 @@ static void readMBMotionVectors (SyntaxElement *currSE, DataPartition *dP, Macro
       {
         memcpy(mvd[jj][0], mvd[0][0],  2 * step_h0 * sizeof(short));
       }
-#endif			
     }
   }
   else
@@ -571,7 +573,7 @@ static void readMBMotionVectors (SyntaxElement *currSE, DataPartition *dP, Macro
 
         if ((currMB->b8pdir[kk] == list || currMB->b8pdir[kk]== BI_PRED) && (currMB->b8mode[kk] != 0))//has forward vector
         {
-          char cur_ref_idx = mv_info[currMB->block_y+j0][currMB->block_x+i0].ref_idx[list];
+          //char cur_ref_idx = mv_info[currMB->block_y+j0][currMB->block_x+i0].ref_idx[list];
           int mv_mode  = currMB->b8mode[kk];
           int step_h = BLOCK_STEP [mv_mode][0];
           int step_v = BLOCK_STEP [mv_mode][1];
@@ -583,7 +585,7 @@ static void readMBMotionVectors (SyntaxElement *currSE, DataPartition *dP, Macro
           {
             currMB->subblock_y = j << 2; // position used for context determination
             j4  = currMB->block_y + j;
-            mvd = &currMB->mvd [list][j];
+            mvd = &currMB->ctx->mvd[list][j];
 
             for (i = i0; i < i0 + step_h0; i += step_h)		
             {
@@ -600,10 +602,10 @@ static void readMBMotionVectors (SyntaxElement *currSE, DataPartition *dP, Macro
 #if TRACE
                 trace_info(currSE, "mvd_l", list);
 #endif
-								cur_mvd_pos = s_cur_mvd_bitpos;
                 currSE->value2   = (k << 1) + list; // identifies the component; only used for context determination
                 dP->readSyntaxElement(currMB, currSE, dP);		//readSyntaxElement_CABAC readSyntaxElement_UVLC
                 curr_mvd[k] = (short) currSE->value1; 
+								cur_mvd_pos = p_Dec->cur_mvd_bitpos;	//start of this mvd, set by readSyntaxElement_CABAC
 
 								if(!mvd_num)
 								{
@@ -633,6 +635,7 @@ static void readMBMotionVectors (SyntaxElement *currSE, DataPartition *dP, Macro
                   (mvinfo++)->mv[list] = curr_mv;
                 }            
               }
+#endif
 
               // Init first line (mvd)
               for(ii = i; ii < i + step_h; ++ii)
@@ -647,7 +650,6 @@ static void readMBMotionVectors (SyntaxElement *currSE, DataPartition *dP, Macro
               {
                 memcpy(&mvd[jj][i][0], &mvd[0][i][0],  2 * step_h * sizeof(short));
               }
-#endif							
             }
           }
         }
@@ -688,6 +690,7 @@ void start_macroblock(Slice *currSlice, Macroblock **currMB)
   (*currMB)->p_Slice = currSlice;
   (*currMB)->p_Vid   = p_Vid;  
   (*currMB)->mbAddrX = mb_nr;
+  (*currMB)->ctx     = get_mb_ctx(p_Vid, mb_nr);
 
   //assert (mb_nr < (int) p_Vid->PicSizeInMbs);
 
@@ -724,16 +727,8 @@ void start_macroblock(Slice *currSlice, Macroblock **currMB)
 
   set_read_and_store_CBP(currMB, currSlice->active_sps->chroma_format_idc);
 
-  // Reset syntax element entries in MB struct
-  if (currSlice->slice_type != I_SLICE)
-  {
-    if (currSlice->slice_type != B_SLICE)
-      fast_memset((*currMB)->mvd[0][0][0], 0, MB_BLOCK_PARTITIONS * 2 * sizeof(short));
-    else
-      fast_memset((*currMB)->mvd[0][0][0], 0, 2 * MB_BLOCK_PARTITIONS * 2 * sizeof(short));
-  }
-  
-  fast_memset((*currMB)->s_cbp, 0, 3 * sizeof(CBPStructure));
+  // Reset syntax element entries (mvd, ref_idx, cbp bits, nnz) of the ring slot
+  fast_memset((*currMB)->ctx, 0, sizeof(MbContext));
 
   // store filtering parameters for this MB
   //(*currMB)->DFDisableIdc    = currSlice->DFDisableIdc;
@@ -1086,7 +1081,11 @@ void setup_slice_methods(Slice *currSlice)
   if ( currSlice->p_Vid->active_sps->chroma_format_idc==YUV444 && (currSlice->p_Vid->separate_colour_plane_flag == 0) )
     currSlice->read_coeff_4x4_CAVLC = read_coeff_4x4_CAVLC_444;
   else
+#if (MVD_PARSE_ONLY)
+    currSlice->read_coeff_4x4_CAVLC = skip_coeff_4x4_CAVLC;
+#else
     currSlice->read_coeff_4x4_CAVLC = read_coeff_4x4_CAVLC;
+#endif
 
   switch(currSlice->p_Vid->active_pps->entropy_coding_mode_flag)
   {
@@ -1168,12 +1167,16 @@ static void read_motion_info_from_NAL_p_slice (Macroblock *currMB)
   int step_v0         = BLOCK_STEP [partmode][1];
 
   int j4;
-  StorablePicture *dec_picture = currSlice->dec_picture;
   PicMotionParams *mv_info = NULL;
 
   int list_offset = currMB->list_offset;
   //StorablePicture **list0 = currSlice->listX[LIST_0 + list_offset];
+#if (MVD_PARSE_ONLY)
+  PicMotionParams **p_mv_info = NULL;   // no mv_info in parse-only mode
+#else
+  StorablePicture *dec_picture = currSlice->dec_picture;
   PicMotionParams **p_mv_info = &dec_picture->mv_info[currMB->block_y];
+#endif
 
   //=====  READ REFERENCE PICTURE INDICES =====
   currSE.type = SE_REFFRAME;
@@ -1189,8 +1192,16 @@ static void read_motion_info_from_NAL_p_slice (Macroblock *currMB)
 
   if (p_Vid->active_pps->entropy_coding_mode_flag == (Boolean) CAVLC || dP->bitstream->ei_flag) 
     currSE.mapping = linfo_se;
-  else                                                  
-    currSE.reading = currSlice->mb_aff_frame_flag ? read_mvd_CABAC_mbaff : read_MVD_CABAC;
+  else if (currSlice->mb_aff_frame_flag)
+  {
+    currSE.reading = read_mvd_CABAC_mbaff;
+    load_mvd_ctx_mbaff(currMB);
+  }
+  else
+  {
+    currSE.reading = read_MVD_CABAC;
+    load_mvd_ctx(currMB);
+  }
 
   // LIST_0 Motion vectors
   readMBMotionVectors (&currSE, dP, currMB, LIST_0, step_h0, step_v0);
@@ -1209,7 +1220,6 @@ static void read_motion_info_from_NAL_b_slice (Macroblock *currMB)
 {
   Slice *currSlice = currMB->p_Slice;
   VideoParameters *p_Vid = currMB->p_Vid;
-  StorablePicture *dec_picture = currSlice->dec_picture;
   SyntaxElement currSE;
   DataPartition *dP = NULL;
   const byte *partMap = assignSE2partition[currSlice->dp_mode];
@@ -1222,7 +1232,12 @@ static void read_motion_info_from_NAL_b_slice (Macroblock *currMB)
   int list_offset = currMB->list_offset; 
   //StorablePicture **list0 = currSlice->listX[LIST_0 + list_offset];
   //StorablePicture **list1 = currSlice->listX[LIST_1 + list_offset];
+#if (MVD_PARSE_ONLY)
+  PicMotionParams **p_mv_info = NULL;   // no mv_info in parse-only mode
+#else
+  StorablePicture *dec_picture = currSlice->dec_picture;
   PicMotionParams **p_mv_info = &dec_picture->mv_info[currMB->block_y];
+#endif
 
   //if (currMB->mb_type == P8x8)
     //currSlice->update_direct_mv_info(currMB);   
@@ -1245,8 +1260,16 @@ static void read_motion_info_from_NAL_b_slice (Macroblock *currMB)
 
   if (p_Vid->active_pps->entropy_coding_mode_flag == (Boolean) CAVLC || dP->bitstream->ei_flag) 
     currSE.mapping = linfo_se;
-  else                                                  
-    currSE.reading = currSlice->mb_aff_frame_flag ? read_mvd_CABAC_mbaff : read_MVD_CABAC;
+  else if (currSlice->mb_aff_frame_flag)
+  {
+    currSE.reading = read_mvd_CABAC_mbaff;
+    load_mvd_ctx_mbaff(currMB);
+  }
+  else
+  {
+    currSE.reading = read_MVD_CABAC;
+    load_mvd_ctx(currMB);
+  }
 
   // LIST_0 Motion vectors
   readMBMotionVectors (&currSE, dP, currMB, LIST_0, step_h0, step_v0);
@@ -669,15 +669,6 @@ static inline void SetB8Mode (Macroblock* currMB, int value, int i)
   }
 }
 
-static inline void reset_coeffs(Macroblock *currMB)
-{
-  VideoParameters *p_Vid = currMB->p_Vid;
-
-  // CAVLC
-  if (p_Vid->active_pps->entropy_coding_mode_flag == (Boolean) CAVLC)
-    fast_memset(p_Vid->nz_coeff[currMB->mbAddrX][0][0], 0, 3 * BLOCK_PIXELS * sizeof(byte));
-}
-
 static inline void field_flag_inference(Macroblock *currMB)
 {
   VideoParameters *p_Vid = currMB->p_Vid;
@@ -771,8 +762,7 @@ void skip_macroblock(Macroblock *currMB)
   zeroMotionLeft  = !mb[0].available ? 1 : a_ref_idx==0 && a_mv->mv_x == 0 && a_mv_y==0 ? 1 : 0;
   zeroMotionAbove = !mb[1].available ? 1 : b_ref_idx==0 && b_mv->mv_x == 0 && b_mv_y==0 ? 1 : 0;
 
-  currMB->cbp = 0;
-  reset_coeffs(currMB);
+  currMB->cbp = 0;   // nnz already cleared with the context slot
 
   if (zeroMotionAbove || zeroMotionLeft)
   {
@@ -830,7 +820,12 @@ static void read_skip_macroblock(Macroblock *currMB)
   //--- init macroblock data ---
   //init_macroblock_basic(currMB);
 
+#if (MVD_PARSE_ONLY)
+  // the inferred P_Skip motion is not needed for parsing
+  currMB->cbp = 0;
+#else
   skip_macroblock(currMB);
+#endif
 }
 
 /*!
@@ -1020,6 +1015,10 @@ static void read_i_pcm_macroblock(Macroblock *currMB, const byte *partMap)
     DataPartition *dP = &(currSlice->partArr[partMap[SE_LUM_DC_INTRA]]);
     read_IPCM_coeffs_from_NAL(currSlice, dP);
   }
+
+  // CAVLC: I_PCM counts as 16 non-zero coefficients for nC prediction
+  if (currSlice->p_Vid->active_pps->entropy_coding_mode_flag == (Boolean) CAVLC)
+    fast_memset(currMB->ctx->nz_coeff[0][0], 16, 3 * BLOCK_PIXELS * sizeof(byte));
 }
 
 /*!
@@ -1868,7 +1867,6 @@ static void read_one_macroblock_b_slice_cavlc(Macroblock *currMB)
     if (currSlice->cod_counter >= 0)
     {
       currMB->cbp = 0;
-      reset_coeffs(currMB);
     }
     else
     {
@@ -64,15 +64,54 @@ FrameStore* alloc_frame_store(void)
 
 void alloc_pic_motion(PicMotionParamsOld *motion, int size_y, int size_x)
 {
-  motion->mb_field = calloc (size_y * size_x, sizeof(byte));
-  if (motion->mb_field == NULL)
-    no_mem_exit("alloc_storable_picture: motion->mb_field");
+  motion->mb_field = mem_calloc_aligned(size_y * size_x, sizeof(byte));
 }
 
 /*!
  ************************************************************************
  * \brief
- *    Allocate memory for a stored picture.
+ *    Take a picture of the given size out of the picture pool.
+ *    The header is cleared, the motion buffers are kept as they are.
+ *
+ * \return
+ *    the recycled StorablePicture or NULL if none matches
+ ************************************************************************
+ */
+static StorablePicture* get_pooled_picture(VideoParameters *p_Vid, int size_x, int size_y)
+{
+  StorablePicture **pp = &p_Vid->pic_pool;
+
+  while (*pp)
+  {
+    StorablePicture *s = *pp;
+    if (s->size_x == size_x && s->size_y == size_y && s->separate_colour_plane_flag == p_Vid->separate_colour_plane_flag)
+    {
+      PicMotionParams   **mv_info = s->mv_info;
+      PicMotionParamsOld  motion  = s->motion;
+      PicMotionParams   **JVmv_info[MAX_PLANE];
+      PicMotionParamsOld  JVmotion[MAX_PLANE];
+
+      memcpy(JVmv_info, s->JVmv_info, sizeof(JVmv_info));
+      memcpy(JVmotion, s->JVmotion, sizeof(JVmotion));
+      *pp = s->pool_next;
+
+      memset(s, 0, sizeof(StorablePicture));
+      s->mv_info = mv_info;
+      s->motion  = motion;
+      memcpy(s->JVmv_info, JVmv_info, sizeof(JVmv_info));
+      memcpy(s->JVmotion, JVmotion, sizeof(JVmotion));
+      return s;
+    }
+    pp = &s->pool_next;
+  }
+  return NULL;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Allocate memory for a stored picture. Pictures handed back with
+ *    release_storable_picture() are reused when the size matches.
  *
  * \param p_Vid
  *    VideoParameters
@@ -96,36 +135,47 @@ StorablePicture* alloc_storable_picture(VideoParameters *p_Vid, PictureStructure
   seq_parameter_set_rbsp_t *active_sps = p_Vid->active_sps;  
 
   StorablePicture *s;
+#if (!MVD_PARSE_ONLY)
   int   nplane;
+#endif
 
   //printf ("Allocating (%s) picture (x=%d, y=%d, x_cr=%d, y_cr=%d)\n", (type == FRAME)?"FRAME":(type == TOP_FIELD)?"TOP_FIELD":"BOTTOM_FIELD", size_x, size_y, size_x_cr, size_y_cr);
 
-  s = calloc (1, sizeof(StorablePicture));
-  if (NULL==s)
-    no_mem_exit("alloc_storable_picture: s");
-
   if (structure!=FRAME)
   {
     size_y    /= 2;
     size_y_cr /= 2;
   }
 
-  s->PicSizeInMbs = (size_x*size_y)/256;
-
-  s->separate_colour_plane_flag = p_Vid->separate_colour_plane_flag;
+  s = get_pooled_picture(p_Vid, size_x, size_y);
+  if (NULL==s)
+  {
+    s = calloc (1, sizeof(StorablePicture));
+    if (NULL==s)
+      no_mem_exit("alloc_storable_picture: s");
 
-  get_mem2Dmp     ( &s->mv_info, (size_y >> BLOCK_SHIFT), (size_x >> BLOCK_SHIFT));
-  alloc_pic_motion( &s->motion , (size_y >> BLOCK_SHIFT), (size_x >> BLOCK_SHIFT));
+    // motion vectors are not reconstructed in parse-only mode, only mb_field is written
+#if (!MVD_PARSE_ONLY)
+    get_mem2Dmp     ( &s->mv_info, (size_y >> BLOCK_SHIFT), (size_x >> BLOCK_SHIFT));
+#endif
+    alloc_pic_motion( &s->motion , (size_y >> BLOCK_SHIFT), (size_x >> BLOCK_SHIFT));
 
-  if( (p_Vid->separate_colour_plane_flag != 0) )
-  {
-    for( nplane=0; nplane<MAX_PLANE; nplane++ )
+#if (!MVD_PARSE_ONLY)
+    if( (p_Vid->separate_colour_plane_flag != 0) )
     {
-      get_mem2Dmp      (&s->JVmv_info[nplane], (size_y >> BLOCK_SHIFT), (size_x >> BLOCK_SHIFT));
-      alloc_pic_motion(&s->JVmotion[nplane] , (size_y >> BLOCK_SHIFT), (size_x >> BLOCK_SHIFT));
+      for( nplane=0; nplane<MAX_PLANE; nplane++ )
+      {
+        get_mem2Dmp      (&s->JVmv_info[nplane], (size_y >> BLOCK_SHIFT), (size_x >> BLOCK_SHIFT));
+        alloc_pic_motion(&s->JVmotion[nplane] , (size_y >> BLOCK_SHIFT), (size_x >> BLOCK_SHIFT));
+      }
     }
+#endif
   }
 
+  s->PicSizeInMbs = (size_x*size_y)/256;
+
+  s->separate_colour_plane_flag = p_Vid->separate_colour_plane_flag;
+
   s->pic_num   = 0;
   s->frame_num = 0;
   //s->long_term_frame_idx = 0;
@@ -204,7 +254,7 @@ void free_pic_motion(PicMotionParamsOld *motion)
 {
   if (motion->mb_field)
   {
-    free(motion->mb_field);
+    mem_free_aligned(motion->mb_field);
     motion->mb_field = NULL;
   }
 }
@@ -282,6 +332,60 @@ void free_storable_picture(StorablePicture* p)
   }
 }
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Hand a picture back for reuse by alloc_storable_picture().
+ *    The pool keeps the most recent MAX_PIC_POOL_SIZE pictures, older
+ *    ones (e.g. of a previous sequence size) are freed.
+ *
+ * \param p_Vid
+ *    VideoParameters
+ * \param p
+ *    Picture to be released
+ *
+ ************************************************************************
+ */
+void release_storable_picture(VideoParameters *p_Vid, StorablePicture* p)
+{
+  StorablePicture **pp;
+  int n;
+
+  if (p == NULL)
+    return;
+
+  p->pool_next = p_Vid->pic_pool;
+  p_Vid->pic_pool = p;
+
+  for (pp = &p_Vid->pic_pool, n = 0; *pp != NULL && n < MAX_PIC_POOL_SIZE; pp = &(*pp)->pool_next, ++n)
+    ;
+  if (*pp)
+  {
+    free_storable_picture(*pp);
+    *pp = NULL;
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Free all pictures held in the picture pool.
+ *
+ * \param p_Vid
+ *    VideoParameters
+ *
+ ************************************************************************
+ */
+void free_picture_pool(VideoParameters *p_Vid)
+{
+  while (p_Vid->pic_pool)
+  {
+    StorablePicture *p = p_Vid->pic_pool;
+    p_Vid->pic_pool = p->pool_next;
+    free_storable_picture(p);
+  }
+}
+
 
 #if (MVC_EXTENSION_ENABLE)
 int GetMaxDecFrameBuffering(VideoParameters *p_Vid)
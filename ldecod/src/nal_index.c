@@ -0,0 +1,374 @@
+/*!
+ *************************************************************************************
+ * \file nal_index.c
+ *
+ * \brief
+ *    NAL unit index of an Annex B bitstream and its sidecar file
+ *
+ *************************************************************************************
+ */
+
+#include <sys/stat.h>
+
+#include "global.h"
+#include "nal_index.h"
+#include "nalu.h"
+#include "memalloc.h"
+
+#define NAL_INDEX_MAGIC   "NALIDX01"
+
+//! header of the sidecar, followed by the entries and the emulation prevention byte offsets
+typedef struct nal_index_header
+{
+  char   magic[8];
+  int    entry_size;   //!< sizeof(NalIndexEntry), a sidecar of another build is rebuilt
+  int    count;
+  int    epb_count;
+  int    reserved;
+  int64  file_size;
+  int64  mtime;
+} NalIndexHeader;
+
+void nal_index_init(NalIndex *idx)
+{
+  memset(idx, 0, sizeof(NalIndex));
+}
+
+void nal_index_free(NalIndex *idx)
+{
+  free(idx->nal);
+  free(idx->epb);
+  nal_index_init(idx);
+}
+
+static void grow_entries(NalIndex *idx, int count)
+{
+  if (idx->count + count > idx->size)
+  {
+    int size = imax(2 * idx->size, idx->count + count);
+    NalIndexEntry *nal = realloc(idx->nal, size * sizeof(NalIndexEntry));
+
+    if (nal == NULL)
+      no_mem_exit("nal_index: nal");
+    idx->nal  = nal;
+    idx->size = size;
+  }
+}
+
+static void add_epb(NalIndex *idx, int offset)
+{
+  if (idx->epb_count == idx->epb_size)
+  {
+    int size = idx->epb_size ? 2 * idx->epb_size : 256;
+    int *epb = realloc(idx->epb, size * sizeof(int));
+
+    if (epb == NULL)
+      no_mem_exit("nal_index: epb");
+    idx->epb      = epb;
+    idx->epb_size = size;
+  }
+  idx->epb[idx->epb_count++] = offset;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Appends the NAL unit buf of len bytes with its header at stream
+ *    offset pos. The emulation prevention bytes are found with the rules
+ *    of EBSPtoRBSP(). A non-VCL NAL unit that may start an access unit
+ *    (7.4.1.2.3) starts one if it follows a VCL NAL unit, a slice with
+ *    first_mb_in_slice 0 starts one if it directly follows a VCL NAL
+ *    unit.
+ ************************************************************************
+ */
+void nal_index_add(NalIndex *idx, int64 pos, int sc_len, const byte *buf, int len)
+{
+  NalIndexEntry *e;
+  int type = buf[0] & 0x1f;
+  int zeros = 0, i;
+
+  grow_entries(idx, 1);
+  e = &idx->nal[idx->count];
+  e->pos       = pos;
+  e->len       = len;
+  e->header    = buf[0];
+  e->sc_len    = (byte) sc_len;
+  e->flags     = 0;
+  e->epb       = idx->epb_count;
+  e->epb_count = 0;
+
+  for (i = 1; i < len; i++)
+  {
+    if (zeros == ZEROBYTES_SHORTSTARTCODE && buf[i] == 0x03)
+    {
+      add_epb(idx, i);
+      e->epb_count++;
+      zeros = 0;
+      continue;
+    }
+    zeros = (buf[i] == 0x00) ? zeros + 1 : 0;
+  }
+
+  if (type >= NALU_TYPE_SLICE && type <= NALU_TYPE_IDR)
+  {
+    int first_mb, slice_type;
+
+    if (idx->count == 0 || (idx->prev_vcl && type != NALU_TYPE_DPB && type != NALU_TYPE_DPC &&
+      peek_slice_header(buf, len, 1, &first_mb, &slice_type) && first_mb == 0))
+    {
+      e->flags |= NAL_INDEX_AU_START;
+      idx->au_start = idx->count;
+    }
+    if (type == NALU_TYPE_IDR)
+      idx->nal[idx->au_start].flags |= NAL_INDEX_IDR_AU;
+    idx->prev_vcl = 1;
+  }
+  else if (type == NALU_TYPE_AUD || type == NALU_TYPE_SPS || type == NALU_TYPE_PPS ||
+    type == NALU_TYPE_SEI || (type >= 13 && type <= 18))
+  {
+    if (idx->count == 0 || idx->prev_vcl)
+    {
+      e->flags |= NAL_INDEX_AU_START;
+      idx->au_start = idx->count;
+    }
+    idx->prev_vcl = 0;
+  }
+  idx->count++;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Appends the entries first to last - 1 of src, moved by delta bytes
+ ************************************************************************
+ */
+void nal_index_copy(NalIndex *dst, const NalIndex *src, int first, int last, int64 delta)
+{
+  int i, k;
+
+  grow_entries(dst, last - first);
+  for (i = first; i < last; i++)
+  {
+    NalIndexEntry *e = &dst->nal[dst->count++];
+
+    *e = src->nal[i];
+    e->pos += delta;
+    e->epb  = dst->epb_count;
+    for (k = 0; k < e->epb_count; k++)
+      add_epb(dst, src->epb[src->nal[i].epb + k]);
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Start of the next NAL unit at or after pos, including a leading
+ *    zero byte of a four byte start code
+ * \return
+ *    offset of the start code, size if there is none
+ ************************************************************************
+ */
+static int64 next_start_code(const byte *data, int64 size, int64 pos)
+{
+  for (; pos + 3 <= size; pos++)
+  {
+    if (data[pos] == 0 && data[pos + 1] == 0 && data[pos + 2] == 1)
+      return (pos > 0 && data[pos - 1] == 0) ? pos - 1 : pos;
+  }
+  return size;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Indexes the Annex B bitstream data of size bytes
+ ************************************************************************
+ */
+void nal_index_scan(NalIndex *idx, const byte *data, int64 size)
+{
+  int64 pos, next;
+
+  for (pos = next_start_code(data, size, 0); pos < size; pos = next)
+  {
+    int sc_len = (data[pos + 2] == 1) ? 3 : 4;
+    int64 nal = pos + sc_len;
+    int64 end;
+
+    next = next_start_code(data, size, nal);
+    for (end = next; end > nal && data[end - 1] == 0; end--)
+      ;
+    if (end > nal)
+      nal_index_add(idx, nal, sc_len, data + nal, (int) (end - nal));
+  }
+}
+
+static void sidecar_name(char *name, const char *fn)
+{
+  snprintf(name, FILE_NAME_SIZE + 8, "%s.nalidx", fn);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Takes the size and modification time of the bitstream file fn as
+ *    key of the index
+ * \return
+ *    0 on success, -1 if the file cannot be found
+ ************************************************************************
+ */
+int nal_index_key(NalIndex *idx, const char *fn)
+{
+  struct stat st;
+
+  if (stat(fn, &st) != 0)
+    return -1;
+  idx->file_size = (int64) st.st_size;
+#if defined(__linux__)
+  // a file written within the second of the last change keeps st_mtime
+  idx->mtime     = (int64) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#else
+  idx->mtime     = (int64) st.st_mtime;
+#endif
+  return 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Loads the sidecar of the bitstream file fn into an empty index
+ * \return
+ *    0 if a valid sidecar was loaded, 1 if there is none or it belongs
+ *    to another version of the file (idx is then empty but keyed),
+ *    -1 if the bitstream file cannot be found
+ ************************************************************************
+ */
+int nal_index_load(NalIndex *idx, const char *fn)
+{
+  char name[FILE_NAME_SIZE + 8];
+  NalIndexHeader h;
+  FILE *f;
+  int i;
+
+  nal_index_init(idx);
+  if (nal_index_key(idx, fn) != 0)
+    return -1;
+
+  sidecar_name(name, fn);
+  if ((f = fopen(name, "rb")) == NULL)
+    return 1;
+  if (fread(&h, sizeof(NalIndexHeader), 1, f) != 1 || memcmp(h.magic, NAL_INDEX_MAGIC, 8) != 0 ||
+    h.entry_size != (int) sizeof(NalIndexEntry) || h.file_size != idx->file_size || h.mtime != idx->mtime ||
+    h.count < 0 || h.epb_count < 0)
+  {
+    fclose(f);
+    return 1;
+  }
+
+  idx->nal = malloc(imax(h.count, 1) * sizeof(NalIndexEntry));
+  idx->epb = malloc(imax(h.epb_count, 1) * sizeof(int));
+  if (idx->nal == NULL || idx->epb == NULL)
+    no_mem_exit("nal_index_load: index");
+  idx->size     = imax(h.count, 1);
+  idx->epb_size = imax(h.epb_count, 1);
+  if (fread(idx->nal, sizeof(NalIndexEntry), h.count, f) != (size_t) h.count ||
+    fread(idx->epb, sizeof(int), h.epb_count, f) != (size_t) h.epb_count)
+  {
+    fclose(f);
+    nal_index_free(idx);
+    nal_index_key(idx, fn);
+    return 1;
+  }
+  fclose(f);
+  idx->count     = h.count;
+  idx->epb_count = h.epb_count;
+
+  // a truncated or foreign sidecar must not make the parser read outside the file
+  for (i = 0; i < idx->count; i++)
+  {
+    NalIndexEntry *e = &idx->nal[i];
+
+    if (e->pos < e->sc_len || e->len <= 0 || e->pos + e->len > idx->file_size ||
+      e->epb < 0 || e->epb_count < 0 || e->epb + e->epb_count > idx->epb_count)
+    {
+      nal_index_free(idx);
+      nal_index_key(idx, fn);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Writes the index as sidecar of the bitstream file fn. The sidecar is
+ *    written to a temporary file first, so a reader never sees half of it.
+ * \return
+ *    0 on success, -1 otherwise
+ ************************************************************************
+ */
+int nal_index_save(const NalIndex *idx, const char *fn)
+{
+  char name[FILE_NAME_SIZE + 8], tmp[FILE_NAME_SIZE + 16];
+  NalIndexHeader h;
+  FILE *f;
+  int ok;
+
+  sidecar_name(name, fn);
+  snprintf(tmp, sizeof(tmp), "%s.tmp", name);
+
+  memset(&h, 0, sizeof(NalIndexHeader));
+  memcpy(h.magic, NAL_INDEX_MAGIC, 8);
+  h.entry_size = (int) sizeof(NalIndexEntry);
+  h.count      = idx->count;
+  h.epb_count  = idx->epb_count;
+  h.file_size  = idx->file_size;
+  h.mtime      = idx->mtime;
+
+  if ((f = fopen(tmp, "wb")) == NULL)
+    return -1;
+  ok = fwrite(&h, sizeof(NalIndexHeader), 1, f) == 1 &&
+    fwrite(idx->nal, sizeof(NalIndexEntry), idx->count, f) == (size_t) idx->count &&
+    fwrite(idx->epb, sizeof(int), idx->epb_count, f) == (size_t) idx->epb_count;
+  if (fclose(f) != 0)
+    ok = 0;
+#ifdef _WIN32
+  if (ok)
+    remove(name);
+#endif
+  if (!ok || rename(tmp, name) != 0)
+  {
+    remove(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Converts the NAL unit of entry e in buf to an RBSP by removing the
+ *    emulation prevention bytes listed in the index
+ * \return
+ *    length of the RBSP in bytes
+ ************************************************************************
+ */
+int nal_index_rbsp(const NalIndex *idx, const NalIndexEntry *e, byte *buf)
+{
+  const int *epb = idx->epb + e->epb;
+  int j, k;
+
+  if (e->epb_count == 0)
+    return e->len;
+
+  j = epb[0];
+  for (k = 0; k < e->epb_count; k++)
+  {
+    int from = epb[k] + 1;
+    int to   = (k + 1 < e->epb_count) ? epb[k + 1] : e->len;
+
+    memmove(buf + j, buf + from, to - from);
+    j += to - from;
+  }
+  return j;
+}
@@ -17,9 +17,9 @@
 #include "nalu.h"
 #include "memalloc.h"
 #include "rtp.h"
-#if (MVC_EXTENSION_ENABLE)
+#include "image.h"
 #include "vlc.h"
-#endif
+#include "dec_stats.h"
 
 /*!
  *************************************************************************************
@@ -38,11 +38,229 @@ static int NALUtoRBSP (NALU_t *nalu)
 {
   assert (nalu != NULL);
 
-  nalu->len = EBSPtoRBSP (nalu->buf, nalu->len, 1) ;
+  if (p_Dec->nal_entry != NULL)
+    nalu->len = nal_index_rbsp (p_Dec->nal_index, p_Dec->nal_entry, nalu->buf);
+  else
+    nalu->len = EBSPtoRBSP (nalu->buf, nalu->len, 1) ;
 
   return nalu->len ;
 }
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Reads first_mb_in_slice and slice_type of a slice NAL unit of
+ *    nal_len bytes that is not yet converted to an RBSP
+ *
+ * \return
+ *    0 if the NAL unit is too short or malformed
+ ************************************************************************
+ */
+int peek_slice_header(const byte *nal, int nal_len, int header_len, int *first_mb, int *slice_type)
+{
+  byte buf[20];
+  int len = imin(nal_len, 16);
+  int bitpos = header_len * 8;
+  int n, info, dummy;
+
+  if (len <= header_len)
+    return 0;
+
+  memcpy(buf, nal, len);
+  len = EBSPtoRBSP(buf, len, header_len);
+  if (len < 0)
+    return 0;
+  buf[len] = 0xFF;  // ends the search for the leading one of a code cut at len
+
+  if ((n = GetVLCSymbol(buf, bitpos, &info, len)) < 0)
+    return 0;
+  linfo_ue(n, info, first_mb, &dummy);
+  bitpos += n;
+
+  if ((n = GetVLCSymbol(buf, bitpos, &info, len)) < 0)
+    return 0;
+  linfo_ue(n, info, slice_type, &dummy);
+  *slice_type %= 5;
+
+  return 1;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    temporal_id of a prefix or slice extension NAL unit, from the SVC
+ *    or MVC NAL unit header extension
+ ************************************************************************
+ */
+static int nalu_temporal_id(NALU_t *nalu)
+{
+  if (nalu->len < 4)
+    return 0;
+  if (nalu->buf[1] & 0x80)        // svc_extension_flag
+    return nalu->buf[3] >> 5;
+  return (nalu->buf[3] >> 3) & 0x07;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Applies the protection policy to the first VCL NAL unit of an inter
+ *    picture: reference pictures only, temporal IDs, every FrameInterval
+ *    picture and the byte fraction, in this order
+ *
+ * \return
+ *    1 if the picture is protected
+ ************************************************************************
+ */
+static int protect_picture(InputParameters *p_Inp, ProtectPolicy *pol, int ref, int tid, int len)
+{
+  if (p_Inp->protect_ref_only && !ref)
+    return 0;
+  if (p_Inp->protect_tid_mask && !(p_Inp->protect_tid_mask & (1 << tid)))
+    return 0;
+  if (p_Inp->FrameInvl > 1 && (pol->inter_pics++ % p_Inp->FrameInvl) != 0)
+    return 0;
+  if (p_Inp->protect_fraction > 0.0)
+  {
+    // the MVD bits of a picture are unknown before it is parsed, the VCL
+    // bytes stand in for them
+    pol->counted = 1;
+    pol->bytes_total += len;
+    if (pol->bytes_protected >= p_Inp->protect_fraction * pol->bytes_total)
+      return 0;
+    pol->bytes_protected += len;
+  }
+  return 1;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Selective protection: decides from the NAL unit header and the first
+ *    two slice header codes whether a NAL unit belongs to a picture the
+ *    policy leaves unprotected. Such NAL units are dropped before the RBSP
+ *    conversion, so the picture is neither parsed nor allocated.
+ *
+ *    A picture starts with a VCL NAL unit whose first_mb_in_slice is 0,
+ *    that follows an access unit delimiter or that changes nal_ref_idc
+ *    or the IDR flag. Intra pictures carry no MVDs and are always passed
+ *    on.
+ *
+ * \return
+ *    1 if the NAL unit is dropped
+ ************************************************************************
+ */
+static int skip_nalu(VideoParameters *p_Vid, NALU_t *nalu)
+{
+  InputParameters *p_Inp = p_Vid->p_Inp;
+  ProtectPolicy *pol = &p_Dec->policy;
+  int header_len = 1;
+  int first_mb, slice_type, ref, idr, tid;
+
+  switch (nalu->nal_unit_type)
+  {
+  case NALU_TYPE_SLICE:
+  case NALU_TYPE_IDR:
+  case NALU_TYPE_DPA:
+    tid = imax(pol->prefix_tid - 1, 0);
+    break;
+  case NALU_TYPE_SLC_EXT:
+    header_len = 4;
+    tid = nalu_temporal_id(nalu);
+    break;
+  case NALU_TYPE_DPB:
+  case NALU_TYPE_DPC:
+    return pol->skip_pic;
+  case NALU_TYPE_AUD:
+    pol->new_au = 1;
+    pol->prefix_tid = 0;
+    return 0;
+  case NALU_TYPE_PREFIX:
+    pol->prefix_tid = nalu_temporal_id(nalu) + 1;
+    return 0;
+  default:
+    pol->prefix_tid = 0;
+    return 0;
+  }
+  pol->prefix_tid = 0;
+
+  if (!peek_slice_header(nalu->buf, nalu->len, header_len, &first_mb, &slice_type))
+    return (pol->skip_pic = 0);   // left to the slice parser to report
+
+  ref = (nalu->nal_reference_idc != 0);
+  idr = (nalu->nal_unit_type == NALU_TYPE_IDR);
+
+  if (first_mb == 0 || pol->new_au || ref != pol->last_ref || idr != pol->last_idr)
+  {
+    pol->counted  = 0;
+    pol->skip_pic = 0;
+    if (slice_type != I_SLICE && slice_type != SI_SLICE)
+      pol->skip_pic = !protect_picture(p_Inp, pol, ref, tid, nalu->len);
+    if (pol->skip_pic)
+    {
+      // the next slice that is parsed starts a new picture
+      init_old_slice(p_Vid->old_slice);
+      STATS_COUNT(COUNT_PIC_SKIPPED, 1);
+    }
+  }
+  else if (pol->counted)
+  {
+    pol->bytes_total += nalu->len;
+    if (!pol->skip_pic)
+      pol->bytes_protected += nalu->len;
+  }
+  pol->new_au   = 0;
+  pol->last_ref = ref;
+  pol->last_idr = idr;
+
+  return pol->skip_pic;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Writes the index recorded while reading the input file as its
+ *    sidecar. The NAL units must cover the whole file, which is not the
+ *    case if the parser skipped zero bytes between them, and the file
+ *    must not have been protected in place yet.
+ ************************************************************************
+ */
+static void save_nal_index(VideoParameters *p_Vid)
+{
+  NalIndex *idx = &p_Dec->nal_index_own;
+  NalIndex now;
+
+  p_Dec->nal_index_record = 0;
+  if (p_Dec->nalu_pos != idx->file_size || nal_index_key(&now, p_Vid->p_Inp->infile) != 0 ||
+    now.file_size != idx->file_size || now.mtime != idx->mtime)
+    return;
+
+  if (nal_index_save(idx, p_Vid->p_Inp->infile) != 0)
+    fprintf(stderr, "Warning: cannot write the NAL unit index of %s\n", p_Vid->p_Inp->infile);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Reads the next NAL unit of the index
+ *
+ * \return
+ *    as get_annex_b_NALU()
+ ************************************************************************
+ */
+static int read_indexed_nalu(VideoParameters *p_Vid, NALU_t *nalu)
+{
+  const NalIndexEntry *e;
+
+  if (p_Dec->nal_index_next >= p_Dec->nal_index->count)
+    return 0;
+
+  e = &p_Dec->nal_index->nal[p_Dec->nal_index_next++];
+  p_Dec->nal_entry = e;
+  p_Dec->nalu_pos  = e->pos - e->sc_len;
+  return get_indexed_NALU(nalu, p_Vid->annex_b, e);
+}
+
 /*!
 ************************************************************************
 * \brief
@@ -53,43 +271,65 @@ int read_next_nalu(VideoParameters *p_Vid, NALU_t *nalu)
 {
   InputParameters *p_Inp = p_Vid->p_Inp;
   int ret;
-	static off_t nalu_pos = 0;
-	static int nalu_nums_in_bs = 0;
+  int policy = (p_Inp->FrameInvl > 1 || p_Inp->protect_ref_only || p_Inp->protect_tid_mask || p_Inp->protect_fraction > 0.0);
+  STATS_TIMER(t_nalu);
 
-  switch( p_Inp->FileFormat )
+  do
   {
-  default:
-  case PAR_OF_ANNEXB:
-    ret = get_annex_b_NALU(p_Vid, nalu, p_Vid->annex_b);
-
-		if(p_Dec->p_Inp->enable_key)
-		{
-			nalu_pos += nalu->startcodeprefix_len;
-			p_Dec->nalu_pos_array[nalu_nums_in_bs++] = nalu_pos;
-			nalu_pos += nalu->len;		
-		}
-    break;
-  case PAR_OF_RTP:
-    ret = GetRTPNALU(p_Vid, nalu, p_Vid->BitStreamFile);
-    break;   
-  }
+    STATS_START(t_nalu);
+    switch( p_Inp->FileFormat )
+    {
+    default:
+    case PAR_OF_ANNEXB:
+      if (p_Dec->nal_index != NULL)
+        ret = read_indexed_nalu(p_Vid, nalu);
+      else
+        ret = get_annex_b_NALU(p_Vid, nalu, p_Vid->annex_b);
 
-  if (ret < 0)
-  {
-    snprintf (errortext, ET_SIZE, "Error while getting the NALU in file format %s, exit\n", p_Inp->FileFormat==PAR_OF_ANNEXB?"Annex B":"RTP");
-    error (errortext, 601);
-  }
-  if (ret == 0)
-  {
-    //FreeNALU(nalu);
-    return 0;
-  }
+      if (ret > 0)
+      {
+        if(nalu->nal_unit_type == NALU_TYPE_SLICE || nalu->nal_unit_type == NALU_TYPE_IDR || nalu->nal_unit_type == NALU_TYPE_DPA)
+          p_Dec->slice_nalu_pos = p_Dec->nalu_pos;
+        p_Dec->nalu_pos += nalu->startcodeprefix_len;
+        p_Dec->nalu_header_pos = p_Dec->nalu_pos;
+        p_Dec->nalu_pos += nalu->len;
+
+        if (p_Dec->nal_index_record && nalu->len > 0)
+          nal_index_add(&p_Dec->nal_index_own, p_Dec->nalu_header_pos, nalu->startcodeprefix_len, nalu->buf, nalu->len);
+      }
+      else if (ret == 0 && p_Dec->nal_index_record)
+      {
+        save_nal_index(p_Vid);
+      }
+      break;
+    case PAR_OF_RTP:
+      ret = GetRTPNALU(p_Vid, nalu, p_Vid->BitStreamFile);
+      break;   
+    }
+    STATS_STAGE(STAGE_NAL_READ, t_nalu);
+
+    if (ret < 0)
+    {
+      snprintf (errortext, ET_SIZE, "Error while getting the NALU in file format %s, exit\n", p_Inp->FileFormat==PAR_OF_ANNEXB?"Annex B":"RTP");
+      error (errortext, 601);
+    }
+    if (ret == 0)
+    {
+      //FreeNALU(nalu);
+      return 0;
+    }
 
-  //In some cases, zero_byte shall be present. If current NALU is a VCL NALU, we can't tell
-  //whether it is the first VCL NALU at this point, so only non-VCL NAL unit is checked here.
-  CheckZeroByteNonVCL(p_Vid, nalu);
+    //In some cases, zero_byte shall be present. If current NALU is a VCL NALU, we can't tell
+    //whether it is the first VCL NALU at this point, so only non-VCL NAL unit is checked here.
+    CheckZeroByteNonVCL(p_Vid, nalu);
+    STATS_COUNT(COUNT_NALU, 1);
+    STATS_COUNT(COUNT_BYTES_IN, nalu->len);
+    TRACE_BIN_NAL(p_Dec->nalu_header_pos, nalu->len, nalu->nal_unit_type);
+  } while (policy && skip_nalu(p_Vid, nalu));
 
+  STATS_START(t_nalu);
   ret = NALUtoRBSP(nalu);
+  STATS_STAGE(STAGE_EBSP, t_nalu);
 
   if (ret < 0)
     error ("Invalid startcode emulation prevention found.", 602);
@@ -214,12 +214,14 @@ static int InterpretSubsetSPS (VideoParameters *p_Vid, DataPartition *p, int *cu
   subset_seq_parameter_set_rbsp_t *subset_sps;
   unsigned int additional_extension2_flag;
   Bitstream *s = p->bitstream;
-  seq_parameter_set_rbsp_t *sps = AllocSPS();
+  seq_parameter_set_rbsp_t sps_buf;
+  seq_parameter_set_rbsp_t *sps = &sps_buf;
 
   assert (p != NULL);
   assert (p->bitstream != NULL);
   assert (p->bitstream->streamBuffer != 0);
 
+  memset (sps, 0, sizeof (seq_parameter_set_rbsp_t));
   InterpretSPS (p_Vid, p, sps);
   get_max_dec_frame_buf_size(sps);
 
@@ -268,7 +270,6 @@ static int InterpretSubsetSPS (VideoParameters *p_Vid, DataPartition *p, int *cu
   if (subset_sps->sps.Valid)
     subset_sps->Valid = TRUE;
 
-  FreeSPS (sps);
   return p_Dec->UsedBits;
 
 }
@@ -522,6 +523,48 @@ void SubsetSPSConsistencyCheck (subset_seq_parameter_set_rbsp_t *subset_sps)
 }
 #endif
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Sets up a data partition that reads the RBSP of a parameter set
+ *    NAL unit in place, without copying the payload
+ ************************************************************************
+ */
+static void init_ps_partition (DataPartition *dp, Bitstream *bs, NALU_t *nalu)
+{
+  memset (dp, 0, sizeof (DataPartition));
+  memset (bs, 0, sizeof (Bitstream));
+  dp->bitstream = bs;
+  bs->streamBuffer = &nalu->buf[1];
+  bs->code_len = bs->bitstream_length = RBSPtoSODB (bs->streamBuffer, nalu->len-1);
+}
+
+static Boolean ps_payload_is_equal (PSPayload *payload, NALU_t *nalu)
+{
+  return (Boolean) (payload->buf != NULL && payload->len == (int) nalu->len - 1 && memcmp (payload->buf, &nalu->buf[1], payload->len) == 0);
+}
+
+static void store_ps_payload (PSPayload *payload, NALU_t *nalu)
+{
+  int len = nalu->len - 1;
+
+  if (payload->len < len || payload->buf == NULL)
+  {
+    free (payload->buf);
+    if ((payload->buf = malloc (len)) == NULL)
+      no_mem_exit ("store_ps_payload: payload->buf");
+  }
+  memcpy (payload->buf, &nalu->buf[1], len);
+  payload->len = len;
+}
+
+static void free_ps_payload (PSPayload *payload)
+{
+  free (payload->buf);
+  payload->buf = NULL;
+  payload->len = 0;
+}
+
 void MakePPSavailable (VideoParameters *p_Vid, int id, pic_parameter_set_rbsp_t *pps)
 {
   assert (pps->Valid == TRUE);
@@ -547,9 +590,18 @@ void CleanUpPPS(VideoParameters *p_Vid)
       free (p_Vid->PicParSet[i].slice_group_id);
 
     p_Vid->PicParSet[i].Valid = FALSE;
+    free_ps_payload (&p_Vid->PicParSetPayload[i]);
   }
 }
 
+void CleanUpSPS(VideoParameters *p_Vid)
+{
+  int i;
+
+  for (i=0; i<MAXSPS; i++)
+    free_ps_payload (&p_Vid->SeqParSetPayload[i]);
+}
+
 
 void MakeSPSavailable (VideoParameters *p_Vid, int id, seq_parameter_set_rbsp_t *sps)
 {
@@ -560,38 +612,62 @@ void MakeSPSavailable (VideoParameters *p_Vid, int id, seq_parameter_set_rbsp_t
 
 void ProcessSPS (VideoParameters *p_Vid, NALU_t *nalu)
 {  
-  DataPartition *dp = AllocPartition(1);
-  seq_parameter_set_rbsp_t *sps = AllocSPS();
-
-  memcpy (dp->bitstream->streamBuffer, &nalu->buf[1], nalu->len-1);
-  dp->bitstream->code_len = dp->bitstream->bitstream_length = RBSPtoSODB (dp->bitstream->streamBuffer, nalu->len-1);
-  dp->bitstream->ei_flag = 0;
-  dp->bitstream->read_len = dp->bitstream->frame_bitoffset = 0;
+  DataPartition dp;
+  Bitstream bs;
+  seq_parameter_set_rbsp_t sps_buf;
+  seq_parameter_set_rbsp_t *sps = &sps_buf;
+  int used_bits = 0;
+  unsigned int id;
+
+  init_ps_partition (&dp, &bs, nalu);
+
+  // an SPS repeated with identical bytes is already stored, skip parsing it
+  read_u_v (24, "SPS: profile_idc, constraint flags, level_idc", &bs, &used_bits);
+  id = read_ue_v ("SPS: seq_parameter_set_id", &bs, &used_bits);
+  if (id < MAXSPS && p_Vid->SeqParSet[id].Valid && ps_payload_is_equal (&p_Vid->SeqParSetPayload[id], nalu))
+  {
+    sps = &p_Vid->SeqParSet[id];
+  }
+  else
+  {
+    int i;
 
-  InterpretSPS (p_Vid, dp, sps);
+    bs.frame_bitoffset = 0;
+    memset (sps, 0, sizeof (seq_parameter_set_rbsp_t));
+    InterpretSPS (p_Vid, &dp, sps);
 #if (MVC_EXTENSION_ENABLE)
-  get_max_dec_frame_buf_size(sps);
+    get_max_dec_frame_buf_size(sps);
 #endif
 
-  if (sps->Valid)
-  {
-    if (p_Vid->active_sps)
+    if (sps->Valid)
     {
-      if (sps->seq_parameter_set_id == p_Vid->active_sps->seq_parameter_set_id)
+      if (p_Vid->active_sps)
       {
-        if (!sps_is_equal(sps, p_Vid->active_sps))
+        if (sps->seq_parameter_set_id == p_Vid->active_sps->seq_parameter_set_id)
         {
-          if (p_Vid->dec_picture) // && p_Vid->num_dec_mb == p_Vid->PicSizeInMbs) //?
+          if (!sps_is_equal(sps, p_Vid->active_sps))
           {
-            // this may only happen on slice loss
-            exit_picture(p_Vid, &p_Vid->dec_picture);
+            if (p_Vid->dec_picture) // && p_Vid->num_dec_mb == p_Vid->PicSizeInMbs) //?
+            {
+              // this may only happen on slice loss
+              exit_picture(p_Vid, &p_Vid->dec_picture);
+            }
+            p_Vid->active_sps=NULL;
           }
-          p_Vid->active_sps=NULL;
         }
       }
+      // SPSConsistencyCheck (pps);
+      MakeSPSavailable (p_Vid, sps->seq_parameter_set_id, sps);
+      store_ps_payload (&p_Vid->SeqParSetPayload[sps->seq_parameter_set_id], nalu);
+
+      // PPS parsing depends on the SPS, so stored PPS payloads are no longer conclusive
+      for (i = 0; i < MAXPPS; i++)
+        free_ps_payload (&p_Vid->PicParSetPayload[i]);
     }
-    // SPSConsistencyCheck (pps);
-    MakeSPSavailable (p_Vid, sps->seq_parameter_set_id, sps);
+  }
+
+  if (sps->Valid)
+  {
 #if (MVC_EXTENSION_ENABLE)
     if (p_Vid->profile_idc < (int) sps->profile_idc)
     {
@@ -610,23 +686,18 @@ void ProcessSPS (VideoParameters *p_Vid, NALU_t *nalu)
       p_Vid->ChromaArrayType = sps->chroma_format_idc;
     }
   }
-
-  FreePartition (dp, 1);
-  FreeSPS (sps);
 }
 
 #if (MVC_EXTENSION_ENABLE)
 void ProcessSubsetSPS (VideoParameters *p_Vid, NALU_t *nalu)
 {
-  DataPartition *dp = AllocPartition(1);
+  DataPartition dp;
+  Bitstream bs;
   subset_seq_parameter_set_rbsp_t *subset_sps;
   int curr_seq_set_id;
 
-  memcpy (dp->bitstream->streamBuffer, &nalu->buf[1], nalu->len-1);
-  dp->bitstream->code_len = dp->bitstream->bitstream_length = RBSPtoSODB (dp->bitstream->streamBuffer, nalu->len-1);
-  dp->bitstream->ei_flag = 0;
-  dp->bitstream->read_len = dp->bitstream->frame_bitoffset = 0;
-  InterpretSubsetSPS (p_Vid, dp, &curr_seq_set_id);		//sps
+  init_ps_partition (&dp, &bs, nalu);
+  InterpretSubsetSPS (p_Vid, &dp, &curr_seq_set_id);		//sps
 
   subset_sps = p_Vid->SubsetSeqParSet + curr_seq_set_id;
   get_max_dec_frame_buf_size(&(subset_sps->sps));
@@ -657,21 +728,28 @@ void ProcessSubsetSPS (VideoParameters *p_Vid, NALU_t *nalu)
       p_Vid->ChromaArrayType = subset_sps->sps.chroma_format_idc;
     }
   }
-
-  FreePartition (dp, 1);  
 }
 #endif
 
 void ProcessPPS (VideoParameters *p_Vid, NALU_t *nalu)
 {
-  DataPartition *dp = AllocPartition(1);
-  pic_parameter_set_rbsp_t *pps = AllocPPS();	//sps
-
-  memcpy (dp->bitstream->streamBuffer, &nalu->buf[1], nalu->len-1);
-  dp->bitstream->code_len = dp->bitstream->bitstream_length = RBSPtoSODB (dp->bitstream->streamBuffer, nalu->len-1);
-  dp->bitstream->ei_flag = 0;
-  dp->bitstream->read_len = dp->bitstream->frame_bitoffset = 0;
-  InterpretPPS (p_Vid, dp, pps);
+  DataPartition dp;
+  Bitstream bs;
+  pic_parameter_set_rbsp_t pps_buf;
+  pic_parameter_set_rbsp_t *pps = &pps_buf;
+  int used_bits = 0;
+  unsigned int id;
+
+  init_ps_partition (&dp, &bs, nalu);
+
+  // a PPS repeated with identical bytes is already stored, nothing to do
+  id = read_ue_v ("PPS: pic_parameter_set_id", &bs, &used_bits);
+  if (id < MAXPPS && p_Vid->PicParSet[id].Valid && ps_payload_is_equal (&p_Vid->PicParSetPayload[id], nalu))
+    return;
+
+  bs.frame_bitoffset = 0;
+  memset (pps, 0, sizeof (pic_parameter_set_rbsp_t));
+  InterpretPPS (p_Vid, &dp, pps);
   // PPSConsistencyCheck (pps);
   if (p_Vid->active_pps)
   {
@@ -693,8 +771,7 @@ void ProcessPPS (VideoParameters *p_Vid, NALU_t *nalu)
     }
   }
   MakePPSavailable (p_Vid, pps->pic_parameter_set_id, pps);
-  FreePartition (dp, 1);
-  FreePPS (pps);
+  store_ps_payload (&p_Vid->PicParSetPayload[pps->pic_parameter_set_id], nalu);
 }
 
 /*!
@@ -0,0 +1,290 @@
+/*!
+ *************************************************************************************
+ * \file pipeline.c
+ *
+ * \brief
+ *    Parse/encrypt overlap: key unit batches go from the parser to an
+ *    encrypt thread, key records from there to a key writer thread
+ *
+ *************************************************************************************
+ */
+
+#include <pthread.h>
+
+#include "global.h"
+#include "pipeline.h"
+#include "memalloc.h"
+
+#ifdef _WIN32
+# define SPSC_LOAD(p)       (MemoryBarrier(), *(p))
+# define SPSC_STORE(p, v)   (MemoryBarrier(), *(p) = (v))
+#else
+# include <sched.h>
+# define SPSC_LOAD(p)       __atomic_load_n((p), __ATOMIC_ACQUIRE)
+# define SPSC_STORE(p, v)   __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#endif
+
+#define SPSC_SPINS  64       //!< yields before a waiting thread starts to sleep
+
+struct pipeline
+{
+  SpscQueue       units;     //!< KeyBatch from the parser to the encrypt thread, NULL ends
+  SpscQueue       keys;      //!< KeyChunk from the encrypt thread to the key writer, NULL ends
+  pthread_t       encrypt_thread;
+  pthread_t       writer_thread;
+  DecoderParams  *pDecoder;
+};
+
+//! key units of one access unit
+typedef struct key_batch
+{
+  KeyUnit *unit;
+  int      count;
+} KeyBatch;
+
+//! key records ready to be written
+typedef struct key_chunk
+{
+  char    *data;
+  int      len;
+} KeyChunk;
+
+extern int  Generate_Key(int64 RelativeByteOff, int64 cur_absolute_offset, int BitOffset, int BitLength, int canfree);
+extern void write_key_records(DecoderParams *pDecoder, const char *buf, int len);
+
+static void spsc_wait(int *spins)
+{
+#ifdef _WIN32
+  if (++(*spins) < SPSC_SPINS)
+    SwitchToThread();
+  else
+    Sleep(1);
+#else
+  if (++(*spins) < SPSC_SPINS)
+    sched_yield();
+  else
+    usleep(100);
+#endif
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Allocates a queue with room for size items, rounded up to a power
+ *    of two
+ * \return
+ *    0 on success, -1 if out of memory
+ ************************************************************************
+ */
+int spsc_init(SpscQueue *q, int size)
+{
+  unsigned int n = 1;
+
+  while (n < (unsigned int) size)
+    n <<= 1;
+  q->slot = (void **) calloc(n, sizeof(void *));
+  q->mask = n - 1;
+  q->head = 0;
+  q->tail = 0;
+  return q->slot == NULL ? -1 : 0;
+}
+
+void spsc_free(SpscQueue *q)
+{
+  free(q->slot);
+  q->slot = NULL;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Appends item, waits while the queue is full. Producer thread only.
+ ************************************************************************
+ */
+void spsc_push(SpscQueue *q, void *item)
+{
+  unsigned int tail = q->tail;
+  int spins = 0;
+
+  while (tail - SPSC_LOAD(&q->head) > q->mask)
+    spsc_wait(&spins);
+  q->slot[tail & q->mask] = item;
+  SPSC_STORE(&q->tail, tail + 1);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Removes the oldest item, waits while the queue is empty. Consumer
+ *    thread only.
+ ************************************************************************
+ */
+void *spsc_pop(SpscQueue *q)
+{
+  unsigned int head = q->head;
+  int spins = 0;
+  void *item;
+
+  while (SPSC_LOAD(&q->tail) == head)
+    spsc_wait(&spins);
+  item = q->slot[head & q->mask];
+  SPSC_STORE(&q->head, head + 1);
+  return item;
+}
+
+static void *encrypt_thread(void *arg)
+{
+  Pipeline *pl = (Pipeline *) arg;
+  KeyBatch *batch;
+  int i;
+
+  set_current_decoder(pl->pDecoder);
+  while ((batch = (KeyBatch *) spsc_pop(&pl->units)) != NULL)
+  {
+    STATS_TIMER(t_encode);
+    for (i = 0; i < batch->count; i++)
+      Generate_Key(batch->unit[i].byte_offset, 0, batch->unit[i].bit_offset, batch->unit[i].key_data_len, 0);
+    STATS_STAGE(STAGE_KEY_ENCODE, t_encode);
+    free(batch);
+  }
+  Generate_Key(0, 0, 0, 0, 1);
+
+  spsc_push(&pl->keys, NULL);
+  return NULL;
+}
+
+static void *key_writer_thread(void *arg)
+{
+  Pipeline *pl = (Pipeline *) arg;
+  KeyChunk *chunk;
+
+  set_current_decoder(pl->pDecoder);
+  while ((chunk = (KeyChunk *) spsc_pop(&pl->keys)) != NULL)
+  {
+    write_key_records(pl->pDecoder, chunk->data, chunk->len);
+    free(chunk);
+  }
+  if (pl->pDecoder->p_KeyFile)
+    fflush(pl->pDecoder->p_KeyFile);
+  return NULL;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Starts the encrypt and the key writer thread of pDecoder, the
+ *    queues hold queue_size batches
+ * \return
+ *    0 on success, -1 if the pipeline could not be set up
+ ************************************************************************
+ */
+int pipeline_start(DecoderParams *pDecoder, int queue_size)
+{
+  Pipeline *pl = (Pipeline *) calloc(1, sizeof(Pipeline));
+
+  if (pl == NULL)
+    return -1;
+  pl->pDecoder = pDecoder;
+  if (spsc_init(&pl->units, queue_size) != 0 || spsc_init(&pl->keys, queue_size) != 0)
+  {
+    spsc_free(&pl->units);
+    spsc_free(&pl->keys);
+    free(pl);
+    return -1;
+  }
+  if (pthread_create(&pl->encrypt_thread, NULL, encrypt_thread, pl) != 0)
+  {
+    spsc_free(&pl->units);
+    spsc_free(&pl->keys);
+    free(pl);
+    return -1;
+  }
+  if (pthread_create(&pl->writer_thread, NULL, key_writer_thread, pl) != 0)
+  {
+    // the encrypt thread ends the stream on its own
+    spsc_push(&pl->units, NULL);
+    pthread_join(pl->encrypt_thread, NULL);
+    spsc_free(&pl->units);
+    spsc_free(&pl->keys);
+    free(pl);
+    return -1;
+  }
+
+  pDecoder->pipeline = pl;
+  return 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Hands the key units captured since the last call to the encrypt
+ *    thread. Called by the parser at the end of an access unit.
+ ************************************************************************
+ */
+void pipeline_push_units(DecoderParams *pDecoder)
+{
+  int n = pDecoder->key_unit_idx;
+  KeyBatch *batch;
+
+  if (n == 0)
+    return;
+
+  batch = (KeyBatch *) malloc(sizeof(KeyBatch) + n * sizeof(KeyUnit));
+  if (batch == NULL)
+    no_mem_exit("pipeline_push_units: batch");
+  batch->unit  = (KeyUnit *) (batch + 1);
+  batch->count = n;
+  memcpy(batch->unit, pDecoder->key_unit_buffer, n * sizeof(KeyUnit));
+  spsc_push(&pDecoder->pipeline->units, batch);
+
+  pDecoder->key_units_protected += n;
+  pDecoder->key_unit_idx = 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Hands len bytes of key records to the key writer thread. Called by
+ *    the encrypt thread.
+ ************************************************************************
+ */
+void pipeline_push_keys(Pipeline *pl, const char *buf, int len)
+{
+  KeyChunk *chunk;
+
+  if (len <= 0)
+    return;
+
+  chunk = (KeyChunk *) malloc(sizeof(KeyChunk) + len);
+  if (chunk == NULL)
+    no_mem_exit("pipeline_push_keys: chunk");
+  chunk->data = (char *) (chunk + 1);
+  chunk->len  = len;
+  memcpy(chunk->data, buf, len);
+  spsc_push(&pl->keys, chunk);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Hands the remaining key units to the encrypt thread and waits until
+ *    the stream is protected and all key records are written
+ ************************************************************************
+ */
+void pipeline_finish(DecoderParams *pDecoder)
+{
+  Pipeline *pl = pDecoder->pipeline;
+
+  if (pl == NULL)
+    return;
+
+  pipeline_push_units(pDecoder);
+  spsc_push(&pl->units, NULL);
+  pthread_join(pl->encrypt_thread, NULL);
+  pthread_join(pl->writer_thread, NULL);
+
+  spsc_free(&pl->units);
+  spsc_free(&pl->keys);
+  free(pl);
+  pDecoder->pipeline = NULL;
+}
@@ -31,6 +31,13 @@
 #define TRACE_STRING_P(s)
 #endif
 
+#if (MVD_PARSE_ONLY)
+// residual blocks are consumed by a single call that returns EOB
+#define RUN_LEVEL_CABAC skipRunLevel_CABAC
+#else
+#define RUN_LEVEL_CABAC readRunLevel_CABAC
+#endif
+
 //! look up tables for FRExt_chroma support
 static const unsigned char subblk_offset_x[3][8][4] =
 {
@@ -138,7 +145,7 @@ static void read_comp_coeff_4x4_smb_CABAC (Macroblock *currMB, SyntaxElement *cu
         if (dP->bitstream->ei_flag)  
           currSE->mapping = linfo_levrun_inter;
         else                                                     
-          currSE->reading = readRunLevel_CABAC;
+          currSE->reading = RUN_LEVEL_CABAC;
 
 #if TRACE
         if (pl == PLANE_Y)
@@ -162,7 +169,7 @@ static void read_comp_coeff_4x4_smb_CABAC (Macroblock *currMB, SyntaxElement *cu
         if (dP->bitstream->ei_flag)  
           currSE->mapping = linfo_levrun_inter;
         else                                                     
-          currSE->reading = readRunLevel_CABAC;
+          currSE->reading = RUN_LEVEL_CABAC;
 
         for(k = 1; (k < 17) && (level != 0); ++k)
         {
@@ -277,7 +284,7 @@ static void readCompCoeff8x8_CABAC (Macroblock *currMB, SyntaxElement *currSE, C
     else
       currSE->context = CR_8x8;  
 
-    currSE->reading = readRunLevel_CABAC;
+    currSE->reading = RUN_LEVEL_CABAC;
 
     // Read DC
     currSE->type = ((currMB->is_intra_block == 1) ? SE_LUM_DC_INTRA : SE_LUM_DC_INTER ); // Intra or Inter?
@@ -346,7 +353,7 @@ static void readCompCoeff8x8_CABAC_lossless (Macroblock *currMB, SyntaxElement *
     else
       currSE->context = CR_8x8;  
 
-    currSE->reading = readRunLevel_CABAC;
+    currSE->reading = RUN_LEVEL_CABAC;
 
     for(k=0; (k < 65) && (level != 0);++k)
     {
@@ -369,7 +376,7 @@ static void readCompCoeff8x8_CABAC_lossless (Macroblock *currMB, SyntaxElement *
 #endif
 
       dP = &(currSlice->partArr[partMap[currSE->type]]);
-      currSE->reading = readRunLevel_CABAC;
+      currSE->reading = RUN_LEVEL_CABAC;
 
       dP->readSyntaxElement(currMB, currSE, dP);
       level = currSE->value1;
@@ -520,7 +527,7 @@ static void read_CBP_and_coeffs_from_NAL_CABAC_420(Macroblock *currMB)
       }
       else
       {
-        currSE.reading = readRunLevel_CABAC;
+        currSE.reading = RUN_LEVEL_CABAC;
       }
 
       level = 1;                            // just to get inside the loop
@@ -579,7 +586,7 @@ static void read_CBP_and_coeffs_from_NAL_CABAC_420(Macroblock *currMB)
       if (dP->bitstream->ei_flag)
         currSE.mapping = linfo_levrun_c2x2;
       else
-        currSE.reading = readRunLevel_CABAC;
+        currSE.reading = RUN_LEVEL_CABAC;
 
       for(k = 0; (k < (p_Vid->num_cdc_coeff + 1))&&(level!=0);++k)
       {
@@ -606,13 +613,14 @@ static void read_CBP_and_coeffs_from_NAL_CABAC_420(Macroblock *currMB)
     if (dP->bitstream->ei_flag)
       currSE.mapping = linfo_levrun_inter;
     else
-      currSE.reading = readRunLevel_CABAC;
+      currSE.reading = RUN_LEVEL_CABAC;
 
     if(currMB->is_lossless == FALSE)
     {
       int b4, b8, k;
       for (b8=0; b8 < p_Vid->num_blk8x8_uv; ++b8)
       {
+        currMB->is_v_block = (b8 > ((p_Vid->num_uv_blocks) - 1 ));
         for (b4 = 0; b4 < 4; ++b4)
         {
           currMB->subblock_y = subblk_offset_y[yuv][b8][b4];
@@ -637,6 +645,7 @@ static void read_CBP_and_coeffs_from_NAL_CABAC_420(Macroblock *currMB)
       int b4, b8, k;
       for (b8=0; b8 < p_Vid->num_blk8x8_uv; ++b8)
       {
+        currMB->is_v_block = (b8 > ((p_Vid->num_uv_blocks) - 1 ));
         for (b4=0; b4 < 4; ++b4)
         {
           level=1;
@@ -659,6 +668,167 @@ static void read_CBP_and_coeffs_from_NAL_CABAC_420(Macroblock *currMB)
 }
 
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Get coded block pattern and coefficients (run/level) of a 4:2:0
+ *    macroblock of a non-partitioned slice (CABAC Mode)
+ *
+ *    All syntax elements are in the first partition, which never has
+ *    ei_flag set, and there are no lossless macroblocks. transform_8x8
+ *    is a constant of each variant, with 0 the transform size flag and
+ *    the 8x8 readers drop out.
+ ************************************************************************
+ */
+static inline void read_CBP_and_coeffs_CABAC_420_dp1(Macroblock *currMB, int transform_8x8)
+{
+  int k, ll, b8, b4;
+  int level;
+  int cbp;
+  SyntaxElement currSE;
+  Slice *currSlice = currMB->p_Slice;
+  DataPartition *dP = &(currSlice->partArr[0]);
+  const byte *partMap = assignSE2partition[PAR_DP_1];
+  int intra = (currMB->is_intra_block == TRUE);
+
+  if (!IS_I16MB (currMB))
+  {
+    //=====   C B P   =====
+    //---------------------
+    currSE.type = (currMB->mb_type == I4MB || currMB->mb_type == SI4MB || currMB->mb_type == I8MB) 
+      ? SE_CBP_INTRA
+      : SE_CBP_INTER;
+    currSE.reading = read_CBP_CABAC;
+
+    TRACE_STRING("coded_block_pattern");
+    readSyntaxElement_CABAC(currMB, &currSE, dP);
+    currMB->cbp = cbp = currSE.value1;
+
+    //============= Transform size flag for INTER MBs =============
+    //-------------------------------------------------------------
+    if (transform_8x8 && (cbp & 15)
+      && ((currMB->mb_type >= 1 && currMB->mb_type <= 3) ||
+      (IS_DIRECT(currMB) && currMB->p_Vid->active_sps->direct_8x8_inference_flag) ||
+      (currMB->NoMbPartLessThan8x8Flag))
+      && currMB->mb_type != I8MB && currMB->mb_type != I4MB)
+    {
+      currSE.type    = SE_HEADER;
+      currSE.reading = readMB_transform_size_flag_CABAC;
+      TRACE_STRING("transform_size_8x8_flag");
+      readSyntaxElement_CABAC(currMB, &currSE, dP);
+      currMB->luma_transform_size_8x8_flag = (Boolean) currSE.value1;
+    }
+
+    //=====   DQUANT   =====
+    //----------------------
+    // Delta quant only if nonzero coeffs
+    if (cbp !=0)
+    {
+      read_delta_quant(&currSE, dP, currMB, partMap, intra ? SE_DELTA_QUANT_INTRA : SE_DELTA_QUANT_INTER);
+    }
+  }
+  else // read DC coeffs for new intra modes
+  {
+    cbp = currMB->cbp;
+  
+    read_delta_quant(&currSE, dP, currMB, partMap, SE_DELTA_QUANT_INTRA);
+
+    if (!currMB->dpl_flag)
+    {
+      currSE.context = LUMA_16DC;
+      currSE.type    = SE_LUM_DC_INTRA;
+      currSE.reading = RUN_LEVEL_CABAC;
+
+      level = 1;                            // just to get inside the loop
+
+      for(k = 0; (k < 17) && (level != 0); ++k)
+      {
+#if TRACE
+        snprintf(currSE.tracestring, TRACESTRING_SIZE, "DC luma 16x16 ");
+#endif
+        readSyntaxElement_CABAC(currMB, &currSE, dP);
+        level = currSE.value1;
+      }
+    }
+  }
+
+  update_qp(currMB, currSlice->qp);
+
+  // luma coefficients
+  if (cbp)
+  {
+    if (transform_8x8 && currMB->luma_transform_size_8x8_flag) 
+      read_comp_coeff_8x8_MB_CABAC (currMB, &currSE, PLANE_Y); 
+    else
+      read_comp_coeff_4x4_CABAC (currMB, &currSE, PLANE_Y, cbp);	
+  }
+
+  //========================== CHROMA DC ============================
+  //-----------------------------------------------------------------
+  if(cbp>15)
+  {   
+    currSE.context = CHROMA_DC;
+    currSE.type    = (intra ? SE_CHR_DC_INTRA : SE_CHR_DC_INTER);
+    currSE.reading = RUN_LEVEL_CABAC;
+
+    for (ll = 0; ll < 3; ll += 2)
+    {
+      level = 1;
+      currMB->is_v_block = ll;
+
+      for(k = 0; (k < 5) && (level != 0); ++k)
+      {
+#if TRACE
+        snprintf(currSE.tracestring, TRACESTRING_SIZE, "2x2 DC Chroma ");
+#endif
+        readSyntaxElement_CABAC(currMB, &currSE, dP);
+        level = currSE.value1;
+      }
+    }      
+  }
+
+  //========================== CHROMA AC ============================
+  //-----------------------------------------------------------------
+  if (cbp >31)
+  {
+    currSE.context = CHROMA_AC;
+    currSE.type    = (intra ? SE_CHR_AC_INTRA : SE_CHR_AC_INTER);
+    currSE.reading = RUN_LEVEL_CABAC;
+
+    for (b8 = 0; b8 < 2; ++b8)
+    {
+      currMB->is_v_block = b8;
+      for (b4 = 0; b4 < 4; ++b4)
+      {
+        currMB->subblock_y = subblk_offset_y[0][b8][b4];
+        currMB->subblock_x = subblk_offset_x[0][b8][b4];
+
+        level = 1;
+
+        for(k = 0; (k < 16) && (level != 0); ++k)
+        {
+#if TRACE
+          snprintf(currSE.tracestring, TRACESTRING_SIZE, "AC Chroma ");
+#endif
+          readSyntaxElement_CABAC(currMB, &currSE, dP);
+          level = currSE.value1;
+        } 
+      }
+    }
+  }  
+}
+
+static void read_CBP_and_coeffs_from_NAL_CABAC_420_dp1(Macroblock *currMB)
+{
+  read_CBP_and_coeffs_CABAC_420_dp1(currMB, 0);
+}
+
+static void read_CBP_and_coeffs_from_NAL_CABAC_420_dp1_8x8(Macroblock *currMB)
+{
+  read_CBP_and_coeffs_CABAC_420_dp1(currMB, 1);
+}
+
+
 /*!
  ************************************************************************
  * \brief
@@ -762,7 +932,7 @@ static void read_CBP_and_coeffs_from_NAL_CABAC_400(Macroblock *currMB)
       }
       else
       {
-        currSE.reading = readRunLevel_CABAC;
+        currSE.reading = RUN_LEVEL_CABAC;
       }
 
       level = 1;                            // just to get inside the loop
@@ -901,7 +1071,7 @@ static void read_CBP_and_coeffs_from_NAL_CABAC_444(Macroblock *currMB)
       }
       else
       {
-        currSE.reading = readRunLevel_CABAC;
+        currSE.reading = RUN_LEVEL_CABAC;
       }
 
       level = 1;                            // just to get inside the loop
@@ -955,7 +1125,7 @@ static void read_CBP_and_coeffs_from_NAL_CABAC_444(Macroblock *currMB)
         }
         else
         {
-          currSE.reading = readRunLevel_CABAC;
+          currSE.reading = RUN_LEVEL_CABAC;
         }
 
         level = 1;                            // just to get inside the loop
@@ -1102,7 +1272,7 @@ static void read_CBP_and_coeffs_from_NAL_CABAC_422(Macroblock *currMB)
         }
         else
         {
-          currSE.reading = readRunLevel_CABAC;
+          currSE.reading = RUN_LEVEL_CABAC;
         }
 
         level = 1;                            // just to get inside the loop
@@ -1161,7 +1331,7 @@ static void read_CBP_and_coeffs_from_NAL_CABAC_422(Macroblock *currMB)
           if (dP->bitstream->ei_flag)
             currSE.mapping = linfo_levrun_c2x2;
           else
-            currSE.reading = readRunLevel_CABAC;
+            currSE.reading = RUN_LEVEL_CABAC;
 
           dP->readSyntaxElement(currMB, &currSE, dP);
 
@@ -1187,7 +1357,7 @@ static void read_CBP_and_coeffs_from_NAL_CABAC_422(Macroblock *currMB)
       if (dP->bitstream->ei_flag)
         currSE.mapping = linfo_levrun_inter;
       else
-        currSE.reading = readRunLevel_CABAC;
+        currSE.reading = RUN_LEVEL_CABAC;
 
       if(currMB->is_lossless == FALSE)
       {          
@@ -1259,7 +1429,16 @@ void set_read_CBP_and_coeffs_cabac(Slice *currSlice)
     currSlice->read_CBP_and_coeffs_from_NAL = read_CBP_and_coeffs_from_NAL_CABAC_422;
     break;
   case YUV420:
-    currSlice->read_CBP_and_coeffs_from_NAL = read_CBP_and_coeffs_from_NAL_CABAC_420;
+    if (currSlice->dp_mode == PAR_DP_1 && currSlice->p_Vid->active_sps->lossless_qpprime_flag == 0)
+    {
+      currSlice->read_CBP_and_coeffs_from_NAL = (currSlice->Transform8x8Mode)
+        ? read_CBP_and_coeffs_from_NAL_CABAC_420_dp1_8x8
+        : read_CBP_and_coeffs_from_NAL_CABAC_420_dp1;
+    }
+    else
+    {
+      currSlice->read_CBP_and_coeffs_from_NAL = read_CBP_and_coeffs_from_NAL_CABAC_420;
+    }
     break;
   case YUV400:
     currSlice->read_CBP_and_coeffs_from_NAL = read_CBP_and_coeffs_from_NAL_CABAC_400;
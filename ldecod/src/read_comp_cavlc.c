@@ -69,15 +69,15 @@ static int predict_nnz(Macroblock *currMB, int block_type, int i,int j)
     switch (block_type)
     {
     case LUMA:
-      pred_nnz = p_Vid->nz_coeff [pix.mb_addr ][0][pix.y][pix.x];
+      pred_nnz = get_mb_ctx(p_Vid, pix.mb_addr)->nz_coeff[0][pix.y][pix.x];
       ++cnt;
       break;
     case CB:
-      pred_nnz = p_Vid->nz_coeff [pix.mb_addr ][1][pix.y][pix.x];
+      pred_nnz = get_mb_ctx(p_Vid, pix.mb_addr)->nz_coeff[1][pix.y][pix.x];
       ++cnt;
       break;
     case CR:
-      pred_nnz = p_Vid->nz_coeff [pix.mb_addr ][2][pix.y][pix.x];
+      pred_nnz = get_mb_ctx(p_Vid, pix.mb_addr)->nz_coeff[2][pix.y][pix.x];
       ++cnt;
       break;
     default:
@@ -101,15 +101,15 @@ static int predict_nnz(Macroblock *currMB, int block_type, int i,int j)
     switch (block_type)
     {
     case LUMA:
-      pred_nnz += p_Vid->nz_coeff [pix.mb_addr ][0][pix.y][pix.x];
+      pred_nnz += get_mb_ctx(p_Vid, pix.mb_addr)->nz_coeff[0][pix.y][pix.x];
       ++cnt;
       break;
     case CB:
-      pred_nnz += p_Vid->nz_coeff [pix.mb_addr ][1][pix.y][pix.x];
+      pred_nnz += get_mb_ctx(p_Vid, pix.mb_addr)->nz_coeff[1][pix.y][pix.x];
       ++cnt;
       break;
     case CR:
-      pred_nnz += p_Vid->nz_coeff [pix.mb_addr ][2][pix.y][pix.x];
+      pred_nnz += get_mb_ctx(p_Vid, pix.mb_addr)->nz_coeff[2][pix.y][pix.x];
       ++cnt;
       break;
     default:
@@ -162,7 +162,7 @@ static int predict_nnz_chroma(Macroblock *currMB, int i,int j)
 
     if (pix.available)
     {
-      pred_nnz = p_Vid->nz_coeff [pix.mb_addr ][1][pix.y][2 * (i>>1) + pix.x];
+      pred_nnz = get_mb_ctx(p_Vid, pix.mb_addr)->nz_coeff[1][pix.y][2 * (i>>1) + pix.x];
       ++cnt;
     }
 
@@ -178,7 +178,7 @@ static int predict_nnz_chroma(Macroblock *currMB, int i,int j)
 
     if (pix.available)
     {
-      pred_nnz += p_Vid->nz_coeff [pix.mb_addr ][1][pix.y][2 * (i>>1) + pix.x];
+      pred_nnz += get_mb_ctx(p_Vid, pix.mb_addr)->nz_coeff[1][pix.y][2 * (i>>1) + pix.x];
       ++cnt;
     }
 
@@ -210,7 +210,6 @@ void read_coeff_4x4_CAVLC (Macroblock *currMB,
 {
   Slice *currSlice = currMB->p_Slice;
   VideoParameters *p_Vid = currMB->p_Vid;
-  int mb_nr = currMB->mbAddrX;
   SyntaxElement currSE;
   DataPartition *dP;
   const byte *partMap = assignSE2partition[currSlice->dp_mode];
@@ -231,37 +230,37 @@ void read_coeff_4x4_CAVLC (Macroblock *currMB,
     max_coeff_num = 16;
     TRACE_PRINTF("Luma");
     dptype = (currMB->is_intra_block == TRUE) ? SE_LUM_AC_INTRA : SE_LUM_AC_INTER;
-    p_Vid->nz_coeff[mb_nr][0][j][i] = 0; 
+    currMB->ctx->nz_coeff[0][j][i] = 0; 
     break;
   case LUMA_INTRA16x16DC:
     max_coeff_num = 16;
     TRACE_PRINTF("Lum16DC");
     dptype = SE_LUM_DC_INTRA;
-    p_Vid->nz_coeff[mb_nr][0][j][i] = 0; 
+    currMB->ctx->nz_coeff[0][j][i] = 0; 
     break;
   case LUMA_INTRA16x16AC:
     max_coeff_num = 15;
     TRACE_PRINTF("Lum16AC");
     dptype = SE_LUM_AC_INTRA;
-    p_Vid->nz_coeff[mb_nr][0][j][i] = 0; 
+    currMB->ctx->nz_coeff[0][j][i] = 0; 
     break;
   case CHROMA_DC:
     max_coeff_num = p_Vid->num_cdc_coeff;
     cdc = 1;
     TRACE_PRINTF("ChrDC");
     dptype = (currMB->is_intra_block == TRUE) ? SE_CHR_DC_INTRA : SE_CHR_DC_INTER;
-    p_Vid->nz_coeff[mb_nr][0][j][i] = 0; 
+    currMB->ctx->nz_coeff[0][j][i] = 0; 
     break;
   case CHROMA_AC:
     max_coeff_num = 15;
     cac = 1;
     TRACE_PRINTF("ChrAC");
     dptype = (currMB->is_intra_block == TRUE) ? SE_CHR_AC_INTRA : SE_CHR_AC_INTER;
-    p_Vid->nz_coeff[mb_nr][0][j][i] = 0; 
+    currMB->ctx->nz_coeff[0][j][i] = 0; 
     break;
   default:
     error ("read_coeff_4x4_CAVLC: invalid block type", 600);
-    p_Vid->nz_coeff[mb_nr][0][j][i] = 0; 
+    currMB->ctx->nz_coeff[0][j][i] = 0; 
     break;
   }
 
@@ -281,7 +280,7 @@ void read_coeff_4x4_CAVLC (Macroblock *currMB,
     numcoeff        =  currSE.value1;
     numtrailingones =  currSE.value2;
 
-    p_Vid->nz_coeff[mb_nr][0][j][i] = (byte) numcoeff;
+    currMB->ctx->nz_coeff[0][j][i] = (byte) numcoeff;
   }
   else
   {
@@ -407,6 +406,181 @@ void read_coeff_4x4_CAVLC (Macroblock *currMB,
   } // if numcoeff
 }
 
+#if (MVD_PARSE_ONLY)
+/*!
+ ************************************************************************
+ * \brief
+ *    Parses coeff of an 4x4 block without level/run reconstruction (CAVLC)
+ *    Only the number of coefficients is kept (nz_coeff, needed for the
+ *    nC prediction of the following blocks); levarr/runarr are untouched.
+ ************************************************************************
+ */
+void skip_coeff_4x4_CAVLC (Macroblock *currMB,
+                           int block_type,
+                           int i, int j, int levarr[16], int runarr[16],
+                           int *number_coefficients)
+{
+  Slice *currSlice = currMB->p_Slice;
+  VideoParameters *p_Vid = currMB->p_Vid;
+  SyntaxElement currSE;
+  DataPartition *dP;
+  const byte *partMap = assignSE2partition[currSlice->dp_mode];
+  Bitstream *currStream;
+
+  int k, vlcnum;
+  int numcoeff = 0, numtrailingones;
+  int level_two_or_higher;
+  int totzeros, abslevel, cdc=0, cac=0;
+  int zerosleft, dptype = 0;
+  int max_coeff_num = 0, nnz;
+  char type[15];
+  static const int incVlc[] = {0, 3, 6, 12, 24, 48, 32768};    // maximum vlc = 6
+
+  switch (block_type)
+  {
+  case LUMA:
+    max_coeff_num = 16;
+    TRACE_PRINTF("Luma");
+    dptype = (currMB->is_intra_block == TRUE) ? SE_LUM_AC_INTRA : SE_LUM_AC_INTER;
+    break;
+  case LUMA_INTRA16x16DC:
+    max_coeff_num = 16;
+    TRACE_PRINTF("Lum16DC");
+    dptype = SE_LUM_DC_INTRA;
+    break;
+  case LUMA_INTRA16x16AC:
+    max_coeff_num = 15;
+    TRACE_PRINTF("Lum16AC");
+    dptype = SE_LUM_AC_INTRA;
+    break;
+  case CHROMA_DC:
+    max_coeff_num = p_Vid->num_cdc_coeff;
+    cdc = 1;
+    TRACE_PRINTF("ChrDC");
+    dptype = (currMB->is_intra_block == TRUE) ? SE_CHR_DC_INTRA : SE_CHR_DC_INTER;
+    break;
+  case CHROMA_AC:
+    max_coeff_num = 15;
+    cac = 1;
+    TRACE_PRINTF("ChrAC");
+    dptype = (currMB->is_intra_block == TRUE) ? SE_CHR_AC_INTRA : SE_CHR_AC_INTER;
+    break;
+  default:
+    error ("skip_coeff_4x4_CAVLC: invalid block type", 600);
+    break;
+  }
+  currMB->ctx->nz_coeff[0][j][i] = 0;
+
+  currSE.type = dptype;
+  dP = &(currSlice->partArr[partMap[dptype]]);
+  currStream = dP->bitstream;
+
+  if (!cdc)
+  {
+    // luma or chroma AC
+    nnz = (!cac) ? predict_nnz(currMB, LUMA, i<<2, j<<2) : predict_nnz_chroma(currMB, i, ((j-4)<<2));
+
+    currSE.value1 = (nnz < 2) ? 0 : ((nnz < 4) ? 1 : ((nnz < 8) ? 2 : 3));
+
+    readSyntaxElement_NumCoeffTrailingOnes(&currSE, currStream, type);
+
+    numcoeff        =  currSE.value1;
+    numtrailingones =  currSE.value2;
+
+    currMB->ctx->nz_coeff[0][j][i] = (byte) numcoeff;
+  }
+  else
+  {
+    // chroma DC
+    readSyntaxElement_NumCoeffTrailingOnesChromaDC(p_Vid, &currSE, currStream);
+
+    numcoeff        =  currSE.value1;
+    numtrailingones =  currSE.value2;
+  }
+
+  *number_coefficients = numcoeff;
+
+  if (numcoeff)
+  {
+    // the signs of the trailing ones are not needed
+    currStream->frame_bitoffset += numtrailingones;
+
+    // decode levels, only their magnitude drives the vlc table selection
+    level_two_or_higher = (numcoeff > 3 && numtrailingones == 3)? 0 : 1;
+    vlcnum = (numcoeff > 10 && numtrailingones < 3) ? 1 : 0;
+
+    for (k = numcoeff - 1 - numtrailingones; k >= 0; k--)
+    {
+
+#if TRACE
+      snprintf(currSE.tracestring,
+        TRACESTRING_SIZE, "%s lev (%d,%d) k=%d vlc=%d ", type, i, j, k, vlcnum);
+#endif
+
+      if (vlcnum == 0)
+        readSyntaxElement_Level_VLC0(&currSE, currStream);
+      else
+        readSyntaxElement_Level_VLCN(&currSE, vlcnum, currStream);
+
+      abslevel = iabs(currSE.inf) + level_two_or_higher;
+      level_two_or_higher = 0;
+
+      // update VLC table
+      if (abslevel  > incVlc[vlcnum])
+        ++vlcnum;
+
+      if (k == numcoeff - 1 - numtrailingones && abslevel >3)
+        vlcnum = 2;
+    }
+
+    if (numcoeff < max_coeff_num)
+    {
+      // decode total run
+      vlcnum = numcoeff - 1;
+      currSE.value1 = vlcnum;
+
+#if TRACE
+      snprintf(currSE.tracestring,
+        TRACESTRING_SIZE, "%s totalrun (%d,%d) vlc=%d ", type, i,j, vlcnum);
+#endif
+      if (cdc)
+        readSyntaxElement_TotalZerosChromaDC(p_Vid, &currSE, currStream);
+      else
+        readSyntaxElement_TotalZeros(&currSE, currStream);
+
+      totzeros = currSE.value1;
+    }
+    else
+    {
+      totzeros = 0;
+    }
+
+    // skip run before each coefficient
+    zerosleft = totzeros;
+    i = numcoeff - 1;
+
+    if (zerosleft > 0 && i > 0)
+    {
+      do
+      {
+        // select VLC for runbefore
+        currSE.value1 = imin(zerosleft - 1, RUNBEFORE_NUM_M1);
+#if TRACE
+        snprintf(currSE.tracestring,
+          TRACESTRING_SIZE, "%s run (%d,%d) k=%d vlc=%d ",
+          type, i, j, i, currSE.value1);
+#endif
+
+        readSyntaxElement_Run(&currSE, currStream);
+
+        zerosleft -= currSE.value1;
+        i --;
+      } while (zerosleft != 0 && i != 0);
+    }
+  } // if numcoeff
+}
+#endif
+
 /*!
  ************************************************************************
  * \brief
@@ -424,7 +598,6 @@ void read_coeff_4x4_CAVLC_444 (Macroblock *currMB,
 {
   Slice *currSlice = currMB->p_Slice;
   VideoParameters *p_Vid = currMB->p_Vid;
-  int mb_nr = currMB->mbAddrX;
   SyntaxElement currSE;
   DataPartition *dP;
   const byte *partMap = assignSE2partition[currSlice->dp_mode];
@@ -445,73 +618,73 @@ void read_coeff_4x4_CAVLC_444 (Macroblock *currMB,
     max_coeff_num = 16;
     TRACE_PRINTF("Luma");
     dptype = (currMB->is_intra_block == TRUE) ? SE_LUM_AC_INTRA : SE_LUM_AC_INTER;
-    p_Vid->nz_coeff[mb_nr][0][j][i] = 0; 
+    currMB->ctx->nz_coeff[0][j][i] = 0; 
     break;
   case LUMA_INTRA16x16DC:
     max_coeff_num = 16;
     TRACE_PRINTF("Lum16DC");
     dptype = SE_LUM_DC_INTRA;
-    p_Vid->nz_coeff[mb_nr][0][j][i] = 0; 
+    currMB->ctx->nz_coeff[0][j][i] = 0; 
     break;
   case LUMA_INTRA16x16AC:
     max_coeff_num = 15;
     TRACE_PRINTF("Lum16AC");
     dptype = SE_LUM_AC_INTRA;
-    p_Vid->nz_coeff[mb_nr][0][j][i] = 0; 
+    currMB->ctx->nz_coeff[0][j][i] = 0; 
     break;
   case CB:
     max_coeff_num = 16;
     TRACE_PRINTF("Luma_add1");
     dptype = ((currMB->is_intra_block == TRUE)) ? SE_LUM_AC_INTRA : SE_LUM_AC_INTER;
-    p_Vid->nz_coeff[mb_nr][1][j][i] = 0; 
+    currMB->ctx->nz_coeff[1][j][i] = 0; 
     break;
   case CB_INTRA16x16DC:
     max_coeff_num = 16;
     TRACE_PRINTF("Luma_add1_16DC");
     dptype = SE_LUM_DC_INTRA;
-    p_Vid->nz_coeff[mb_nr][1][j][i] = 0; 
+    currMB->ctx->nz_coeff[1][j][i] = 0; 
     break;
   case CB_INTRA16x16AC:
     max_coeff_num = 15;
     TRACE_PRINTF("Luma_add1_16AC");
     dptype = SE_LUM_AC_INTRA;
-    p_Vid->nz_coeff[mb_nr][1][j][i] = 0; 
+    currMB->ctx->nz_coeff[1][j][i] = 0; 
     break;
   case CR:
     max_coeff_num = 16;
     TRACE_PRINTF("Luma_add2");
     dptype = ((currMB->is_intra_block == TRUE)) ? SE_LUM_AC_INTRA : SE_LUM_AC_INTER;
-    p_Vid->nz_coeff[mb_nr][2][j][i] = 0; 
+    currMB->ctx->nz_coeff[2][j][i] = 0; 
     break;
   case CR_INTRA16x16DC:
     max_coeff_num = 16;
     TRACE_PRINTF("Luma_add2_16DC");
     dptype = SE_LUM_DC_INTRA;
-    p_Vid->nz_coeff[mb_nr][2][j][i] = 0; 
+    currMB->ctx->nz_coeff[2][j][i] = 0; 
     break;
   case CR_INTRA16x16AC:
     max_coeff_num = 15;
     TRACE_PRINTF("Luma_add1_16AC");
     dptype = SE_LUM_AC_INTRA;
-    p_Vid->nz_coeff[mb_nr][2][j][i] = 0; 
+    currMB->ctx->nz_coeff[2][j][i] = 0; 
     break;        
   case CHROMA_DC:
     max_coeff_num = p_Vid->num_cdc_coeff;
     cdc = 1;
     TRACE_PRINTF("ChrDC");
     dptype = (currMB->is_intra_block == TRUE) ? SE_CHR_DC_INTRA : SE_CHR_DC_INTER;
-    p_Vid->nz_coeff[mb_nr][0][j][i] = 0; 
+    currMB->ctx->nz_coeff[0][j][i] = 0; 
     break;
   case CHROMA_AC:
     max_coeff_num = 15;
     cac = 1;
     TRACE_PRINTF("ChrAC");
     dptype = (currMB->is_intra_block == TRUE) ? SE_CHR_AC_INTRA : SE_CHR_AC_INTER;
-    p_Vid->nz_coeff[mb_nr][0][j][i] = 0; 
+    currMB->ctx->nz_coeff[0][j][i] = 0; 
     break;
   default:
     error ("read_coeff_4x4_CAVLC: invalid block type", 600);
-    p_Vid->nz_coeff[mb_nr][0][j][i] = 0; 
+    currMB->ctx->nz_coeff[0][j][i] = 0; 
     break;
   }
 
@@ -543,11 +716,11 @@ void read_coeff_4x4_CAVLC_444 (Macroblock *currMB,
     numtrailingones =  currSE.value2;
 
     if(block_type==LUMA || block_type==LUMA_INTRA16x16DC || block_type==LUMA_INTRA16x16AC ||block_type==CHROMA_AC)
-      p_Vid->nz_coeff[mb_nr][0][j][i] = (byte) numcoeff;
+      currMB->ctx->nz_coeff[0][j][i] = (byte) numcoeff;
     else if (block_type==CB || block_type==CB_INTRA16x16DC || block_type==CB_INTRA16x16AC)
-      p_Vid->nz_coeff[mb_nr][1][j][i] = (byte) numcoeff;
+      currMB->ctx->nz_coeff[1][j][i] = (byte) numcoeff;
     else
-      p_Vid->nz_coeff[mb_nr][2][j][i] = (byte) numcoeff;        
+      currMB->ctx->nz_coeff[2][j][i] = (byte) numcoeff;        
   }
   else
   {
@@ -680,7 +853,7 @@ void read_coeff_4x4_CAVLC_444 (Macroblock *currMB,
 *    from the NAL (CABAC Mode)
 ************************************************************************
 */
-static void read_comp_coeff_4x4_CAVLC (Macroblock *currMB, ColorPlane pl,/* int (*InvLevelScale4x4)[4], int qp_per,*/ int cbp, byte **nzcoeff)
+static void read_comp_coeff_4x4_CAVLC (Macroblock *currMB, ColorPlane pl,/* int (*InvLevelScale4x4)[4], int qp_per,*/ int cbp, byte (*nzcoeff)[BLOCK_SIZE])
 {
   int block_y, block_x, b8;
   int i, j;
@@ -747,7 +920,7 @@ static void read_comp_coeff_4x4_CAVLC (Macroblock *currMB, ColorPlane pl,/* int
 *    from the NAL (CAVLC Lossless Mode)
 ************************************************************************
 */
-static void read_comp_coeff_4x4_CAVLC_ls (Macroblock *currMB, ColorPlane pl,/* int (*InvLevelScale4x4)[4], int qp_per,*/ int cbp, byte **nzcoeff)
+static void read_comp_coeff_4x4_CAVLC_ls (Macroblock *currMB, ColorPlane pl,/* int (*InvLevelScale4x4)[4], int qp_per,*/ int cbp, byte (*nzcoeff)[BLOCK_SIZE])
 {
   int block_y, block_x, b8;
   int i, j;
@@ -809,7 +982,7 @@ static void read_comp_coeff_4x4_CAVLC_ls (Macroblock *currMB, ColorPlane pl,/* i
 *    from the NAL (CABAC Mode)
 ************************************************************************
 */
-static void read_comp_coeff_8x8_CAVLC (Macroblock *currMB, ColorPlane pl,/* int (*InvLevelScale8x8)[8], int qp_per,*/ int cbp, byte **nzcoeff)
+static void read_comp_coeff_8x8_CAVLC (Macroblock *currMB, ColorPlane pl,/* int (*InvLevelScale8x8)[8], int qp_per,*/ int cbp, byte (*nzcoeff)[BLOCK_SIZE])
 {
   int block_y, block_x, b4, b8;
   int block_y4, block_x4;
@@ -875,7 +1048,7 @@ static void read_comp_coeff_8x8_CAVLC (Macroblock *currMB, ColorPlane pl,/* int
 *    from the NAL (CAVLC Lossless Mode)
 ************************************************************************
 */
-static void read_comp_coeff_8x8_CAVLC_ls (Macroblock *currMB, ColorPlane pl,/* int (*InvLevelScale8x8)[8], int qp_per,*/ int cbp, byte **nzcoeff)
+static void read_comp_coeff_8x8_CAVLC_ls (Macroblock *currMB, ColorPlane pl,/* int (*InvLevelScale8x8)[8], int qp_per,*/ int cbp, byte (*nzcoeff)[BLOCK_SIZE])
 {
   int block_y, block_x, b8;
   int i, j;
@@ -940,7 +1113,6 @@ static void read_comp_coeff_8x8_CAVLC_ls (Macroblock *currMB, ColorPlane pl,/* i
 static void read_CBP_and_coeffs_from_NAL_CAVLC_400(Macroblock *currMB)
 {
   int k;
-  int mb_nr = currMB->mbAddrX;
   int cbp;
   SyntaxElement currSE;
   DataPartition *dP = NULL;
@@ -1021,16 +1193,16 @@ static void read_CBP_and_coeffs_from_NAL_CAVLC_400(Macroblock *currMB)
     if (!currMB->luma_transform_size_8x8_flag) // 4x4 transform
     {
 			//read_comp_coeff_4x4_CAVLC read_comp_coeff_4x4_CAVLC_ls
-      currMB->read_comp_coeff_4x4_CAVLC (currMB, PLANE_Y, cbp, p_Vid->nz_coeff[mb_nr][PLANE_Y]);
+      currMB->read_comp_coeff_4x4_CAVLC (currMB, PLANE_Y, cbp, currMB->ctx->nz_coeff[PLANE_Y]);
     }
     else // 8x8 transform
     {
-      currMB->read_comp_coeff_8x8_CAVLC (currMB, PLANE_Y, cbp, p_Vid->nz_coeff[mb_nr][PLANE_Y]);
+      currMB->read_comp_coeff_8x8_CAVLC (currMB, PLANE_Y, cbp, currMB->ctx->nz_coeff[PLANE_Y]);
     }
   }
   else
   {
-    fast_memset(p_Vid->nz_coeff[mb_nr][0][0], 0, BLOCK_PIXELS * sizeof(byte));
+    fast_memset(currMB->ctx->nz_coeff[0][0], 0, BLOCK_PIXELS * sizeof(byte));
   }
 }
 
@@ -1044,7 +1216,6 @@ static void read_CBP_and_coeffs_from_NAL_CAVLC_400(Macroblock *currMB)
 static void read_CBP_and_coeffs_from_NAL_CAVLC_422(Macroblock *currMB)
 {
   int i,j,k;
-  int mb_nr = currMB->mbAddrX;
   int cbp;
   SyntaxElement currSE;
   DataPartition *dP = NULL;
@@ -1129,17 +1300,17 @@ static void read_CBP_and_coeffs_from_NAL_CAVLC_422(Macroblock *currMB)
     if (!currMB->luma_transform_size_8x8_flag) // 4x4 transform
     {
 			//read_comp_coeff_4x4_CAVLC read_comp_coeff_4x4_CAVLC_ls
-      currMB->read_comp_coeff_4x4_CAVLC (currMB, PLANE_Y, cbp, p_Vid->nz_coeff[mb_nr][PLANE_Y]);
+      currMB->read_comp_coeff_4x4_CAVLC (currMB, PLANE_Y, cbp, currMB->ctx->nz_coeff[PLANE_Y]);
     }
     else // 8x8 transform
     {
 			//read_comp_coeff_8x8_CAVLC read_comp_coeff_8x8_CAVLC_ls
-      currMB->read_comp_coeff_8x8_CAVLC (currMB, PLANE_Y, cbp, p_Vid->nz_coeff[mb_nr][PLANE_Y]);
+      currMB->read_comp_coeff_8x8_CAVLC (currMB, PLANE_Y, cbp, currMB->ctx->nz_coeff[PLANE_Y]);
     }
   }
   else
   {
-    fast_memset(p_Vid->nz_coeff[mb_nr][0][0], 0, BLOCK_PIXELS * sizeof(byte));
+    fast_memset(currMB->ctx->nz_coeff[0][0], 0, BLOCK_PIXELS * sizeof(byte));
   }
 
   //========================== CHROMA DC ============================
@@ -1159,7 +1330,7 @@ static void read_CBP_and_coeffs_from_NAL_CAVLC_422(Macroblock *currMB)
   // chroma AC coeff, all zero fram start_scan
   if (cbp<=31)
   {
-    fast_memset(p_Vid->nz_coeff [mb_nr ][1][0], 0, 2 * BLOCK_PIXELS * sizeof(byte));
+    fast_memset(currMB->ctx->nz_coeff[1][0], 0, 2 * BLOCK_PIXELS * sizeof(byte));
   }
   else
   {
@@ -1206,7 +1377,6 @@ static void read_CBP_and_coeffs_from_NAL_CAVLC_422(Macroblock *currMB)
 static void read_CBP_and_coeffs_from_NAL_CAVLC_444(Macroblock *currMB)
 {
   int i,k;
-  int mb_nr = currMB->mbAddrX;
   int cbp;
   SyntaxElement currSE;
   DataPartition *dP = NULL;
@@ -1287,16 +1457,16 @@ static void read_CBP_and_coeffs_from_NAL_CAVLC_444(Macroblock *currMB)
   {
     if (!currMB->luma_transform_size_8x8_flag) // 4x4 transform
     {
-      currMB->read_comp_coeff_4x4_CAVLC (currMB, PLANE_Y, cbp, p_Vid->nz_coeff[mb_nr][PLANE_Y]);
+      currMB->read_comp_coeff_4x4_CAVLC (currMB, PLANE_Y, cbp, currMB->ctx->nz_coeff[PLANE_Y]);
     }
     else // 8x8 transform
     {
-      currMB->read_comp_coeff_8x8_CAVLC (currMB, PLANE_Y, cbp, p_Vid->nz_coeff[mb_nr][PLANE_Y]);
+      currMB->read_comp_coeff_8x8_CAVLC (currMB, PLANE_Y, cbp, currMB->ctx->nz_coeff[PLANE_Y]);
     }
   }
   else
   {
-    fast_memset(p_Vid->nz_coeff[mb_nr][0][0], 0, BLOCK_PIXELS * sizeof(byte));
+    fast_memset(currMB->ctx->nz_coeff[0][0], 0, BLOCK_PIXELS * sizeof(byte));
   }
 
   for (uv = PLANE_U; uv <= PLANE_V; ++uv )
@@ -1314,11 +1484,11 @@ static void read_CBP_and_coeffs_from_NAL_CAVLC_444(Macroblock *currMB)
 
     if (!currMB->luma_transform_size_8x8_flag) // 4x4 transform
     {
-      currMB->read_comp_coeff_4x4_CAVLC (currMB, (ColorPlane) (uv), cbp, p_Vid->nz_coeff[mb_nr][uv]);
+      currMB->read_comp_coeff_4x4_CAVLC (currMB, (ColorPlane) (uv), cbp, currMB->ctx->nz_coeff[uv]);
     }
     else // 8x8 transform
     {
-      currMB->read_comp_coeff_8x8_CAVLC (currMB, PLANE_Y, cbp, p_Vid->nz_coeff[mb_nr][PLANE_Y]);
+      currMB->read_comp_coeff_8x8_CAVLC (currMB, PLANE_Y, cbp, currMB->ctx->nz_coeff[PLANE_Y]);
     }   
   }   
 }
@@ -1333,7 +1503,6 @@ static void read_CBP_and_coeffs_from_NAL_CAVLC_444(Macroblock *currMB)
 static void read_CBP_and_coeffs_from_NAL_CAVLC_420(Macroblock *currMB)
 {
   int i,j,k;
-  int mb_nr = currMB->mbAddrX;
   int cbp;
   SyntaxElement currSE;
   DataPartition *dP = NULL;
@@ -1417,16 +1586,16 @@ static void read_CBP_and_coeffs_from_NAL_CAVLC_420(Macroblock *currMB)
   {
     if (!currMB->luma_transform_size_8x8_flag) // 4x4 transform
     {
-      currMB->read_comp_coeff_4x4_CAVLC (currMB, PLANE_Y, cbp, p_Vid->nz_coeff[mb_nr][PLANE_Y]);
+      currMB->read_comp_coeff_4x4_CAVLC (currMB, PLANE_Y, cbp, currMB->ctx->nz_coeff[PLANE_Y]);
     }
     else // 8x8 transform
     {
-      currMB->read_comp_coeff_8x8_CAVLC (currMB, PLANE_Y, cbp, p_Vid->nz_coeff[mb_nr][PLANE_Y]);
+      currMB->read_comp_coeff_8x8_CAVLC (currMB, PLANE_Y, cbp, currMB->ctx->nz_coeff[PLANE_Y]);
     }
   }
   else
   {
-    fast_memset(p_Vid->nz_coeff[mb_nr][0][0], 0, BLOCK_PIXELS * sizeof(byte));
+    fast_memset(currMB->ctx->nz_coeff[0][0], 0, BLOCK_PIXELS * sizeof(byte));
   }
 
   //========================== CHROMA DC ============================
@@ -1448,7 +1617,7 @@ static void read_CBP_and_coeffs_from_NAL_CAVLC_420(Macroblock *currMB)
   // chroma AC coeff, all zero fram start_scan
   if (cbp<=31)
   {
-    fast_memset(p_Vid->nz_coeff [mb_nr ][1][0], 0, 2 * BLOCK_PIXELS * sizeof(byte));
+    fast_memset(currMB->ctx->nz_coeff[1][0], 0, 2 * BLOCK_PIXELS * sizeof(byte));
   }
   else
   {
@@ -1486,6 +1655,147 @@ static void read_CBP_and_coeffs_from_NAL_CAVLC_420(Macroblock *currMB)
 }
 
 
+#if (MVD_PARSE_ONLY)
+#define READ_COEFF_4x4_CAVLC skip_coeff_4x4_CAVLC
+#else
+#define READ_COEFF_4x4_CAVLC read_coeff_4x4_CAVLC
+#endif
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Get coded block pattern and coefficients (run/level) of a 4:2:0
+ *    macroblock of a non-partitioned slice (CAVLC Mode)
+ *
+ *    All syntax elements are in the first partition and there are no
+ *    lossless macroblocks. transform_8x8 is a constant of each variant,
+ *    with 0 the transform size flag and the 8x8 readers drop out.
+ ************************************************************************
+ */
+static inline void read_CBP_and_coeffs_CAVLC_420_dp1(Macroblock *currMB, int transform_8x8)
+{
+  int i, j, b8, b4;
+  int cbp;
+  SyntaxElement currSE;
+  Slice *currSlice = currMB->p_Slice;
+  DataPartition *dP = &(currSlice->partArr[0]);
+  const byte *partMap = assignSE2partition[PAR_DP_1];
+  int levarr[16], runarr[16], numcoeff;
+  int intra = (currMB->is_intra_block == TRUE);
+
+  // read CBP if not new intra mode
+  if (!IS_I16MB (currMB))
+  {
+    //=====   C B P   =====
+    //---------------------
+    if (currMB->mb_type == I4MB || currMB->mb_type == SI4MB || currMB->mb_type == I8MB)
+    {
+      currSE.type    = SE_CBP_INTRA;
+      currSE.mapping = currSlice->linfo_cbp_intra;
+    }
+    else
+    {
+      currSE.type    = SE_CBP_INTER;
+      currSE.mapping = currSlice->linfo_cbp_inter;
+    }
+
+    TRACE_STRING("coded_block_pattern");
+    readSyntaxElement_UVLC(currMB, &currSE, dP);
+    currMB->cbp = cbp = currSE.value1;
+
+    //============= Transform size flag for INTER MBs =============
+    //-------------------------------------------------------------
+    if (transform_8x8 && (cbp & 15)
+      && ((currMB->mb_type >= 1 && currMB->mb_type <= 3) ||
+      (IS_DIRECT(currMB) && currMB->p_Vid->active_sps->direct_8x8_inference_flag) ||
+      (currMB->NoMbPartLessThan8x8Flag))
+      && currMB->mb_type != I8MB && currMB->mb_type != I4MB)
+    {
+      currSE.type = SE_HEADER;
+      TRACE_STRING("transform_size_8x8_flag");
+
+      // read CAVLC transform_size_8x8_flag
+      currSE.len = 1;
+      readSyntaxElement_FLC(&currSE, dP->bitstream);
+
+      currMB->luma_transform_size_8x8_flag = (Boolean) currSE.value1;
+    }
+
+    //=====   DQUANT   =====
+    //----------------------
+    // Delta quant only if nonzero coeffs
+    if (cbp !=0)
+    {
+      read_delta_quant(&currSE, dP, currMB, partMap, intra ? SE_DELTA_QUANT_INTRA : SE_DELTA_QUANT_INTER);
+    }
+  }
+  else
+  {
+    cbp = currMB->cbp;  
+    read_delta_quant(&currSE, dP, currMB, partMap, SE_DELTA_QUANT_INTRA);
+
+    if (!currMB->dpl_flag)
+    {
+      READ_COEFF_4x4_CAVLC(currMB, LUMA_INTRA16x16DC, 0, 0, levarr, runarr, &numcoeff);
+    }
+  }
+
+  update_qp(currMB, currSlice->qp);
+
+  // luma coefficients
+  if (cbp)
+  {
+    if (transform_8x8 && currMB->luma_transform_size_8x8_flag)
+      read_comp_coeff_8x8_CAVLC (currMB, PLANE_Y, cbp, currMB->ctx->nz_coeff[PLANE_Y]);
+    else
+      read_comp_coeff_4x4_CAVLC (currMB, PLANE_Y, cbp, currMB->ctx->nz_coeff[PLANE_Y]);
+  }
+  else
+  {
+    fast_memset(currMB->ctx->nz_coeff[0][0], 0, BLOCK_PIXELS * sizeof(byte));
+  }
+
+  //========================== CHROMA DC ============================
+  //-----------------------------------------------------------------
+  if(cbp>15)
+  {
+    READ_COEFF_4x4_CAVLC(currMB, CHROMA_DC, 0, 0, levarr, runarr, &numcoeff);
+    READ_COEFF_4x4_CAVLC(currMB, CHROMA_DC, 0, 0, levarr, runarr, &numcoeff);
+  }
+
+  //========================== CHROMA AC ============================
+  //-----------------------------------------------------------------
+  if (cbp<=31)
+  {
+    fast_memset(currMB->ctx->nz_coeff[1][0], 0, 2 * BLOCK_PIXELS * sizeof(byte));
+  }
+  else
+  {
+    for (b8 = 0; b8 < 2; ++b8)
+    {
+      currMB->is_v_block = b8;
+
+      for (b4 = 0; b4 < 4; ++b4)
+      {
+        i = cofuv_blk_x[0][b8][b4];
+        j = cofuv_blk_y[0][b8][b4];
+
+        READ_COEFF_4x4_CAVLC(currMB, CHROMA_AC, i + 2 * b8, j + 4, levarr, runarr, &numcoeff);
+      }
+    }
+  }
+}
+
+static void read_CBP_and_coeffs_from_NAL_CAVLC_420_dp1(Macroblock *currMB)
+{
+  read_CBP_and_coeffs_CAVLC_420_dp1(currMB, 0);
+}
+
+static void read_CBP_and_coeffs_from_NAL_CAVLC_420_dp1_8x8(Macroblock *currMB)
+{
+  read_CBP_and_coeffs_CAVLC_420_dp1(currMB, 1);
+}
+
 /*!
 ************************************************************************
 * \brief
@@ -1526,7 +1836,16 @@ void set_read_CBP_and_coeffs_cavlc(Slice *currSlice)
     currSlice->read_CBP_and_coeffs_from_NAL = read_CBP_and_coeffs_from_NAL_CAVLC_422;
     break;
   case YUV420:
-    currSlice->read_CBP_and_coeffs_from_NAL = read_CBP_and_coeffs_from_NAL_CAVLC_420;
+    if (currSlice->dp_mode == PAR_DP_1 && currSlice->p_Vid->active_sps->lossless_qpprime_flag == 0)
+    {
+      currSlice->read_CBP_and_coeffs_from_NAL = (currSlice->Transform8x8Mode)
+        ? read_CBP_and_coeffs_from_NAL_CAVLC_420_dp1_8x8
+        : read_CBP_and_coeffs_from_NAL_CAVLC_420_dp1;
+    }
+    else
+    {
+      currSlice->read_CBP_and_coeffs_from_NAL = read_CBP_and_coeffs_from_NAL_CAVLC_420;
+    }
     break;
   case YUV400:
     currSlice->read_CBP_and_coeffs_from_NAL = read_CBP_and_coeffs_from_NAL_CAVLC_400;
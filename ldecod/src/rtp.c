@@ -152,9 +152,6 @@ void CloseRTPFile(int *p_BitStreamFile)
 
 int GetRTPNALU (VideoParameters *p_Vid, NALU_t *nalu, int BitStreamFile)
 {
-  static uint16 first_call = 1;  //!< triggers sequence number initialization on first call
-  static uint16 old_seq = 0;     //!< store the last RTP sequence number for loss detection
-
   RTPpacket_t *p;
   int ret;
 
@@ -171,14 +168,14 @@ int GetRTPNALU (VideoParameters *p_Vid, NALU_t *nalu, int BitStreamFile)
 
   if (ret > 0) // we got a packet ( -1=error, 0=end of file )
   {
-    if (first_call)
+    if (!p_Vid->rtp_seq_valid)
     {
-      first_call = 0;
-      old_seq = (uint16) (p->seq - 1);
+      p_Vid->rtp_seq_valid = 1;
+      p_Vid->rtp_old_seq = (uint16) (p->seq - 1);
     }
 
-    nalu->lost_packets = (uint16) ( p->seq - (old_seq + 1) );
-    old_seq = p->seq;
+    nalu->lost_packets = (uint16) ( p->seq - (p_Vid->rtp_old_seq + 1) );
+    p_Vid->rtp_old_seq = p->seq;
 
     assert (p->paylen < nalu->max_size);
 
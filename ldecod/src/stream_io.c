@@ -0,0 +1,514 @@
+/*!
+ *************************************************************************************
+ * \file stream_io.c
+ *
+ * \brief
+ *    Bitstream input from a file, a memory buffer or a read callback and
+ *    output of the protected bitstream
+ *
+ *************************************************************************************
+ */
+
+#include "global.h"
+#include "stream_io.h"
+#include "async_io.h"
+#include "memalloc.h"
+
+#define STREAM_CHUNK_SIZE (1024*1024)
+
+//! a write-back in flight
+typedef struct stream_write
+{
+  int         tag;
+  const byte *buf;
+  int64       offset;
+  int         size;
+} StreamWrite;
+
+//! read-ahead of the parser and write-back of the key generation pass
+typedef struct stream_async
+{
+  AsyncIO     *read;          //!< on fd, used by the parser
+  byte       **ra_buf;
+  int         *ra_tag;        //!< request of each buffer, -1 if none
+  int          ra_depth;
+  int          ra_size;       //!< chunk size, taken from the first stream_next_chunk()
+  int          ra_next;       //!< buffer of the next chunk
+  int          ra_out;        //!< buffer handed to the parser, -1 if none
+  int64        ra_pos;        //!< offset of the next chunk to request
+  AsyncIO     *write;         //!< on fd_rw, used by the key generation pass
+  StreamWrite *pending;
+  int          pending_count;
+  int          write_depth;
+} StreamAsync;
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Sets up the input and output of a decoder. Without in the bitstream
+ *    is read from the file given to stream_io_open().
+ ************************************************************************
+ */
+void stream_io_init(StreamIO *io, const StreamInput *in, const StreamOutput *out)
+{
+  memset(io, 0, sizeof(StreamIO));
+  io->fd    = -1;
+  io->fd_rw = -1;
+
+  if (in != NULL)
+  {
+    if (in->data != NULL)
+    {
+      io->mem      = in->data;
+      io->mem_size = in->size;
+    }
+    else
+    {
+      io->read        = in->read;
+      io->read_opaque = in->opaque;
+    }
+  }
+  if (out != NULL)
+    io->out = *out;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Opens the bitstream file fn unless the input is a memory buffer or
+ *    a callback
+ * \return
+ *    0 on success, -1 if the file cannot be opened
+ ************************************************************************
+ */
+int stream_io_open(StreamIO *io, const char *fn)
+{
+  if (io->mem != NULL || io->read != NULL)
+    return 0;
+
+  io->fd    = open(fn, OPENFLAGS_READ);
+  io->fd_rw = open(fn, OPENFLAGS_RDWR);
+  return (io->fd == -1 || io->fd_rw == -1) ? -1 : 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Switches an opened file to asynchronous I/O: the parser reads depth
+ *    chunks ahead and, with write_back, the key generation pass writes
+ *    its windows back without waiting. Memory and callback input and
+ *    mode ASYNC_IO_OFF keep blocking I/O.
+ ************************************************************************
+ */
+void stream_io_async(StreamIO *io, int mode, int depth, int write_back)
+{
+  StreamAsync *a;
+  int i;
+
+  if (mode == ASYNC_IO_OFF || io->fd == -1 || io->async != NULL)
+    return;
+  if ((a = calloc(1, sizeof(StreamAsync))) == NULL)
+    no_mem_exit("stream_io_async: a");
+  depth = imax(depth, 1);
+
+  if ((a->read = async_io_open(io->fd, depth, mode)) != NULL)
+  {
+    a->ra_depth = depth;
+    a->ra_out   = -1;
+    a->ra_pos   = (int64) lseek(io->fd, 0, SEEK_CUR);   // the first chunk has been read already
+    a->ra_buf   = calloc(depth, sizeof(byte *));
+    a->ra_tag   = malloc(depth * sizeof(int));
+    if (a->ra_buf == NULL || a->ra_tag == NULL)
+      no_mem_exit("stream_io_async: ra_buf");
+    for (i = 0; i < depth; i++)
+      a->ra_tag[i] = -1;
+  }
+  if (write_back && (a->write = async_io_open(io->fd_rw, depth, mode)) != NULL)
+  {
+    a->write_depth = depth;
+    if ((a->pending = calloc(depth, sizeof(StreamWrite))) == NULL)
+      no_mem_exit("stream_io_async: pending");
+  }
+
+  if (a->read == NULL && a->write == NULL)
+    free(a);
+  else
+    io->async = a;
+}
+
+static void finish_write(StreamAsync *a, int i)
+{
+  StreamWrite *p = &a->pending[i];
+
+  if (async_io_wait(a->write, p->tag) != p->size)
+    fprintf(stderr, "Warning: write-back of %d bytes at offset %lld failed\n", p->size, (long long) p->offset);
+  a->pending_count--;
+  memmove(p, p + 1, (a->pending_count - i) * sizeof(StreamWrite));
+}
+
+//! waits for the write-backs that overlap size bytes at offset
+static void wait_overlap(StreamIO *io, int64 offset, int size)
+{
+  StreamAsync *a = io->async;
+  int i = 0;
+
+  if (a == NULL)
+    return;
+  while (i < a->pending_count)
+  {
+    StreamWrite *p = &a->pending[i];
+
+    if (p->offset < offset + size && offset < p->offset + p->size)
+      finish_write(a, i);
+    else
+      i++;
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Waits for all write-backs
+ ************************************************************************
+ */
+void stream_io_drain(StreamIO *io)
+{
+  StreamAsync *a = io->async;
+
+  while (a != NULL && a->pending_count > 0)
+    finish_write(a, 0);
+}
+
+static void close_async(StreamIO *io)
+{
+  StreamAsync *a = io->async;
+  int i;
+
+  stream_io_drain(io);
+  async_io_close(a->read);
+  async_io_close(a->write);
+  for (i = 0; i < a->ra_depth; i++)
+    free(a->ra_buf[i]);
+  free(a->ra_buf);
+  free(a->ra_tag);
+  free(a->pending);
+  free(a);
+  io->async = NULL;
+}
+
+void stream_io_close(StreamIO *io)
+{
+  if (io->async != NULL)
+    close_async(io);
+  if (io->fd != -1)
+  {
+    close(io->fd);
+    io->fd = -1;
+  }
+  if (io->fd_rw != -1)
+  {
+    close(io->fd_rw);
+    io->fd_rw = -1;
+  }
+  if (io->mem_alloc)
+    free(io->mem);
+  io->mem       = NULL;
+  io->mem_size  = 0;
+  io->mem_alloc = 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Next chunk of the file from the read-ahead. The buffer handed out
+ *    last time is requested again for the chunk depth places further.
+ ************************************************************************
+ */
+static int read_ahead(StreamAsync *a, int size, byte **data)
+{
+  int i, n;
+
+  if (a->ra_size == 0)
+  {
+    a->ra_size = size;
+    for (i = 0; i < a->ra_depth; i++)
+    {
+      if ((a->ra_buf[i] = malloc(size)) == NULL)
+        no_mem_exit("read_ahead: ra_buf");
+      a->ra_tag[i] = async_io_submit(a->read, 0, a->ra_buf[i], size, a->ra_pos);
+      a->ra_pos += size;
+    }
+  }
+  else if (a->ra_out >= 0)
+  {
+    a->ra_tag[a->ra_out] = async_io_submit(a->read, 0, a->ra_buf[a->ra_out], a->ra_size, a->ra_pos);
+    a->ra_pos += a->ra_size;
+  }
+
+  i = a->ra_next;
+  n = async_io_wait(a->read, a->ra_tag[i]);
+  a->ra_tag[i] = -1;
+  a->ra_out    = i;
+  a->ra_next   = (i + 1) % a->ra_depth;
+  *data = a->ra_buf[i];
+  return n;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Returns the next chunk of at most size bytes of the bitstream in
+ *    *data. Memory and callback input are not copied, *data points into
+ *    the memory image, file input is read into buf or, with read-ahead,
+ *    handed out in a buffer that is valid until the next call.
+ * \return
+ *    number of bytes, 0 at the end of the stream
+ ************************************************************************
+ */
+int stream_next_chunk(StreamIO *io, byte *buf, int size, byte **data)
+{
+  int n;
+
+  if (io->fd != -1 && io->async != NULL && io->async->read != NULL)
+  {
+    n = read_ahead(io->async, size, data);
+  }
+  else if (io->fd != -1)
+  {
+    n = (int) read(io->fd, buf, size);
+    *data = buf;
+  }
+  else if (io->read == NULL)
+  {
+    n = (int) i64min(io->mem_size - io->read_pos, size);
+    *data = io->mem + io->read_pos;
+    io->read_pos += n;
+  }
+  else
+  {
+    // the image keeps everything delivered so far for the key generation
+    // pass, except for what has been emitted already in live mode
+    if (io->out_pos - io->mem_base >= STREAM_CHUNK_SIZE)
+    {
+      int64 drop = io->out_pos - io->mem_base;
+
+      memmove(io->mem, io->mem + drop, (size_t) (io->mem_size - drop));
+      io->mem_base += drop;
+      io->mem_size -= drop;
+    }
+    if (io->mem_size + size > io->mem_alloc)
+    {
+      int64 alloc = i64max(2 * io->mem_alloc, io->mem_size + size);
+      byte *mem = realloc(io->mem, (size_t) alloc);
+
+      if (mem == NULL)
+        no_mem_exit("stream_next_chunk: mem");
+      io->mem       = mem;
+      io->mem_alloc = alloc;
+    }
+    n = io->read(io->read_opaque, io->mem + io->mem_size, size);
+    *data = io->mem + io->mem_size;
+    if (n > 0)
+      io->mem_size += n;
+  }
+
+  return n > 0 ? n : 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Reads size bytes of the bitstream at offset for the parser, which
+ *    then goes by a NAL unit index instead of stream_next_chunk().
+ *    Callback input has no index.
+ * \return
+ *    number of bytes read, less than size at the end of the stream
+ ************************************************************************
+ */
+int stream_read_at(StreamIO *io, byte *buf, int size, int64 offset)
+{
+  int n;
+
+  if (io->fd != -1)
+  {
+    // fd is the parser's own descriptor, fd_rw may be in use by the key generation pass
+    lseek(io->fd, offset, SEEK_SET);
+    n = (int) read(io->fd, buf, size);
+    return n > 0 ? n : 0;
+  }
+  if (io->read != NULL || offset < 0 || offset >= io->mem_size)
+    return 0;
+  n = (int) i64min(io->mem_size - offset, size);
+  memcpy(buf, io->mem + offset, n);
+  return n;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Reads size bytes of the bitstream at offset
+ * \return
+ *    number of bytes read, less than size at the end of the stream
+ ************************************************************************
+ */
+int stream_pread(StreamIO *io, byte *buf, int size, int64 offset)
+{
+  int n;
+
+  wait_overlap(io, offset, size);
+  if (io->fd_rw != -1)
+  {
+    lseek(io->fd_rw, offset, SEEK_SET);
+    n = (int) read(io->fd_rw, buf, size);
+    return n > 0 ? n : 0;
+  }
+
+  offset -= io->mem_base;
+  if (offset < 0 || offset >= io->mem_size)
+    return 0;
+  n = (int) i64min(io->mem_size - offset, size);
+  memcpy(buf, io->mem + offset, n);
+  return n;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Writes size bytes back into the bitstream at offset. The memory
+ *    image is never extended.
+ ************************************************************************
+ */
+int stream_pwrite(StreamIO *io, const byte *buf, int size, int64 offset)
+{
+  int n;
+
+  wait_overlap(io, offset, size);
+  if (io->fd_rw != -1)
+  {
+    lseek(io->fd_rw, offset, SEEK_SET);
+    n = (int) write(io->fd_rw, buf, size);
+    return n > 0 ? n : 0;
+  }
+
+  offset -= io->mem_base;
+  if (offset < 0 || offset >= io->mem_size)
+    return 0;
+  n = (int) i64min(io->mem_size - offset, size);
+  memcpy(io->mem + offset, buf, n);
+  return n;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Writes size bytes back into the bitstream at offset like
+ *    stream_pwrite(), but with write-back it only starts the write. buf
+ *    must not change before stream_wait_buffer() returned for it.
+ ************************************************************************
+ */
+int stream_pwrite_async(StreamIO *io, const byte *buf, int size, int64 offset)
+{
+  StreamAsync *a = io->async;
+  StreamWrite *p;
+
+  if (a == NULL || a->write == NULL || io->fd_rw == -1 || size <= 0)
+    return stream_pwrite(io, buf, size, offset);
+
+  // a later write must not be overtaken by an earlier one
+  wait_overlap(io, offset, size);
+  if (a->pending_count == a->write_depth)
+    finish_write(a, 0);
+
+  p = &a->pending[a->pending_count++];
+  p->buf    = buf;
+  p->offset = offset;
+  p->size   = size;
+  p->tag    = async_io_submit(a->write, 1, (byte *) buf, size, offset);
+  return size;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Waits for the write-backs from buf
+ ************************************************************************
+ */
+void stream_wait_buffer(StreamIO *io, const byte *buf)
+{
+  StreamAsync *a = io->async;
+  int i = 0;
+
+  while (a != NULL && i < a->pending_count)
+  {
+    if (a->pending[i].buf == buf)
+      finish_write(a, i);
+    else
+      i++;
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Hands the protected bitstream up to stream offset end (the end of
+ *    the stream if end < 0) to the write_stream callback, if there is
+ *    one. The bytes must not change anymore.
+ * \return
+ *    0 on success, -1 if the callback did not take all bytes
+ ************************************************************************
+ */
+int stream_emit_output(StreamIO *io, int64 end)
+{
+  int n;
+
+  if (io->out.write_stream == NULL)
+    return 0;
+
+  if (io->fd_rw == -1)
+  {
+    if (end < 0 || end > io->mem_base + io->mem_size)
+      end = io->mem_base + io->mem_size;
+    for (; io->out_pos < end; io->out_pos += n)
+    {
+      n = (int) i64min(end - io->out_pos, STREAM_CHUNK_SIZE);
+      if (io->out.write_stream(io->out.opaque, io->mem + (io->out_pos - io->mem_base), n) != n)
+        return -1;
+    }
+  }
+  else
+  {
+    byte *buf = malloc(STREAM_CHUNK_SIZE);
+
+    if (buf == NULL)
+      no_mem_exit("stream_emit_output: buf");
+    while (end < 0 || io->out_pos < end)
+    {
+      n = end < 0 ? STREAM_CHUNK_SIZE : (int) i64min(end - io->out_pos, STREAM_CHUNK_SIZE);
+      if ((n = stream_pread(io, buf, n, io->out_pos)) == 0)
+        break;
+      if (io->out.write_stream(io->out.opaque, buf, n) != n)
+      {
+        free(buf);
+        return -1;
+      }
+      io->out_pos += n;
+    }
+    free(buf);
+  }
+
+  return 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Hands the rest of the protected bitstream to the write_stream
+ *    callback, if there is one
+ * \return
+ *    0 on success, -1 if the callback did not take all bytes
+ ************************************************************************
+ */
+int stream_flush_output(StreamIO *io)
+{
+  return stream_emit_output(io, -1);
+}
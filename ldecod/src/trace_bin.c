@@ -0,0 +1,226 @@
+/*!
+ *************************************************************************************
+ * \file trace_bin.c
+ *
+ * \brief
+ *    Ring buffers of the binary syntax element trace and the text dump of
+ *    trace files
+ *
+ *************************************************************************************
+ */
+
+#include "global.h"
+#include "elements.h"
+#include "trace_bin.h"
+#include "memalloc.h"
+
+#ifdef _WIN32
+#define ATOMIC_INC(p)  (InterlockedIncrement(p) - 1)
+#else
+#define ATOMIC_INC(p)  __sync_fetch_and_add((p), 1)
+#endif
+
+THREAD_LOCAL TraceBin *p_TraceBin;
+
+//! trace files opened by the process, the first one gets the configured name
+static volatile long trace_files;
+
+static const char *kind_name[TRACE_BIN_KINDS] =
+{
+  "NAL", "MB", "KEY", "VLC", "FLC", "IPRED", "COEFF_TOKEN", "LEVEL", "TOTAL_ZEROS", "RUN", "CABAC"
+};
+
+static const char *se_name[SE_MAX_ELEMENTS] =
+{
+  "header", "ptype", "mb_type", "ref_idx", "intra_pred_mode", "mvd", "cbp_intra",
+  "luma_dc_intra", "chroma_dc_intra", "luma_ac_intra", "chroma_ac_intra", "cbp_inter",
+  "luma_dc_inter", "chroma_dc_inter", "luma_ac_inter", "chroma_ac_inter",
+  "dquant_inter", "dquant_intra", "bframe", "eos"
+};
+
+static const char slice_name[] = "PBIps";
+
+static void put_u32(FILE *f, unsigned int v)
+{
+  fwrite(&v, sizeof(unsigned int), 1, f);
+}
+
+static int get_u32(FILE *f, unsigned int *v)
+{
+  return fread(v, sizeof(unsigned int), 1, f) == 1 ? 0 : -1;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Opens the trace file fn for the stream and allocates its ring. From
+ *    the second trace file of the process on, ".<n>" is appended to fn,
+ *    several decoder instances never share a file.
+ * \param last
+ *    0: the whole trace is written, otherwise at least the last this
+ *    many records
+ * \return
+ *    the ring, NULL if the file cannot be created
+ ************************************************************************
+ */
+TraceBin *trace_bin_open(const char *fn, const char *stream, int last)
+{
+  char name[FILE_NAME_SIZE + 16];
+  long n = ATOMIC_INC(&trace_files);
+  unsigned int size = TRACE_BIN_RING;
+  TraceBin *tb;
+
+  if (n == 0)
+    snprintf(name, sizeof(name), "%s", fn);
+  else
+    snprintf(name, sizeof(name), "%s.%ld", fn, n);
+  if (last > 0)
+  {
+    for (size = 1; size <= (unsigned int) last && size < (1u << 30); size <<= 1)
+      ;
+  }
+
+  if ((tb = (TraceBin *) calloc(1, sizeof(TraceBin))) == NULL)
+    no_mem_exit("trace_bin_open: tb");
+  if ((tb->rec = (TraceBinRecord *) malloc(size * sizeof(TraceBinRecord))) == NULL)
+    no_mem_exit("trace_bin_open: rec");
+  if ((tb->f = fopen(name, "wb")) == NULL)
+  {
+    fprintf(stderr, "trace_bin_open: cannot create %s\n", name);
+    free(tb->rec);
+    free(tb);
+    return NULL;
+  }
+  tb->mask    = size - 1;
+  tb->last    = (last > 0);
+  tb->nal_idx = -1;
+  tb->mb_addr = -1;
+
+  fwrite(TRACE_BIN_MAGIC, 1, 8, tb->f);
+  put_u32(tb->f, TRACE_BIN_BOM);
+  put_u32(tb->f, sizeof(TraceBinRecord));
+  put_u32(tb->f, (unsigned int) strlen(stream));
+  fwrite(stream, 1, strlen(stream), tb->f);
+  return tb;
+}
+
+static void write_records(TraceBin *tb)
+{
+  unsigned int n     = tb->head - tb->tail;
+  unsigned int first = tb->tail & tb->mask;
+  unsigned int run   = imin(n, tb->mask + 1 - first);
+
+  fwrite(tb->rec + first, sizeof(TraceBinRecord), run, tb->f);
+  if (n > run)
+    fwrite(tb->rec, sizeof(TraceBinRecord), n - run, tb->f);
+  tb->tail = tb->head;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Makes room in a full ring, by writing it or, with TraceLast, by
+ *    dropping its oldest record
+ ************************************************************************
+ */
+void trace_bin_full(TraceBin *tb)
+{
+  if (tb->last)
+  {
+    tb->tail++;
+    tb->dropped++;
+  }
+  else
+    write_records(tb);
+}
+
+//! writes the records of the ring that are not yet in the file
+void trace_bin_flush(TraceBin *tb)
+{
+  if (tb != NULL)
+  {
+    write_records(tb);
+    fflush(tb->f);
+  }
+}
+
+void trace_bin_close(TraceBin *tb)
+{
+  if (tb != NULL)
+  {
+    write_records(tb);
+    fclose(tb->f);
+    free(tb->rec);
+    free(tb);
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Prints the trace file fn as text, one line per record
+ * \return
+ *    0 on success, -1 if fn is not a trace file of this byte order or
+ *    ends inside a record
+ ************************************************************************
+ */
+int trace_bin_dump(const char *fn, FILE *out)
+{
+  FILE *f = fopen(fn, "rb");
+  char magic[8];
+  char stream[FILE_NAME_SIZE];
+  unsigned int bom = 0, rec_size = 0, len = 0;
+  int64 records = 0;
+  TraceBinRecord r;
+  size_t got;
+
+  if (f == NULL)
+  {
+    fprintf(stderr, "trace_bin_dump: cannot open %s\n", fn);
+    return -1;
+  }
+  if (fread(magic, 1, 8, f) != 8 || memcmp(magic, TRACE_BIN_MAGIC, 8) != 0 ||
+    get_u32(f, &bom) != 0 || bom != TRACE_BIN_BOM ||
+    get_u32(f, &rec_size) != 0 || rec_size != sizeof(TraceBinRecord) ||
+    get_u32(f, &len) != 0 || len >= FILE_NAME_SIZE || fread(stream, 1, len, f) != len)
+  {
+    fprintf(stderr, "trace_bin_dump: %s is not a trace file of this build and byte order\n", fn);
+    fclose(f);
+    return -1;
+  }
+  stream[len] = 0;
+
+  fprintf(out, "# trace of %s\n", stream);
+  fprintf(out, "# %-11s %7s %6s %10s %4s %-16s %s\n", "kind", "nal", "mb", "bit", "len", "type", "value");
+  while ((got = fread(&r, 1, sizeof(TraceBinRecord), f)) == sizeof(TraceBinRecord))
+  {
+    records++;
+    switch (r.kind)
+    {
+    case TRACE_BIN_NAL:
+      fprintf(out, "NAL %7d  pos %lld  type %d  size %d\n", r.nal_idx, (long long) r.bit_pos, r.len, r.value);
+      break;
+    case TRACE_BIN_MB:
+      fprintf(out, "MB  %7d  mb %d  slice %c\n", r.nal_idx, r.mb_addr,
+        (r.value >= 0 && r.value < 5) ? slice_name[r.value] : '?');
+      break;
+    case TRACE_BIN_KEY:
+      fprintf(out, "KEY %7d  mb %d  file bit %lld (byte %lld bit %d)  rbsp bit %d  len %d\n",
+        r.nal_idx, r.mb_addr, (long long) r.bit_pos, (long long) (r.bit_pos >> 3), (int) (r.bit_pos & 7), r.value, r.len);
+      break;
+    default:
+      fprintf(out, "  %-11s %7d %6d %10lld %4d %-16s %d\n",
+        r.kind < TRACE_BIN_KINDS ? kind_name[r.kind] : "?", r.nal_idx, r.mb_addr, (long long) r.bit_pos, r.len,
+        r.se_type < SE_MAX_ELEMENTS ? se_name[r.se_type] : "?", r.value);
+      break;
+    }
+  }
+  fclose(f);
+  fprintf(out, "# %lld records\n", (long long) records);
+  if (got != 0)
+  {
+    fprintf(stderr, "trace_bin_dump: %s ends inside record %lld\n", fn, (long long) records);
+    return -1;
+  }
+  return ferror(out) ? -1 : 0;
+}
@@ -377,6 +377,7 @@ int readSyntaxElement_VLC(SyntaxElement *sym, Bitstream *currStream)
 #if TRACE
   tracebits(sym->tracestring, sym->len, sym->inf, sym->value1);
 #endif
+  TRACE_BIN_SE(TRACE_BIN_VLC, sym->type, currStream->frame_bitoffset - sym->len, sym->len, sym->value1);
 
   return 1;
 }
@@ -414,6 +415,7 @@ int readSyntaxElement_Intra4x4PredictionMode(SyntaxElement *sym, Bitstream   *cu
 #if TRACE
   tracebits2(sym->tracestring, sym->len, sym->value1);
 #endif
+  TRACE_BIN_SE(TRACE_BIN_IPRED, sym->type, currStream->frame_bitoffset - sym->len, sym->len, sym->value1);
 
   return 1;
 }
@@ -678,6 +680,7 @@ int readSyntaxElement_FLC(SyntaxElement *sym, Bitstream *currStream)
 #if TRACE
   tracebits2(sym->tracestring, sym->len, sym->inf);
 #endif
+  TRACE_BIN_SE(TRACE_BIN_FLC, sym->type, currStream->frame_bitoffset - sym->len, sym->len, sym->inf);
 
   return 1;
 }
@@ -784,6 +787,7 @@ int readSyntaxElement_NumCoeffTrailingOnes(SyntaxElement *sym,
            type, vlcnum, sym->value1, sym->value2);
   tracebits2(sym->tracestring, sym->len, code);
 #endif
+  TRACE_BIN_SE(TRACE_BIN_COEFF_TOKEN, sym->type, currStream->frame_bitoffset - sym->len, sym->len, sym->value1);
 
   return retval;
 }
@@ -852,6 +856,7 @@ int readSyntaxElement_NumCoeffTrailingOnesChromaDC(VideoParameters *p_Vid, Synta
   tracebits2(sym->tracestring, sym->len, code);
 
 #endif
+  TRACE_BIN_SE(TRACE_BIN_COEFF_TOKEN, sym->type, currStream->frame_bitoffset - sym->len, sym->len, sym->value1);
 
   return retval;
 }
@@ -911,6 +916,7 @@ int readSyntaxElement_Level_VLC0(SyntaxElement *sym, Bitstream *currStream)
 #endif
 
   currStream->frame_bitoffset = frame_bitoffset;
+  TRACE_BIN_SE(TRACE_BIN_LEVEL, sym->type, currStream->frame_bitoffset - sym->len, sym->len, sym->inf);
   return 0;
 }
 
@@ -984,6 +990,7 @@ int readSyntaxElement_Level_VLCN(SyntaxElement *sym, int vlc, Bitstream *currStr
 #if TRACE
   tracebits2(sym->tracestring, sym->len, code);
 #endif
+  TRACE_BIN_SE(TRACE_BIN_LEVEL, sym->type, currStream->frame_bitoffset - sym->len, sym->len, sym->inf);
 
   return 0;
 }
@@ -1048,6 +1055,7 @@ int readSyntaxElement_TotalZeros(SyntaxElement *sym,  Bitstream *currStream)
 #if TRACE
   tracebits2(sym->tracestring, sym->len, code);
 #endif
+  TRACE_BIN_SE(TRACE_BIN_TOTAL_ZEROS, sym->type, currStream->frame_bitoffset - sym->len, sym->len, sym->value1);
 
   return retval;
 }
@@ -1138,6 +1146,7 @@ int readSyntaxElement_TotalZerosChromaDC(VideoParameters *p_Vid, SyntaxElement *
 #if TRACE
   tracebits2(sym->tracestring, sym->len, code);
 #endif
+  TRACE_BIN_SE(TRACE_BIN_TOTAL_ZEROS, sym->type, currStream->frame_bitoffset - sym->len, sym->len, sym->value1);
 
   return retval;
 }
@@ -1185,6 +1194,7 @@ int readSyntaxElement_Run(SyntaxElement *sym, Bitstream *currStream)
 #if TRACE
   tracebits2(sym->tracestring, sym->len, code);
 #endif
+  TRACE_BIN_SE(TRACE_BIN_RUN, sym->type, currStream->frame_bitoffset - sym->len, sym->len, sym->value1);
 
   return retval;
 }